@@ -98,8 +98,9 @@ def main():
     config["header_files"] = [
         "fort_utils.h",
         "vector.h",
-        "wcwidth.h",
         "utf8.h",
+        "wcwidth.h",
+        "width_table.h",
         "string_buffer.h",
         "properties.h",
         "cell.h",
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+Generates src/width_table.h - staged lookup tables of widths of codepoints
+used by wcwidth.c.
+
+Widths are stored with 2 bits per codepoint in three stages:
+  plane (cp >> 16) -> table of 256 blocks of the plane
+  block ((cp >> 8) & 0xFF) -> 64 bytes with widths of 256 codepoints.
+Identical blocks and planes are stored once and shared by all width
+functions.
+
+Width functions:
+  wc - width of wchar_t strings (Markus Kuhn's wcwidth: 0 for combining
+       characters, -1 for control characters);
+  u8 - width of utf-8 strings (utf8cwidth from utf8.h).
+
+Usage: python3 gen_width_table.py [-o ./src/width_table.h]
+"""
+
+import sys
+
+MAX_CODEPOINT = 0x10FFFF
+PLANE_SZ = 0x10000
+BLOCK_SZ = 0x100
+
+# Value of 2 bits for width -1
+CONTROL = 3
+
+# sorted list of non-overlapping intervals of non-spacing characters
+# generated by "uniset +cat=Me +cat=Mn +cat=Cf -00AD +1160-11FF +200B c"
+COMBINING = [
+    (0x0300, 0x036F), (0x0483, 0x0486), (0x0488, 0x0489), (0x0591, 0x05BD),
+    (0x05BF, 0x05BF), (0x05C1, 0x05C2), (0x05C4, 0x05C5), (0x05C7, 0x05C7),
+    (0x0600, 0x0603), (0x0610, 0x0615), (0x064B, 0x065E), (0x0670, 0x0670),
+    (0x06D6, 0x06E4), (0x06E7, 0x06E8), (0x06EA, 0x06ED), (0x070F, 0x070F),
+    (0x0711, 0x0711), (0x0730, 0x074A), (0x07A6, 0x07B0), (0x07EB, 0x07F3),
+    (0x0901, 0x0902), (0x093C, 0x093C), (0x0941, 0x0948), (0x094D, 0x094D),
+    (0x0951, 0x0954), (0x0962, 0x0963), (0x0981, 0x0981), (0x09BC, 0x09BC),
+    (0x09C1, 0x09C4), (0x09CD, 0x09CD), (0x09E2, 0x09E3), (0x0A01, 0x0A02),
+    (0x0A3C, 0x0A3C), (0x0A41, 0x0A42), (0x0A47, 0x0A48), (0x0A4B, 0x0A4D),
+    (0x0A70, 0x0A71), (0x0A81, 0x0A82), (0x0ABC, 0x0ABC), (0x0AC1, 0x0AC5),
+    (0x0AC7, 0x0AC8), (0x0ACD, 0x0ACD), (0x0AE2, 0x0AE3), (0x0B01, 0x0B01),
+    (0x0B3C, 0x0B3C), (0x0B3F, 0x0B3F), (0x0B41, 0x0B43), (0x0B4D, 0x0B4D),
+    (0x0B56, 0x0B56), (0x0B82, 0x0B82), (0x0BC0, 0x0BC0), (0x0BCD, 0x0BCD),
+    (0x0C3E, 0x0C40), (0x0C46, 0x0C48), (0x0C4A, 0x0C4D), (0x0C55, 0x0C56),
+    (0x0CBC, 0x0CBC), (0x0CBF, 0x0CBF), (0x0CC6, 0x0CC6), (0x0CCC, 0x0CCD),
+    (0x0CE2, 0x0CE3), (0x0D41, 0x0D43), (0x0D4D, 0x0D4D), (0x0DCA, 0x0DCA),
+    (0x0DD2, 0x0DD4), (0x0DD6, 0x0DD6), (0x0E31, 0x0E31), (0x0E34, 0x0E3A),
+    (0x0E47, 0x0E4E), (0x0EB1, 0x0EB1), (0x0EB4, 0x0EB9), (0x0EBB, 0x0EBC),
+    (0x0EC8, 0x0ECD), (0x0F18, 0x0F19), (0x0F35, 0x0F35), (0x0F37, 0x0F37),
+    (0x0F39, 0x0F39), (0x0F71, 0x0F7E), (0x0F80, 0x0F84), (0x0F86, 0x0F87),
+    (0x0F90, 0x0F97), (0x0F99, 0x0FBC), (0x0FC6, 0x0FC6), (0x102D, 0x1030),
+    (0x1032, 0x1032), (0x1036, 0x1037), (0x1039, 0x1039), (0x1058, 0x1059),
+    (0x1160, 0x11FF), (0x135F, 0x135F), (0x1712, 0x1714), (0x1732, 0x1734),
+    (0x1752, 0x1753), (0x1772, 0x1773), (0x17B4, 0x17B5), (0x17B7, 0x17BD),
+    (0x17C6, 0x17C6), (0x17C9, 0x17D3), (0x17DD, 0x17DD), (0x180B, 0x180D),
+    (0x18A9, 0x18A9), (0x1920, 0x1922), (0x1927, 0x1928), (0x1932, 0x1932),
+    (0x1939, 0x193B), (0x1A17, 0x1A18), (0x1B00, 0x1B03), (0x1B34, 0x1B34),
+    (0x1B36, 0x1B3A), (0x1B3C, 0x1B3C), (0x1B42, 0x1B42), (0x1B6B, 0x1B73),
+    (0x1DC0, 0x1DCA), (0x1DFE, 0x1DFF), (0x200B, 0x200F), (0x202A, 0x202E),
+    (0x2060, 0x2063), (0x206A, 0x206F), (0x20D0, 0x20EF), (0x302A, 0x302F),
+    (0x3099, 0x309A), (0xA806, 0xA806), (0xA80B, 0xA80B), (0xA825, 0xA826),
+    (0xFB1E, 0xFB1E), (0xFE00, 0xFE0F), (0xFE20, 0xFE23), (0xFEFF, 0xFEFF),
+    (0xFFF9, 0xFFFB), (0x10A01, 0x10A03), (0x10A05, 0x10A06), (0x10A0C, 0x10A0F),
+    (0x10A38, 0x10A3A), (0x10A3F, 0x10A3F), (0x1D167, 0x1D169), (0x1D173, 0x1D182),
+    (0x1D185, 0x1D18B), (0x1D1AA, 0x1D1AD), (0x1D242, 0x1D244), (0xE0001, 0xE0001),
+    (0xE0020, 0xE007F), (0xE0100, 0xE01EF),
+]
+
+WC_WIDE = [
+    (0x1100, 0x115F),  # Hangul Jamo init. consonants
+    (0x2329, 0x232A),
+    (0x2E80, 0x303E),  # CJK ... Yi
+    (0x3040, 0xA4CF),
+    (0xAC00, 0xD7A3),  # Hangul Syllables
+    (0xF900, 0xFAFF),  # CJK Compatibility Ideographs
+    (0xFE10, 0xFE19),  # Vertical forms
+    (0xFE30, 0xFE6F),  # CJK Compatibility Forms
+    (0xFF00, 0xFF60),  # Fullwidth Forms
+    (0xFFE0, 0xFFE6),
+    (0x20000, 0x2FFFD),
+    (0x30000, 0x3FFFD),
+]
+
+U8_WIDE = [
+    # Fullwidth
+    (0x3000, 0x3000), (0xFF01, 0xFF60), (0xFFE0, 0xFFE6),
+    # Wide
+    (0x1100, 0x115F), (0x11A3, 0x11A7), (0x11FA, 0x11FF), (0x2329, 0x232A),
+    (0x2E80, 0x2E99), (0x2E9B, 0x2EF3), (0x2F00, 0x2FD5), (0x2FF0, 0x2FFB),
+    (0x3001, 0x303E), (0x3041, 0x3096), (0x3099, 0x30FF), (0x3105, 0x312D),
+    (0x3131, 0x318E), (0x3190, 0x31BA), (0x31C0, 0x31E3), (0x31F0, 0x321E),
+    (0x3220, 0x3247), (0x3250, 0x32FE), (0x3300, 0x4DBF), (0x4E00, 0xA48C),
+    (0xA490, 0xA4C6), (0xA960, 0xA97C), (0xAC00, 0xD7A3), (0xD7B0, 0xD7C6),
+    (0xD7CB, 0xD7FB), (0xF900, 0xFAFF), (0xFE10, 0xFE19), (0xFE30, 0xFE52),
+    (0xFE54, 0xFE66), (0xFE68, 0xFE6B), (0x1B000, 0x1B001), (0x1F200, 0x1F202),
+    (0x1F210, 0x1F23A), (0x1F240, 0x1F248), (0x1F250, 0x1F251), (0x20000, 0x2F73F),
+    (0x2B740, 0x2FFFD), (0x30000, 0x3FFFD),
+]
+
+
+def fill(widths, intervals, value):
+    for first, last in intervals:
+        for cp in range(first, last + 1):
+            widths[cp] = value
+
+
+def wc_widths():
+    widths = bytearray([1]) * (MAX_CODEPOINT + 1)
+    fill(widths, WC_WIDE, 2)
+    fill(widths, COMBINING, 0)
+    fill(widths, [(0x01, 0x1F), (0x7F, 0x9F)], CONTROL)
+    widths[0] = 0
+    return widths
+
+
+def u8_widths():
+    widths = bytearray([1]) * (MAX_CODEPOINT + 1)
+    fill(widths, U8_WIDE, 2)
+    widths[0] = 0
+    return widths
+
+
+class Tables:
+    def __init__(self):
+        self.blocks = []       # packed blocks of widths
+        self.block_ids = {}
+        self.planes = []       # tuples of block indexes
+        self.plane_ids = {}
+
+    def add_block(self, widths):
+        packed = bytearray(BLOCK_SZ // 4)
+        for i, w in enumerate(widths):
+            packed[i // 4] |= w << ((i % 4) * 2)
+        packed = bytes(packed)
+        if packed not in self.block_ids:
+            self.block_ids[packed] = len(self.blocks)
+            self.blocks.append(packed)
+        return self.block_ids[packed]
+
+    def add_plane(self, widths):
+        plane = tuple(self.add_block(widths[i:i + BLOCK_SZ])
+                      for i in range(0, PLANE_SZ, BLOCK_SZ))
+        if plane not in self.plane_ids:
+            self.plane_ids[plane] = len(self.planes)
+            self.planes.append(plane)
+        return self.plane_ids[plane]
+
+    def add_function(self, widths):
+        return [self.add_plane(widths[i:i + PLANE_SZ])
+                for i in range(0, MAX_CODEPOINT + 1, PLANE_SZ)]
+
+
+def lookup(tables, planes, cp):
+    block = tables.blocks[tables.planes[planes[cp >> 16]][(cp >> 8) & 0xFF]]
+    return (block[(cp & 0xFF) >> 2] >> ((cp & 3) * 2)) & 3
+
+
+def c_array(values, per_line, fmt):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ", ".join(fmt % v for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def generate(output_file):
+    tables = Tables()
+    functions = [("wc", "FT_HAVE_WCHAR", wc_widths()),
+                 ("u8", "FT_HAVE_UTF8", u8_widths())]
+    function_planes = []
+    for name, guard, widths in functions:
+        planes = tables.add_function(widths)
+        for cp in range(MAX_CODEPOINT + 1):
+            assert lookup(tables, planes, cp) == widths[cp]
+        function_planes.append((name, guard, planes))
+    assert len(tables.blocks) <= 256 and len(tables.planes) <= 256
+
+    out = []
+    out.append("/* Generated by gen_width_table.py. Do not edit. */")
+    out.append("")
+    out.append("#ifndef WIDTH_TABLE_H")
+    out.append("#define WIDTH_TABLE_H")
+    out.append("")
+    out.append('#include "fort_utils.h"')
+    out.append("")
+    out.append("#if defined(FT_HAVE_WCHAR) || defined(FT_HAVE_UTF8)")
+    out.append("")
+    out.append("/*")
+    out.append(" * Widths of codepoints (2 bits per codepoint, 3 means -1) are looked up as")
+    out.append(" * width_blocks[width_planes[X[cp >> 16]][(cp >> 8) & 0xFF]][(cp & 0xFF) >> 2]")
+    out.append(" * where X is the table of the width function.")
+    out.append(" */")
+    out.append("#define FT_WIDTH_MAX_CODEPOINT 0x%X" % MAX_CODEPOINT)
+    out.append("")
+    out.append("static const uint8_t width_blocks[%d][%d] = {" % (len(tables.blocks), BLOCK_SZ // 4))
+    for block in tables.blocks:
+        out.append("    {")
+        out.append("    " + c_array(list(block), 16, "0x%02X").replace("\n", "\n    "))
+        out.append("    },")
+    out.append("};")
+    out.append("")
+    out.append("static const uint8_t width_planes[%d][%d] = {" % (len(tables.planes), PLANE_SZ // BLOCK_SZ))
+    for plane in tables.planes:
+        out.append("    {")
+        out.append("    " + c_array(list(plane), 16, "%3d").replace("\n", "\n    "))
+        out.append("    },")
+    out.append("};")
+    out.append("")
+    out.append("#endif /* defined(FT_HAVE_WCHAR) || defined(FT_HAVE_UTF8) */")
+    for name, guard, planes in function_planes:
+        out.append("")
+        out.append("#ifdef %s" % guard)
+        out.append("static const uint8_t %s_width_planes[%d] = {" % (name, len(planes)))
+        out.append(c_array(planes, 17, "%d"))
+        out.append("};")
+        out.append("#endif /* %s */" % guard)
+    out.append("")
+    out.append("#endif /* WIDTH_TABLE_H */")
+    out.append("")
+
+    with open(output_file, "w") as f:
+        f.write("\n".join(out))
+
+
+def main():
+    output_file = "./src/width_table.h"
+    if len(sys.argv) >= 3 and sys.argv[1] == "-o":
+        output_file = sys.argv[2]
+    generate(output_file)
+
+
+if __name__ == "__main__":
+    main()
@@ -47,6 +47,7 @@ SOFTWARE.
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include "fort.h"
 
 /* Define FT_INTERNAL to make internal libfort functions static
@@ -59,6 +60,20 @@ SOFTWARE.
 #endif /* FT_AMALGAMED_SORCE */
 
 
+/* Storage class of per thread state */
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define FT_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define FT_THREAD_LOCAL _Thread_local
+#elif defined(FT_GCC_COMPILER) || defined(FT_CLANG_COMPILER)
+#define FT_THREAD_LOCAL __thread
+#elif defined(FT_MICROSOFT_COMPILER)
+#define FT_THREAD_LOCAL __declspec(thread)
+#else
+#define FT_THREAD_LOCAL
+#endif
+
+
 #define FORT_DEFAULT_COL_SEPARATOR '|'
 extern char g_col_separator;
 
@@ -72,8 +87,7 @@ extern char g_col_separator;
 #define F_REALLOC fort_realloc
 #define F_STRDUP fort_strdup
 #define F_WCSDUP fort_wcsdup
-/* @todo: replace with custom impl !!!*/
-#define F_UTF8DUP utf8dup
+#define F_UTF8DUP(str) fort_strdup((const char *)(str))
 
 #define F_CREATE(type) ((type *)F_CALLOC(sizeof(type), 1))
 
@@ -124,6 +138,23 @@ enum f_string_type {
 #endif /* FT_HAVE_WCHAR */
 };
 
+enum f_number_type {
+    F_NUM_I64,
+    F_NUM_U64,
+    F_NUM_F64
+};
+
+union f_number {
+    int64_t i64;
+    uint64_t u64;
+    double f64;
+};
+
+/* Size of buffer enough for numbers formatted with default format */
+#define FT_NUMBER_BUF_SZ 32
+/* Size of buffer for printf format of a number converted from user spec */
+#define FT_NUMBER_FMT_SZ 64
+
 struct f_string_view {
     union {
         const char *cstr;
@@ -178,6 +209,19 @@ struct f_context {
 };
 typedef struct f_context f_context_t;
 
+/*
+ * Destination of streamed output. Output is printed to the chunk buffer
+ * which is passed to the user callback every time it becomes full.
+ */
+struct f_output_sink {
+    ft_output_fn write_fn;
+    void *ctx;
+    char *chunk;
+    size_t chunk_sz;    /* raw size of the chunk buffer */
+    size_t char_sz;     /* raw size of a code unit */
+};
+typedef struct f_output_sink f_output_sink_t;
+
 struct f_conv_context {
     union {
         char *buf;
@@ -191,18 +235,64 @@ struct f_conv_context {
     size_t raw_avail;
     struct f_context *cntx;
     enum f_string_type b_type;
+    const struct f_emitter *emitter;   /* printing functions for b_type */
+    f_output_sink_t *sink;  /* NULL if output is printed to one buffer */
 };
 typedef struct f_conv_context f_conv_context_t;
 
+/*
+ * Printing functions instantiated for one type of output (see fort_utils.c).
+ * Emitter is selected once per conversion (get_emitter), so printing
+ * functions don't dispatch on type of output for every printed string.
+ */
+struct f_glyph;
+struct f_emitter {
+    int (*print_n_glyphs)(f_conv_context_t *cntx, size_t n, const struct f_glyph *glyph);
+    int (*print_n_spaces)(f_conv_context_t *cntx, size_t n);
+    int (*print_range)(f_conv_context_t *cntx, const void *beg, const void *end,
+                       enum f_string_type content_type);
+};
+typedef struct f_emitter f_emitter_t;
+
 
 /*****************************************************************************
  *               LIBFORT helpers
  *****************************************************************************/
 
-extern void *(*fort_malloc)(size_t size);
-extern void (*fort_free)(void *ptr);
-extern void *(*fort_calloc)(size_t nmemb, size_t size);
-extern void *(*fort_realloc)(void *ptr, size_t size);
+/*
+ * Allocator used at the moment by the current thread (global one or allocator
+ * of the table processed by the thread).
+ */
+extern FT_THREAD_LOCAL const ft_allocator_t *fort_allocator;
+
+FT_INTERNAL
+void *fort_malloc(size_t size);
+
+FT_INTERNAL
+void fort_free(void *ptr);
+
+FT_INTERNAL
+void *fort_calloc(size_t nmemb, size_t size);
+
+FT_INTERNAL
+void *fort_realloc(void *ptr, size_t old_size, size_t size);
+
+/*
+ * Makes allocator current. Returns allocator that was current before (it
+ * should be restored after the operation).
+ */
+FT_INTERNAL
+const ft_allocator_t *use_allocator(const ft_allocator_t *allocator);
+
+/*
+ * Makes global allocator current (e.g. for objects that are not owned by
+ * tables with their own allocators). Returns allocator that was current.
+ */
+FT_INTERNAL
+const ft_allocator_t *use_global_allocator(void);
+
+FT_INTERNAL
+f_status set_allocator(const ft_allocator_t *allocator);
 
 FT_INTERNAL
 void set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr));
@@ -218,6 +308,47 @@ size_t number_of_columns_in_format_string(const f_string_view_t *fmt);
 FT_INTERNAL
 size_t number_of_columns_in_format_buffer(const f_string_buffer_t *fmt);
 
+/* Types of printf arguments after default argument promotions */
+enum f_printf_arg_type {
+    F_ARG_INT,
+    F_ARG_LONG,
+    F_ARG_LLONG,
+    F_ARG_INTMAX,
+    F_ARG_SIZE,
+    F_ARG_PTRDIFF,
+    F_ARG_WINT,
+    F_ARG_DOUBLE,
+    F_ARG_LDOUBLE,
+    F_ARG_PTR
+};
+
+struct f_row_format_field {
+    const char *fmt;      /* printf format of the cell */
+    size_t len;           /* length of fmt */
+    size_t first_arg;     /* index of the first argument of the cell */
+    size_t n_args;
+    int is_literal;       /* fmt has no conversion specifications */
+};
+
+/* Format string of ft_printf split to cells with parsed argument types */
+struct ft_row_format {
+    char *fmt;
+    struct f_row_format_field *fields;
+    size_t n_fields;
+    enum f_printf_arg_type *arg_types;
+    size_t n_args;
+};
+
+FT_INTERNAL
+ft_row_format_t *create_row_format(const char *fmt);
+
+FT_INTERNAL
+void destroy_row_format(ft_row_format_t *format);
+
+/* Skips arguments of the specified types in the argument list */
+FT_INTERNAL
+void skip_printf_args(va_list *va, const enum f_printf_arg_type *arg_types, size_t n);
+
 #if defined(FT_HAVE_WCHAR)
 FT_INTERNAL
 wchar_t *fort_wcsdup(const wchar_t *str);
@@ -225,9 +356,94 @@ wchar_t *fort_wcsdup(const wchar_t *str);
 
 
 
+FT_INTERNAL
+size_t u64_to_str(uint64_t value, char *buf);
+
+FT_INTERNAL
+size_t i64_to_str(int64_t value, char *buf);
+
+/* Number of chars in decimal representation of value */
+FT_INTERNAL
+size_t u64_str_len(uint64_t value);
+
+FT_INTERNAL
+size_t i64_str_len(int64_t value);
+
+/*
+ * Converts format specification of a number (printf conversion
+ * specification without length modifier, e.g. "%08d" or "%.2f", that can be
+ * surrounded by text, or the same specification without '%' and text, e.g.
+ * ".2f") to printf format string.
+ */
+FT_INTERNAL
+f_status number_format_from_spec(const char *spec, enum f_number_type type, char *fmt, size_t fmt_sz);
+
+/*
+ * Formats number with format returned by number_format_from_spec (or with
+ * the default format if fmt is NULL). Returns the same value as snprintf.
+ */
+FT_INTERNAL
+int format_number(char *buf, size_t buf_sz, const char *fmt,
+                  enum f_number_type type, const union f_number *value);
+
+/*
+ * String printed many times (e.g. border char) prepared for printing: it is
+ * measured and converted to wide char once instead of on every print.
+ */
+struct f_glyph {
+    const char *str;
+    size_t len;           /* length in bytes */
+    size_t cod_len;       /* number of codepoints of utf-8 string */
+    int ascii;            /* string has only ASCII chars */
+#ifdef FT_HAVE_WCHAR
+    wchar_t wch;          /* glyph of one utf-8 codepoint as wide char, 0 otherwise */
+#endif /* FT_HAVE_WCHAR */
+};
+typedef struct f_glyph f_glyph_t;
+
+FT_INTERNAL
+void init_glyph(f_glyph_t *glyph, const char *str);
+
+/* Prints glyph `n` times, returns number of printed codepoints (or -1) */
+FT_INTERNAL
+int print_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph);
+
 FT_INTERNAL
 int print_n_strings(f_conv_context_t *cntx, size_t n, const char *str);
 
+FT_INTERNAL
+int print_n_spaces(f_conv_context_t *cntx, size_t n);
+
+/*
+ * Prints content of type `content_type` between `beg` and `end`, content of
+ * other type than output is transcoded while it is printed (wide content
+ * can't be printed to char strings). Returns number of printed code units
+ * (or -1).
+ */
+FT_INTERNAL
+int print_range(f_conv_context_t *cntx, const void *beg, const void *end,
+                enum f_string_type content_type);
+
+FT_INTERNAL
+const f_emitter_t *get_emitter(enum f_string_type type);
+
+#ifdef FT_HAVE_UTF8
+/*
+ * Decodes well-formed utf-8 sequence of 2-4 bytes at the beginning of `str`
+ * (at most `len` bytes). Returns length of the sequence or 0 if it is
+ * ill-formed (overlong forms, surrogates and codepoints after U+10FFFF are
+ * ill-formed too).
+ */
+FT_INTERNAL
+size_t utf8_decode(const unsigned char *str, size_t len, uint32_t *c);
+#endif /* FT_HAVE_UTF8 */
+
+/*
+ * Passes content of the chunk buffer of streamed output to the sink.
+ */
+FT_INTERNAL
+int flush_output_sink(f_conv_context_t *cntx);
+
 
 FT_INTERNAL
 int ft_nprint(f_conv_context_t *cntx, const char *str, size_t strlen);
@@ -308,6 +524,9 @@ size_t vector_size(const f_vector_t *);
 FT_INTERNAL
 size_t vector_capacity(const f_vector_t *);
 
+FT_INTERNAL
+f_status vector_reserve(f_vector_t *, size_t capacity);
+
 FT_INTERNAL
 int vector_push(f_vector_t *, const void *item);
 
@@ -332,8 +551,10 @@ void vector_clear(f_vector_t *);
 FT_INTERNAL
 int vector_erase(f_vector_t *, size_t index);
 
-#ifdef FT_TEST_BUILD
+FT_INTERNAL
 f_vector_t *copy_vector(f_vector_t *);
+
+#ifdef FT_TEST_BUILD
 size_t vector_index_of(const f_vector_t *, const void *item);
 #endif
 
@@ -350,30 +571,6 @@ size_t vector_index_of(const f_vector_t *, const void *item);
  ********************************************************/
 
 
-/********************************************************
-   Begin of file "wcwidth.h"
- ********************************************************/
-
-#ifndef WCWIDTH_H
-#define WCWIDTH_H
-
-/* #include "fort_utils.h" */ /* Commented by amalgamation script */
-
-#ifdef FT_HAVE_WCHAR
-#include <wchar.h>
-
-FT_INTERNAL
-int mk_wcswidth(const wchar_t *pwcs, size_t n);
-
-#endif /* FT_HAVE_WCHAR */
-
-#endif /* WCWIDTH_H */
-
-/********************************************************
-   End of file "wcwidth.h"
- ********************************************************/
-
-
 /********************************************************
    Begin of file "utf8.h"
  ********************************************************/
@@ -1761,1346 +1958,3129 @@ utf8_int32_t utf8uprcodepoint(utf8_int32_t cp)
 
 
 /********************************************************
-   Begin of file "string_buffer.h"
+   Begin of file "wcwidth.h"
  ********************************************************/
 
-#ifndef STRING_BUFFER_H
-#define STRING_BUFFER_H
+#ifndef WCWIDTH_H
+#define WCWIDTH_H
 
 /* #include "fort_utils.h" */ /* Commented by amalgamation script */
 
-
-/*****************************************************************************
- *               STRING BUFFER
- * ***************************************************************************/
-
-struct f_string_buffer {
-    union {
-        char *cstr;
 #ifdef FT_HAVE_WCHAR
-        wchar_t *wstr;
-#endif
-#ifdef FT_HAVE_UTF8
-        void *u8str;
-#endif
-        void *data;
-    } str;
-    size_t data_sz;
-    enum f_string_type type;
-};
-
-FT_INTERNAL
-f_string_buffer_t *create_string_buffer(size_t number_of_chars, enum f_string_type type);
-
-FT_INTERNAL
-void destroy_string_buffer(f_string_buffer_t *buffer);
-
-FT_INTERNAL
-f_string_buffer_t *copy_string_buffer(const f_string_buffer_t *buffer);
-
-FT_INTERNAL
-f_status realloc_string_buffer_without_copy(f_string_buffer_t *buffer);
+#include <wchar.h>
 
 FT_INTERNAL
-f_status fill_buffer_from_string(f_string_buffer_t *buffer, const char *str);
+int mk_wcswidth(const wchar_t *pwcs, size_t n);
 
-#ifdef FT_HAVE_WCHAR
-FT_INTERNAL
-f_status fill_buffer_from_wstring(f_string_buffer_t *buffer, const wchar_t *str);
 #endif /* FT_HAVE_WCHAR */
 
 #ifdef FT_HAVE_UTF8
-FT_INTERNAL
-f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str);
-#endif /* FT_HAVE_UTF8 */
-
-FT_INTERNAL
-size_t buffer_text_visible_width(const f_string_buffer_t *buffer);
-
-FT_INTERNAL
-size_t buffer_text_visible_height(const f_string_buffer_t *buffer);
-
-FT_INTERNAL
-size_t string_buffer_cod_width_capacity(const f_string_buffer_t *buffer);
-
-FT_INTERNAL
-size_t string_buffer_raw_capacity(const f_string_buffer_t *buffer);
-
-FT_INTERNAL
-size_t string_buffer_width_capacity(const f_string_buffer_t *buffer);
-
-FT_INTERNAL
-void *buffer_get_data(f_string_buffer_t *buffer);
-
-FT_INTERNAL
-int buffer_check_align(f_string_buffer_t *buffer);
+/* #include "utf8.h" */ /* Commented by amalgamation script */
 
+/*
+ * Returns visible width of utf-8 string [beg, end) (utf8cwidth is used for
+ * codepoints).
+ */
 FT_INTERNAL
-int buffer_printf(f_string_buffer_t *buffer, size_t buffer_row, f_conv_context_t *cntx, size_t cod_width,
-                  const char *content_style_tag, const char *reset_content_style_tag);
+size_t utf8_range_width(const void *beg, const void *end);
 
-#ifdef FT_HAVE_UTF8
+/* Returns visible width of non null codepoint of utf-8 string */
 FT_INTERNAL
-void buffer_set_u8strwid_func(int (*u8strwid)(const void *beg, const void *end, size_t *width));
+size_t utf8_codepoint_width(uint32_t c);
 #endif /* FT_HAVE_UTF8 */
 
-
-#endif /* STRING_BUFFER_H */
+#endif /* WCWIDTH_H */
 
 /********************************************************
-   End of file "string_buffer.h"
+   End of file "wcwidth.h"
  ********************************************************/
 
 
 /********************************************************
-   Begin of file "properties.h"
+   Begin of file "width_table.h"
  ********************************************************/
 
-#ifndef PROPERTIES_H
-#define PROPERTIES_H
-
-/* #include "fort_utils.h" */ /* Commented by amalgamation script */
-#include <stdint.h>
-#include <limits.h>
-
-#define PROP_IS_SET(ft_props, property) ((ft_props) & (property))
-#define PROP_SET(ft_props, property) ((ft_props) |=(property))
-#define PROP_UNSET(ft_props, property) ((ft_props) &= ~((uint32_t)(property)))
-
-#define TEXT_STYLE_TAG_MAX_SIZE (64 * 2)
-
-FT_INTERNAL
-void get_style_tag_for_cell(const f_table_properties_t *props,
-                            size_t row, size_t col, char *style_tag, size_t sz);
-
-FT_INTERNAL
-void get_reset_style_tag_for_cell(const f_table_properties_t *props,
-                                  size_t row, size_t col, char *style_tag, size_t sz);
-
-FT_INTERNAL
-void get_style_tag_for_content(const f_table_properties_t *props,
-                               size_t row, size_t col, char *style_tag, size_t sz);
-
-FT_INTERNAL
-void get_reset_style_tag_for_content(const f_table_properties_t *props,
-                                     size_t row, size_t col, char *style_tag, size_t sz);
-
+/* Generated by gen_width_table.py. Do not edit. */
 
-struct f_cell_props {
-    size_t cell_row;
-    size_t cell_col;
-    uint32_t properties_flags;
+#ifndef WIDTH_TABLE_H
+#define WIDTH_TABLE_H
 
-    unsigned int col_min_width;
-    enum ft_text_alignment align;
-    unsigned int cell_padding_top;
-    unsigned int cell_padding_bottom;
-    unsigned int cell_padding_left;
-    unsigned int cell_padding_right;
-    unsigned int cell_empty_string_height;
-    enum ft_row_type row_type;
-    unsigned int content_fg_color_number;
-    unsigned int content_bg_color_number;
-    unsigned int cell_bg_color_number;
-    enum ft_text_style cell_text_style;
-    enum ft_text_style content_text_style;
-};
+/* #include "fort_utils.h" */ /* Commented by amalgamation script */
 
-typedef struct f_cell_props f_cell_props_t;
-typedef f_vector_t f_cell_prop_container_t;
+#if defined(FT_HAVE_WCHAR) || defined(FT_HAVE_UTF8)
 
-FT_INTERNAL
-f_cell_prop_container_t *create_cell_prop_container(void);
+/*
+ * Widths of codepoints (2 bits per codepoint, 3 means -1) are looked up as
+ * width_blocks[width_planes[X[cp >> 16]][(cp >> 8) & 0xFF]][(cp & 0xFF) >> 2]
+ * where X is the table of the width function.
+ */
+#define FT_WIDTH_MAX_CODEPOINT 0x10FFFF
 
-FT_INTERNAL
-void destroy_cell_prop_container(f_cell_prop_container_t *cont);
-
-FT_INTERNAL
-const f_cell_props_t *cget_cell_prop(const f_cell_prop_container_t *cont, size_t row, size_t col);
-
-FT_INTERNAL
-f_cell_props_t *get_cell_prop_and_create_if_not_exists(f_cell_prop_container_t *cont, size_t row, size_t col);
-
-FT_INTERNAL
-f_status set_cell_property(f_cell_prop_container_t *cont, size_t row, size_t col, uint32_t property, int value);
-
-FT_INTERNAL
-int get_cell_property_hierarchically(const f_table_properties_t *properties, size_t row, size_t column, uint32_t property);
-
-FT_INTERNAL
-f_status set_default_cell_property(uint32_t property, int value);
-
-
-/*         TABLE BORDER DESСRIPTION
- *
- *
- *   TL TT TT TT TV TT TT TT TT TT TT TT TR
- *   LL          IV                      RR
- *   LL          IV                      RR
- *   LH IH IH IH II IH IH IH TI IH IH IH RH
- *   LL          IV          IV          RR
- *   LL          IV          IV          RR
- *   LL          LI IH IH IH RI          RH
- *   LL          IV          IV          RR
- *   LL          IV          IV          RR
- *   LH IH IH IH BI IH IH IH II IH IH IH RH
- *   LL                      IV          RR
- *   LL                      IV          RR
- *   BL BB BB BB BV BB BB BB BV BB BB BB BR
- */
+static const uint8_t width_blocks[55][64] = {
+    {
+        0xFC, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xD5,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x15, 0x40, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+        0x41, 0x10, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x00, 0x55, 0x55, 0x55, 0x00, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x15, 0x00, 0x00, 0x00, 0x00, 0x40, 0x55, 0x55, 0x55, 0x55, 0x54, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x00, 0x00, 0x14, 0x04, 0x50, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x15, 0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x40, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x00, 0x54, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00, 0x00, 0x55, 0x55, 0x55,
+    },
+    {
+        0x41, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x54,
+        0x01, 0x00, 0x54, 0x51, 0x01, 0x54, 0x55, 0x55, 0x05, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x54,
+        0x01, 0x54, 0x55, 0x51, 0x55, 0x55, 0x55, 0x55, 0x05, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x41, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x54,
+        0x41, 0x15, 0x14, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x50, 0x55, 0x55, 0x55,
+        0x41, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x54,
+        0x01, 0x10, 0x54, 0x51, 0x55, 0x55, 0x55, 0x55, 0x05, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x14,
+        0x01, 0x55, 0x55, 0x51, 0x55, 0x45, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x45, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x54, 0x55, 0x55, 0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05,
+        0x54, 0x05, 0x04, 0x50, 0x55, 0x41, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x14,
+        0x55, 0x45, 0x55, 0x50, 0x55, 0x55, 0x55, 0x55, 0x05, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x01, 0x55, 0x55, 0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x45, 0x55, 0x05, 0x44, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x51, 0x00, 0x40, 0x55,
+        0x55, 0x15, 0x00, 0x40, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x51, 0x00, 0x10, 0x54,
+        0x55, 0x55, 0x00, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x11, 0x51, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x01, 0x00, 0x00, 0x40,
+        0x00, 0x04, 0x55, 0x55, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x54,
+        0x55, 0x45, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x01, 0x44, 0x05, 0x51, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x05, 0x54, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x54, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x05, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x10, 0x00, 0x50,
+        0x55, 0x45, 0x01, 0x00, 0x00, 0x55, 0x55, 0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x15, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x51, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x40, 0x15, 0x54, 0x55, 0x45, 0x55, 0x01, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x54, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x00, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x04, 0x40, 0x54,
+        0x45, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00, 0x00, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x00, 0x00, 0x40, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05,
+    },
+    {
+        0x55, 0x55, 0x15, 0x00, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x40, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x55, 0x05, 0x00, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x69, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x0A, 0x00, 0xAA, 0xAA, 0xAA, 0x6A,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x82, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x45, 0x15, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x41, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x45, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x00, 0x00, 0x00, 0x00, 0xAA, 0xAA, 0x5A, 0x55, 0x00, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xAA, 0x6A, 0x55, 0x55, 0x55, 0x55, 0x01, 0x55,
+    },
+    {
+        0x01, 0x41, 0x55, 0x00, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x40, 0x15,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x50, 0x55, 0x15, 0x00, 0x00, 0x00,
+        0x40, 0x01, 0x00, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x50, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x05, 0x54, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x5A,
+    },
+    {
+        0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x54, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xAA, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xA5, 0xAA,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x9A, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x5A, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x6A,
+        0xA9, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x6A, 0xA9, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+    },
+    {
+        0x55, 0xA9, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x5A, 0xA9, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0x6A, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x6A, 0x55,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0xAA,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x6A, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x6A,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0x56, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0x6A, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x56,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0x6A, 0x95, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x55,
+    },
+    {
+        0x55, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0x5A, 0x55, 0x55, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0x6A, 0xAA, 0xAA, 0xAA, 0xAA, 0x6A, 0xAA, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0xA9, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xAA, 0x6A, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x5A, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+    {
+        0x6A, 0x55, 0x55, 0x55, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x6A, 0x55,
+        0xAA, 0xAA, 0x56, 0x55, 0x5A, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    },
+};
 
+static const uint8_t width_planes[7][256] = {
+    {
+          0,   1,   1,   2,   3,   4,   5,   6,   1,   7,   8,   9,  10,  11,  12,  13,
+         14,  15,   1,  16,   1,   1,   1,  17,  18,  19,  20,  21,   1,  22,   1,   1,
+         23,   1,   1,  24,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,  25,  26,
+         27,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  28,   1,   1,   1,  29,   1,   1,   1,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  30,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,  26,  26,  31,   1,   1,  32,  33,
+    },
+    {
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,  34,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,  35,  36,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+    },
+    {
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  37,
+    },
+    {
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+    },
+    {
+         38,  39,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+    },
+    {
+         40,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,  41,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,  24,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,  42,  43,
+         44,  45,  46,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  47,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  48,   1,   1,   1,   1,  49,   1,   1,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,  26,
+         26,  26,  26,  26,  26,  26,  26,  50,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,  26,  26,   1,   1,   1,  51,  52,
+    },
+    {
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+         53,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+          1,   1,  54,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+    },
+};
 
-/*      HORIZONTAL SEPARATOR DESCRIPTION
- *
- *
- *   TL TT TT TT TV TT TT TT TV TT TT TT TR        <----- TOP_SEPARATOR
- *   LL          IV          IV          RR
- *   LH IH IH IH II IH IH IH II IH IH IH RH        <----- INSIDE_SEPARATOR
- *   LL          IV          IV          RR
- *   BL BB BB BB BV BB BB BB BV BB BB BB BR        <----- BOTTOM_SEPARATOR
- */
+#endif /* defined(FT_HAVE_WCHAR) || defined(FT_HAVE_UTF8) */
 
-enum f_hor_separator_pos {
-    TOP_SEPARATOR,
-    INSIDE_SEPARATOR,
-    BOTTOM_SEPARATOR
+#ifdef FT_HAVE_WCHAR
+static const uint8_t wc_width_planes[17] = {
+    0, 1, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 3, 3,
 };
+#endif /* FT_HAVE_WCHAR */
 
-enum f_border_item_pos {
-    TL_bip = 0,
-    TT_bip = 1,
-    TV_bip = 2,
-    TR_bip = 3,
+#ifdef FT_HAVE_UTF8
+static const uint8_t u8_width_planes[17] = {
+    5, 6, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+};
+#endif /* FT_HAVE_UTF8 */
 
-    LL_bip = 4,
-    IV_bip = 5,
-    RR_bip = 6,
+#endif /* WIDTH_TABLE_H */
 
-    LH_bip = 7,
-    IH_bip = 8,
-    II_bip = 9,
-    RH_bip = 10,
+/********************************************************
+   End of file "width_table.h"
+ ********************************************************/
 
-    BL_bip = 11,
-    BB_bip = 12,
-    BV_bip = 13,
-    BR_bip = 14,
 
-    LI_bip = 15,
-    TI_bip = 16,
-    RI_bip = 17,
-    BI_bip = 18,
+/********************************************************
+   Begin of file "string_buffer.h"
+ ********************************************************/
 
-    BORDER_ITEM_POS_SIZE
-};
+#ifndef STRING_BUFFER_H
+#define STRING_BUFFER_H
 
+/* #include "fort_utils.h" */ /* Commented by amalgamation script */
 
-enum f_separator_item_pos {
-    LH_sip = 0,
-    IH_sip = 1,
-    II_sip = 2,
-    RH_sip = 3,
 
-    TI_sip = 4,
-    BI_sip = 5,
+/*****************************************************************************
+ *               STRING BUFFER
+ * ***************************************************************************/
 
-    SEPARATOR_ITEM_POS_SIZE
+/*
+ * Ownership of the buffer data.
+ */
+enum f_buffer_ownership {
+    F_BUF_OWNED = 0,   /* allocated by libfort */
+    F_BUF_ADOPTED,     /* adopted from user, released with free_fn */
+    F_BUF_BORROWED     /* owned by user, never released by libfort */
 };
 
-
-struct fort_border_style {
-    const char *border_chars[BORDER_ITEM_POS_SIZE];
-    const char *header_border_chars[BORDER_ITEM_POS_SIZE];
-    const char *separator_chars[SEPARATOR_ITEM_POS_SIZE];
+/*
+ * Properties of the buffer content. They are computed in one pass over the
+ * content and used instead of rescanning it while the table is printed.
+ */
+struct f_text_metrics {
+    size_t len;           /* number of code units (chars, wchars or bytes) */
+    size_t lines;         /* number of lines (0 for empty string) */
+    size_t max_line_len;  /* maximum number of code units in a line */
+    size_t width;         /* visible width of the content, SIZE_MAX if unknown */
+    const void *data;     /* content for which metrics were computed */
+    struct f_line_index *line_index;  /* owned, NULL until it is needed */
+    int shared_line_index;  /* line_index is owned by string pool of the table */
+    int printable_ascii;  /* content has only printable ASCII chars and '\n' */
+    int utf8_errors;      /* utf-8 content has ill-formed sequences */
+    enum f_string_type type;
+    int valid;
 };
-extern struct fort_border_style FORT_BASIC_STYLE;
-extern struct fort_border_style FORT_BASIC2_STYLE;
-extern struct fort_border_style FORT_SIMPLE_STYLE;
-extern struct fort_border_style FORT_PLAIN_STYLE;
-extern struct fort_border_style FORT_DOT_STYLE;
-extern struct fort_border_style FORT_EMPTY_STYLE;
-extern struct fort_border_style FORT_EMPTY2_STYLE;
-extern struct fort_border_style FORT_SOLID_STYLE;
-extern struct fort_border_style FORT_SOLID_ROUND_STYLE;
-extern struct fort_border_style FORT_NICE_STYLE;
-extern struct fort_border_style FORT_DOUBLE_STYLE;
-extern struct fort_border_style FORT_DOUBLE2_STYLE;
-extern struct fort_border_style FORT_BOLD_STYLE;
-extern struct fort_border_style FORT_BOLD2_STYLE;
-extern struct fort_border_style FORT_FRAME_STYLE;
 
+/*
+ * Offsets of lines of multiline content. Lines of cells are printed one by
+ * one, so the index is built on the first access to a line instead of
+ * searching for the n-th newline from the beginning of the content each time.
+ */
+struct f_line_index {
+    size_t count;         /* number of lines */
+    size_t offsets[1];    /* beginnings of lines and offsets[count] = len + 1 */
+};
 
-struct fort_entire_table_properties {
-    unsigned int left_margin;
-    unsigned int top_margin;
-    unsigned int right_margin;
-    unsigned int bottom_margin;
-    enum ft_adding_strategy add_strategy;
+struct f_string_buffer {
+    union {
+        char *cstr;
+#ifdef FT_HAVE_WCHAR
+        wchar_t *wstr;
+#endif
+#ifdef FT_HAVE_UTF8
+        void *u8str;
+#endif
+        void *data;
+    } str;
+    union {
+        size_t data_sz;    /* size of memory owned by the buffer */
+        void *owner;       /* object released with free_fn (adopted buffers) */
+    } mem;
+    enum f_string_type type;
+    enum f_buffer_ownership ownership;
+    void (*free_fn)(void *ptr);
+    struct f_text_metrics metrics;
 };
-typedef struct fort_entire_table_properties fort_entire_table_properties_t;
-extern fort_entire_table_properties_t g_entire_table_properties;
 
+/* Initializes empty buffer that doesn't own memory (e.g. buffer of a cell) */
 FT_INTERNAL
-f_status set_entire_table_property(f_table_properties_t *table_properties, uint32_t property, int value);
+void init_string_buffer(f_string_buffer_t *buffer, enum f_string_type type);
 
+/* Returns 1 if nothing was written to the buffer since it was initialized */
 FT_INTERNAL
-f_status set_default_entire_table_property(uint32_t property, int value);
-
-struct f_table_properties {
-    struct fort_border_style border_style;
-    f_cell_prop_container_t *cell_properties;
-    fort_entire_table_properties_t entire_table_properties;
-};
-extern f_table_properties_t g_table_properties;
+int buffer_is_unwritten(const f_string_buffer_t *buffer);
 
 FT_INTERNAL
-size_t max_border_elem_strlen(struct f_table_properties *);
+f_string_buffer_t *create_string_buffer(size_t number_of_chars, enum f_string_type type);
 
 FT_INTERNAL
-f_table_properties_t *create_table_properties(void);
+void destroy_string_buffer(f_string_buffer_t *buffer);
 
+/* Frees content of the buffer initialized with init_string_buffer */
 FT_INTERNAL
-void destroy_table_properties(f_table_properties_t *properties);
+void release_buffer_data(f_string_buffer_t *buffer);
 
+/* Initializes `result` with a copy of content of `buffer` */
 FT_INTERNAL
-f_table_properties_t *copy_table_properties(const f_table_properties_t *property);
-
-#endif /* PROPERTIES_H */
-
-/********************************************************
-   End of file "properties.h"
- ********************************************************/
-
-
-/********************************************************
-   Begin of file "cell.h"
- ********************************************************/
-
-#ifndef CELL_H
-#define CELL_H
-
-/* #include "fort_utils.h" */ /* Commented by amalgamation script */
+f_status copy_string_buffer(f_string_buffer_t *result, const f_string_buffer_t *buffer);
 
 FT_INTERNAL
-f_cell_t *create_cell(void);
+f_status realloc_string_buffer_without_copy(f_string_buffer_t *buffer);
 
 FT_INTERNAL
-void destroy_cell(f_cell_t *cell);
+f_status fill_buffer_from_string(f_string_buffer_t *buffer, const char *str);
 
+#ifdef FT_HAVE_WCHAR
 FT_INTERNAL
-f_cell_t *copy_cell(f_cell_t *cell);
+f_status fill_buffer_from_wstring(f_string_buffer_t *buffer, const wchar_t *str);
+#endif /* FT_HAVE_WCHAR */
 
+#ifdef FT_HAVE_UTF8
 FT_INTERNAL
-size_t cell_vis_width(const f_cell_t *cell, const f_context_t *context);
+f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str);
+#endif /* FT_HAVE_UTF8 */
 
+/*
+ * Copies first `len` code units of `str` (it may be not null-terminated) to
+ * the buffer computing metrics of the content at the same time.
+ */
 FT_INTERNAL
-size_t cell_invis_codes_width(const f_cell_t *cell, const f_context_t *context);
+f_status fill_buffer_from_string_len(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len);
 
+/*
+ * Copies `str` (first `len` code units of it or the whole null-terminated
+ * string if `len` is SIZE_MAX) to `dst` computing metrics of the content at the
+ * same time. Memory at `dst` is managed by the caller (e.g. text slab of the
+ * table) and is borrowed by the buffer. Returns length of the copied string.
+ */
 FT_INTERNAL
-size_t hint_height_cell(const f_cell_t *cell, const f_context_t *context);
+size_t fill_buffer_from_string_at(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len, void *dst);
 
+/*
+ * Makes buffer borrow content interned by the table. Metrics of the content
+ * (and index of its lines) were computed when it was interned and are shared
+ * by all buffers with this content.
+ */
 FT_INTERNAL
-void set_cell_type(f_cell_t *cell, enum f_cell_type type);
+void fill_buffer_from_interned(f_string_buffer_t *buffer, const void *data, const struct f_text_metrics *metrics);
 
+/*
+ * Builds index of lines of the multiline content. Used to build index of
+ * interned content before it is shared. Returns NULL if the content has one
+ * line or memory can't be allocated.
+ */
 FT_INTERNAL
-enum f_cell_type get_cell_type(const f_cell_t *cell);
+struct f_line_index *buffer_line_index(const f_string_buffer_t *buffer);
 
+/*
+ * Makes buffer use `str` without copying it. If free_fn is NULL the string is
+ * borrowed, otherwise buffer takes ownership of it (or of `owner` of the
+ * string if it is not NULL) and releases it with free_fn.
+ */
 FT_INTERNAL
-int cell_printf(f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t cod_width);
+void fill_buffer_from_external(f_string_buffer_t *buffer, const f_string_view_t *str,
+                               void (*free_fn)(void *ptr), void *owner);
 
+/*
+ * Makes buffer own `data` allocated with F_MALLOC and filled by the caller
+ * (e.g. formatted in place). Metrics of the content are computed when they
+ * are requested.
+ */
 FT_INTERNAL
-f_status fill_cell_from_string(f_cell_t *cell, const char *str);
+void fill_buffer_from_allocated(f_string_buffer_t *buffer, void *data, enum f_string_type type);
 
-#ifdef FT_HAVE_WCHAR
+#ifdef FT_HAVE_UTF8
+/*
+ * Handles ill-formed sequences of utf-8 content of the buffer: keeps them,
+ * rejects content (the buffer is left empty and FT_EINVAL is returned) or
+ * replaces them with U+FFFD.
+ */
 FT_INTERNAL
-f_status fill_cell_from_wstring(f_cell_t *cell, const wchar_t *str);
-#endif
+f_status buffer_check_utf8(f_string_buffer_t *buffer, enum ft_invalid_utf8_handling handling);
+#endif /* FT_HAVE_UTF8 */
 
 FT_INTERNAL
-f_status fill_cell_from_buffer(f_cell_t *cell, const f_string_buffer_t *buf);
+size_t buffer_text_visible_width(const f_string_buffer_t *buffer);
 
 FT_INTERNAL
-f_string_buffer_t *cell_get_string_buffer(f_cell_t *cell);
-
-#endif /* CELL_H */
-
-/********************************************************
-   End of file "cell.h"
- ********************************************************/
-
-
-/********************************************************
-   Begin of file "row.h"
- ********************************************************/
-
-#ifndef ROW_H
-#define ROW_H
-
-/* #include "fort_utils.h" */ /* Commented by amalgamation script */
-#include "fort.h"
-#include <stdarg.h>
-/* #include "properties.h" */ /* Commented by amalgamation script */
-#ifdef FT_HAVE_WCHAR
-#include <wchar.h>
-#endif
+size_t buffer_text_visible_height(const f_string_buffer_t *buffer);
 
+/*
+ * Returns upper bound of the number of code units of the content that don't
+ * take columns of the output (bytes of multibyte utf-8 sequences that are
+ * copied to char output as they are, zero-width wide chars).
+ */
 FT_INTERNAL
-f_row_t *create_row(void);
+size_t buffer_text_extra_code_units(const f_string_buffer_t *buffer);
 
 FT_INTERNAL
-void destroy_row(f_row_t *row);
+size_t string_buffer_cod_width_capacity(const f_string_buffer_t *buffer);
 
 FT_INTERNAL
-f_row_t *copy_row(f_row_t *row);
+size_t string_buffer_raw_capacity(const f_string_buffer_t *buffer);
 
 FT_INTERNAL
-f_row_t *split_row(f_row_t *row, size_t pos);
+size_t string_buffer_width_capacity(const f_string_buffer_t *buffer);
 
-// Delete range [left; right] of cells (both ends included)
 FT_INTERNAL
-int ft_row_erase_range(f_row_t *row, size_t left, size_t right);
+void *buffer_get_data(f_string_buffer_t *buffer);
 
 FT_INTERNAL
-f_row_t *create_row_from_string(const char *str);
+int buffer_check_align(f_string_buffer_t *buffer);
 
 FT_INTERNAL
-f_row_t *create_row_from_fmt_string(const struct f_string_view  *fmt, va_list *va_args);
+int buffer_printf(f_string_buffer_t *buffer, size_t buffer_row, f_conv_context_t *cntx, size_t cod_width,
+                  const char *content_style_tag, const char *reset_content_style_tag);
 
+#ifdef FT_HAVE_UTF8
 FT_INTERNAL
-size_t columns_in_row(const f_row_t *row);
+void buffer_set_u8strwid_func(int (*u8strwid)(const void *beg, const void *end, size_t *width));
+#endif /* FT_HAVE_UTF8 */
 
-FT_INTERNAL
-f_cell_t *get_cell(f_row_t *row, size_t col);
 
-FT_INTERNAL
-const f_cell_t *get_cell_c(const f_row_t *row, size_t col);
+#endif /* STRING_BUFFER_H */
 
-FT_INTERNAL
-f_cell_t *get_cell_and_create_if_not_exists(f_row_t *row, size_t col);
+/********************************************************
+   End of file "string_buffer.h"
+ ********************************************************/
 
-FT_INTERNAL
-f_cell_t *create_cell_in_position(f_row_t *row, size_t col);
 
-FT_INTERNAL
-f_status swap_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos);
+/********************************************************
+   Begin of file "properties.h"
+ ********************************************************/
 
-FT_INTERNAL
-f_status insert_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos);
+#ifndef PROPERTIES_H
+#define PROPERTIES_H
 
-FT_INTERNAL
-size_t group_cell_number(const f_row_t *row, size_t master_cell_col);
+/* #include "fort_utils.h" */ /* Commented by amalgamation script */
+#include <stdint.h>
+#include <limits.h>
 
-FT_INTERNAL
-int get_row_cell_types(const f_row_t *row, enum f_cell_type *types, size_t types_sz);
+#define PROP_IS_SET(ft_props, property) ((ft_props) & (property))
+#define PROP_SET(ft_props, property) ((ft_props) |=(property))
+#define PROP_UNSET(ft_props, property) ((ft_props) &= ~((uint32_t)(property)))
 
-FT_INTERNAL
-f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span);
+#define TEXT_STYLE_TAG_MAX_SIZE (64 * 2)
 
 FT_INTERNAL
-int print_row_separator(f_conv_context_t *cntx,
-                        const size_t *col_width_arr, size_t cols,
-                        const f_row_t *upper_row, const f_row_t *lower_row,
-                        enum f_hor_separator_pos separatorPos, const f_separator_t *sep);
+void get_style_tag_for_cell(const f_table_properties_t *props,
+                            size_t row, size_t col, char *style_tag, size_t sz);
 
 FT_INTERNAL
-int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_arr, size_t col_width_arr_sz,
-                 size_t row_height);
+void get_reset_style_tag_for_cell(const f_table_properties_t *props,
+                                  size_t row, size_t col, char *style_tag, size_t sz);
 
-#ifdef FT_HAVE_WCHAR
 FT_INTERNAL
-f_row_t *create_row_from_wstring(const wchar_t *str);
-#endif
-
-
-#endif /* ROW_H */
-
-/********************************************************
-   End of file "row.h"
- ********************************************************/
-
+void get_style_tag_for_content(const f_table_properties_t *props,
+                               size_t row, size_t col, char *style_tag, size_t sz);
 
-/********************************************************
-   Begin of file "table.h"
- ********************************************************/
+FT_INTERNAL
+void get_reset_style_tag_for_content(const f_table_properties_t *props,
+                                     size_t row, size_t col, char *style_tag, size_t sz);
 
-#ifndef TABLE_H
-#define TABLE_H
 
-/* #include "fort_utils.h" */ /* Commented by amalgamation script */
+struct f_cell_props {
+    size_t cell_row;
+    size_t cell_col;
+    uint32_t properties_flags;
 
-struct ft_table {
-    f_vector_t *rows;
-    f_table_properties_t *properties;
-    f_string_buffer_t *conv_buffer;
-    size_t cur_row;
-    size_t cur_col;
-    f_vector_t *separators;
+    unsigned int col_min_width;
+    enum ft_text_alignment align;
+    unsigned int cell_padding_top;
+    unsigned int cell_padding_bottom;
+    unsigned int cell_padding_left;
+    unsigned int cell_padding_right;
+    unsigned int cell_empty_string_height;
+    enum ft_row_type row_type;
+    unsigned int content_fg_color_number;
+    unsigned int content_bg_color_number;
+    unsigned int cell_bg_color_number;
+    enum ft_text_style cell_text_style;
+    enum ft_text_style content_text_style;
 };
 
-FT_INTERNAL
-f_separator_t *create_separator(int enabled);
+typedef struct f_cell_props f_cell_props_t;
+typedef f_vector_t f_cell_prop_container_t;
 
 FT_INTERNAL
-void destroy_separator(f_separator_t *sep);
+f_cell_prop_container_t *create_cell_prop_container(void);
 
 FT_INTERNAL
-f_separator_t *copy_separator(f_separator_t *sep);
+void destroy_cell_prop_container(f_cell_prop_container_t *cont);
 
 FT_INTERNAL
-f_status get_table_sizes(const ft_table_t *table, size_t *rows, size_t *cols);
+const f_cell_props_t *cget_cell_prop(const f_cell_prop_container_t *cont, size_t row, size_t col);
 
 FT_INTERNAL
-f_row_t *get_row(ft_table_t *table, size_t row);
+f_cell_props_t *get_cell_prop_and_create_if_not_exists(f_cell_prop_container_t *cont, size_t row, size_t col);
 
 FT_INTERNAL
-const f_row_t *get_row_c(const ft_table_t *table, size_t row);
+f_status set_cell_property(f_cell_prop_container_t *cont, size_t row, size_t col, uint32_t property, int value);
 
 FT_INTERNAL
-f_row_t *get_row_and_create_if_not_exists(ft_table_t *table, size_t row);
+int get_cell_property_hierarchically(const f_table_properties_t *properties, size_t row, size_t column, uint32_t property);
 
 FT_INTERNAL
-f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table);
+f_status set_default_cell_property(uint32_t property, int value);
 
 
-FT_INTERNAL
-f_status table_rows_and_cols_geometry(const ft_table_t *table,
-                                      size_t **col_width_arr_p, size_t *col_width_arr_sz,
-                                      size_t **row_height_arr_p, size_t *row_height_arr_sz,
-                                      enum f_geometry_type geom);
+/*         TABLE BORDER DESСRIPTION
+ *
+ *
+ *   TL TT TT TT TV TT TT TT TT TT TT TT TR
+ *   LL          IV                      RR
+ *   LL          IV                      RR
+ *   LH IH IH IH II IH IH IH TI IH IH IH RH
+ *   LL          IV          IV          RR
+ *   LL          IV          IV          RR
+ *   LL          LI IH IH IH RI          RH
+ *   LL          IV          IV          RR
+ *   LL          IV          IV          RR
+ *   LH IH IH IH BI IH IH IH II IH IH IH RH
+ *   LL                      IV          RR
+ *   LL                      IV          RR
+ *   BL BB BB BB BV BB BB BB BV BB BB BB BR
+ */
 
-FT_INTERNAL
-f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width);
 
-/*
- * Returns geometry in codepoints(characters) (include codepoints of invisible
- * elements: e.g. styles tags).
+/*      HORIZONTAL SEPARATOR DESCRIPTION
+ *
+ *
+ *   TL TT TT TT TV TT TT TT TV TT TT TT TR        <----- TOP_SEPARATOR
+ *   LL          IV          IV          RR
+ *   LH IH IH IH II IH IH IH II IH IH IH RH        <----- INSIDE_SEPARATOR
+ *   LL          IV          IV          RR
+ *   BL BB BB BB BV BB BB BB BV BB BB BB BR        <----- BOTTOM_SEPARATOR
  */
-FT_INTERNAL
-f_status table_internal_codepoints_geometry(const ft_table_t *table, size_t *height, size_t *width);
 
-#endif /* TABLE_H */
+enum f_hor_separator_pos {
+    TOP_SEPARATOR,
+    INSIDE_SEPARATOR,
+    BOTTOM_SEPARATOR
+};
 
-/********************************************************
-   End of file "table.h"
- ********************************************************/
+enum f_border_item_pos {
+    TL_bip = 0,
+    TT_bip = 1,
+    TV_bip = 2,
+    TR_bip = 3,
 
+    LL_bip = 4,
+    IV_bip = 5,
+    RR_bip = 6,
 
-/********************************************************
-   Begin of file "cell.c"
- ********************************************************/
+    LH_bip = 7,
+    IH_bip = 8,
+    II_bip = 9,
+    RH_bip = 10,
 
-/* #include "cell.h" */ /* Commented by amalgamation script */
-/* #include "properties.h" */ /* Commented by amalgamation script */
-/* #include "string_buffer.h" */ /* Commented by amalgamation script */
-#include <assert.h>
+    BL_bip = 11,
+    BB_bip = 12,
+    BV_bip = 13,
+    BR_bip = 14,
 
-struct f_cell {
-    f_string_buffer_t *str_buffer;
-    enum f_cell_type cell_type;
+    LI_bip = 15,
+    TI_bip = 16,
+    RI_bip = 17,
+    BI_bip = 18,
+
+    BORDER_ITEM_POS_SIZE
 };
 
-FT_INTERNAL
-f_cell_t *create_cell(void)
-{
-    f_cell_t *cell = (f_cell_t *)F_CALLOC(sizeof(f_cell_t), 1);
-    if (cell == NULL)
-        return NULL;
-    cell->str_buffer = create_string_buffer(DEFAULT_STR_BUF_SIZE, CHAR_BUF);
-    if (cell->str_buffer == NULL) {
-        F_FREE(cell);
-        return NULL;
-    }
-    cell->cell_type = COMMON_CELL;
-    return cell;
-}
 
-FT_INTERNAL
-void destroy_cell(f_cell_t *cell)
-{
-    if (cell == NULL)
-        return;
-    destroy_string_buffer(cell->str_buffer);
-    F_FREE(cell);
-}
-
-FT_INTERNAL
-f_cell_t *copy_cell(f_cell_t *cell)
-{
-    assert(cell);
+enum f_separator_item_pos {
+    LH_sip = 0,
+    IH_sip = 1,
+    II_sip = 2,
+    RH_sip = 3,
 
-    f_cell_t *result = create_cell();
-    if (result == NULL)
-        return NULL;
-    destroy_string_buffer(result->str_buffer);
-    result->str_buffer = copy_string_buffer(cell->str_buffer);
-    if (result->str_buffer == NULL) {
-        destroy_cell(result);
-        return NULL;
-    }
-    result->cell_type = cell->cell_type;
-    return result;
-}
+    TI_sip = 4,
+    BI_sip = 5,
 
-FT_INTERNAL
-void set_cell_type(f_cell_t *cell, enum f_cell_type type)
-{
-    assert(cell);
-    cell->cell_type = type;
-}
+    SEPARATOR_ITEM_POS_SIZE
+};
 
-FT_INTERNAL
-enum f_cell_type get_cell_type(const f_cell_t *cell)
-{
-    assert(cell);
-    return cell->cell_type;
-}
 
-FT_INTERNAL
-size_t cell_vis_width(const f_cell_t *cell, const f_context_t *context)
-{
-    /* todo:
-     * At the moment min width includes paddings. Maybe it is better that min width weren't include
-     * paddings but be min width of the cell content without padding
-     */
+struct fort_border_style {
+    const char *border_chars[BORDER_ITEM_POS_SIZE];
+    const char *header_border_chars[BORDER_ITEM_POS_SIZE];
+    const char *separator_chars[SEPARATOR_ITEM_POS_SIZE];
+};
+extern struct fort_border_style FORT_BASIC_STYLE;
+extern struct fort_border_style FORT_BASIC2_STYLE;
+extern struct fort_border_style FORT_SIMPLE_STYLE;
+extern struct fort_border_style FORT_PLAIN_STYLE;
+extern struct fort_border_style FORT_DOT_STYLE;
+extern struct fort_border_style FORT_EMPTY_STYLE;
+extern struct fort_border_style FORT_EMPTY2_STYLE;
+extern struct fort_border_style FORT_SOLID_STYLE;
+extern struct fort_border_style FORT_SOLID_ROUND_STYLE;
+extern struct fort_border_style FORT_NICE_STYLE;
+extern struct fort_border_style FORT_DOUBLE_STYLE;
+extern struct fort_border_style FORT_DOUBLE2_STYLE;
+extern struct fort_border_style FORT_BOLD_STYLE;
+extern struct fort_border_style FORT_BOLD2_STYLE;
+extern struct fort_border_style FORT_FRAME_STYLE;
 
-    assert(cell);
-    assert(context);
 
-    f_table_properties_t *properties = context->table_properties;
-    size_t row = context->row;
-    size_t column = context->column;
+struct fort_entire_table_properties {
+    unsigned int left_margin;
+    unsigned int top_margin;
+    unsigned int right_margin;
+    unsigned int bottom_margin;
+    enum ft_adding_strategy add_strategy;
+    enum ft_invalid_utf8_handling invalid_utf8;
+    int intern_strings;
+};
+typedef struct fort_entire_table_properties fort_entire_table_properties_t;
+extern fort_entire_table_properties_t g_entire_table_properties;
 
-    size_t padding_left = get_cell_property_hierarchically(properties, row, column, FT_CPROP_LEFT_PADDING);
-    size_t padding_right = get_cell_property_hierarchically(properties, row, column, FT_CPROP_RIGHT_PADDING);
-    size_t result = padding_left + padding_right;
-    if (cell->str_buffer && cell->str_buffer->str.data) {
-        result += buffer_text_visible_width(cell->str_buffer);
-    }
-    result = MAX(result, (size_t)get_cell_property_hierarchically(properties, row, column, FT_CPROP_MIN_WIDTH));
-    return result;
-}
+FT_INTERNAL
+f_status set_entire_table_property(f_table_properties_t *table_properties, uint32_t property, int value);
 
 FT_INTERNAL
-size_t cell_invis_codes_width(const f_cell_t *cell, const f_context_t *context)
-{
-    assert(cell);
-    assert(context);
+f_status set_default_entire_table_property(uint32_t property, int value);
 
-    f_table_properties_t *properties = context->table_properties;
-    size_t row = context->row;
-    size_t column = context->column;
+/*
+ * Formats of numbers stored in the cells of a column. Format specification
+ * is converted to printf formats for every number type it suits.
+ */
+struct f_column_format {
+    size_t col;
+    char fmt[3][FT_NUMBER_FMT_SZ];    /* indexed by enum f_number_type */
+    int has_fmt[3];
+};
+typedef struct f_column_format f_column_format_t;
 
-    size_t result = 0;
-    char cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_style_tag_for_cell(properties, row, column, cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    result += strlen(cell_style_tag);
+/*
+ * Chars of the border style prepared for printing. They are prepared when the
+ * style is set (see prepare_border_glyphs).
+ */
+struct f_border_glyphs {
+    int ready;
+    size_t max_len;       /* maximum length of glyphs in bytes */
+    f_glyph_t border[BORDER_ITEM_POS_SIZE];
+    f_glyph_t header_border[BORDER_ITEM_POS_SIZE];
+    f_glyph_t separator[SEPARATOR_ITEM_POS_SIZE];
+};
 
-    char reset_cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_reset_style_tag_for_cell(properties, row, column, reset_cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    result += strlen(reset_cell_style_tag);
+struct f_table_properties {
+    struct fort_border_style border_style;
+    struct f_border_glyphs border_glyphs;
+    f_cell_prop_container_t *cell_properties;
+    fort_entire_table_properties_t entire_table_properties;
+    f_vector_t *column_formats;
+};
+extern f_table_properties_t g_table_properties;
 
-    char content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_style_tag_for_content(properties, row, column, content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    result += strlen(content_style_tag);
+FT_INTERNAL
+f_status set_column_number_format(f_table_properties_t *properties, size_t col, const char *fmt_spec);
 
-    char reset_content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_reset_style_tag_for_content(properties, row, column, reset_content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    result += strlen(reset_content_style_tag);
-    return result;
-}
+/*
+ * Returns printf format for numbers of the type in the column or NULL if
+ * the default format should be used.
+ */
+FT_INTERNAL
+const char *get_column_number_format(const f_table_properties_t *properties, size_t col, enum f_number_type type);
 
 FT_INTERNAL
-size_t hint_height_cell(const f_cell_t *cell, const f_context_t *context)
-{
-    assert(cell);
-    assert(context);
-    f_table_properties_t *properties = context->table_properties;
-    size_t row = context->row;
-    size_t column = context->column;
+size_t max_border_elem_strlen(struct f_table_properties *);
 
-    size_t padding_top = get_cell_property_hierarchically(properties, row, column, FT_CPROP_TOP_PADDING);
-    size_t padding_bottom = get_cell_property_hierarchically(properties, row, column, FT_CPROP_BOTTOM_PADDING);
-    size_t empty_string_height = get_cell_property_hierarchically(properties, row, column, FT_CPROP_EMPTY_STR_HEIGHT);
+FT_INTERNAL
+void prepare_border_glyphs(f_table_properties_t *properties);
 
-    size_t result = padding_top + padding_bottom;
-    if (cell->str_buffer && cell->str_buffer->str.data) {
-        size_t text_height = buffer_text_visible_height(cell->str_buffer);
-        result += text_height == 0 ? empty_string_height : text_height;
-    }
-    return result;
-}
+/* Returns glyphs of the border style preparing them if necessary */
+FT_INTERNAL
+const struct f_border_glyphs *border_glyphs(f_table_properties_t *properties);
 
+FT_INTERNAL
+f_table_properties_t *create_table_properties(void);
 
 FT_INTERNAL
-int cell_printf(f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t vis_width)
-{
-    const f_context_t *context = cntx->cntx;
-    size_t buf_len = vis_width;
+void destroy_table_properties(f_table_properties_t *properties);
 
-    if (cell == NULL || (vis_width < cell_vis_width(cell, context))) {
-        return -1;
-    }
+FT_INTERNAL
+f_table_properties_t *copy_table_properties(const f_table_properties_t *property);
 
-    f_table_properties_t *properties = context->table_properties;
-    unsigned int padding_top = get_cell_property_hierarchically(properties, context->row, context->column, FT_CPROP_TOP_PADDING);
-    unsigned int padding_left = get_cell_property_hierarchically(properties, context->row, context->column, FT_CPROP_LEFT_PADDING);
-    unsigned int padding_right = get_cell_property_hierarchically(properties, context->row, context->column, FT_CPROP_RIGHT_PADDING);
+#endif /* PROPERTIES_H */
 
-    size_t written = 0;
-    size_t invisible_written = 0;
-    int tmp = 0;
+/********************************************************
+   End of file "properties.h"
+ ********************************************************/
 
-    /* todo: Dirty hack with changing buf_len! need refactoring. */
-    /* Also maybe it is better to move all struff with colors to buffers? */
-    char cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_style_tag_for_cell(properties, context->row, context->column, cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    buf_len += strlen(cell_style_tag);
 
-    char reset_cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_reset_style_tag_for_cell(properties, context->row, context->column, reset_cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    buf_len += strlen(reset_cell_style_tag);
+/********************************************************
+   Begin of file "cell.h"
+ ********************************************************/
 
-    char content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_style_tag_for_content(properties, context->row, context->column, content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    buf_len += strlen(content_style_tag);
+#ifndef CELL_H
+#define CELL_H
 
-    char reset_content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
-    get_reset_style_tag_for_content(properties, context->row, context->column, reset_content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
-    buf_len += strlen(reset_content_style_tag);
+/* #include "fort_utils.h" */ /* Commented by amalgamation script */
+/* #include "string_buffer.h" */ /* Commented by amalgamation script */
 
-    /*    CELL_STYLE_T   LEFT_PADDING   CONTENT_STYLE_T  CONTENT   RESET_CONTENT_STYLE_T    RIGHT_PADDING   RESET_CELL_STYLE_T
-     *  |              |              |                |         |                       |                |                    |
-     *        L1                                                                                                    R1
-     *                     L2                                                                   R2
-     *                                     L3                               R3
-     */
+/*
+ * Type of the cell content. Typed values are formatted only while the table
+ * is printed.
+ */
+enum f_cell_value_type {
+    F_CELL_TEXT = 0,
+    F_CELL_I64,
+    F_CELL_U64,
+    F_CELL_F64,
+    F_CELL_BOOL
+};
 
-    size_t L2 = padding_left;
+/*
+ * Cells are stored by value in contiguous arrays of rows (see row.c), so
+ * pointers to cells are invalidated when cells are added to or removed from
+ * the row.
+ */
+struct f_cell {
+    f_string_buffer_t str_buffer;
+    enum f_cell_type cell_type;
+    enum f_cell_value_type value_type;
+    union f_number value;  /* typed value (bool is stored in u64) */
+};
 
-    size_t R2 = padding_right;
-    size_t R3 = strlen(reset_cell_style_tag);
+/*
+ * Returns empty cell which represents gaps of sparse rows. The cell must not
+ * be modified.
+ */
+FT_INTERNAL
+const f_cell_t *get_empty_cell(void);
 
-#define TOTAL_WRITTEN (written + invisible_written)
-#define RIGHT (padding_right + extra_right)
+/* Initializes empty cell; it doesn't allocate memory */
+FT_INTERNAL
+void init_cell(f_cell_t *cell);
 
-#define WRITE_CELL_STYLE_TAG        CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, cell_style_tag))
-#define WRITE_RESET_CELL_STYLE_TAG  CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, reset_cell_style_tag))
-#define WRITE_CONTENT_STYLE_TAG        CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, content_style_tag))
-#define WRITE_RESET_CONTENT_STYLE_TAG  CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, reset_content_style_tag))
+/* Frees content of the cell */
+FT_INTERNAL
+void release_cell(f_cell_t *cell);
 
-    if (row >= hint_height_cell(cell, context)
-        || row < padding_top
-        || row >= (padding_top + buffer_text_visible_height(cell->str_buffer))) {
-        WRITE_CELL_STYLE_TAG;
-        WRITE_CONTENT_STYLE_TAG;
-        WRITE_RESET_CONTENT_STYLE_TAG;
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, buf_len - TOTAL_WRITTEN - R3, FT_SPACE));
-        WRITE_RESET_CELL_STYLE_TAG;
+/* Returns 1 if nothing was written to the cell since it was initialized */
+FT_INTERNAL
+int cell_is_unwritten(const f_cell_t *cell);
 
-        return (int)TOTAL_WRITTEN;
-    }
+/* Initializes `result` with a copy of `cell` */
+FT_INTERNAL
+f_status copy_cell(f_cell_t *result, const f_cell_t *cell);
 
-    WRITE_CELL_STYLE_TAG;
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, L2, FT_SPACE));
-    if (cell->str_buffer) {
-        CHCK_RSLT_ADD_TO_WRITTEN(buffer_printf(cell->str_buffer, row - padding_top, cntx, vis_width - L2 - R2, content_style_tag, reset_content_style_tag));
-    } else {
-        WRITE_CONTENT_STYLE_TAG;
-        WRITE_RESET_CONTENT_STYLE_TAG;
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, vis_width - L2 - R2, FT_SPACE));
-    }
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, R2, FT_SPACE));
-    WRITE_RESET_CELL_STYLE_TAG;
+FT_INTERNAL
+size_t cell_vis_width(const f_cell_t *cell, const f_context_t *context);
 
-    return (int)TOTAL_WRITTEN;
+FT_INTERNAL
+size_t cell_invis_codes_width(const f_cell_t *cell, const f_context_t *context);
 
-clear:
-    return -1;
-#undef WRITE_CELL_STYLE_TAG
-#undef WRITE_RESET_CELL_STYLE_TAG
-#undef WRITE_CONTENT_STYLE_TAG
-#undef WRITE_RESET_CONTENT_STYLE_TAG
-#undef TOTAL_WRITTEN
-#undef RIGHT
-}
+FT_INTERNAL
+size_t hint_height_cell(const f_cell_t *cell, const f_context_t *context);
 
 FT_INTERNAL
-f_status fill_cell_from_string(f_cell_t *cell, const char *str)
-{
-    assert(str);
-    assert(cell);
+void set_cell_type(f_cell_t *cell, enum f_cell_type type);
 
-    return fill_buffer_from_string(cell->str_buffer, str);
-}
+FT_INTERNAL
+enum f_cell_type get_cell_type(const f_cell_t *cell);
 
-#ifdef FT_HAVE_WCHAR
 FT_INTERNAL
-f_status fill_cell_from_wstring(f_cell_t *cell, const wchar_t *str)
-{
-    assert(str);
-    assert(cell);
+int cell_printf(f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t cod_width);
 
-    return fill_buffer_from_wstring(cell->str_buffer, str);
-}
+FT_INTERNAL
+f_status fill_cell_from_string(f_cell_t *cell, const char *str);
+
+#ifdef FT_HAVE_WCHAR
+FT_INTERNAL
+f_status fill_cell_from_wstring(f_cell_t *cell, const wchar_t *str);
 #endif
 
 #ifdef FT_HAVE_UTF8
-static
-f_status fill_cell_from_u8string(f_cell_t *cell, const void *str)
-{
-    assert(str);
-    assert(cell);
-    return fill_buffer_from_u8string(cell->str_buffer, str);
-}
+FT_INTERNAL
+f_status fill_cell_from_u8string(f_cell_t *cell, const void *str);
 #endif /* FT_HAVE_UTF8 */
 
 FT_INTERNAL
-f_string_buffer_t *cell_get_string_buffer(f_cell_t *cell)
-{
-    assert(cell);
-    assert(cell->str_buffer);
-    return cell->str_buffer;
-}
+f_status fill_cell_from_buffer(f_cell_t *cell, const f_string_buffer_t *buf);
 
+/*
+ * Returns buffer to write text content of the cell. Typed value of the cell
+ * is dropped.
+ */
 FT_INTERNAL
-f_status fill_cell_from_buffer(f_cell_t *cell, const f_string_buffer_t *buffer)
-{
-    assert(cell);
-    assert(buffer);
-    switch (buffer->type) {
-        case CHAR_BUF:
-            return fill_cell_from_string(cell, buffer->str.cstr);
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            return fill_cell_from_wstring(cell, buffer->str.wstr);
-#endif /* FT_HAVE_WCHAR */
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            return fill_cell_from_u8string(cell, buffer->str.u8str);
-#endif /* FT_HAVE_UTF8 */
-        default:
-            assert(0);
-            return FT_GEN_ERROR;
-    }
+f_string_buffer_t *cell_get_string_buffer(f_cell_t *cell);
 
-}
+FT_INTERNAL
+f_status set_cell_value(f_cell_t *cell, enum f_cell_value_type type, const union f_number *value);
+
+#endif /* CELL_H */
 
 /********************************************************
-   End of file "cell.c"
+   End of file "cell.h"
  ********************************************************/
 
 
 /********************************************************
-   Begin of file "fort_impl.c"
+   Begin of file "row.h"
  ********************************************************/
 
-/*
-libfort
+#ifndef ROW_H
+#define ROW_H
 
-MIT License
+/* #include "fort_utils.h" */ /* Commented by amalgamation script */
+#include "fort.h"
+#include <stdarg.h>
+/* #include "properties.h" */ /* Commented by amalgamation script */
+#ifdef FT_HAVE_WCHAR
+#include <wchar.h>
+#endif
 
-Copyright (c) 2017 - 2018 Seleznev Anton
+FT_INTERNAL
+f_row_t *create_row(void);
 
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
+FT_INTERNAL
+f_row_t *create_row_with_capacity(size_t cols);
 
-The above copyright notice and this permission notice shall be included in all
-copies or substantial portions of the Software.
+FT_INTERNAL
+void destroy_row(f_row_t *row);
 
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
-SOFTWARE.
-*/
+FT_INTERNAL
+f_row_t *copy_row(f_row_t *row);
 
-#include <stdlib.h>
-#include <stdarg.h>
-#include <stdio.h>
-#include "fort.h"
-#include <assert.h>
-#include <string.h>
-#include <wchar.h>
+FT_INTERNAL
+f_row_t *split_row(f_row_t *row, size_t pos);
 
-/* #include "vector.h" */ /* Commented by amalgamation script */
-/* #include "fort_utils.h" */ /* Commented by amalgamation script */
-/* #include "string_buffer.h" */ /* Commented by amalgamation script */
-/* #include "table.h" */ /* Commented by amalgamation script */
-/* #include "row.h" */ /* Commented by amalgamation script */
-/* #include "properties.h" */ /* Commented by amalgamation script */
+// Delete range [left; right] of cells (both ends included)
+FT_INTERNAL
+int ft_row_erase_range(f_row_t *row, size_t left, size_t right);
 
+FT_INTERNAL
+f_row_t *create_row_from_string(const char *str);
 
-ft_table_t *ft_create_table(void)
-{
-    ft_table_t *result = (ft_table_t *)F_CALLOC(1, sizeof(ft_table_t));
-    if (result == NULL)
-        return NULL;
+FT_INTERNAL
+f_row_t *create_row_from_fmt_string(const struct f_string_view  *fmt, va_list *va_args);
 
-    result->rows = create_vector(sizeof(f_row_t *), DEFAULT_VECTOR_CAPACITY);
-    if (result->rows == NULL) {
-        F_FREE(result);
-        return NULL;
-    }
-    result->separators = create_vector(sizeof(f_separator_t *), DEFAULT_VECTOR_CAPACITY);
-    if (result->separators == NULL) {
-        destroy_vector(result->rows);
-        F_FREE(result);
-        return NULL;
-    }
+FT_INTERNAL
+size_t columns_in_row(const f_row_t *row);
 
-    result->properties = create_table_properties();
-    if (result->properties == NULL) {
-        destroy_vector(result->separators);
-        destroy_vector(result->rows);
-        F_FREE(result);
-        return NULL;
-    }
-    result->conv_buffer = NULL;
-    result->cur_row = 0;
-    result->cur_col = 0;
-    return result;
-}
+FT_INTERNAL
+f_status row_reserve_cells(f_row_t *row, size_t cols);
 
+FT_INTERNAL
+f_cell_t *get_cell(f_row_t *row, size_t col);
 
-void ft_destroy_table(ft_table_t *table)
-{
-    size_t i = 0;
+FT_INTERNAL
+const f_cell_t *get_cell_c(const f_row_t *row, size_t col);
 
-    if (table == NULL)
-        return;
+FT_INTERNAL
+f_cell_t *get_cell_and_create_if_not_exists(f_row_t *row, size_t col);
 
-    if (table->rows) {
-        size_t row_n = vector_size(table->rows);
-        for (i = 0; i < row_n; ++i) {
-            destroy_row(VECTOR_AT(table->rows, i, f_row_t *));
-        }
-        destroy_vector(table->rows);
-    }
-    if (table->separators) {
-        size_t row_n = vector_size(table->separators);
-        for (i = 0; i < row_n; ++i) {
-            destroy_separator(VECTOR_AT(table->separators, i, f_separator_t *));
-        }
-        destroy_vector(table->separators);
-    }
-    destroy_table_properties(table->properties);
-    destroy_string_buffer(table->conv_buffer);
-    F_FREE(table);
-}
+FT_INTERNAL
+f_cell_t *create_cell_in_position(f_row_t *row, size_t col);
 
-ft_table_t *ft_copy_table(ft_table_t *table)
-{
-    if (table == NULL)
-        return NULL;
+FT_INTERNAL
+f_status swap_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos);
 
-    ft_table_t *result = ft_create_table();
-    if (result == NULL)
-        return NULL;
+FT_INTERNAL
+f_status insert_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos);
 
-    size_t i = 0;
-    size_t rows_n = vector_size(table->rows);
-    for (i = 0; i < rows_n; ++i) {
-        f_row_t *row = VECTOR_AT(table->rows, i, f_row_t *);
-        f_row_t *new_row = copy_row(row);
-        if (new_row == NULL) {
-            ft_destroy_table(result);
-            return NULL;
-        }
-        vector_push(result->rows, &new_row);
-    }
+FT_INTERNAL
+size_t group_cell_number(const f_row_t *row, size_t master_cell_col);
 
-    size_t sep_sz = vector_size(table->separators);
-    for (i = 0; i < sep_sz; ++i) {
-        f_separator_t *sep = VECTOR_AT(table->separators, i, f_separator_t *);
-        f_separator_t *new_sep = copy_separator(sep);
-        if (new_sep == NULL) {
-            ft_destroy_table(result);
-            return NULL;
-        }
-        vector_push(result->separators, &new_sep);
-    }
+/*
+ * Drops span map of the row. It should be called if types of cells of the
+ * row are changed with set_cell_type.
+ */
+FT_INTERNAL
+void invalidate_span_map(f_row_t *row);
 
-    /* note: by default new table has allocated default properties, so we
-     * have to destroy them first.
-     */
-    if (result->properties) {
-        destroy_table_properties(result->properties);
-    }
-    result->properties = copy_table_properties(table->properties);
-    if (result->properties == NULL) {
-        ft_destroy_table(result);
-        return NULL;
-    }
+FT_INTERNAL
+f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span);
 
-    /* todo: copy conv_buffer  ??  */
+FT_INTERNAL
+int print_row_separator(f_conv_context_t *cntx,
+                        const size_t *col_width_arr, size_t cols,
+                        const f_row_t *upper_row, const f_row_t *lower_row,
+                        enum f_hor_separator_pos separatorPos, const f_separator_t *sep);
 
-    result->cur_row = table->cur_row;
-    result->cur_col = table->cur_col;
-    return result;
-}
+FT_INTERNAL
+int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, const size_t *col_width_arr, size_t col_width_arr_sz,
+                 size_t row_height);
 
-static int split_cur_row(ft_table_t *table, f_row_t **tail_of_cur_row)
-{
-    if (table->cur_row >= vector_size(table->rows)) {
-        tail_of_cur_row = NULL;
-        return 0;
-    }
+#ifdef FT_HAVE_WCHAR
+FT_INTERNAL
+f_row_t *create_row_from_wstring(const wchar_t *str);
+#endif
+
+
+#endif /* ROW_H */
+
+/********************************************************
+   End of file "row.h"
+ ********************************************************/
+
+
+/********************************************************
+   Begin of file "table.h"
+ ********************************************************/
+
+#ifndef TABLE_H
+#define TABLE_H
+
+/* #include "fort_utils.h" */ /* Commented by amalgamation script */
+
+/*
+ * Content source of virtual tables. Cell content is requested from the
+ * provider while the table is being converted to string and is stored only
+ * in two scratch rows (current row and the previous one). Cell spans are
+ * kept in a vector sorted by rows and columns, so the table doesn't create
+ * rows for them.
+ */
+struct f_virtual_span {
+    size_t row;
+    size_t col;
+    size_t hor_span;
+};
+
+struct f_virtual_data {
+    size_t rows;
+    size_t cols;
+    ft_cell_provider_t provider;
+    void *ctx;
+    f_row_t *scratch_rows[2];
+    f_vector_t *spans;  /* of struct f_virtual_span, NULL if no spans are set */
+};
+typedef struct f_virtual_data f_virtual_data_t;
+
+/*
+ * Geometry of the whole table used by windowed rendering (ft_render_rows).
+ * It is computed on demand in one pass over the table and dropped by every
+ * function that may change geometry of the table. Changes of the default
+ * properties are tracked with generation of geometry (see
+ * invalidate_all_geometry_caches).
+ */
+struct f_geometry_cache {
+    size_t *vis_col_width_arr;
+    size_t *cod_col_width_arr;
+    size_t *row_height_arr;
+    size_t cols;
+    size_t rows;
+    size_t generation;
+    int valid;
+};
+typedef struct f_geometry_cache f_geometry_cache_t;
+
+/*
+ * Pool of strings interned by the table (see FT_TPROP_INTERN_STRINGS). Each
+ * distinct cell content is stored once in text slabs together with its
+ * metrics, cells borrow content from the pool. The pool is an open addressing
+ * hash table of entries which is created on the first interned write.
+ */
+struct f_intern_entry;
+struct f_intern_pool {
+    struct f_intern_entry **slots;
+    size_t capacity;      /* power of 2 */
+    size_t count;         /* number of distinct strings */
+    size_t lookups;
+    size_t hits;
+    size_t bytes;         /* memory used by entries and slots */
+};
+typedef struct f_intern_pool f_intern_pool_t;
+
+struct ft_table {
+    f_vector_t *rows;
+    f_table_properties_t *properties;
+    f_string_buffer_t *conv_buffer;
+    size_t cur_row;
+    size_t cur_col;
+    f_vector_t *separators;
+    f_virtual_data_t *virt;
+    f_geometry_cache_t geometry_cache;
+    f_vector_t *text_slabs;
+    f_intern_pool_t *intern_pool;
+    size_t reserved_cols;   /* capacity of new rows (see ft_reserve) */
+    ft_allocator_t allocator;   /* malloc_fn is NULL if global allocator is used */
+};
+
+FT_INTERNAL
+f_virtual_data_t *create_virtual_data(size_t rows, size_t cols, ft_cell_provider_t provider, void *ctx);
+
+FT_INTERNAL
+void destroy_virtual_data(f_virtual_data_t *virt);
+
+FT_INTERNAL
+f_virtual_data_t *copy_virtual_data(const f_virtual_data_t *virt);
+
+FT_INTERNAL
+f_status virtual_data_set_cell_span(f_virtual_data_t *virt, size_t row, size_t col, size_t hor_span);
+
+/*
+ * Allocates block of memory for content of cells written by bulk functions
+ * (ft_table_write, ft_row_write). Cells borrow their content from slabs, so
+ * slabs are released only with the table.
+ */
+FT_INTERNAL
+void *alloc_text_slab(ft_table_t *table, size_t sz);
+
+FT_INTERNAL
+void destroy_text_slabs(ft_table_t *table);
+
+/*
+ * Fills buffer with interned copy of first `len` code units of `str` adding it
+ * to the pool of the table if it is not there yet.
+ */
+FT_INTERNAL
+f_status fill_buffer_from_pool(ft_table_t *table, f_string_buffer_t *buffer, const f_string_view_t *str, size_t len);
+
+FT_INTERNAL
+void destroy_intern_pool(ft_table_t *table);
+
+/*
+ * Makes allocator of the table current (global allocator if the table doesn't
+ * have its own one).
+ * Returns allocator that should be restored with use_allocator after the
+ * operation on the table.
+ */
+FT_INTERNAL
+const ft_allocator_t *use_table_allocator(const ft_table_t *table);
+
+FT_INTERNAL
+f_separator_t *create_separator(int enabled);
+
+FT_INTERNAL
+void destroy_separator(f_separator_t *sep);
+
+FT_INTERNAL
+f_separator_t *copy_separator(f_separator_t *sep);
+
+FT_INTERNAL
+f_status get_table_sizes(const ft_table_t *table, size_t *rows, size_t *cols);
+
+FT_INTERNAL
+f_row_t *get_row(ft_table_t *table, size_t row);
+
+FT_INTERNAL
+const f_row_t *get_row_c(const ft_table_t *table, size_t row);
+
+FT_INTERNAL
+f_row_t *get_row_and_create_if_not_exists(ft_table_t *table, size_t row);
+
+FT_INTERNAL
+f_cell_t *get_cur_cell_and_create_if_not_exists(ft_table_t *table);
+
+FT_INTERNAL
+f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table);
+
+
+FT_INTERNAL
+f_status table_full_geometry(const ft_table_t *table,
+                             size_t **vis_col_width_arr_p, size_t **cod_col_width_arr_p, size_t *cols_p,
+                             size_t **row_height_arr_p, size_t *rows_p);
+
+FT_INTERNAL
+f_status table_rows_and_cols_geometry(const ft_table_t *table,
+                                      size_t **col_width_arr_p, size_t *col_width_arr_sz,
+                                      size_t **row_height_arr_p, size_t *row_height_arr_sz,
+                                      enum f_geometry_type geom);
+
+FT_INTERNAL
+f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width);
+
+/*
+ * Returns geometry in characters of the part of the table consisting of rows
+ * with heights `row_height_arr` given widths of columns in codepoints.
+ */
+FT_INTERNAL
+f_status table_geometry_for_rows(const ft_table_t *table,
+                                 const size_t *cod_col_width_arr, size_t cols,
+                                 const size_t *row_height_arr, size_t rows,
+                                 size_t *height, size_t *width);
+
+FT_INTERNAL
+const f_geometry_cache_t *table_geometry_cache(const ft_table_t *table);
+
+FT_INTERNAL
+void invalidate_geometry_cache(ft_table_t *table);
+
+FT_INTERNAL
+void destroy_geometry_cache(ft_table_t *table);
+
+/*
+ * Drops geometry caches of all tables (they depend on the default properties
+ * and on the function that computes width of utf-8 strings).
+ */
+FT_INTERNAL
+void invalidate_all_geometry_caches(void);
+
+/*
+ * Returns geometry in codepoints(characters) (include codepoints of invisible
+ * elements: e.g. styles tags).
+ */
+FT_INTERNAL
+f_status table_internal_codepoints_geometry(const ft_table_t *table, size_t *height, size_t *width);
+
+#endif /* TABLE_H */
+
+/********************************************************
+   End of file "table.h"
+ ********************************************************/
+
+
+/********************************************************
+   Begin of file "cell.c"
+ ********************************************************/
+
+/* #include "cell.h" */ /* Commented by amalgamation script */
+/* #include "properties.h" */ /* Commented by amalgamation script */
+/* #include "string_buffer.h" */ /* Commented by amalgamation script */
+#include <assert.h>
+
+static const char empty_cell_str[] = "";
+
+/* Metrics of the content are precomputed, so the cell is never written */
+static const f_cell_t empty_cell = {
+    {
+        {(char *)empty_cell_str}, {0}, CHAR_BUF, F_BUF_BORROWED, NULL,
+        {0, 0, 0, 0, empty_cell_str, NULL, 0, 1, 0, CHAR_BUF, 1}
+    },
+    COMMON_CELL, F_CELL_TEXT, {0}
+};
+
+FT_INTERNAL
+const f_cell_t *get_empty_cell(void)
+{
+    return &empty_cell;
+}
+
+FT_INTERNAL
+void init_cell(f_cell_t *cell)
+{
+    assert(cell);
+    /* Empty buffer doesn't allocate memory for the content */
+    init_string_buffer(&cell->str_buffer, CHAR_BUF);
+    cell->cell_type = COMMON_CELL;
+    cell->value_type = F_CELL_TEXT;
+    memset(&cell->value, 0, sizeof(cell->value));
+}
+
+FT_INTERNAL
+void release_cell(f_cell_t *cell)
+{
+    assert(cell);
+    release_buffer_data(&cell->str_buffer);
+}
+
+FT_INTERNAL
+int cell_is_unwritten(const f_cell_t *cell)
+{
+    assert(cell);
+    return cell->value_type == F_CELL_TEXT && buffer_is_unwritten(&cell->str_buffer);
+}
+
+FT_INTERNAL
+f_status copy_cell(f_cell_t *result, const f_cell_t *cell)
+{
+    assert(result);
+    assert(cell);
+
+    init_cell(result);
+    f_status status = copy_string_buffer(&result->str_buffer, &cell->str_buffer);
+    if (FT_IS_ERROR(status)) {
+        release_cell(result);
+        return status;
+    }
+    result->cell_type = cell->cell_type;
+    result->value_type = cell->value_type;
+    result->value = cell->value;
+    return FT_SUCCESS;
+}
+
+FT_INTERNAL
+void set_cell_type(f_cell_t *cell, enum f_cell_type type)
+{
+    assert(cell);
+    cell->cell_type = type;
+}
+
+FT_INTERNAL
+enum f_cell_type get_cell_type(const f_cell_t *cell)
+{
+    assert(cell);
+    return cell->cell_type;
+}
+
+FT_INTERNAL
+f_status set_cell_value(f_cell_t *cell, enum f_cell_value_type type, const union f_number *value)
+{
+    assert(cell);
+    assert(type != F_CELL_TEXT);
+    assert(value);
+
+    /* Text of typed cells is produced only while the table is printed */
+    f_string_view_t empty;
+    empty.type = CHAR_BUF;
+    empty.u.cstr = "";
+    fill_buffer_from_external(&cell->str_buffer, &empty, NULL, NULL);
+
+    cell->value_type = type;
+    cell->value = *value;
+    return FT_SUCCESS;
+}
+
+static
+enum f_number_type cell_number_type(const f_cell_t *cell)
+{
+    switch (cell->value_type) {
+        case F_CELL_I64:
+            return F_NUM_I64;
+        case F_CELL_F64:
+            return F_NUM_F64;
+        default:
+            return F_NUM_U64;
+    }
+}
+
+/*
+ * Writes text of the typed value of the cell to buf. Returns the same value
+ * as snprintf.
+ */
+static
+int cell_value_to_str(const f_cell_t *cell, const f_context_t *context, char *buf, size_t buf_sz)
+{
+    if (cell->value_type == F_CELL_BOOL) {
+        const char *str = cell->value.u64 ? "true" : "false";
+        size_t len = strlen(str);
+        if (len < buf_sz)
+            memcpy(buf, str, len + 1);
+        return (int)len;
+    }
+
+    enum f_number_type type = cell_number_type(cell);
+    const char *fmt = get_column_number_format(context->table_properties, context->column, type);
+    return format_number(buf, buf_sz, fmt, type, &cell->value);
+}
+
+/*
+ * Width of the text of the typed value. Text of integers in the default
+ * format is not produced at all.
+ */
+static
+size_t cell_value_width(const f_cell_t *cell, const f_context_t *context)
+{
+    enum f_number_type type = cell_number_type(cell);
+    const char *fmt = get_column_number_format(context->table_properties, context->column, type);
+    if (fmt == NULL) {
+        switch (cell->value_type) {
+            case F_CELL_I64:
+                return i64_str_len(cell->value.i64);
+            case F_CELL_U64:
+                return u64_str_len(cell->value.u64);
+            case F_CELL_BOOL:
+                return cell->value.u64 ? 4 : 5;
+            default:
+                break;
+        }
+    }
+
+    char buf[FT_NUMBER_BUF_SZ];
+    int len = cell_value_to_str(cell, context, buf, sizeof(buf));
+    return len < 0 ? 0 : (size_t)len;
+}
+
+static
+size_t cell_text_height(const f_cell_t *cell)
+{
+    if (cell->value_type != F_CELL_TEXT)
+        return 1;
+    return buffer_text_visible_height(&cell->str_buffer);
+}
+
+FT_INTERNAL
+size_t cell_vis_width(const f_cell_t *cell, const f_context_t *context)
+{
+    /* todo:
+     * At the moment min width includes paddings. Maybe it is better that min width weren't include
+     * paddings but be min width of the cell content without padding
+     */
+
+    assert(cell);
+    assert(context);
+
+    f_table_properties_t *properties = context->table_properties;
+    size_t row = context->row;
+    size_t column = context->column;
+
+    size_t padding_left = get_cell_property_hierarchically(properties, row, column, FT_CPROP_LEFT_PADDING);
+    size_t padding_right = get_cell_property_hierarchically(properties, row, column, FT_CPROP_RIGHT_PADDING);
+    size_t result = padding_left + padding_right;
+    if (cell->value_type != F_CELL_TEXT) {
+        result += cell_value_width(cell, context);
+    } else if (cell->str_buffer.str.data) {
+        result += buffer_text_visible_width(&cell->str_buffer);
+    }
+    result = MAX(result, (size_t)get_cell_property_hierarchically(properties, row, column, FT_CPROP_MIN_WIDTH));
+    return result;
+}
+
+FT_INTERNAL
+size_t cell_invis_codes_width(const f_cell_t *cell, const f_context_t *context)
+{
+    assert(cell);
+    assert(context);
+
+    f_table_properties_t *properties = context->table_properties;
+    size_t row = context->row;
+    size_t column = context->column;
+
+    size_t result = 0;
+    char cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_style_tag_for_cell(properties, row, column, cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    result += strlen(cell_style_tag);
+
+    char reset_cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_reset_style_tag_for_cell(properties, row, column, reset_cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    result += strlen(reset_cell_style_tag);
+
+    char content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_style_tag_for_content(properties, row, column, content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    result += strlen(content_style_tag);
+
+    char reset_content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_reset_style_tag_for_content(properties, row, column, reset_content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    result += strlen(reset_content_style_tag);
+
+    if (cell->value_type == F_CELL_TEXT && cell->str_buffer.str.data)
+        result += buffer_text_extra_code_units(&cell->str_buffer);
+    return result;
+}
+
+FT_INTERNAL
+size_t hint_height_cell(const f_cell_t *cell, const f_context_t *context)
+{
+    assert(cell);
+    assert(context);
+    f_table_properties_t *properties = context->table_properties;
+    size_t row = context->row;
+    size_t column = context->column;
+
+    size_t padding_top = get_cell_property_hierarchically(properties, row, column, FT_CPROP_TOP_PADDING);
+    size_t padding_bottom = get_cell_property_hierarchically(properties, row, column, FT_CPROP_BOTTOM_PADDING);
+    size_t empty_string_height = get_cell_property_hierarchically(properties, row, column, FT_CPROP_EMPTY_STR_HEIGHT);
+
+    size_t result = padding_top + padding_bottom;
+    if (cell->str_buffer.str.data) {
+        size_t text_height = cell_text_height(cell);
+        result += text_height == 0 ? empty_string_height : text_height;
+    }
+    return result;
+}
+
+/*
+ * Prints text of the typed value of the cell as content of a buffer of the
+ * output type.
+ */
+static
+int cell_value_printf(const f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t vis_width,
+                      const char *content_style_tag, const char *reset_content_style_tag)
+{
+    char str_buf[FT_NUMBER_BUF_SZ];
+    char *str = str_buf;
+    int result = -1;
+
+    int len = cell_value_to_str(cell, cntx->cntx, str_buf, sizeof(str_buf));
+    if (len < 0)
+        return -1;
+    if ((size_t)len >= sizeof(str_buf)) {
+        /* Number formatted with user spec can be very long */
+        str = (char *)F_MALLOC((size_t)len + 1);
+        if (str == NULL)
+            return -1;
+        cell_value_to_str(cell, cntx->cntx, str, (size_t)len + 1);
+    }
+
+    f_string_buffer_t buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = cntx->b_type;
+    buffer.ownership = F_BUF_BORROWED;
+    buffer.str.cstr = str;
+    buffer.mem.data_sz = (size_t)len + 1;
+
+#ifdef FT_HAVE_WCHAR
+    wchar_t wstr_buf[FT_NUMBER_BUF_SZ];
+    wchar_t *wstr = NULL;
+    if (cntx->b_type == W_CHAR_BUF) {
+        wstr = wstr_buf;
+        if ((size_t)len >= FT_NUMBER_BUF_SZ) {
+            wstr = (wchar_t *)F_MALLOC(((size_t)len + 1) * sizeof(wchar_t));
+            if (wstr == NULL)
+                goto clear;
+        }
+        /* Text of numbers is ASCII */
+        int i = 0;
+        for (i = 0; i <= len; ++i)
+            wstr[i] = (wchar_t)(unsigned char)str[i];
+        buffer.str.wstr = wstr;
+        buffer.mem.data_sz = ((size_t)len + 1) * sizeof(wchar_t);
+    }
+#endif /* FT_HAVE_WCHAR */
+
+    result = buffer_printf(&buffer, row, cntx, vis_width, content_style_tag, reset_content_style_tag);
+
+#ifdef FT_HAVE_WCHAR
+clear:
+    if (wstr != NULL && wstr != wstr_buf)
+        F_FREE(wstr);
+#endif /* FT_HAVE_WCHAR */
+    if (str != str_buf)
+        F_FREE(str);
+    return result;
+}
+
+FT_INTERNAL
+int cell_printf(f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t vis_width)
+{
+    const f_context_t *context = cntx->cntx;
+    size_t buf_len = vis_width;
+
+    if (cell == NULL || (vis_width < cell_vis_width(cell, context))) {
+        return -1;
+    }
+
+    f_table_properties_t *properties = context->table_properties;
+    unsigned int padding_top = get_cell_property_hierarchically(properties, context->row, context->column, FT_CPROP_TOP_PADDING);
+    unsigned int padding_left = get_cell_property_hierarchically(properties, context->row, context->column, FT_CPROP_LEFT_PADDING);
+    unsigned int padding_right = get_cell_property_hierarchically(properties, context->row, context->column, FT_CPROP_RIGHT_PADDING);
+
+    size_t written = 0;
+    size_t invisible_written = 0;
+    int tmp = 0;
+
+    /* todo: Dirty hack with changing buf_len! need refactoring. */
+    /* Also maybe it is better to move all struff with colors to buffers? */
+    char cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_style_tag_for_cell(properties, context->row, context->column, cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    buf_len += strlen(cell_style_tag);
+
+    char reset_cell_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_reset_style_tag_for_cell(properties, context->row, context->column, reset_cell_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    buf_len += strlen(reset_cell_style_tag);
+
+    char content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_style_tag_for_content(properties, context->row, context->column, content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    buf_len += strlen(content_style_tag);
+
+    char reset_content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
+    get_reset_style_tag_for_content(properties, context->row, context->column, reset_content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
+    buf_len += strlen(reset_content_style_tag);
+
+    /*    CELL_STYLE_T   LEFT_PADDING   CONTENT_STYLE_T  CONTENT   RESET_CONTENT_STYLE_T    RIGHT_PADDING   RESET_CELL_STYLE_T
+     *  |              |              |                |         |                       |                |                    |
+     *        L1                                                                                                    R1
+     *                     L2                                                                   R2
+     *                                     L3                               R3
+     */
+
+    size_t L2 = padding_left;
+
+    size_t R2 = padding_right;
+    size_t R3 = strlen(reset_cell_style_tag);
+
+#define TOTAL_WRITTEN (written + invisible_written)
+#define RIGHT (padding_right + extra_right)
+
+#define WRITE_CELL_STYLE_TAG        CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, cell_style_tag))
+#define WRITE_RESET_CELL_STYLE_TAG  CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, reset_cell_style_tag))
+#define WRITE_CONTENT_STYLE_TAG        CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, content_style_tag))
+#define WRITE_RESET_CONTENT_STYLE_TAG  CHCK_RSLT_ADD_TO_INVISIBLE_WRITTEN(print_n_strings(cntx, 1, reset_content_style_tag))
+
+    if (row >= hint_height_cell(cell, context)
+        || row < padding_top
+        || row >= (padding_top + cell_text_height(cell))) {
+        WRITE_CELL_STYLE_TAG;
+        WRITE_CONTENT_STYLE_TAG;
+        WRITE_RESET_CONTENT_STYLE_TAG;
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, buf_len - TOTAL_WRITTEN - R3));
+        WRITE_RESET_CELL_STYLE_TAG;
+
+        return (int)TOTAL_WRITTEN;
+    }
+
+    WRITE_CELL_STYLE_TAG;
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, L2));
+    if (cell->value_type != F_CELL_TEXT) {
+        CHCK_RSLT_ADD_TO_WRITTEN(cell_value_printf(cell, row - padding_top, cntx, vis_width - L2 - R2, content_style_tag, reset_content_style_tag));
+    } else if (cell->str_buffer.str.data) {
+        CHCK_RSLT_ADD_TO_WRITTEN(buffer_printf(&cell->str_buffer, row - padding_top, cntx, vis_width - L2 - R2, content_style_tag, reset_content_style_tag));
+    } else {
+        WRITE_CONTENT_STYLE_TAG;
+        WRITE_RESET_CONTENT_STYLE_TAG;
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, vis_width - L2 - R2));
+    }
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, R2));
+    WRITE_RESET_CELL_STYLE_TAG;
+
+    return (int)TOTAL_WRITTEN;
+
+clear:
+    return -1;
+#undef WRITE_CELL_STYLE_TAG
+#undef WRITE_RESET_CELL_STYLE_TAG
+#undef WRITE_CONTENT_STYLE_TAG
+#undef WRITE_RESET_CONTENT_STYLE_TAG
+#undef TOTAL_WRITTEN
+#undef RIGHT
+}
+
+FT_INTERNAL
+f_status fill_cell_from_string(f_cell_t *cell, const char *str)
+{
+    assert(str);
+    assert(cell);
+
+    cell->value_type = F_CELL_TEXT;
+    return fill_buffer_from_string(&cell->str_buffer, str);
+}
+
+#ifdef FT_HAVE_WCHAR
+FT_INTERNAL
+f_status fill_cell_from_wstring(f_cell_t *cell, const wchar_t *str)
+{
+    assert(str);
+    assert(cell);
+
+    cell->value_type = F_CELL_TEXT;
+    return fill_buffer_from_wstring(&cell->str_buffer, str);
+}
+#endif
+
+#ifdef FT_HAVE_UTF8
+FT_INTERNAL
+f_status fill_cell_from_u8string(f_cell_t *cell, const void *str)
+{
+    assert(str);
+    assert(cell);
+    cell->value_type = F_CELL_TEXT;
+    return fill_buffer_from_u8string(&cell->str_buffer, str);
+}
+#endif /* FT_HAVE_UTF8 */
+
+FT_INTERNAL
+f_string_buffer_t *cell_get_string_buffer(f_cell_t *cell)
+{
+    assert(cell);
+    cell->value_type = F_CELL_TEXT;
+    return &cell->str_buffer;
+}
+
+FT_INTERNAL
+f_status fill_cell_from_buffer(f_cell_t *cell, const f_string_buffer_t *buffer)
+{
+    assert(cell);
+    assert(buffer);
+    switch (buffer->type) {
+        case CHAR_BUF:
+            return fill_cell_from_string(cell, buffer->str.cstr);
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            return fill_cell_from_wstring(cell, buffer->str.wstr);
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            return fill_cell_from_u8string(cell, buffer->str.u8str);
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+            return FT_GEN_ERROR;
+    }
+
+}
+
+/********************************************************
+   End of file "cell.c"
+ ********************************************************/
+
+
+/********************************************************
+   Begin of file "fort_impl.c"
+ ********************************************************/
+
+/*
+libfort
+
+MIT License
+
+Copyright (c) 2017 - 2018 Seleznev Anton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "fort.h"
+#include <assert.h>
+#include <string.h>
+#include <wchar.h>
+
+/* #include "vector.h" */ /* Commented by amalgamation script */
+/* #include "fort_utils.h" */ /* Commented by amalgamation script */
+/* #include "string_buffer.h" */ /* Commented by amalgamation script */
+/* #include "table.h" */ /* Commented by amalgamation script */
+/* #include "row.h" */ /* Commented by amalgamation script */
+/* #include "cell.h" */ /* Commented by amalgamation script */
+/* #include "properties.h" */ /* Commented by amalgamation script */
+
+
+static
+ft_table_t *create_table_impl(void)
+{
+    ft_table_t *result = (ft_table_t *)F_CALLOC(1, sizeof(ft_table_t));
+    if (result == NULL)
+        return NULL;
+
+    result->rows = create_vector(sizeof(f_row_t *), DEFAULT_VECTOR_CAPACITY);
+    if (result->rows == NULL) {
+        F_FREE(result);
+        return NULL;
+    }
+    result->separators = create_vector(sizeof(f_separator_t *), DEFAULT_VECTOR_CAPACITY);
+    if (result->separators == NULL) {
+        destroy_vector(result->rows);
+        F_FREE(result);
+        return NULL;
+    }
+
+    result->properties = create_table_properties();
+    if (result->properties == NULL) {
+        destroy_vector(result->separators);
+        destroy_vector(result->rows);
+        F_FREE(result);
+        return NULL;
+    }
+    result->conv_buffer = NULL;
+    result->cur_row = 0;
+    result->cur_col = 0;
+    result->virt = NULL;
+    result->text_slabs = NULL;
+    result->intern_pool = NULL;
+    result->reserved_cols = 0;
+    return result;
+}
+
+ft_table_t *ft_create_table(void)
+{
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    ft_table_t *result = create_table_impl();
+    use_allocator(prev_allocator);
+    return result;
+}
+
+ft_table_t *ft_create_table_with_allocator(const ft_allocator_t *allocator)
+{
+    if (allocator == NULL || allocator->malloc_fn == NULL || allocator->free_fn == NULL)
+        return NULL;
+
+    const ft_allocator_t *prev_allocator = use_allocator(allocator);
+    ft_table_t *result = create_table_impl();
+    use_allocator(prev_allocator);
+    if (result)
+        result->allocator = *allocator;
+    return result;
+}
+
+
+ft_table_t *ft_create_virtual_table(size_t rows, size_t cols, ft_cell_provider_t provider, void *ctx)
+{
+    if (provider == NULL)
+        return NULL;
+
+    ft_table_t *result = ft_create_table();
+    if (result == NULL)
+        return NULL;
+
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    result->virt = create_virtual_data(rows, cols, provider, ctx);
+    use_allocator(prev_allocator);
+    if (result->virt == NULL) {
+        ft_destroy_table(result);
+        return NULL;
+    }
+    return result;
+}
+
+
+void ft_destroy_table(ft_table_t *table)
+{
+    size_t i = 0;
+
+    if (table == NULL)
+        return;
+
+    /* Allocator is copied as it is released with the table */
+    ft_allocator_t allocator = table->allocator;
+    const ft_allocator_t *prev_allocator = allocator.malloc_fn ? use_allocator(&allocator) : use_global_allocator();
+
+    if (table->rows) {
+        size_t row_n = vector_size(table->rows);
+        for (i = 0; i < row_n; ++i) {
+            destroy_row(VECTOR_AT(table->rows, i, f_row_t *));
+        }
+        destroy_vector(table->rows);
+    }
+    if (table->separators) {
+        size_t row_n = vector_size(table->separators);
+        for (i = 0; i < row_n; ++i) {
+            destroy_separator(VECTOR_AT(table->separators, i, f_separator_t *));
+        }
+        destroy_vector(table->separators);
+    }
+    destroy_table_properties(table->properties);
+    destroy_string_buffer(table->conv_buffer);
+    destroy_virtual_data(table->virt);
+    destroy_geometry_cache(table);
+    destroy_intern_pool(table);
+    destroy_text_slabs(table);
+    F_FREE(table);
+    use_allocator(prev_allocator);
+}
+
+static
+ft_table_t *ft_copy_table_impl(ft_table_t *table)
+{
+    if (table == NULL)
+        return NULL;
+
+    ft_table_t *result = create_table_impl();
+    if (result == NULL)
+        return NULL;
+    result->allocator = table->allocator;
+
+    size_t i = 0;
+    size_t rows_n = vector_size(table->rows);
+    for (i = 0; i < rows_n; ++i) {
+        f_row_t *row = VECTOR_AT(table->rows, i, f_row_t *);
+        f_row_t *new_row = copy_row(row);
+        if (new_row == NULL) {
+            ft_destroy_table(result);
+            return NULL;
+        }
+        vector_push(result->rows, &new_row);
+    }
+
+    size_t sep_sz = vector_size(table->separators);
+    for (i = 0; i < sep_sz; ++i) {
+        f_separator_t *sep = VECTOR_AT(table->separators, i, f_separator_t *);
+        f_separator_t *new_sep = copy_separator(sep);
+        if (new_sep == NULL) {
+            ft_destroy_table(result);
+            return NULL;
+        }
+        vector_push(result->separators, &new_sep);
+    }
+
+    /* note: by default new table has allocated default properties, so we
+     * have to destroy them first.
+     */
+    if (result->properties) {
+        destroy_table_properties(result->properties);
+    }
+    result->properties = copy_table_properties(table->properties);
+    if (result->properties == NULL) {
+        ft_destroy_table(result);
+        return NULL;
+    }
+
+    if (table->virt) {
+        result->virt = copy_virtual_data(table->virt);
+        if (result->virt == NULL) {
+            ft_destroy_table(result);
+            return NULL;
+        }
+    }
+
+    /* todo: copy conv_buffer  ??  */
+
+    result->cur_row = table->cur_row;
+    result->cur_col = table->cur_col;
+    return result;
+}
+
+ft_table_t *ft_copy_table(ft_table_t *table)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    ft_table_t *result = ft_copy_table_impl(table);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+static int split_cur_row(ft_table_t *table, f_row_t **tail_of_cur_row)
+{
+    if (table->cur_row >= vector_size(table->rows)) {
+        tail_of_cur_row = NULL;
+        return 0;
+    }
+
+    f_row_t *row = VECTOR_AT(table->rows, table->cur_row, f_row_t *);
+    if (table->cur_col >= columns_in_row(row)) {
+        tail_of_cur_row = NULL;
+        return 0;
+    }
+
+    f_row_t *tail = split_row(row, table->cur_col);
+    if (!tail) {
+        tail_of_cur_row = NULL;
+        return FT_GEN_ERROR;
+    }
+
+    *tail_of_cur_row = tail;
+    return 0;
+}
+
+static
+int ft_ln_impl(ft_table_t *table)
+{
+    assert(table);
+    fort_entire_table_properties_t *table_props = &table->properties->entire_table_properties;
+    invalidate_geometry_cache(table);
+    switch (table_props->add_strategy) {
+        case FT_STRATEGY_INSERT: {
+            f_row_t *new_row = NULL;
+            if (FT_IS_ERROR(split_cur_row(table, &new_row))) {
+                return FT_GEN_ERROR;
+            }
+            if (new_row) {
+                if (FT_IS_ERROR(vector_insert(table->rows, &new_row, table->cur_row + 1))) {
+                    destroy_row(new_row);
+                    return FT_GEN_ERROR;
+                }
+            }
+            break;
+        }
+        case FT_STRATEGY_REPLACE:
+            // do nothing
+            break;
+        default:
+            assert(0 && "Unexpected situation inside libfort");
+            break;
+    }
+    table->cur_col = 0;
+    table->cur_row++;
+    return FT_SUCCESS;
+}
+
+int ft_ln(ft_table_t *table)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_ln_impl(table);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+size_t ft_cur_row(const ft_table_t *table)
+{
+    assert(table);
+    return table->cur_row;
+}
+
+size_t ft_cur_col(const ft_table_t *table)
+{
+    assert(table);
+    return table->cur_col;
+}
+
+void ft_set_cur_cell(ft_table_t *table, size_t row, size_t col)
+{
+    assert(table);
+    table->cur_row = row;
+    table->cur_col = col;
+}
+
+int ft_is_empty(const ft_table_t *table)
+{
+    assert(table);
+    return ft_row_count(table) == 0;
+}
+
+size_t ft_row_count(const ft_table_t *table)
+{
+    assert(table && table->rows);
+    if (table->virt)
+        return table->virt->rows;
+    return vector_size(table->rows);
+}
+
+size_t ft_col_count(const ft_table_t *table)
+{
+    assert(table && table->rows);
+    if (table->virt)
+        return table->virt->cols;
+    size_t i = 0;
+    size_t cols_n = 0;
+    size_t rows_n = vector_size(table->rows);
+    for (i = 0; i < rows_n; ++i) {
+        f_row_t *row = VECTOR_AT(table->rows, i, f_row_t *);
+        size_t ncols = columns_in_row(row);
+        cols_n = MAX(cols_n, ncols);
+    }
+    return cols_n;
+}
+
+static
+int ft_reserve_impl(ft_table_t *table, size_t rows, size_t cols)
+{
+    assert(table && table->rows);
+    if (table->virt)
+        return FT_EINVAL;
+
+    int status = vector_reserve(table->rows, rows);
+    if (FT_IS_ERROR(status))
+        return status;
+
+    size_t i = 0;
+    size_t rows_n = vector_size(table->rows);
+    for (i = 0; i < rows_n; ++i) {
+        status = row_reserve_cells(VECTOR_AT(table->rows, i, f_row_t *), cols);
+        if (FT_IS_ERROR(status))
+            return status;
+    }
+    table->reserved_cols = cols;
+    return FT_SUCCESS;
+}
+
+int ft_reserve(ft_table_t *table, size_t rows, size_t cols)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_reserve_impl(table, rows, cols);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+static
+int ft_reserve_cell_props_impl(ft_table_t *table, size_t n)
+{
+    assert(table);
+    if (table->properties == NULL || table->properties->cell_properties == NULL)
+        return FT_GEN_ERROR;
+    return vector_reserve(table->properties->cell_properties, n);
+}
+
+int ft_reserve_cell_props(ft_table_t *table, size_t n)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_reserve_cell_props_impl(table, n);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_get_intern_stats(const ft_table_t *table, ft_intern_stats_t *stats)
+{
+    if (table == NULL || stats == NULL)
+        return FT_EINVAL;
+
+    const f_intern_pool_t *pool = table->intern_pool;
+    stats->lookups = pool ? pool->lookups : 0;
+    stats->hits = pool ? pool->hits : 0;
+    stats->strings = pool ? pool->count : 0;
+    stats->bytes = pool ? pool->bytes : 0;
+    return FT_SUCCESS;
+}
+
+static
+int ft_erase_range_impl(ft_table_t *table,
+                        size_t top_left_row, size_t top_left_col,
+                        size_t bottom_right_row, size_t bottom_right_col)
+{
+    assert(table && table->rows);
+    int status = FT_SUCCESS;
+
+    if (table->virt)
+        return FT_EINVAL;
+
+    invalidate_geometry_cache(table);
+    size_t rows_n = vector_size(table->rows);
+
+    if (top_left_row == FT_CUR_ROW)
+        top_left_row = table->cur_row;
+    if (bottom_right_row == FT_CUR_ROW)
+        bottom_right_row = table->cur_row;
+
+    if (top_left_col == FT_CUR_COLUMN)
+        top_left_col = table->cur_row;
+    if (bottom_right_col == FT_CUR_COLUMN)
+        bottom_right_col = table->cur_row;
+
+    if (top_left_row > bottom_right_row || top_left_col > bottom_right_col)
+        return FT_EINVAL;
+
+    f_row_t *row = NULL;
+    size_t i = top_left_row;
+    while (i < rows_n && i <= bottom_right_row) {
+        row = VECTOR_AT(table->rows, i, f_row_t *);
+        status = ft_row_erase_range(row, top_left_col, bottom_right_col);
+        if (FT_IS_ERROR(status))
+            return status;
+        ++i;
+    }
+
+    f_separator_t *separator = NULL;
+
+    size_t n_iterations = MIN(rows_n - 1, bottom_right_row) - top_left_row + 1;
+    size_t j = 0;
+    i = top_left_row;
+    for (j = 0; j < n_iterations; ++j) {
+        row = VECTOR_AT(table->rows, i, f_row_t *);
+        if (columns_in_row(row)) {
+            ++i;
+        } else {
+            destroy_row(row);
+            status = vector_erase(table->rows, i);
+            if (FT_IS_ERROR(status))
+                return status;
+            if (i < vector_size(table->separators)) {
+                separator = VECTOR_AT(table->separators, i, f_separator_t *);
+                destroy_separator(separator);
+                vector_erase(table->separators, i);
+            }
+        }
+    }
+
+    return FT_SUCCESS;
+}
+
+int ft_erase_range(ft_table_t *table,
+                   size_t top_left_row, size_t top_left_col,
+                   size_t bottom_right_row, size_t bottom_right_col)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_erase_range_impl(table, top_left_row, top_left_col, bottom_right_row, bottom_right_col);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+
+/* Applies FT_TPROP_INVALID_UTF8 property of the table to the written content */
+static f_status check_written_content(const ft_table_t *table, f_string_buffer_t *buf)
+{
+#ifdef FT_HAVE_UTF8
+    return buffer_check_utf8(buf, table->properties->entire_table_properties.invalid_utf8);
+#else
+    (void)table;
+    (void)buf;
+    return FT_SUCCESS;
+#endif /* FT_HAVE_UTF8 */
+}
+
+/*
+ * Fills buffer of the cell with first `len` code units of the content. The
+ * content is interned if FT_TPROP_INTERN_STRINGS property of the table is set.
+ */
+static f_status fill_cell_content(ft_table_t *table, f_string_buffer_t *buf,
+                                  const f_string_view_t *content, size_t len)
+{
+    if (table->properties->entire_table_properties.intern_strings)
+        return fill_buffer_from_pool(table, buf, content, len);
+    return fill_buffer_from_string_len(buf, content, len);
+}
+
+static int ft_row_printf_body_(ft_table_t *table, size_t row, const struct f_string_view *fmt, va_list *va)
+{
+    size_t i = 0;
+    size_t new_cols = 0;
+
+    if (table == NULL || table->virt)
+        return -1;
+
+    invalidate_geometry_cache(table);
+    f_row_t *new_row = create_row_from_fmt_string(fmt, va);
+
+    if (new_row == NULL) {
+        return -1;
+    }
+
+    new_cols = columns_in_row(new_row);
+    for (i = 0; i < new_cols; ++i) {
+        if (FT_IS_ERROR(check_written_content(table, cell_get_string_buffer(get_cell(new_row, i)))))
+            goto clear;
+    }
+
+    f_row_t **cur_row_p = NULL;
+    size_t sz = vector_size(table->rows);
+    if (row >= sz) {
+        size_t push_n = row - sz + 1;
+        for (i = 0; i < push_n; ++i) {
+            f_row_t *padding_row = create_row();
+            if (padding_row == NULL)
+                goto clear;
+
+            if (FT_IS_ERROR(vector_push(table->rows, &padding_row))) {
+                destroy_row(padding_row);
+                goto clear;
+            }
+        }
+    }
+    /* todo: clearing pushed items in case of error ?? */
+
+    cur_row_p = &VECTOR_AT(table->rows, row, f_row_t *);
+
+    switch (table->properties->entire_table_properties.add_strategy) {
+        case FT_STRATEGY_INSERT: {
+            if (FT_IS_ERROR(insert_row(*cur_row_p, new_row, table->cur_col)))
+                goto clear;
+            break;
+        }
+        case FT_STRATEGY_REPLACE: {
+            if (FT_IS_ERROR(swap_row(*cur_row_p, new_row, table->cur_col)))
+                goto clear;
+            break;
+        }
+        default:
+            assert(0 && "Unexpected situation inside libfort");
+            break;
+    }
+
+    table->cur_col += new_cols;
+    destroy_row(new_row);
+    return (int)new_cols;
+
+clear:
+    destroy_row(new_row);
+    return -1;
+}
+
+static int ft_row_printf_impl_(ft_table_t *table, size_t row, const struct f_string_view *fmt, va_list *va)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_row_printf_body_(table, row, fmt, va);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+#if defined(FT_CLANG_COMPILER) || defined(FT_GCC_COMPILER)
+#define FT_PRINTF ft_printf
+#define FT_PRINTF_LN ft_printf_ln
+#else
+#define FT_PRINTF ft_printf_impl
+#define FT_PRINTF_LN ft_printf_ln_impl
+#endif
+
+
+
+int FT_PRINTF(ft_table_t *table, const char *fmt, ...)
+{
+    assert(table);
+    va_list va;
+    va_start(va, fmt);
+
+    struct f_string_view fmt_str;
+    fmt_str.type = CHAR_BUF;
+    fmt_str.u.cstr = fmt;
+    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
+    va_end(va);
+    return result;
+}
+
+int FT_PRINTF_LN(ft_table_t *table, const char *fmt, ...)
+{
+    assert(table);
+    va_list va;
+    va_start(va, fmt);
+
+    struct f_string_view fmt_str;
+    fmt_str.type = CHAR_BUF;
+    fmt_str.u.cstr = fmt;
+    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
+    if (result >= 0) {
+        ft_ln(table);
+    }
+    va_end(va);
+    return result;
+}
+
+#undef FT_PRINTF
+#undef FT_PRINTF_LN
+
+ft_row_format_t *ft_compile_row_format(const char *fmt)
+{
+    if (fmt == NULL)
+        return NULL;
+    /* Formats are not owned by tables, so they use global allocator */
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    ft_row_format_t *result = create_row_format(fmt);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+void ft_destroy_row_format(ft_row_format_t *format)
+{
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    destroy_row_format(format);
+    use_allocator(prev_allocator);
+}
+
+static int ft_printf_compiled_body_(ft_table_t *table, const ft_row_format_t *format, va_list *va)
+{
+    if (table == NULL || format == NULL || table->virt)
+        return -1;
+
+    invalidate_geometry_cache(table);
+
+    /* Disable compiler diagnostic (format string is not a string literal) */
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    size_t i = 0;
+    for (i = 0; i < format->n_fields; ++i) {
+        const struct f_row_format_field *field = &format->fields[i];
+        f_string_buffer_t *buf = get_cur_str_buffer_and_create_if_not_exists(table);
+        if (buf == NULL)
+            return -1;
+
+        if (field->is_literal) {
+            content.u.cstr = field->fmt;
+            if (FT_IS_ERROR(fill_cell_content(table, buf, &content, field->len)))
+                return -1;
+            table->cur_col++;
+            continue;
+        }
+
+        /* Field is measured first and then formatted right into memory of the cell */
+        va_list field_va;
+        va_copy(field_va, *va);
+        int len = vsnprintf(NULL, 0, field->fmt, field_va);
+        va_end(field_va);
+        if (len < 0)
+            return -1;
+
+        char *str = (char *)F_MALLOC((size_t)len + 1);
+        if (str == NULL)
+            return -1;
+        va_copy(field_va, *va);
+        vsnprintf(str, (size_t)len + 1, field->fmt, field_va);
+        va_end(field_va);
+
+        if (table->properties->entire_table_properties.intern_strings) {
+            /* Interned content is copied to the string pool of the table */
+            content.u.cstr = str;
+            int status = fill_buffer_from_pool(table, buf, &content, (size_t)len);
+            F_FREE(str);
+            if (FT_IS_ERROR(status))
+                return -1;
+        } else {
+            fill_buffer_from_allocated(buf, str, CHAR_BUF);
+        }
+
+        skip_printf_args(va, format->arg_types + field->first_arg, field->n_args);
+        table->cur_col++;
+    }
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic pop
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic pop
+#endif
+    return (int)format->n_fields;
+}
+
+static int ft_printf_compiled_impl_(ft_table_t *table, const ft_row_format_t *format, va_list *va)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_printf_compiled_body_(table, format, va);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_printf_compiled(ft_table_t *table, const ft_row_format_t *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    int result = ft_printf_compiled_impl_(table, format, &va);
+    va_end(va);
+    return result;
+}
+
+int ft_printf_compiled_ln(ft_table_t *table, const ft_row_format_t *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    int result = ft_printf_compiled_impl_(table, format, &va);
+    if (result >= 0) {
+        ft_ln(table);
+    }
+    va_end(va);
+    return result;
+}
+
+#ifdef FT_HAVE_WCHAR
+int ft_wprintf(ft_table_t *table, const wchar_t *fmt, ...)
+{
+    assert(table);
+    va_list va;
+    va_start(va, fmt);
+
+    struct f_string_view fmt_str;
+    fmt_str.type = W_CHAR_BUF;
+    fmt_str.u.wstr = fmt;
+    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
+    va_end(va);
+    return result;
+}
+
+int ft_wprintf_ln(ft_table_t *table, const wchar_t *fmt, ...)
+{
+    assert(table);
+    va_list va;
+    va_start(va, fmt);
 
-    f_row_t *row = VECTOR_AT(table->rows, table->cur_row, f_row_t *);
-    if (table->cur_col >= columns_in_row(row)) {
-        tail_of_cur_row = NULL;
-        return 0;
+    struct f_string_view fmt_str;
+    fmt_str.type = W_CHAR_BUF;
+    fmt_str.u.wstr = fmt;
+    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
+    if (result >= 0) {
+        ft_ln(table);
     }
+    va_end(va);
+    return result;
+}
 
-    f_row_t *tail = split_row(row, table->cur_col);
-    if (!tail) {
-        tail_of_cur_row = NULL;
-        return FT_GEN_ERROR;
-    }
+#endif
 
-    *tail_of_cur_row = tail;
-    return 0;
+void ft_set_default_printf_field_separator(char separator)
+{
+    g_col_separator = separator;
 }
 
-int ft_ln(ft_table_t *table)
+/*
+ * Writes content to the current cell. If `external` is set the content is
+ * not copied: it is borrowed (free_fn is NULL) or adopted by the table
+ * (together with its owner if it is not NULL).
+ */
+static int ft_write_body_(ft_table_t *table, const f_string_view_t *cell_content,
+                          int external, void (*free_fn)(void *ptr), void *owner)
 {
     assert(table);
-    fort_entire_table_properties_t *table_props = &table->properties->entire_table_properties;
-    switch (table_props->add_strategy) {
-        case FT_STRATEGY_INSERT: {
-            f_row_t *new_row = NULL;
-            if (FT_IS_ERROR(split_cur_row(table, &new_row))) {
-                return FT_GEN_ERROR;
-            }
-            if (new_row) {
-                if (FT_IS_ERROR(vector_insert(table->rows, &new_row, table->cur_row + 1))) {
-                    destroy_row(new_row);
-                    return FT_GEN_ERROR;
-                }
-            }
+    if (table->virt)
+        return FT_EINVAL;
+
+    invalidate_geometry_cache(table);
+    f_string_buffer_t *buf = get_cur_str_buffer_and_create_if_not_exists(table);
+    if (buf == NULL)
+        return FT_GEN_ERROR;
+
+    int status = FT_SUCCESS;
+    if (external) {
+        fill_buffer_from_external(buf, cell_content, free_fn, owner);
+        status = check_written_content(table, buf);
+        if (FT_IS_SUCCESS(status))
+            table->cur_col++;
+        return status;
+    }
+    size_t len = 0;
+    switch (cell_content->type) {
+        case CHAR_BUF:
+            len = strlen(cell_content->u.cstr);
             break;
-        }
-        case FT_STRATEGY_REPLACE:
-            // do nothing
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            len = wcslen(cell_content->u.wstr);
             break;
-        default:
-            assert(0 && "Unexpected situation inside libfort");
+#endif
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            len = strlen((const char *)cell_content->u.u8str);
             break;
+#endif
+        default:
+            return FT_GEN_ERROR;
     }
-    table->cur_col = 0;
-    table->cur_row++;
-    return FT_SUCCESS;
+    status = fill_cell_content(table, buf, cell_content, len);
+    if (FT_IS_SUCCESS(status))
+        status = check_written_content(table, buf);
+    if (FT_IS_SUCCESS(status)) {
+        table->cur_col++;
+    }
+    return status;
 }
 
-size_t ft_cur_row(const ft_table_t *table)
+static int ft_write_impl_(ft_table_t *table, const f_string_view_t *cell_content,
+                          int external, void (*free_fn)(void *ptr), void *owner)
 {
-    assert(table);
-    return table->cur_row;
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_body_(table, cell_content, external, free_fn, owner);
+    use_allocator(prev_allocator);
+    return result;
 }
 
-size_t ft_cur_col(const ft_table_t *table)
+static int ft_write_impl(ft_table_t *table, const char *cell_content)
 {
-    assert(table);
-    return table->cur_col;
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
 }
 
-void ft_set_cur_cell(ft_table_t *table, size_t row, size_t col)
+#ifdef FT_HAVE_UTF8
+static int ft_u8write_impl(ft_table_t *table, const void *cell_content)
 {
-    assert(table);
-    table->cur_row = row;
-    table->cur_col = col;
+    f_string_view_t content;
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
 }
+#endif /* FT_HAVE_UTF8 */
 
-int ft_is_empty(const ft_table_t *table)
+#ifdef FT_HAVE_WCHAR
+static int ft_wwrite_impl(ft_table_t *table, const wchar_t *cell_content)
+{
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
+}
+#endif
+/*
+ * Writes first `len` code units of the content to the current cell.
+ */
+static int ft_write_len_body_(ft_table_t *table, const f_string_view_t *cell_content, size_t len)
 {
     assert(table);
-    return ft_row_count(table) == 0;
+    if (table->virt || cell_content->u.data == NULL)
+        return FT_EINVAL;
+
+    invalidate_geometry_cache(table);
+    f_string_buffer_t *buf = get_cur_str_buffer_and_create_if_not_exists(table);
+    if (buf == NULL)
+        return FT_GEN_ERROR;
+
+    int status = fill_cell_content(table, buf, cell_content, len);
+    if (FT_IS_SUCCESS(status))
+        status = check_written_content(table, buf);
+    if (FT_IS_SUCCESS(status)) {
+        table->cur_col++;
+    }
+    return status;
 }
 
-size_t ft_row_count(const ft_table_t *table)
+static int ft_write_len_impl_(ft_table_t *table, const f_string_view_t *cell_content, size_t len)
 {
-    assert(table && table->rows);
-    return vector_size(table->rows);
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_len_body_(table, cell_content, len);
+    use_allocator(prev_allocator);
+    return result;
 }
 
-size_t ft_col_count(const ft_table_t *table)
+int ft_write_len(ft_table_t *table, const char *cell_content, size_t len)
 {
-    assert(table && table->rows);
-    size_t i = 0;
-    size_t cols_n = 0;
-    size_t rows_n = vector_size(table->rows);
-    for (i = 0; i < rows_n; ++i) {
-        f_row_t *row = VECTOR_AT(table->rows, i, f_row_t *);
-        size_t ncols = columns_in_row(row);
-        cols_n = MAX(cols_n, ncols);
-    }
-    return cols_n;
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_len_impl_(table, &content, len);
 }
 
-int ft_erase_range(ft_table_t *table,
-                   size_t top_left_row, size_t top_left_col,
-                   size_t bottom_right_row, size_t bottom_right_col)
+#ifdef FT_HAVE_WCHAR
+int ft_wwrite_len(ft_table_t *table, const wchar_t *cell_content, size_t len)
 {
-    assert(table && table->rows);
-    int status = FT_SUCCESS;
-
-    size_t rows_n = vector_size(table->rows);
-
-    if (top_left_row == FT_CUR_ROW)
-        top_left_row = table->cur_row;
-    if (bottom_right_row == FT_CUR_ROW)
-        bottom_right_row = table->cur_row;
-
-    if (top_left_col == FT_CUR_COLUMN)
-        top_left_col = table->cur_row;
-    if (bottom_right_col == FT_CUR_COLUMN)
-        bottom_right_col = table->cur_row;
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_len_impl_(table, &content, len);
+}
+#endif
 
-    if (top_left_row > bottom_right_row || top_left_col > bottom_right_col)
+#ifdef FT_HAVE_UTF8
+int ft_u8write_len(ft_table_t *table, const void *cell_content, size_t len)
+{
+    f_string_view_t content;
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_len_impl_(table, &content, len);
+}
+#endif /* FT_HAVE_UTF8 */
+static int ft_write_value_body_(ft_table_t *table, enum f_cell_value_type type, const union f_number *value)
+{
+    assert(table);
+    if (table->virt)
         return FT_EINVAL;
 
-    f_row_t *row = NULL;
-    size_t i = top_left_row;
-    while (i < rows_n && i <= bottom_right_row) {
-        row = VECTOR_AT(table->rows, i, f_row_t *);
-        status = ft_row_erase_range(row, top_left_col, bottom_right_col);
-        if (FT_IS_ERROR(status))
-            return status;
-        ++i;
+    invalidate_geometry_cache(table);
+    f_cell_t *cell = get_cur_cell_and_create_if_not_exists(table);
+    if (cell == NULL)
+        return FT_GEN_ERROR;
+
+    int status = set_cell_value(cell, type, value);
+    if (FT_IS_SUCCESS(status)) {
+        table->cur_col++;
     }
+    return status;
+}
 
-    f_separator_t *separator = NULL;
+static int ft_write_value_impl_(ft_table_t *table, enum f_cell_value_type type, const union f_number *value)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_value_body_(table, type, value);
+    use_allocator(prev_allocator);
+    return result;
+}
 
-    size_t n_iterations = MIN(rows_n - 1, bottom_right_row) - top_left_row + 1;
-    size_t j = 0;
-    i = top_left_row;
-    for (j = 0; j < n_iterations; ++j) {
-        row = VECTOR_AT(table->rows, i, f_row_t *);
-        if (columns_in_row(row)) {
-            ++i;
-        } else {
-            destroy_row(row);
-            status = vector_erase(table->rows, i);
-            if (FT_IS_ERROR(status))
-                return status;
-            if (i < vector_size(table->separators)) {
-                separator = VECTOR_AT(table->separators, i, f_separator_t *);
-                destroy_separator(separator);
-                vector_erase(table->separators, i);
-            }
-        }
-    }
+int ft_write_i64(ft_table_t *table, int64_t value)
+{
+    union f_number number;
+    number.i64 = value;
+    return ft_write_value_impl_(table, F_CELL_I64, &number);
+}
 
-    return FT_SUCCESS;
+int ft_write_u64(ft_table_t *table, uint64_t value)
+{
+    union f_number number;
+    number.u64 = value;
+    return ft_write_value_impl_(table, F_CELL_U64, &number);
 }
 
+int ft_write_f64(ft_table_t *table, double value)
+{
+    union f_number number;
+    number.f64 = value;
+    return ft_write_value_impl_(table, F_CELL_F64, &number);
+}
 
-static int ft_row_printf_impl_(ft_table_t *table, size_t row, const struct f_string_view *fmt, va_list *va)
+int ft_write_bool(ft_table_t *table, int value)
 {
-    size_t i = 0;
-    size_t new_cols = 0;
+    union f_number number;
+    number.u64 = value ? 1 : 0;
+    return ft_write_value_impl_(table, F_CELL_BOOL, &number);
+}
 
-    if (table == NULL)
-        return -1;
+static
+int ft_set_column_format_impl(ft_table_t *table, size_t col, const char *fmt_spec)
+{
+    assert(table);
 
-    f_row_t *new_row = create_row_from_fmt_string(fmt, va);
+    if (table->properties == NULL) {
+        table->properties = create_table_properties();
+        if (table->properties == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    invalidate_geometry_cache(table);
+    return set_column_number_format(table->properties, col, fmt_spec);
+}
 
-    if (new_row == NULL) {
-        return -1;
+int ft_set_column_format(ft_table_t *table, size_t col, const char *fmt_spec)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_column_format_impl(table, col, fmt_spec);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+/*
+ * Writes numbers to cells [first_row, first_row + n) of the column. Numbers
+ * without format specification are stored as typed values.
+ */
+static int ft_write_column_body_(ft_table_t *table, size_t col, size_t first_row,
+                                 const void *values, size_t n, const char *fmt_spec,
+                                 enum f_number_type type)
+{
+    assert(table);
+    if (table->virt || (values == NULL && n != 0))
+        return FT_EINVAL;
+
+    char fmt_buf[FT_NUMBER_FMT_SZ];
+    const char *fmt = NULL;
+    if (fmt_spec) {
+        if (FT_IS_ERROR(number_format_from_spec(fmt_spec, type, fmt_buf, sizeof(fmt_buf))))
+            return FT_EINVAL;
+        fmt = fmt_buf;
     }
 
-    f_row_t **cur_row_p = NULL;
-    size_t sz = vector_size(table->rows);
-    if (row >= sz) {
-        size_t push_n = row - sz + 1;
-        for (i = 0; i < push_n; ++i) {
-            f_row_t *padding_row = create_row();
-            if (padding_row == NULL)
-                goto clear;
+    invalidate_geometry_cache(table);
 
-            if (FT_IS_ERROR(vector_push(table->rows, &padding_row))) {
-                destroy_row(padding_row);
-                goto clear;
-            }
+    char str_buf[FT_NUMBER_BUF_SZ];
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    size_t i = 0;
+    for (i = 0; i < n; ++i) {
+        union f_number value;
+        switch (type) {
+            case F_NUM_I64:
+                value.i64 = ((const int64_t *)values)[i];
+                break;
+            case F_NUM_U64:
+                value.u64 = ((const uint64_t *)values)[i];
+                break;
+            case F_NUM_F64:
+                value.f64 = ((const double *)values)[i];
+                break;
         }
-    }
-    /* todo: clearing pushed items in case of error ?? */
 
-    new_cols = columns_in_row(new_row);
-    cur_row_p = &VECTOR_AT(table->rows, row, f_row_t *);
+        f_row_t *row = get_row_and_create_if_not_exists(table, first_row + i);
+        if (row == NULL)
+            return FT_GEN_ERROR;
+        f_cell_t *cell = get_cell_and_create_if_not_exists(row, col);
+        if (cell == NULL)
+            return FT_GEN_ERROR;
 
-    switch (table->properties->entire_table_properties.add_strategy) {
-        case FT_STRATEGY_INSERT: {
-            if (FT_IS_ERROR(insert_row(*cur_row_p, new_row, table->cur_col)))
-                goto clear;
-            break;
+        if (fmt == NULL) {
+            static const enum f_cell_value_type value_types[] = {F_CELL_I64, F_CELL_U64, F_CELL_F64};
+            int status = set_cell_value(cell, value_types[type], &value);
+            if (FT_IS_ERROR(status))
+                return status;
+            continue;
         }
-        case FT_STRATEGY_REPLACE: {
-            if (FT_IS_ERROR(swap_row(*cur_row_p, new_row, table->cur_col)))
-                goto clear;
-            break;
+
+        int len = format_number(str_buf, sizeof(str_buf), fmt, type, &value);
+        if (len < 0)
+            return FT_GEN_ERROR;
+
+        int status = FT_SUCCESS;
+        if ((size_t)len < sizeof(str_buf)) {
+            content.u.cstr = str_buf;
+            status = fill_cell_content(table, cell_get_string_buffer(cell), &content, (size_t)len);
+        } else {
+            /* Number formatted with user spec can be very long */
+            char *long_str = (char *)F_MALLOC((size_t)len + 1);
+            if (long_str == NULL)
+                return FT_MEMORY_ERROR;
+            format_number(long_str, (size_t)len + 1, fmt, type, &value);
+            content.u.cstr = long_str;
+            status = fill_cell_content(table, cell_get_string_buffer(cell), &content, (size_t)len);
+            F_FREE(long_str);
         }
-        default:
-            assert(0 && "Unexpected situation inside libfort");
-            break;
+        if (FT_IS_ERROR(status))
+            return status;
     }
+    return FT_SUCCESS;
+}
 
-    table->cur_col += new_cols;
-    destroy_row(new_row);
-    return (int)new_cols;
-
-clear:
-    destroy_row(new_row);
-    return -1;
+static int ft_write_column_impl_(ft_table_t *table, size_t col, size_t first_row,
+                                 const void *values, size_t n, const char *fmt_spec,
+                                 enum f_number_type type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_column_body_(table, col, first_row, values, n, fmt_spec, type);
+    use_allocator(prev_allocator);
+    return result;
 }
 
-#if defined(FT_CLANG_COMPILER) || defined(FT_GCC_COMPILER)
-#define FT_PRINTF ft_printf
-#define FT_PRINTF_LN ft_printf_ln
-#else
-#define FT_PRINTF ft_printf_impl
-#define FT_PRINTF_LN ft_printf_ln_impl
-#endif
+int ft_write_column_i64(ft_table_t *table, size_t col, size_t first_row,
+                        const int64_t *values, size_t n, const char *fmt_spec)
+{
+    return ft_write_column_impl_(table, col, first_row, values, n, fmt_spec, F_NUM_I64);
+}
 
+int ft_write_column_u64(ft_table_t *table, size_t col, size_t first_row,
+                        const uint64_t *values, size_t n, const char *fmt_spec)
+{
+    return ft_write_column_impl_(table, col, first_row, values, n, fmt_spec, F_NUM_U64);
+}
 
+int ft_write_column_f64(ft_table_t *table, size_t col, size_t first_row,
+                        const double *values, size_t n, const char *fmt_spec)
+{
+    return ft_write_column_impl_(table, col, first_row, values, n, fmt_spec, F_NUM_F64);
+}
 
-int FT_PRINTF(ft_table_t *table, const char *fmt, ...)
+int ft_write_borrowed(ft_table_t *table, const char *cell_content)
 {
     assert(table);
-    va_list va;
-    va_start(va, fmt);
+    if (cell_content == NULL)
+        return FT_EINVAL;
 
-    struct f_string_view fmt_str;
-    fmt_str.type = CHAR_BUF;
-    fmt_str.u.cstr = fmt;
-    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
-    va_end(va);
-    return result;
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, NULL, NULL);
 }
 
-int FT_PRINTF_LN(ft_table_t *table, const char *fmt, ...)
+int ft_write_owned(ft_table_t *table, char *cell_content, size_t len, void (*free_fn)(void *ptr))
 {
     assert(table);
-    va_list va;
-    va_start(va, fmt);
+    if (cell_content == NULL || free_fn == NULL || cell_content[len] != '\0')
+        return FT_EINVAL;
 
-    struct f_string_view fmt_str;
-    fmt_str.type = CHAR_BUF;
-    fmt_str.u.cstr = fmt;
-    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
-    if (result >= 0) {
-        ft_ln(table);
-    }
-    va_end(va);
-    return result;
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, NULL);
 }
 
-#undef FT_PRINTF
-#undef FT_PRINTF_LN
-
-#ifdef FT_HAVE_WCHAR
-int ft_wprintf(ft_table_t *table, const wchar_t *fmt, ...)
+int ft_write_owned_by(ft_table_t *table, const char *cell_content, size_t len,
+                      void (*free_fn)(void *owner), void *owner)
 {
     assert(table);
-    va_list va;
-    va_start(va, fmt);
+    if (cell_content == NULL || free_fn == NULL || owner == NULL || cell_content[len] != '\0')
+        return FT_EINVAL;
 
-    struct f_string_view fmt_str;
-    fmt_str.type = W_CHAR_BUF;
-    fmt_str.u.wstr = fmt;
-    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
-    va_end(va);
-    return result;
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, owner);
 }
 
-int ft_wprintf_ln(ft_table_t *table, const wchar_t *fmt, ...)
+#ifdef FT_HAVE_WCHAR
+int ft_wwrite_borrowed(ft_table_t *table, const wchar_t *cell_content)
 {
     assert(table);
-    va_list va;
-    va_start(va, fmt);
+    if (cell_content == NULL)
+        return FT_EINVAL;
 
-    struct f_string_view fmt_str;
-    fmt_str.type = W_CHAR_BUF;
-    fmt_str.u.wstr = fmt;
-    int result = ft_row_printf_impl_(table, table->cur_row, &fmt_str, &va);
-    if (result >= 0) {
-        ft_ln(table);
-    }
-    va_end(va);
-    return result;
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, NULL, NULL);
 }
 
-#endif
-
-void ft_set_default_printf_field_separator(char separator)
+int ft_wwrite_owned(ft_table_t *table, wchar_t *cell_content, size_t len, void (*free_fn)(void *ptr))
 {
-    g_col_separator = separator;
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || cell_content[len] != L'\0')
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, NULL);
 }
 
-static int ft_write_impl_(ft_table_t *table, const f_string_view_t *cell_content)
+int ft_wwrite_owned_by(ft_table_t *table, const wchar_t *cell_content, size_t len,
+                       void (*free_fn)(void *owner), void *owner)
 {
     assert(table);
-    f_string_buffer_t *buf = get_cur_str_buffer_and_create_if_not_exists(table);
-    if (buf == NULL)
-        return FT_GEN_ERROR;
+    if (cell_content == NULL || free_fn == NULL || owner == NULL || cell_content[len] != L'\0')
+        return FT_EINVAL;
 
-    int status = FT_SUCCESS;
-    switch (cell_content->type) {
-        case CHAR_BUF:
-            status = fill_buffer_from_string(buf, cell_content->u.cstr);
-            break;
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            status = fill_buffer_from_wstring(buf, cell_content->u.wstr);
-            break;
-#endif
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            status = fill_buffer_from_u8string(buf, cell_content->u.u8str);
-            break;
-#endif
-        default:
-            status = FT_GEN_ERROR;
-    }
-    if (FT_IS_SUCCESS(status)) {
-        table->cur_col++;
-    }
-    return status;
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, owner);
 }
+#endif
 
-static int ft_write_impl(ft_table_t *table, const char *cell_content)
+#ifdef FT_HAVE_UTF8
+int ft_u8write_borrowed(ft_table_t *table, const void *cell_content)
 {
+    assert(table);
+    if (cell_content == NULL)
+        return FT_EINVAL;
+
     f_string_view_t content;
-    content.type = CHAR_BUF;
-    content.u.cstr = cell_content;
-    return ft_write_impl_(table, &content);
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, NULL, NULL);
 }
 
-#ifdef FT_HAVE_UTF8
-static int ft_u8write_impl(ft_table_t *table, const void *cell_content)
+int ft_u8write_owned(ft_table_t *table, void *cell_content, size_t len, void (*free_fn)(void *ptr))
 {
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || ((const char *)cell_content)[len] != '\0')
+        return FT_EINVAL;
+
     f_string_view_t content;
     content.type = UTF8_BUF;
     content.u.u8str = cell_content;
-    return ft_write_impl_(table, &content);
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, NULL);
 }
-#endif /* FT_HAVE_UTF8 */
 
-#ifdef FT_HAVE_WCHAR
-static int ft_wwrite_impl(ft_table_t *table, const wchar_t *cell_content)
+int ft_u8write_owned_by(ft_table_t *table, const void *cell_content, size_t len,
+                        void (*free_fn)(void *owner), void *owner)
 {
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || owner == NULL || ((const char *)cell_content)[len] != '\0')
+        return FT_EINVAL;
+
     f_string_view_t content;
-    content.type = W_CHAR_BUF;
-    content.u.wstr = cell_content;
-    return ft_write_impl_(table, &content);
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, owner);
 }
-#endif
+#endif /* FT_HAVE_UTF8 */
 
 
 int ft_nwrite(ft_table_t *table, size_t count, const char *cell_content, ...)
@@ -3206,20 +5186,150 @@ int ft_nwwrite_ln(ft_table_t *table, size_t n, const wchar_t *cell_content, ...)
 #endif
 
 
-int ft_row_write(ft_table_t *table, size_t cols, const char *cells[])
+/*
+ * Writes cells one by one (used when cells are inserted into the table).
+ */
+static int ft_cells_write_impl_(ft_table_t *table, size_t rows, size_t cols,
+                                const void *const cells[], enum f_string_type type)
 {
     size_t i = 0;
+    size_t j = 0;
+    f_string_view_t content;
+    content.type = type;
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < cols; ++j) {
+            content.u.data = cells[i * cols + j];
+            int status = ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
+            if (FT_IS_ERROR(status)) {
+                /* todo: maybe current pos in case of error should be equal
+                 * to the one before function call?
+                 */
+                return status;
+            }
+        }
+        if (i != rows - 1)
+            ft_ln(table);
+    }
+    return FT_SUCCESS;
+}
+
+/* Returns length of content of a cell passed to bulk write functions */
+static size_t bulk_cell_len(const void *cell, enum f_string_type type)
+{
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        return wcslen((const wchar_t *)cell);
+#else
+    (void)type;
+#endif
+    return strlen((const char *)cell);
+}
+
+/* Returns 1 if cell of the table wasn't written yet (or doesn't exist) */
+static int bulk_cell_is_unwritten(ft_table_t *table, size_t row, size_t col)
+{
+    f_cell_t *cell = get_cell(get_row(table, row), col);
+    return cell == NULL || cell_is_unwritten(cell);
+}
+
+/*
+ * Writes `rows` x `cols` cells starting from the current cell (next rows
+ * start from the first column as after ft_ln). Vectors of rows and cells are
+ * reserved once and content of cells that weren't written yet is copied to
+ * one text slab of the table. Cells that already have content are rewritten
+ * one by one, so that rewriting the same cells doesn't pile up slabs.
+ */
+static int ft_bulk_write_body_(ft_table_t *table, size_t rows, size_t cols,
+                               const void *const cells[], enum f_string_type type)
+{
     assert(table);
-    for (i = 0; i < cols; ++i) {
-        int status = ft_write_impl(table, cells[i]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal to the one before function call? */
-            return status;
+    if (table->virt)
+        return FT_EINVAL;
+    if (rows == 0)
+        return FT_SUCCESS;
+    if (cols == 0 || table->properties->entire_table_properties.add_strategy != FT_STRATEGY_REPLACE
+        || table->properties->entire_table_properties.intern_strings)
+        return ft_cells_write_impl_(table, rows, cols, cells, type);
+    if (rows > SIZE_MAX / cols)
+        return FT_EINVAL;
+
+    size_t char_sz = 1;
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        char_sz = sizeof(wchar_t);
+#endif
+    size_t i = 0;
+    size_t j = 0;
+    size_t first_col = table->cur_col;
+    size_t slab_len = 0;
+    for (i = 0; i < rows; ++i) {
+        size_t col = (i == 0) ? first_col : 0;
+        for (j = 0; j < cols; ++j) {
+            if (cells[i * cols + j] == NULL)
+                return FT_EINVAL;
+            if (bulk_cell_is_unwritten(table, table->cur_row + i, col + j))
+                slab_len += bulk_cell_len(cells[i * cols + j], type) + 1;
+        }
+    }
+    if (slab_len > SIZE_MAX / char_sz)
+        return FT_EINVAL;
+
+    invalidate_geometry_cache(table);
+    char *slab = NULL;
+    if (slab_len) {
+        slab = (char *)alloc_text_slab(table, slab_len * char_sz);
+        if (slab == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    if (FT_IS_ERROR(vector_reserve(table->rows, table->cur_row + rows)))
+        return FT_MEMORY_ERROR;
+
+    f_string_view_t content;
+    content.type = type;
+    for (i = 0; i < rows; ++i) {
+        f_row_t *row = get_row_and_create_if_not_exists(table, table->cur_row + i);
+        if (row == NULL)
+            return FT_GEN_ERROR;
+        size_t col = (i == 0) ? first_col : 0;
+        /* Cells written after a gap may be stored sparsely, see row.c */
+        if (col <= columns_in_row(row) && FT_IS_ERROR(row_reserve_cells(row, col + cols)))
+            return FT_MEMORY_ERROR;
+        for (j = 0; j < cols; ++j) {
+            f_cell_t *cell = get_cell_and_create_if_not_exists(row, col + j);
+            if (cell == NULL)
+                return FT_GEN_ERROR;
+            content.u.data = cells[i * cols + j];
+            if (!cell_is_unwritten(cell)) {
+                f_string_buffer_t *buf = cell_get_string_buffer(cell);
+                f_status status = fill_cell_content(table, buf, &content, bulk_cell_len(content.u.data, type));
+                if (FT_IS_ERROR(status))
+                    return status;
+                continue;
+            }
+            size_t len = fill_buffer_from_string_at(cell_get_string_buffer(cell), &content, SIZE_MAX, slab);
+            slab += (len + 1) * char_sz;
         }
     }
+    table->cur_row += rows - 1;
+    table->cur_col = (rows == 1 ? first_col : 0) + cols;
     return FT_SUCCESS;
 }
 
+static int ft_bulk_write_impl_(ft_table_t *table, size_t rows, size_t cols,
+                               const void *const cells[], enum f_string_type type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_bulk_write_body_(table, rows, cols, cells, type);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_row_write(ft_table_t *table, size_t cols, const char *cells[])
+{
+    assert(table);
+    return ft_bulk_write_impl_(table, 1, cols, (const void *const *)cells, CHAR_BUF);
+}
+
 int ft_row_write_ln(ft_table_t *table, size_t cols, const char *cells[])
 {
     assert(table);
@@ -3230,21 +5340,11 @@ int ft_row_write_ln(ft_table_t *table, size_t cols, const char *cells[])
     return status;
 }
 
-#ifdef FT_HAVE_WCHAR
-int ft_row_wwrite(ft_table_t *table, size_t cols, const wchar_t *cells[])
-{
-    size_t i = 0;
-    assert(table);
-    for (i = 0; i < cols; ++i) {
-        int status = ft_wwrite_impl(table, cells[i]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal
-             * to the one before function call?
-             */
-            return status;
-        }
-    }
-    return FT_SUCCESS;
+#ifdef FT_HAVE_WCHAR
+int ft_row_wwrite(ft_table_t *table, size_t cols, const wchar_t *cells[])
+{
+    assert(table);
+    return ft_bulk_write_impl_(table, 1, cols, (const void *const *)cells, W_CHAR_BUF);
 }
 
 int ft_row_wwrite_ln(ft_table_t *table, size_t cols, const wchar_t *cells[])
@@ -3262,20 +5362,8 @@ int ft_row_wwrite_ln(ft_table_t *table, size_t cols, const wchar_t *cells[])
 
 int ft_table_write(ft_table_t *table, size_t rows, size_t cols, const char *table_cells[])
 {
-    size_t i = 0;
     assert(table);
-    for (i = 0; i < rows; ++i) {
-        int status = ft_row_write(table, cols, (const char **)&table_cells[i * cols]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal
-             * to the one before function call?
-             */
-            return status;
-        }
-        if (i != rows - 1)
-            ft_ln(table);
-    }
-    return FT_SUCCESS;
+    return ft_bulk_write_impl_(table, rows, cols, (const void *const *)table_cells, CHAR_BUF);
 }
 
 int ft_table_write_ln(ft_table_t *table, size_t rows, size_t cols, const char *table_cells[])
@@ -3292,20 +5380,8 @@ int ft_table_write_ln(ft_table_t *table, size_t rows, size_t cols, const char *t
 #ifdef FT_HAVE_WCHAR
 int ft_table_wwrite(ft_table_t *table, size_t rows, size_t cols, const wchar_t *table_cells[])
 {
-    size_t i = 0;
     assert(table);
-    for (i = 0; i < rows; ++i) {
-        int status = ft_row_wwrite(table, cols, (const wchar_t **)&table_cells[i * cols]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal
-             * to the one before function call?
-             */
-            return status;
-        }
-        if (i != rows - 1)
-            ft_ln(table);
-    }
-    return FT_SUCCESS;
+    return ft_bulk_write_impl_(table, rows, cols, (const void *const *)table_cells, W_CHAR_BUF);
 }
 
 int ft_table_wwrite_ln(ft_table_t *table, size_t rows, size_t cols, const wchar_t *table_cells[])
@@ -3322,21 +5398,82 @@ int ft_table_wwrite_ln(ft_table_t *table, size_t rows, size_t cols, const wchar_
 static
 const char *empty_str_arr[] = {"", (const char *)L"", ""};
 
+/* Prints `lines` lines of the table margin */
 static
-const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type)
+int print_margin_lines(f_conv_context_t *cntx, size_t lines, size_t cod_width)
 {
-    assert(table);
+    int tmp = 0;
+    size_t i = 0;
+    for (i = 0; i < lines; ++i) {
+        FT_CHECK(print_n_spaces(cntx, cod_width - 1/* minus new_line*/));
+        FT_CHECK(print_n_strings(cntx, 1, FT_NEWLINE));
+    }
+    return 0;
+
+clear:
+    return -1;
+}
 
-    const char *result = NULL;
+/*
+ * Prints row of the table with the separator above it. Separator above
+ * first printed row (first_row) is the top border of the table.
+ */
+static
+int print_table_row(f_conv_context_t *cntx, const ft_table_t *table,
+                    const size_t *col_vis_width_arr, size_t cols, size_t row_height,
+                    size_t row, size_t first_row, const f_row_t **prev_row)
+{
+    int tmp = 0;
+    size_t sep_size = vector_size(table->separators);
+    f_separator_t *cur_sep = (row < sep_size && (row != first_row || row == 0)) ? VECTOR_AT(table->separators, row, f_separator_t *) : NULL;
+    const f_row_t *cur_row = get_row_c(table, row);
+    if (cur_row == NULL)
+        return -1;
+    enum f_hor_separator_pos separatorPos = (row == first_row) ? TOP_SEPARATOR : INSIDE_SEPARATOR;
+    cntx->cntx->row = row;
+    FT_CHECK(print_row_separator(cntx, col_vis_width_arr, cols, *prev_row, cur_row, separatorPos, cur_sep));
+    FT_CHECK(snprintf_row(cur_row, cntx, col_vis_width_arr, cols, row_height));
+    *prev_row = cur_row;
+    return 0;
 
-    /* Determine size of table string representation */
-    size_t cod_height = 0;
-    size_t cod_width = 0;
-    int status = table_internal_codepoints_geometry(table, &cod_height, &cod_width);
-    if (FT_IS_ERROR(status)) {
-        return NULL;
-    }
+clear:
+    return -1;
+}
+
+/* Prints separator below the last printed row (row - 1) */
+static
+int print_bottom_separator(f_conv_context_t *cntx, const ft_table_t *table,
+                           const size_t *col_vis_width_arr, size_t cols,
+                           size_t row, const f_row_t *prev_row)
+{
+    size_t sep_size = vector_size(table->separators);
+    f_separator_t *cur_sep = (row < sep_size && row == ft_row_count(table)) ? VECTOR_AT(table->separators, row, f_separator_t *) : NULL;
+    cntx->cntx->row = row;
+    return print_row_separator(cntx, col_vis_width_arr, cols, prev_row, NULL, BOTTOM_SEPARATOR, cur_sep);
+}
+
+/* Minimal number of lines kept in the buffer when output is streamed */
+#define FT_STREAM_CHUNK_LINES 32
+
+/*
+ * Prints rows [first_row, first_row + count) of the table into its conversion
+ * buffer. Top and bottom borders of the printed part are borders of the table,
+ * so any row range is printed as a complete table.
+ *
+ * If sink is not NULL output is streamed to it through the conversion buffer
+ * that holds only a few lines of the table.
+ */
+static
+const void *ft_print_rows_impl(const ft_table_t *table, enum f_string_type b_type,
+                               const size_t *col_vis_width_arr, size_t cols,
+                               const size_t *row_vis_height_arr,
+                               size_t first_row, size_t count,
+                               size_t cod_height, size_t cod_width,
+                               f_output_sink_t *sink)
+{
     size_t n_codepoints = cod_height * cod_width + 1;
+    if (sink && cod_height > FT_STREAM_CHUNK_LINES)
+        n_codepoints = FT_STREAM_CHUNK_LINES * cod_width + 1;
 
     /* Allocate string buffer for string representation */
     if (table->conv_buffer == NULL) {
@@ -3344,6 +5481,12 @@ const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type
         if (table->conv_buffer == NULL)
             return NULL;
     }
+    /*
+     * The buffer may be left by conversion to string of another type. Its
+     * capacity is measured in code units of the new type (4 bytes per
+     * codepoint of utf-8 output).
+     */
+    table->conv_buffer->type = b_type;
     while (string_buffer_cod_width_capacity(table->conv_buffer) < n_codepoints) {
         if (FT_IS_ERROR(realloc_string_buffer_without_copy(table->conv_buffer))) {
             return NULL;
@@ -3353,83 +5496,352 @@ const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type
         return NULL;
     char *buffer = (char *)buffer_get_data(table->conv_buffer);
 
-    size_t cols = 0;
-    size_t rows = 0;
-    size_t *col_vis_width_arr = NULL;
-    size_t *row_vis_height_arr = NULL;
-    status = table_rows_and_cols_geometry(table, &col_vis_width_arr, &cols, &row_vis_height_arr, &rows, VISIBLE_GEOMETRY);
-    if (FT_IS_ERROR(status))
-        return NULL;
-
-    if (rows == 0) {
-        F_FREE(col_vis_width_arr);
-        F_FREE(row_vis_height_arr);
-        return empty_str_arr[b_type];
-    }
-
     int tmp = 0;
     size_t i = 0;
     f_context_t context;
     context.table_properties = (table->properties ? table->properties : &g_table_properties);
-    f_row_t *prev_row = NULL;
-    f_row_t *cur_row = NULL;
-    f_separator_t *cur_sep = NULL;
-    size_t sep_size = vector_size(table->separators);
+    const f_row_t *prev_row = NULL;
+    size_t last_row = first_row + count;
 
     f_conv_context_t cntx;
     cntx.u.buf = buffer;
     cntx.raw_avail = string_buffer_raw_capacity(table->conv_buffer);
     cntx.cntx = &context;
     cntx.b_type = b_type;
-
-    /* Print top margin */
-    for (i = 0; i < context.table_properties->entire_table_properties.top_margin; ++i) {
-        FT_CHECK(print_n_strings(&cntx, cod_width - 1/* minus new_line*/, FT_SPACE));
-        FT_CHECK(print_n_strings(&cntx, 1, FT_NEWLINE));
+    cntx.emitter = get_emitter(b_type);
+    cntx.sink = sink;
+    if (sink) {
+        /* Buffer may be bigger after previous conversions to string */
+        size_t raw_cod_sz = cntx.raw_avail / string_buffer_cod_width_capacity(table->conv_buffer);
+        cntx.raw_avail = MIN(cntx.raw_avail, n_codepoints * raw_cod_sz);
+        sink->chunk = buffer;
+        sink->chunk_sz = cntx.raw_avail;
     }
 
-    for (i = 0; i < rows; ++i) {
-        cur_sep = (i < sep_size) ? VECTOR_AT(table->separators, i, f_separator_t *) : NULL;
-        cur_row = VECTOR_AT(table->rows, i, f_row_t *);
-        enum f_hor_separator_pos separatorPos = (i == 0) ? TOP_SEPARATOR : INSIDE_SEPARATOR;
-        context.row = i;
-        FT_CHECK(print_row_separator(&cntx, col_vis_width_arr, cols, prev_row, cur_row, separatorPos, cur_sep));
-        FT_CHECK(snprintf_row(cur_row, &cntx, col_vis_width_arr, cols, row_vis_height_arr[i]));
-        prev_row = cur_row;
+    FT_CHECK(print_margin_lines(&cntx, context.table_properties->entire_table_properties.top_margin, cod_width));
+    for (i = first_row; i < last_row; ++i) {
+        FT_CHECK(print_table_row(&cntx, table, col_vis_width_arr, cols, row_vis_height_arr[i - first_row],
+                                 i, first_row, &prev_row));
     }
-    cur_row = NULL;
-    cur_sep = (i < sep_size) ? VECTOR_AT(table->separators, i, f_separator_t *) : NULL;
-    context.row = i;
-    FT_CHECK(print_row_separator(&cntx, col_vis_width_arr, cols, prev_row, cur_row, BOTTOM_SEPARATOR, cur_sep));
+    FT_CHECK(print_bottom_separator(&cntx, table, col_vis_width_arr, cols, last_row, prev_row));
+    FT_CHECK(print_margin_lines(&cntx, context.table_properties->entire_table_properties.bottom_margin, cod_width));
 
-    /* Print bottom margin */
-    for (i = 0; i < context.table_properties->entire_table_properties.bottom_margin; ++i) {
-        FT_CHECK(print_n_strings(&cntx, cod_width - 1/* minus new_line*/, FT_SPACE));
-        FT_CHECK(print_n_strings(&cntx, 1, FT_NEWLINE));
-    }
+    if (sink)
+        FT_CHECK(flush_output_sink(&cntx));
 
-    result = buffer;
+    return buffer;
 
 clear:
+    return NULL;
+}
+
+static
+const void *ft_to_string_body(const ft_table_t *table, enum f_string_type b_type,
+                              f_output_sink_t *sink)
+{
+    assert(table);
+
+    const void *result = NULL;
+
+    /* Determine size of table string representation */
+    size_t cod_height = 0;
+    size_t cod_width = 0;
+    int status = table_internal_codepoints_geometry(table, &cod_height, &cod_width);
+    if (FT_IS_ERROR(status)) {
+        return NULL;
+    }
+
+    size_t cols = 0;
+    size_t rows = 0;
+    size_t *col_vis_width_arr = NULL;
+    size_t *row_vis_height_arr = NULL;
+    status = table_rows_and_cols_geometry(table, &col_vis_width_arr, &cols, &row_vis_height_arr, &rows, VISIBLE_GEOMETRY);
+    if (FT_IS_ERROR(status))
+        return NULL;
+
+    if (rows == 0) {
+        result = empty_str_arr[b_type];
+    } else {
+        result = ft_print_rows_impl(table, b_type, col_vis_width_arr, cols, row_vis_height_arr,
+                                    0, rows, cod_height, cod_width, sink);
+    }
+
     F_FREE(col_vis_width_arr);
     F_FREE(row_vis_height_arr);
     return result;
 }
 
+static
+const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type,
+                              f_output_sink_t *sink)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    const void *result = ft_to_string_body(table, b_type, sink);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+static
+const void *ft_render_rows_body(const ft_table_t *table, size_t first_row, size_t count,
+                                enum f_string_type b_type)
+{
+    assert(table);
+
+    size_t rows = ft_row_count(table);
+    if (first_row >= rows || count == 0)
+        return empty_str_arr[b_type];
+    if (count > rows - first_row)
+        count = rows - first_row;
+
+    const f_geometry_cache_t *geometry = table_geometry_cache(table);
+    if (geometry == NULL)
+        return NULL;
+
+    size_t cod_height = 0;
+    size_t cod_width = 0;
+    const size_t *row_height_arr = geometry->row_height_arr + first_row;
+    if (FT_IS_ERROR(table_geometry_for_rows(table, geometry->cod_col_width_arr, geometry->cols,
+                                            row_height_arr, count, &cod_height, &cod_width)))
+        return NULL;
+
+    return ft_print_rows_impl(table, b_type, geometry->vis_col_width_arr, geometry->cols,
+                              row_height_arr, first_row, count, cod_height, cod_width, NULL);
+}
+
+static
+const void *ft_render_rows_impl(const ft_table_t *table, size_t first_row, size_t count,
+                                enum f_string_type b_type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    const void *result = ft_render_rows_body(table, first_row, count, b_type);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 const char *ft_to_string(const ft_table_t *table)
 {
-    return (const char *)ft_to_string_impl(table, CHAR_BUF);
+    return (const char *)ft_to_string_impl(table, CHAR_BUF, NULL);
 }
 
 #ifdef FT_HAVE_WCHAR
 const wchar_t *ft_to_wstring(const ft_table_t *table)
 {
-    return (const wchar_t *)ft_to_string_impl(table, W_CHAR_BUF);
+    return (const wchar_t *)ft_to_string_impl(table, W_CHAR_BUF, NULL);
 }
 #endif
 
+static
+int ft_print_to_body(const ft_table_t *table, enum f_string_type b_type, size_t char_sz,
+                     ft_output_fn write_fn, void *ctx)
+{
+    assert(table);
+    if (write_fn == NULL)
+        return FT_EINVAL;
+
+    f_output_sink_t sink;
+    sink.write_fn = write_fn;
+    sink.ctx = ctx;
+    sink.chunk = NULL;
+    sink.chunk_sz = 0;
+    sink.char_sz = char_sz;
+    if (ft_to_string_impl(table, b_type, &sink) == NULL)
+        return FT_GEN_ERROR;
+    return FT_SUCCESS;
+}
 
-int ft_add_separator(ft_table_t *table)
+static
+int ft_print_to_impl(const ft_table_t *table, enum f_string_type b_type, size_t char_sz,
+                     ft_output_fn write_fn, void *ctx)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_print_to_body(table, b_type, char_sz, write_fn, ctx);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_print_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx)
+{
+    return ft_print_to_impl(table, CHAR_BUF, sizeof(char), write_fn, ctx);
+}
+
+#ifdef FT_HAVE_WCHAR
+int ft_wprint_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx)
+{
+    return ft_print_to_impl(table, W_CHAR_BUF, sizeof(wchar_t), write_fn, ctx);
+}
+#endif
+
+/*
+ * Iterator over lines of the string representation of the table. Output is
+ * printed by blocks (top margin, every row with the separator above it,
+ * bottom separator with bottom margin), so only lines of one block are kept
+ * in memory.
+ */
+struct ft_line_iter {
+    const ft_table_t *table;
+    f_context_t context;
+    size_t *col_vis_width_arr;
+    size_t cols;
+    size_t *row_vis_height_arr;
+    size_t rows;
+    size_t cod_width;
+    size_t step;            /* next block: 0 - top margin, i - row (i - 1) */
+    const f_row_t *prev_row;
+    f_string_buffer_t *buffer;
+    const char *pos;        /* lines of the current block not returned yet */
+    const char *end;
+};
+
+static
+ft_line_iter_t *ft_line_iter_begin_body(const ft_table_t *table, enum f_string_type b_type)
+{
+    assert(table);
+
+    ft_line_iter_t *iter = (ft_line_iter_t *)F_CALLOC(sizeof(ft_line_iter_t), 1);
+    if (iter == NULL)
+        return NULL;
+
+    size_t cod_height = 0;
+    if (FT_IS_ERROR(table_internal_codepoints_geometry(table, &cod_height, &iter->cod_width)))
+        goto clear;
+    if (FT_IS_ERROR(table_rows_and_cols_geometry(table, &iter->col_vis_width_arr, &iter->cols,
+                    &iter->row_vis_height_arr, &iter->rows, VISIBLE_GEOMETRY)))
+        goto clear;
+    iter->buffer = create_string_buffer(iter->cod_width + 1, b_type);
+    if (iter->buffer == NULL)
+        goto clear;
+
+    iter->table = table;
+    iter->context.table_properties = (table->properties ? table->properties : &g_table_properties);
+    return iter;
+
+clear:
+    ft_line_iter_end(iter);
+    return NULL;
+}
+
+static
+ft_line_iter_t *ft_line_iter_begin_impl(const ft_table_t *table, enum f_string_type b_type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    ft_line_iter_t *result = ft_line_iter_begin_body(table, b_type);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+/*
+ * Prints next block of lines. Returns 0 if there are no more blocks.
+ */
+static
+int ft_line_iter_print_block(ft_line_iter_t *iter)
+{
+    size_t rows = iter->rows;
+    if (rows == 0 || iter->step > rows + 1)
+        return 0;
+
+    const fort_entire_table_properties_t *table_props = &iter->context.table_properties->entire_table_properties;
+    size_t lines = 0;
+    if (iter->step == 0)
+        lines = table_props->top_margin;
+    else if (iter->step <= rows)
+        lines = iter->row_vis_height_arr[iter->step - 1] + 1;
+    else
+        lines = table_props->bottom_margin + 1;
+
+    while (string_buffer_cod_width_capacity(iter->buffer) < lines * iter->cod_width + 1) {
+        if (FT_IS_ERROR(realloc_string_buffer_without_copy(iter->buffer)))
+            return -1;
+    }
+
+    int tmp = 0;
+    f_conv_context_t cntx;
+    cntx.u.buf = (char *)buffer_get_data(iter->buffer);
+    cntx.raw_avail = string_buffer_raw_capacity(iter->buffer);
+    cntx.cntx = &iter->context;
+    cntx.b_type = iter->buffer->type;
+    cntx.emitter = get_emitter(cntx.b_type);
+    cntx.sink = NULL;
+
+    if (iter->step == 0) {
+        FT_CHECK(print_margin_lines(&cntx, table_props->top_margin, iter->cod_width));
+    } else if (iter->step <= rows) {
+        FT_CHECK(print_table_row(&cntx, iter->table, iter->col_vis_width_arr, iter->cols,
+                                 iter->row_vis_height_arr[iter->step - 1], iter->step - 1, 0, &iter->prev_row));
+    } else {
+        FT_CHECK(print_bottom_separator(&cntx, iter->table, iter->col_vis_width_arr, iter->cols,
+                                        rows, iter->prev_row));
+        FT_CHECK(print_margin_lines(&cntx, table_props->bottom_margin, iter->cod_width));
+    }
+
+    iter->pos = (const char *)buffer_get_data(iter->buffer);
+    iter->end = cntx.u.buf;
+    iter->step++;
+    return 1;
+
+clear:
+    return -1;
+}
+
+ft_line_iter_t *ft_line_iter_begin(const ft_table_t *table)
+{
+    return ft_line_iter_begin_impl(table, CHAR_BUF);
+}
+
+int ft_line_iter_next(ft_line_iter_t *iter, char *buf, size_t buf_sz, size_t *len)
+{
+    if (iter == NULL || (buf == NULL && buf_sz != 0))
+        return FT_EINVAL;
+
+    while (iter->pos == iter->end) {
+        const ft_allocator_t *prev_allocator = use_table_allocator(iter->table);
+        int status = ft_line_iter_print_block(iter);
+        use_allocator(prev_allocator);
+        if (status < 0)
+            return FT_GEN_ERROR;
+        if (status == 0)
+            return 0;
+    }
+
+    const char *new_line = (const char *)memchr(iter->pos, '\n', (size_t)(iter->end - iter->pos));
+    size_t line_len = (size_t)((new_line ? new_line : iter->end) - iter->pos);
+    if (len)
+        *len = line_len;
+    if (buf_sz <= line_len)
+        return FT_EINVAL;
+
+    memcpy(buf, iter->pos, line_len);
+    buf[line_len] = '\0';
+    iter->pos = new_line ? new_line + 1 : iter->end;
+    return 1;
+}
+
+void ft_line_iter_end(ft_line_iter_t *iter)
+{
+    if (iter == NULL)
+        return;
+    const ft_allocator_t *prev_allocator = use_table_allocator(iter->table);
+    F_FREE(iter->col_vis_width_arr);
+    F_FREE(iter->row_vis_height_arr);
+    destroy_string_buffer(iter->buffer);
+    F_FREE(iter);
+    use_allocator(prev_allocator);
+}
+
+const char *ft_render_rows(const ft_table_t *table, size_t first_row, size_t count)
+{
+    return (const char *)ft_render_rows_impl(table, first_row, count, CHAR_BUF);
+}
+
+#ifdef FT_HAVE_WCHAR
+const wchar_t *ft_wrender_rows(const ft_table_t *table, size_t first_row, size_t count)
+{
+    return (const wchar_t *)ft_render_rows_impl(table, first_row, count, W_CHAR_BUF);
+}
+#endif
+
+
+static
+int ft_add_separator_impl(ft_table_t *table)
 {
     assert(table);
     assert(table->separators);
@@ -3454,6 +5866,14 @@ int ft_add_separator(ft_table_t *table)
     return FT_SUCCESS;
 }
 
+int ft_add_separator(ft_table_t *table)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_add_separator_impl(table);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 static const struct fort_border_style *built_in_styles[] = {
     &FORT_BASIC_STYLE,
     &FORT_BASIC2_STYLE,
@@ -3503,6 +5923,7 @@ static void set_border_props_for_props(f_table_properties_t *properties, const s
     if (style >= built_in_external_styles && style < (built_in_external_styles + BUILT_IN_STYLES_SZ)) {
         size_t pos = (size_t)(style - built_in_external_styles);
         memcpy(&(properties->border_style), built_in_styles[pos], sizeof(struct fort_border_style));
+        prepare_border_glyphs(properties);
         return;
     }
 
@@ -3553,16 +5974,20 @@ static void set_border_props_for_props(f_table_properties_t *properties, const s
 #undef BOR_CHARS
 #undef H_BOR_CHARS
 #undef SEP_CHARS
+
+    prepare_border_glyphs(properties);
 }
 
 
 int ft_set_default_border_style(const struct ft_border_style *style)
 {
     set_border_props_for_props(&g_table_properties, style);
+    invalidate_all_geometry_caches();
     return FT_SUCCESS;
 }
 
-int ft_set_border_style(ft_table_t *table, const struct ft_border_style *style)
+static
+int ft_set_border_style_impl(ft_table_t *table, const struct ft_border_style *style)
 {
     assert(table);
     if (table->properties == NULL) {
@@ -3571,14 +5996,25 @@ int ft_set_border_style(ft_table_t *table, const struct ft_border_style *style)
             return FT_MEMORY_ERROR;
     }
     set_border_props_for_props(table->properties, style);
+    invalidate_geometry_cache(table);
     return FT_SUCCESS;
 }
 
+int ft_set_border_style(ft_table_t *table, const struct ft_border_style *style)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_border_style_impl(table, style);
+    use_allocator(prev_allocator);
+    return result;
+}
 
 
-int ft_set_cell_prop(ft_table_t *table, size_t row, size_t col, uint32_t property, int value)
+
+static
+int ft_set_cell_prop_impl(ft_table_t *table, size_t row, size_t col, uint32_t property, int value)
 {
     assert(table);
+    invalidate_geometry_cache(table);
 
     if (table->properties == NULL) {
         table->properties = create_table_properties();
@@ -3600,20 +6036,32 @@ int ft_set_cell_prop(ft_table_t *table, size_t row, size_t col, uint32_t propert
     return set_cell_property(table->properties->cell_properties, row, col, property, value);
 }
 
+int ft_set_cell_prop(ft_table_t *table, size_t row, size_t col, uint32_t property, int value)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_cell_prop_impl(table, row, col, property, value);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 int ft_set_default_cell_prop(uint32_t property, int value)
 {
+    invalidate_all_geometry_caches();
     return set_default_cell_property(property, value);
 }
 
 
 int ft_set_default_tbl_prop(uint32_t property, int value)
 {
+    invalidate_all_geometry_caches();
     return set_default_entire_table_property(property, value);
 }
 
-int ft_set_tbl_prop(ft_table_t *table, uint32_t property, int value)
+static
+int ft_set_tbl_prop_impl(ft_table_t *table, uint32_t property, int value)
 {
     assert(table);
+    invalidate_geometry_cache(table);
 
     if (table->properties == NULL) {
         table->properties = create_table_properties();
@@ -3623,11 +6071,24 @@ int ft_set_tbl_prop(ft_table_t *table, uint32_t property, int value)
     return set_entire_table_property(table->properties, property, value);
 }
 
+int ft_set_tbl_prop(ft_table_t *table, uint32_t property, int value)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_tbl_prop_impl(table, property, value);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 void ft_set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr))
 {
     set_memory_funcs(f_malloc, f_free);
 }
 
+int ft_set_allocator(const ft_allocator_t *allocator)
+{
+    return set_allocator(allocator);
+}
+
 const char *ft_strerror(int error_code)
 {
     switch (error_code) {
@@ -3647,17 +6108,23 @@ const char *ft_strerror(int error_code)
     }
 }
 
-int ft_set_cell_span(ft_table_t *table, size_t row, size_t col, size_t hor_span)
+static
+int ft_set_cell_span_impl(ft_table_t *table, size_t row, size_t col, size_t hor_span)
 {
     assert(table);
     if (hor_span < 2)
         return FT_EINVAL;
 
+    invalidate_geometry_cache(table);
+
     if (row == FT_CUR_ROW)
         row = table->cur_row;
     if (row == FT_CUR_COLUMN)
         col = table->cur_col;
 
+    if (table->virt)
+        return virtual_data_set_cell_span(table->virt, row, col, hor_span);
+
     f_row_t *row_p = get_row_and_create_if_not_exists(table, row);
     if (row_p == NULL)
         return FT_GEN_ERROR;
@@ -3665,6 +6132,14 @@ int ft_set_cell_span(ft_table_t *table, size_t row, size_t col, size_t hor_span)
     return row_set_cell_span(row_p, col, hor_span);
 }
 
+int ft_set_cell_span(ft_table_t *table, size_t row, size_t col, size_t hor_span)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_cell_span_impl(table, row, col, hor_span);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 #ifdef FT_HAVE_UTF8
 
 int ft_u8nwrite(ft_table_t *table, size_t n, const void *cell_content, ...)
@@ -3751,12 +6226,28 @@ int ft_u8printf_ln(ft_table_t *table, const char *fmt, ...)
 
 const void *ft_to_u8string(const ft_table_t *table)
 {
-    return (const void *)ft_to_string_impl(table, UTF8_BUF);
+    return (const void *)ft_to_string_impl(table, UTF8_BUF, NULL);
+}
+
+const void *ft_u8render_rows(const ft_table_t *table, size_t first_row, size_t count)
+{
+    return (const void *)ft_render_rows_impl(table, first_row, count, UTF8_BUF);
+}
+
+int ft_u8print_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx)
+{
+    return ft_print_to_impl(table, UTF8_BUF, sizeof(char), write_fn, ctx);
+}
+
+ft_line_iter_t *ft_u8line_iter_begin(const ft_table_t *table)
+{
+    return ft_line_iter_begin_impl(table, UTF8_BUF);
 }
 
 void ft_set_u8strwid_func(int (*u8strwid)(const void *beg, const void *end, size_t *width))
 {
     buffer_set_u8strwid_func(u8strwid);
+    invalidate_all_geometry_caches();
 }
 
 #endif /* FT_HAVE_UTF8 */
@@ -3786,69 +6277,141 @@ char g_col_separator = FORT_DEFAULT_COL_SEPARATOR;
  *               LIBFORT helpers
  *****************************************************************************/
 
-#if defined(FT_GCC_COMPILER) || defined(FT_CLANG_COMPILER)
-void *(*fort_malloc)(size_t size) = &malloc;
-void (*fort_free)(void *ptr) = &free;
-void *(*fort_calloc)(size_t nmemb, size_t size) = &calloc;
-void *(*fort_realloc)(void *ptr, size_t size) = &realloc;
-#else
-static void *local_malloc(size_t size)
+static void *std_malloc(size_t size, void *ctx)
 {
+    (void)ctx;
     return malloc(size);
 }
 
-static void local_free(void *ptr)
+static void *std_calloc(size_t nmemb, size_t size, void *ctx)
 {
-    free(ptr);
+    (void)ctx;
+    return calloc(nmemb, size);
 }
 
-static void *local_calloc(size_t nmemb, size_t size)
+static void *std_realloc(void *ptr, size_t old_size, size_t size, void *ctx)
 {
-    return calloc(nmemb, size);
+    (void)old_size;
+    (void)ctx;
+    return realloc(ptr, size);
 }
 
-static void *local_realloc(void *ptr, size_t size)
+static void std_free(void *ptr, void *ctx)
 {
-    return realloc(ptr, size);
+    (void)ctx;
+    free(ptr);
 }
 
-void *(*fort_malloc)(size_t size) = &local_malloc;
-void (*fort_free)(void *ptr) = &local_free;
-void *(*fort_calloc)(size_t nmemb, size_t size) = &local_calloc;
-void *(*fort_realloc)(void *ptr, size_t size) = &local_realloc;
-#endif
+static const ft_allocator_t std_allocator = {
+    &std_malloc, &std_calloc, &std_realloc, &std_free, NULL
+};
+
+/* Global allocator (see ft_set_allocator) */
+static ft_allocator_t g_allocator = {
+    &std_malloc, &std_calloc, &std_realloc, &std_free, NULL
+};
+
+/*
+ * Tables with their own allocators make it current for the time of calls of
+ * public functions (see use_table_allocator), so it is kept per thread: calls
+ * for different tables in different threads don't affect each other.
+ */
+FT_THREAD_LOCAL const ft_allocator_t *fort_allocator = &g_allocator;
+
+FT_INTERNAL
+void *fort_malloc(size_t size)
+{
+    return fort_allocator->malloc_fn(size, fort_allocator->ctx);
+}
+
+FT_INTERNAL
+void fort_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    fort_allocator->free_fn(ptr, fort_allocator->ctx);
+}
 
-static void *custom_fort_calloc(size_t nmemb, size_t size)
+FT_INTERNAL
+void *fort_calloc(size_t nmemb, size_t size)
 {
+    if (fort_allocator->calloc_fn)
+        return fort_allocator->calloc_fn(nmemb, size, fort_allocator->ctx);
+
+    if (size && nmemb > SIZE_MAX / size)
+        return NULL;
     size_t total_size = nmemb * size;
-    void *result = F_MALLOC(total_size);
+    void *result = fort_malloc(total_size);
     if (result != NULL)
         memset(result, 0, total_size);
     return result;
 }
 
-static void *custom_fort_realloc(void *ptr, size_t size)
+FT_INTERNAL
+void *fort_realloc(void *ptr, size_t old_size, size_t size)
 {
+    if (fort_allocator->realloc_fn)
+        return fort_allocator->realloc_fn(ptr, old_size, size, fort_allocator->ctx);
+
     if (ptr == NULL)
-        return F_MALLOC(size);
+        return fort_malloc(size);
     if (size == 0) {
-        F_FREE(ptr);
+        fort_free(ptr);
         return NULL;
     }
 
-    void *new_chunk = F_MALLOC(size);
+    void *new_chunk = fort_malloc(size);
     if (new_chunk == NULL)
         return NULL;
 
-    /*
-     * In theory we should copy MIN(size, size allocated for ptr) bytes,
-     * but this is rather dummy implementation so we don't care about it
-     */
-    memcpy(new_chunk, ptr, size);
-    F_FREE(ptr);
+    memcpy(new_chunk, ptr, MIN(old_size, size));
+    fort_free(ptr);
     return new_chunk;
 }
 
+FT_INTERNAL
+const ft_allocator_t *use_allocator(const ft_allocator_t *allocator)
+{
+    assert(allocator);
+    const ft_allocator_t *prev = fort_allocator;
+    fort_allocator = allocator;
+    return prev;
+}
+
+FT_INTERNAL
+const ft_allocator_t *use_global_allocator(void)
+{
+    return use_allocator(&g_allocator);
+}
+
+FT_INTERNAL
+f_status set_allocator(const ft_allocator_t *allocator)
+{
+    if (allocator == NULL) {
+        g_allocator = std_allocator;
+        return FT_SUCCESS;
+    }
+    if (allocator->malloc_fn == NULL || allocator->free_fn == NULL)
+        return FT_EINVAL;
+    g_allocator = *allocator;
+    return FT_SUCCESS;
+}
+
+/* Functions set by ft_set_memory_funcs */
+static void *(*user_malloc)(size_t size) = NULL;
+static void (*user_free)(void *ptr) = NULL;
+
+static void *user_malloc_adapter(size_t size, void *ctx)
+{
+    (void)ctx;
+    return user_malloc(size);
+}
+
+static void user_free_adapter(void *ptr, void *ctx)
+{
+    (void)ctx;
+    user_free(ptr);
+}
 
 FT_INTERNAL
 void set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr))
@@ -3857,24 +6420,16 @@ void set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr))
            || (f_malloc != NULL && f_free != NULL) /* Use custom functions */);
 
     if (f_malloc == NULL && f_free == NULL) {
-#if defined(FT_GCC_COMPILER) || defined(FT_CLANG_COMPILER)
-        fort_malloc = &malloc;
-        fort_free = &free;
-        fort_calloc = &calloc;
-        fort_realloc = &realloc;
-#else
-        fort_malloc = &local_malloc;
-        fort_free = &local_free;
-        fort_calloc = &local_calloc;
-        fort_realloc = &local_realloc;
-#endif
+        set_allocator(NULL);
     } else {
-        fort_malloc = f_malloc;
-        fort_free = f_free;
-        fort_calloc = &custom_fort_calloc;
-        fort_realloc = &custom_fort_realloc;
+        /* calloc and realloc are emulated with f_malloc and f_free */
+        ft_allocator_t allocator = {
+            &user_malloc_adapter, NULL, NULL, &user_free_adapter, NULL
+        };
+        user_malloc = f_malloc;
+        user_free = f_free;
+        set_allocator(&allocator);
     }
-
 }
 
 FT_INTERNAL
@@ -3892,6 +6447,182 @@ char *fort_strdup(const char *str)
     return str_copy;
 }
 
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Writes decimal representation of value to buf (at least 21 chars long) */
+FT_INTERNAL
+size_t u64_to_str(uint64_t value, char *buf)
+{
+    char tmp[20];
+    char *pos = tmp + sizeof(tmp);
+    while (value >= 100) {
+        size_t i = (size_t)(value % 100) * 2;
+        value /= 100;
+        *--pos = digit_pairs[i + 1];
+        *--pos = digit_pairs[i];
+    }
+    if (value >= 10) {
+        size_t i = (size_t)value * 2;
+        *--pos = digit_pairs[i + 1];
+        *--pos = digit_pairs[i];
+    } else {
+        *--pos = (char)('0' + value);
+    }
+
+    size_t len = (size_t)(tmp + sizeof(tmp) - pos);
+    memcpy(buf, pos, len);
+    buf[len] = '\0';
+    return len;
+}
+
+FT_INTERNAL
+size_t i64_to_str(int64_t value, char *buf)
+{
+    if (value < 0) {
+        buf[0] = '-';
+        /* Negate as unsigned to handle INT64_MIN */
+        return 1 + u64_to_str((uint64_t)0 - (uint64_t)value, buf + 1);
+    }
+    return u64_to_str((uint64_t)value, buf);
+}
+
+FT_INTERNAL
+size_t u64_str_len(uint64_t value)
+{
+    size_t len = 1;
+    while (value >= 10000) {
+        value /= 10000;
+        len += 4;
+    }
+    if (value >= 1000)
+        return len + 3;
+    if (value >= 100)
+        return len + 2;
+    if (value >= 10)
+        return len + 1;
+    return len;
+}
+
+FT_INTERNAL
+size_t i64_str_len(int64_t value)
+{
+    if (value < 0)
+        return 1 + u64_str_len((uint64_t)0 - (uint64_t)value);
+    return u64_str_len((uint64_t)value);
+}
+
+FT_INTERNAL
+f_status number_format_from_spec(const char *spec, enum f_number_type type, char *fmt, size_t fmt_sz)
+{
+    assert(spec);
+    const char *conversions = NULL;
+    switch (type) {
+        case F_NUM_I64:
+            conversions = "di";
+            break;
+        case F_NUM_U64:
+            conversions = "uxXo";
+            break;
+        case F_NUM_F64:
+            conversions = "fFeEgGaA";
+            break;
+    }
+
+    size_t n_conversions = 0;
+    size_t i = 0;
+    const char *pos = spec;
+    /* Specification without text may be given without '%' (e.g. ".2f") */
+    int bare_spec = (strchr(spec, '%') == NULL);
+    while (*pos) {
+        /* Room for '%', "ll", conversion and '\0' */
+        if (i + 4 >= fmt_sz)
+            return FT_EINVAL;
+        if (bare_spec) {
+            fmt[i++] = '%';
+        } else {
+            if (*pos != '%') {
+                fmt[i++] = *pos++;
+                continue;
+            }
+            fmt[i++] = *pos++;
+            if (*pos == '%') {
+                fmt[i++] = *pos++;
+                continue;
+            }
+        }
+
+        /* flags, width and precision */
+        while (*pos && strchr("-+ #0123456789.", *pos)) {
+            if (i + 3 >= fmt_sz)
+                return FT_EINVAL;
+            fmt[i++] = *pos++;
+        }
+        if (*pos == '\0' || strchr(conversions, *pos) == NULL)
+            return FT_EINVAL;
+        if (type != F_NUM_F64) {
+            fmt[i++] = 'l';
+            fmt[i++] = 'l';
+        }
+        fmt[i++] = *pos++;
+        n_conversions++;
+        if (bare_spec && *pos)
+            return FT_EINVAL;
+    }
+    fmt[i] = '\0';
+    return n_conversions == 1 ? FT_SUCCESS : FT_EINVAL;
+}
+
+FT_INTERNAL
+int format_number(char *buf, size_t buf_sz, const char *fmt,
+                  enum f_number_type type, const union f_number *value)
+{
+    if (fmt == NULL && buf_sz >= FT_NUMBER_BUF_SZ) {
+        switch (type) {
+            case F_NUM_I64:
+                return (int)i64_to_str(value->i64, buf);
+            case F_NUM_U64:
+                return (int)u64_to_str(value->u64, buf);
+            case F_NUM_F64:
+                break;
+        }
+    }
+
+    /* Disable compiler diagnostic (format string is not a string literal) */
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    switch (type) {
+        case F_NUM_I64:
+            return snprintf(buf, buf_sz, fmt ? fmt : "%lld", (long long)value->i64);
+        case F_NUM_U64:
+            return snprintf(buf, buf_sz, fmt ? fmt : "%llu", (unsigned long long)value->u64);
+        case F_NUM_F64:
+            return snprintf(buf, buf_sz, fmt ? fmt : "%g", value->f64);
+    }
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic pop
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic pop
+#endif
+    return -1;
+}
+
 #if defined(FT_HAVE_WCHAR)
 FT_INTERNAL
 wchar_t *fort_wcsdup(const wchar_t *str)
@@ -3983,121 +6714,376 @@ size_t number_of_columns_in_format_string(const f_string_view_t *fmt)
 }
 
 FT_INTERNAL
-size_t number_of_columns_in_format_buffer(const f_string_buffer_t *fmt)
+size_t number_of_columns_in_format_buffer(const f_string_buffer_t *fmt)
+{
+    switch (fmt->type) {
+        case CHAR_BUF:
+            return columns_number_in_fmt_string(fmt->str.cstr);
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            return columns_number_in_fmt_wstring(fmt->str.wstr);
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            return columns_number_in_fmt_u8string(fmt->str.u8str);
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+    }
+    return 0;
+}
+
+/*
+ * Parses conversion specification at `spec` (the char after '%'). Pushes
+ * types of its arguments to `arg_types` (it should have room for 3 of them)
+ * and returns pointer to the char after the specification or NULL if it is
+ * not supported.
+ */
+static
+const char *parse_printf_conversion(const char *spec, enum f_printf_arg_type *arg_types, size_t *n_args)
+{
+    const char *pos = spec;
+    if (*pos == '%')
+        return pos + 1;
+
+    while (*pos && strchr("-+ #0'", *pos))
+        ++pos;
+    if (*pos == '*') {
+        arg_types[(*n_args)++] = F_ARG_INT;
+        ++pos;
+    } else {
+        while (*pos >= '0' && *pos <= '9')
+            ++pos;
+    }
+    if (*pos == '.') {
+        ++pos;
+        if (*pos == '*') {
+            arg_types[(*n_args)++] = F_ARG_INT;
+            ++pos;
+        } else {
+            while (*pos >= '0' && *pos <= '9')
+                ++pos;
+        }
+    }
+
+    enum f_printf_arg_type int_type = F_ARG_INT;
+    int long_modifier = 0;
+    switch (*pos) {
+        case 'h':
+            pos += (pos[1] == 'h') ? 2 : 1;
+            break;
+        case 'l':
+            if (pos[1] == 'l') {
+                int_type = F_ARG_LLONG;
+                pos += 2;
+            } else {
+                int_type = F_ARG_LONG;
+                long_modifier = 1;
+                pos += 1;
+            }
+            break;
+        case 'j':
+            int_type = F_ARG_INTMAX;
+            ++pos;
+            break;
+        case 'z':
+            int_type = F_ARG_SIZE;
+            ++pos;
+            break;
+        case 't':
+            int_type = F_ARG_PTRDIFF;
+            ++pos;
+            break;
+        case 'L':
+            long_modifier = 2;
+            ++pos;
+            break;
+        default:
+            break;
+    }
+
+    switch (*pos) {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            arg_types[(*n_args)++] = int_type;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            arg_types[(*n_args)++] = (long_modifier == 2) ? F_ARG_LDOUBLE : F_ARG_DOUBLE;
+            break;
+        case 'c':
+            arg_types[(*n_args)++] = long_modifier ? F_ARG_WINT : F_ARG_INT;
+            break;
+        case 's':
+        case 'p':
+        case 'n':
+            arg_types[(*n_args)++] = F_ARG_PTR;
+            break;
+        default:
+            return NULL;
+    }
+    return pos + 1;
+}
+
+FT_INTERNAL
+ft_row_format_t *create_row_format(const char *fmt)
+{
+    assert(fmt);
+
+    ft_row_format_t *format = (ft_row_format_t *)F_CALLOC(sizeof(ft_row_format_t), 1);
+    if (format == NULL)
+        return NULL;
+
+    format->fmt = F_STRDUP(fmt);
+    if (format->fmt == NULL)
+        goto clear;
+
+    /* Every conversion has at most 3 arguments (width, precision, value) */
+    size_t fmt_len = strlen(fmt);
+    size_t n_conversions = 0;
+    const char *pos = fmt;
+    for (pos = fmt; *pos; ++pos) {
+        if (*pos == '%')
+            n_conversions++;
+    }
+    format->n_fields = columns_number_in_fmt_string(fmt);
+    format->fields = (struct f_row_format_field *)F_CALLOC(sizeof(struct f_row_format_field), format->n_fields);
+    format->arg_types = (enum f_printf_arg_type *)F_CALLOC(sizeof(enum f_printf_arg_type), 3 * n_conversions + 1);
+    if (format->fields == NULL || format->arg_types == NULL)
+        goto clear;
+
+    size_t i = 0;
+    char *field_beg = format->fmt;
+    for (i = 0; i < format->n_fields; ++i) {
+        struct f_row_format_field *field = &format->fields[i];
+        char *field_end = strchr(field_beg, g_col_separator);
+        if (field_end == NULL)
+            field_end = format->fmt + fmt_len;
+        *field_end = '\0';
+
+        field->fmt = field_beg;
+        field->len = (size_t)(field_end - field_beg);
+        field->first_arg = format->n_args;
+        field->is_literal = (strchr(field_beg, '%') == NULL);
+        pos = field_beg;
+        while ((pos = strchr(pos, '%')) != NULL) {
+            pos = parse_printf_conversion(pos + 1, format->arg_types, &format->n_args);
+            if (pos == NULL)
+                goto clear;
+        }
+        field->n_args = format->n_args - field->first_arg;
+        field_beg = field_end + 1;
+    }
+    return format;
+
+clear:
+    destroy_row_format(format);
+    return NULL;
+}
+
+FT_INTERNAL
+void destroy_row_format(ft_row_format_t *format)
+{
+    if (format == NULL)
+        return;
+    F_FREE(format->fmt);
+    F_FREE(format->fields);
+    F_FREE(format->arg_types);
+    F_FREE(format);
+}
+
+FT_INTERNAL
+void skip_printf_args(va_list *va, const enum f_printf_arg_type *arg_types, size_t n)
+{
+    size_t i = 0;
+    for (i = 0; i < n; ++i) {
+        switch (arg_types[i]) {
+            case F_ARG_INT:
+                (void)va_arg(*va, int);
+                break;
+            case F_ARG_LONG:
+                (void)va_arg(*va, long);
+                break;
+            case F_ARG_LLONG:
+                (void)va_arg(*va, long long);
+                break;
+            case F_ARG_INTMAX:
+                (void)va_arg(*va, intmax_t);
+                break;
+            case F_ARG_SIZE:
+                (void)va_arg(*va, size_t);
+                break;
+            case F_ARG_PTRDIFF:
+                (void)va_arg(*va, ptrdiff_t);
+                break;
+            case F_ARG_WINT:
+#ifdef FT_HAVE_WCHAR
+                (void)va_arg(*va, wint_t);
+#else
+                (void)va_arg(*va, int);
+#endif
+                break;
+            case F_ARG_DOUBLE:
+                (void)va_arg(*va, double);
+                break;
+            case F_ARG_LDOUBLE:
+                (void)va_arg(*va, long double);
+                break;
+            case F_ARG_PTR:
+                (void)va_arg(*va, void *);
+                break;
+        }
+    }
+}
+
+#if defined(FT_HAVE_WCHAR)
+static
+int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str);
+#endif
+
+
+
+FT_INTERNAL
+int flush_output_sink(f_conv_context_t *cntx)
 {
-    switch (fmt->type) {
-        case CHAR_BUF:
-            return columns_number_in_fmt_string(fmt->str.cstr);
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            return columns_number_in_fmt_wstring(fmt->str.wstr);
-#endif /* FT_HAVE_WCHAR */
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            return columns_number_in_fmt_u8string(fmt->str.u8str);
-#endif /* FT_HAVE_UTF8 */
-        default:
-            assert(0);
-    }
+    f_output_sink_t *sink = cntx->sink;
+    assert(sink);
+
+    size_t raw_len = (size_t)(cntx->u.buf - sink->chunk);
+    if (raw_len && sink->write_fn(sink->chunk, raw_len / sink->char_sz, sink->ctx) < 0)
+        return -1;
+    cntx->u.buf = sink->chunk;
+    cntx->raw_avail = sink->chunk_sz;
     return 0;
 }
 
+/*
+ * Makes room for `raw_len` bytes (and the terminating null char) in the
+ * output buffer if output is streamed.
+ */
 static
-int snprint_n_strings_impl(char *buf, size_t length, size_t n, const char *str)
+int reserve_output(f_conv_context_t *cntx, size_t raw_len)
 {
-    size_t str_len = strlen(str);
-    if (length <= n * str_len)
-        return -1;
-
-    if (n == 0)
+    if (cntx->sink == NULL || cntx->raw_avail >= raw_len + cntx->sink->char_sz)
         return 0;
+    return flush_output_sink(cntx);
+}
 
-    /* To ensure valid return value it is safely not print such big strings */
-    if (n * str_len > INT_MAX)
-        return -1;
-
-    if (str_len == 0)
+/*
+ * Decodes glyph of one utf-8 codepoint to wide char. Returns 0 if the glyph
+ * isn't one well-formed codepoint (or it doesn't fit wchar_t).
+ */
+#ifdef FT_HAVE_WCHAR
+static
+wchar_t glyph_to_wchar(const unsigned char *s, size_t len)
+{
+    static const unsigned long min_cp[] = {0, 0, 0x80, 0x800, 0x10000};
+    size_t i = 0;
+    unsigned long cp = 0;
+
+    if (len == 1)
+        return (s[0] < 0x80) ? (wchar_t)s[0] : 0;
+    if (len == 2 && (s[0] & 0xE0) == 0xC0)
+        cp = s[0] & 0x1F;
+    else if (len == 3 && (s[0] & 0xF0) == 0xE0)
+        cp = s[0] & 0x0F;
+    else if (len == 4 && (s[0] & 0xF8) == 0xF0)
+        cp = s[0] & 0x07;
+    else
         return 0;
+    for (i = 1; i < len; ++i) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    if (cp < min_cp[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)
+        || cp > (unsigned long)WCHAR_MAX)
+        return 0;
+    return (wchar_t)cp;
+}
+#endif /* FT_HAVE_WCHAR */
 
-    int status = snprintf(buf, length, "%0*d", (int)(n * str_len), 0);
-    if (status < 0)
-        return status;
-
+FT_INTERNAL
+void init_glyph(f_glyph_t *glyph, const char *str)
+{
+    const unsigned char *s = (const unsigned char *)str;
     size_t i = 0;
-    for (i = 0; i < n; ++i) {
-        const char *str_p = str;
-        while (*str_p)
-            *(buf++) = *(str_p++);
-    }
-    return (int)(n * str_len);
+    size_t cod_len = 0;
+    int ascii = 1;
+    for (i = 0; s[i]; ++i) {
+        if (s[i] >= 0x80)
+            ascii = 0;
+        if ((s[i] & 0xC0) != 0x80)
+            cod_len++;
+    }
+    glyph->str = str;
+    glyph->len = i;
+    glyph->cod_len = cod_len;
+    glyph->ascii = ascii;
+#ifdef FT_HAVE_WCHAR
+    glyph->wch = (cod_len == 1) ? glyph_to_wchar(s, i) : 0;
+#endif /* FT_HAVE_WCHAR */
 }
 
+/* Copies `n` glyphs to `buf` (there should be room for them and null char) */
 static
-int snprint_n_strings(f_conv_context_t *cntx, size_t n, const char *str)
+void copy_n_glyphs(char *buf, size_t n, const f_glyph_t *glyph)
 {
-    int w = snprint_n_strings_impl(cntx->u.buf, cntx->raw_avail, n, str);
-    if (w >= 0) {
-        cntx->u.buf += w;
-        cntx->raw_avail -= w;
+    if (glyph->len == 1) {
+        memset(buf, glyph->str[0], n);
+        buf[n] = '\0';
+        return;
+    }
+    size_t i = 0;
+    for (i = 0; i < n; ++i) {
+        memcpy(buf, glyph->str, glyph->len);
+        buf += glyph->len;
     }
-    return w;
+    *buf = '\0';
 }
 
-#if defined(FT_HAVE_WCHAR)
-static
-int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str);
-#endif
-
-#if defined(FT_HAVE_UTF8)
+#ifdef FT_HAVE_WCHAR
+/* Prints wide form of the glyph, returns number of printed wide chars */
 static
-int u8nprint_n_strings(void *buf, size_t length, size_t n, const void *str);
-#endif
-
-
-FT_INTERNAL
-int print_n_strings(f_conv_context_t *cntx, size_t n, const char *str)
+int wprint_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph)
 {
-    int cod_w;
-    int raw_written;
-
-    switch (cntx->b_type) {
-        case CHAR_BUF:
-            raw_written = snprint_n_strings(cntx, n, str);
-            cod_w = raw_written;
-            return cod_w;
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            cod_w = wsnprint_n_string(cntx->u.wbuf, cntx->raw_avail, n, str);
-            if (cod_w < 0)
-                return cod_w;
-            raw_written = sizeof(wchar_t) * cod_w;
+    /* Non utf-8 glyphs are converted with the current locale */
+    if (glyph->wch == 0 && !glyph->ascii)
+        return wsnprint_n_string(cntx->u.wbuf, cntx->raw_avail, n, glyph->str);
 
-            cntx->u.buf += raw_written;
-            cntx->raw_avail -= raw_written;
-            return cod_w;
-#endif /* FT_HAVE_WCHAR */
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            /* Everying is very strange and differs with W_CHAR_BUF */
-            raw_written = u8nprint_n_strings(cntx->u.buf, cntx->raw_avail, n, str);
-            if (raw_written < 0) {
-                fprintf(stderr, " raw_written = %d\n", raw_written);
-                return raw_written;
-            }
+    size_t wlen = glyph->wch ? n : n * glyph->len;
+    if (wlen > INT_MAX || cntx->raw_avail < (wlen + 1) * sizeof(wchar_t))
+        return -1;
 
-            cntx->u.buf += raw_written;
-            cntx->raw_avail -= raw_written;
-            return utf8len(str) * n;
-#endif /* FT_HAVE_UTF8 */
-        default:
-            assert(0);
-            return -1;
+    wchar_t *wbuf = cntx->u.wbuf;
+    size_t i = 0;
+    if (glyph->wch) {
+        for (i = 0; i < n; ++i)
+            wbuf[i] = glyph->wch;
+    } else {
+        for (i = 0; i < wlen; ++i)
+            wbuf[i] = (wchar_t)glyph->str[i % glyph->len];
     }
+    wbuf[wlen] = L'\0';
+    return (int)wlen;
 }
+#endif /* FT_HAVE_WCHAR */
 
 FT_INTERNAL
 int ft_nprint(f_conv_context_t *cntx, const char *str, size_t strlen)
 {
+    if (reserve_output(cntx, strlen) < 0)
+        return -1;
     if (cntx->raw_avail + 1/* for 0 */ < strlen)
         return -1;
 
@@ -4111,6 +7097,8 @@ int ft_nprint(f_conv_context_t *cntx, const char *str, size_t strlen)
 #ifdef FT_HAVE_WCHAR
 int ft_nwprint(f_conv_context_t *cntx, const wchar_t *str, size_t strlen)
 {
+    if (reserve_output(cntx, strlen * sizeof(wchar_t)) < 0)
+        return -1;
     if (cntx->raw_avail + 1/* for 0 */ < strlen)
         return -1;
 
@@ -4134,6 +7122,8 @@ int ft_nu8print(f_conv_context_t *cntx, const void *beg, const void *end)
     const char *bc = (const char *)beg;
     const char *ec = (const char *)end;
     size_t raw_len = ec - bc;
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
     if (cntx->raw_avail + 1 < raw_len)
         return -1;
 
@@ -4143,7 +7133,354 @@ int ft_nu8print(f_conv_context_t *cntx, const void *beg, const void *end)
     *(cntx->u.buf) = '\0'; /* Do we need this ? */
     return raw_len; /* what return here ? */
 }
-#endif /* FT_HAVE_UTF8 */
+#endif /* FT_HAVE_UTF8 */
+
+
+#ifdef FT_HAVE_UTF8
+FT_INTERNAL
+size_t utf8_decode(const unsigned char *str, size_t len, uint32_t *c)
+{
+    unsigned char b0 = str[0];
+    if (b0 >= 0xc2 && b0 <= 0xdf) {
+        if (len < 2 || (str[1] & 0xc0) != 0x80)
+            return 0;
+        *c = ((uint32_t)(b0 & 0x1f) << 6) | (str[1] & 0x3f);
+        return 2;
+    }
+    if (b0 >= 0xe0 && b0 <= 0xef) {
+        if (len < 3 || (str[1] & 0xc0) != 0x80 || (str[2] & 0xc0) != 0x80)
+            return 0;
+        if ((b0 == 0xe0 && str[1] < 0xa0) || (b0 == 0xed && str[1] > 0x9f))
+            return 0;
+        *c = ((uint32_t)(b0 & 0x0f) << 12) | ((uint32_t)(str[1] & 0x3f) << 6) | (str[2] & 0x3f);
+        return 3;
+    }
+    if (b0 >= 0xf0 && b0 <= 0xf4) {
+        if (len < 4 || (str[1] & 0xc0) != 0x80 || (str[2] & 0xc0) != 0x80 || (str[3] & 0xc0) != 0x80)
+            return 0;
+        if ((b0 == 0xf0 && str[1] < 0x90) || (b0 == 0xf4 && str[1] > 0x8f))
+            return 0;
+        *c = ((uint32_t)(b0 & 0x07) << 18) | ((uint32_t)(str[1] & 0x3f) << 12)
+             | ((uint32_t)(str[2] & 0x3f) << 6) | (str[3] & 0x3f);
+        return 4;
+    }
+    return 0;
+}
+#endif /* FT_HAVE_UTF8 */
+
+/*
+ * Bodies of printing functions are written once for all types of output and
+ * take the type as a parameter. Emitters instantiate them with constant type
+ * (FT_DEFINE_EMITTER), so checks of the type are resolved at compile time.
+ */
+static FT_INLINE
+int emit_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph, enum f_string_type type)
+{
+    /* Every char of the glyph is printed as at most one code unit */
+    if (cntx->sink && reserve_output(cntx, n * glyph->len * cntx->sink->char_sz) < 0)
+        return -1;
+
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF) {
+        int cod_w = wprint_n_glyphs(cntx, n, glyph);
+        if (cod_w < 0)
+            return cod_w;
+        cntx->u.buf += sizeof(wchar_t) * cod_w;
+        cntx->raw_avail -= sizeof(wchar_t) * cod_w;
+        return cod_w;
+    }
+#endif /* FT_HAVE_WCHAR */
+
+    size_t raw_len = n * glyph->len;
+    /* To ensure valid return value it is safely not print such big strings */
+    if (cntx->raw_avail <= raw_len || raw_len > INT_MAX)
+        return -1;
+    copy_n_glyphs(cntx->u.buf, n, glyph);
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    return (int)(type == CHAR_BUF ? raw_len : n * glyph->cod_len);
+}
+
+static FT_INLINE
+int emit_n_spaces(f_conv_context_t *cntx, size_t n, enum f_string_type type)
+{
+    size_t unit_sz = 1;
+    (void)type;  /* unused if wchar support is disabled */
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        unit_sz = sizeof(wchar_t);
+#endif /* FT_HAVE_WCHAR */
+    size_t raw_len = n * unit_sz;
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
+    if (cntx->raw_avail < raw_len + unit_sz || n > INT_MAX)
+        return -1;
+
+    if (unit_sz == 1) {
+        memset(cntx->u.buf, ' ', n);
+        cntx->u.buf[n] = '\0';
+    }
+#ifdef FT_HAVE_WCHAR
+    else {
+        size_t i = 0;
+        for (i = 0; i < n; ++i)
+            cntx->u.wbuf[i] = L' ';
+        cntx->u.wbuf[n] = L'\0';
+    }
+#endif /* FT_HAVE_WCHAR */
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    return (int)n;
+}
+
+#ifdef FT_HAVE_WCHAR
+/*
+ * Converts char string [beg, end) to wide chars with the current locale (only
+ * counts them if `dst` is NULL). Invalid sequences are replaced with U+FFFD.
+ */
+static
+size_t mbs_to_wcs(wchar_t *dst, const char *beg, const char *end)
+{
+    mbstate_t state;
+    memset(&state, 0, sizeof(state));
+    size_t n = 0;
+    while (beg < end) {
+        wchar_t wch = 0;
+        size_t sz = 1;
+        if ((unsigned char)*beg < 0x80) {
+            wch = (wchar_t)*beg;
+        } else {
+            sz = mbrtowc(&wch, beg, (size_t)(end - beg), &state);
+            if (sz == (size_t) -1 || sz == (size_t) -2 || sz == 0) {
+                memset(&state, 0, sizeof(state));
+                wch = (wchar_t)0xFFFD;
+                sz = 1;
+            }
+        }
+        if (dst)
+            dst[n] = wch;
+        n++;
+        beg += sz;
+    }
+    return n;
+}
+#endif /* FT_HAVE_WCHAR */
+
+#if defined(FT_HAVE_WCHAR) && defined(FT_HAVE_UTF8)
+/*
+ * Decodes utf-8 string [beg, end) to wide chars (only counts them if `dst` is
+ * NULL). Ill-formed bytes are replaced with U+FFFD, codepoints after U+FFFF
+ * are written as surrogate pairs if wchar_t is 16 bit.
+ */
+static
+size_t u8_to_wcs(wchar_t *dst, const char *beg, const char *end)
+{
+    const unsigned char *s = (const unsigned char *)beg;
+    size_t len = (size_t)(end - beg);
+    size_t i = 0;
+    size_t n = 0;
+    while (i < len) {
+        uint32_t c = s[i];
+        size_t sz = 1;
+        if (c >= 0x80) {
+            sz = utf8_decode(s + i, len - i, &c);
+            if (sz == 0) {
+                c = 0xFFFD;
+                sz = 1;
+            }
+        }
+        i += sz;
+        if (sizeof(wchar_t) == 2 && c > 0xFFFF) {
+            if (dst) {
+                dst[n] = (wchar_t)(0xD800 + ((c - 0x10000) >> 10));
+                dst[n + 1] = (wchar_t)(0xDC00 + ((c - 0x10000) & 0x3FF));
+            }
+            n += 2;
+        } else {
+            if (dst)
+                dst[n] = (wchar_t)c;
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Encodes wide chars [beg, end) to utf-8 (only counts bytes if `dst` is NULL).
+ * Surrogate pairs of 16 bit wchar_t are combined, other values that aren't
+ * codepoints are replaced with U+FFFD.
+ */
+static
+size_t wcs_to_u8(char *dst, const wchar_t *beg, const wchar_t *end)
+{
+    size_t n = 0;
+    for (; beg < end; ++beg) {
+        utf8_int32_t c = (utf8_int32_t)*beg;
+        if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF
+            && beg + 1 < end && beg[1] >= 0xDC00 && beg[1] <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + ((utf8_int32_t)beg[1] - 0xDC00);
+            ++beg;
+        } else if (c < 0 || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+            c = 0xFFFD;
+        }
+        if (dst)
+            utf8catcodepoint(dst + n, c, 4);
+        n += utf8codepointsize(c);
+    }
+    return n;
+}
+
+/* Prints wide content to utf-8 output */
+static
+int print_u8_from_wcs(f_conv_context_t *cntx, const wchar_t *beg, const wchar_t *end)
+{
+    size_t raw_len = wcs_to_u8(NULL, beg, end);
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
+    if (cntx->raw_avail <= raw_len || raw_len > INT_MAX)
+        return -1;
+
+    wcs_to_u8(cntx->u.buf, beg, end);
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    *cntx->u.buf = '\0';
+    return (int)raw_len;
+}
+#endif /* defined(FT_HAVE_WCHAR) && defined(FT_HAVE_UTF8) */
+
+#ifdef FT_HAVE_WCHAR
+/* Prints char or utf-8 content to wide output */
+static
+int print_wcs_from_bytes(f_conv_context_t *cntx, const char *beg, const char *end,
+                         enum f_string_type content_type)
+{
+    size_t (*decode)(wchar_t *dst, const char *beg, const char *end) = mbs_to_wcs;
+#ifdef FT_HAVE_UTF8
+    if (content_type == UTF8_BUF)
+        decode = u8_to_wcs;
+#endif /* FT_HAVE_UTF8 */
+    (void)content_type;  /* unused if utf-8 support is disabled */
+
+    size_t len = decode(NULL, beg, end);
+    size_t raw_len = len * sizeof(wchar_t);
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
+    if (cntx->raw_avail < raw_len + sizeof(wchar_t) || len > INT_MAX)
+        return -1;
+
+    decode(cntx->u.wbuf, beg, end);
+    cntx->u.wbuf[len] = L'\0';
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    return (int)len;
+}
+#endif /* FT_HAVE_WCHAR */
+
+static FT_INLINE
+int emit_range(f_conv_context_t *cntx, const void *beg, const void *end,
+               enum f_string_type content_type, enum f_string_type type)
+{
+    (void)type;  /* unused if wchar and utf-8 support is disabled */
+    (void)content_type;
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF) {
+        if (content_type == W_CHAR_BUF)
+            return ft_nwprint(cntx, (const wchar_t *)beg, (size_t)((const wchar_t *)end - (const wchar_t *)beg));
+        return print_wcs_from_bytes(cntx, (const char *)beg, (const char *)end, content_type);
+    }
+    if (content_type == W_CHAR_BUF) {
+#ifdef FT_HAVE_UTF8
+        if (type == UTF8_BUF)
+            return print_u8_from_wcs(cntx, (const wchar_t *)beg, (const wchar_t *)end);
+#endif /* FT_HAVE_UTF8 */
+        return -1;
+    }
+#endif /* FT_HAVE_WCHAR */
+
+    /* Char and utf-8 content is printed to char and utf-8 output as it is */
+#ifdef FT_HAVE_UTF8
+    if (type == UTF8_BUF)
+        return ft_nu8print(cntx, beg, end);
+#endif /* FT_HAVE_UTF8 */
+    return ft_nprint(cntx, (const char *)beg, (size_t)((const char *)end - (const char *)beg));
+}
+
+#define FT_DEFINE_EMITTER(name, type) \
+    static int name##_print_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph) \
+    { \
+        return emit_n_glyphs(cntx, n, glyph, type); \
+    } \
+    static int name##_print_n_spaces(f_conv_context_t *cntx, size_t n) \
+    { \
+        return emit_n_spaces(cntx, n, type); \
+    } \
+    static int name##_print_range(f_conv_context_t *cntx, const void *beg, const void *end, \
+                                  enum f_string_type content_type) \
+    { \
+        return emit_range(cntx, beg, end, content_type, type); \
+    } \
+    static const f_emitter_t name = { \
+        name##_print_n_glyphs, \
+        name##_print_n_spaces, \
+        name##_print_range \
+    };
+
+FT_DEFINE_EMITTER(char_emitter, CHAR_BUF)
+#ifdef FT_HAVE_WCHAR
+FT_DEFINE_EMITTER(wchar_emitter, W_CHAR_BUF)
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+FT_DEFINE_EMITTER(utf8_emitter, UTF8_BUF)
+#endif /* FT_HAVE_UTF8 */
+
+#undef FT_DEFINE_EMITTER
+
+FT_INTERNAL
+const f_emitter_t *get_emitter(enum f_string_type type)
+{
+    switch (type) {
+        case CHAR_BUF:
+            return &char_emitter;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            return &wchar_emitter;
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            return &utf8_emitter;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+            return NULL;
+    }
+}
+
+FT_INTERNAL
+int print_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph)
+{
+    return cntx->emitter->print_n_glyphs(cntx, n, glyph);
+}
+
+FT_INTERNAL
+int print_n_strings(f_conv_context_t *cntx, size_t n, const char *str)
+{
+    f_glyph_t glyph;
+    init_glyph(&glyph, str);
+    return cntx->emitter->print_n_glyphs(cntx, n, &glyph);
+}
+
+FT_INTERNAL
+int print_n_spaces(f_conv_context_t *cntx, size_t n)
+{
+    return cntx->emitter->print_n_spaces(cntx, n);
+}
+
+FT_INTERNAL
+int print_range(f_conv_context_t *cntx, const void *beg, const void *end,
+                enum f_string_type content_type)
+{
+    return cntx->emitter->print_range(cntx, beg, end, content_type);
+}
 
 #if defined(FT_HAVE_WCHAR)
 #define WCS_SIZE 64
@@ -4171,6 +7508,8 @@ int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str)
                 /* for simplicity */
                 if ((wcs_len == (size_t) - 1) || wcs_len > 1) {
                     return -1;
+                } else if (length < (n + 1) * sizeof(wchar_t) || n > INT_MAX) {
+                    return -1;
                 } else {
                     wcs[wcs_len] = L'\0';
                     size_t k = n;
@@ -4179,7 +7518,7 @@ int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str)
                         ++buf;
                         --k;
                     }
-                    buf[n] = L'\0';
+                    *buf = L'\0';
                     return (int)n;
                 }
             }
@@ -4214,34 +7553,7 @@ int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str)
 #endif
 
 
-#if defined(FT_HAVE_UTF8)
-static
-int u8nprint_n_strings(void *buf, size_t length, size_t n, const void *str)
-{
-    size_t str_size = utf8size(str) - 1; /* str_size - raw size in bytes, excluding \0 */
-    if (length <= n * str_size)
-        return -1;
-
-    if (n == 0)
-        return 0;
-
-    /* To ensure valid return value it is safely not print such big strings */
-    if (n * str_size > INT_MAX)
-        return -1;
-
-    if (str_size == 0)
-        return 0;
 
-    size_t i = n;
-    while (i) {
-        memcpy(buf, str, str_size);
-        buf = (char *)buf + str_size;
-        --i;
-    }
-    *(char *)buf = '\0';
-    return (int)(n * str_size);
-}
-#endif
 
 /********************************************************
    End of file "fort_utils.c"
@@ -5129,6 +8441,8 @@ fort_entire_table_properties_t g_entire_table_properties = {
     0, /* right_margin */
     0, /* bottom_margin */
     FT_STRATEGY_REPLACE, /* add_strategy */
+    FT_INVALID_UTF8_KEEP, /* invalid_utf8 */
+    0, /* intern_strings */
 };
 
 static f_status set_entire_table_property_internal(fort_entire_table_properties_t *properties, uint32_t property, int value)
@@ -5145,6 +8459,14 @@ static f_status set_entire_table_property_internal(fort_entire_table_properties_
         properties->bottom_margin = value;
     } else if (PROP_IS_SET(property, FT_TPROP_ADDING_STRATEGY)) {
         properties->add_strategy = (enum ft_adding_strategy)value;
+    } else if (PROP_IS_SET(property, FT_TPROP_INVALID_UTF8)) {
+        if (value > FT_INVALID_UTF8_REPLACE)
+            return FT_EINVAL;
+        properties->invalid_utf8 = (enum ft_invalid_utf8_handling)value;
+    } else if (PROP_IS_SET(property, FT_TPROP_INTERN_STRINGS)) {
+        if (value > 1)
+            return FT_EINVAL;
+        properties->intern_strings = value;
     } else {
         return FT_EINVAL;
     }
@@ -5174,26 +8496,46 @@ FT_INTERNAL
 size_t max_border_elem_strlen(struct f_table_properties *properties)
 {
     assert(properties);
-    size_t result = 1;
-    int i = 0;
-    for (i = 0; i < BORDER_ITEM_POS_SIZE; ++i) {
-        result = MAX(result, strlen(properties->border_style.border_chars[i]));
-    }
+    return border_glyphs(properties)->max_len;
+}
+
 
+FT_INTERNAL
+void prepare_border_glyphs(f_table_properties_t *properties)
+{
+    assert(properties);
+    const struct fort_border_style *style = &properties->border_style;
+    struct f_border_glyphs *glyphs = &properties->border_glyphs;
+    size_t max_len = 1;
+    int i = 0;
     for (i = 0; i < BORDER_ITEM_POS_SIZE; ++i) {
-        result = MAX(result, strlen(properties->border_style.header_border_chars[i]));
+        init_glyph(&glyphs->border[i], style->border_chars[i]);
+        init_glyph(&glyphs->header_border[i], style->header_border_chars[i]);
+        max_len = MAX(max_len, MAX(glyphs->border[i].len, glyphs->header_border[i].len));
     }
-
     for (i = 0; i < SEPARATOR_ITEM_POS_SIZE; ++i) {
-        result = MAX(result, strlen(properties->border_style.separator_chars[i]));
+        init_glyph(&glyphs->separator[i], style->separator_chars[i]);
+        max_len = MAX(max_len, glyphs->separator[i].len);
     }
-    return result;
+    glyphs->max_len = max_len;
+    glyphs->ready = 1;
+}
+
+
+FT_INTERNAL
+const struct f_border_glyphs *border_glyphs(f_table_properties_t *properties)
+{
+    assert(properties);
+    if (!properties->border_glyphs.ready)
+        prepare_border_glyphs(properties);
+    return &properties->border_glyphs;
 }
 
 
 f_table_properties_t g_table_properties = {
     /* border_style */
     BASIC_STYLE,
+    {0},      /* border_glyphs (prepared on demand) */
     NULL,     /* cell_properties */
     /* entire_table_properties */
     {
@@ -5202,7 +8544,10 @@ f_table_properties_t g_table_properties = {
         0, /* right_margin */
         0,  /* bottom_margin */
         FT_STRATEGY_REPLACE, /* add_strategy */
-    }
+        FT_INVALID_UTF8_KEEP, /* invalid_utf8 */
+        0, /* intern_strings */
+    },
+    NULL,     /* column_formats */
 };
 
 
@@ -5214,12 +8559,14 @@ f_table_properties_t *create_table_properties(void)
         return NULL;
     }
     memcpy(properties, &g_table_properties, sizeof(f_table_properties_t));
+    prepare_border_glyphs(properties);
     properties->cell_properties = create_cell_prop_container();
     if (properties->cell_properties == NULL) {
         destroy_table_properties(properties);
         return NULL;
     }
     memcpy(&properties->entire_table_properties, &g_entire_table_properties, sizeof(fort_entire_table_properties_t));
+    properties->column_formats = NULL;
     return properties;
 }
 
@@ -5232,6 +8579,9 @@ void destroy_table_properties(f_table_properties_t *properties)
     if (properties->cell_properties != NULL) {
         destroy_cell_prop_container(properties->cell_properties);
     }
+    if (properties->column_formats != NULL) {
+        destroy_vector(properties->column_formats);
+    }
     F_FREE(properties);
 }
 
@@ -5269,12 +8619,97 @@ f_table_properties_t *copy_table_properties(const f_table_properties_t *properti
     }
 
     memcpy(&new_opt->border_style, &properties->border_style, sizeof(struct fort_border_style));
+    memcpy(&new_opt->border_glyphs, &properties->border_glyphs, sizeof(struct f_border_glyphs));
     memcpy(&new_opt->entire_table_properties,
            &properties->entire_table_properties, sizeof(fort_entire_table_properties_t));
 
+    if (properties->column_formats) {
+        size_t sz = vector_size(properties->column_formats);
+        new_opt->column_formats = create_vector(sizeof(f_column_format_t), DEFAULT_VECTOR_CAPACITY);
+        if (new_opt->column_formats == NULL) {
+            destroy_table_properties(new_opt);
+            return NULL;
+        }
+        size_t i = 0;
+        for (i = 0; i < sz; ++i) {
+            if (FT_IS_ERROR(vector_push(new_opt->column_formats, vector_at(properties->column_formats, i)))) {
+                destroy_table_properties(new_opt);
+                return NULL;
+            }
+        }
+    }
+
     return new_opt;
 }
 
+
+static
+size_t column_format_index(const f_table_properties_t *properties, size_t col)
+{
+    if (properties->column_formats == NULL)
+        return INVALID_VEC_INDEX;
+
+    size_t i = 0;
+    size_t sz = vector_size(properties->column_formats);
+    for (i = 0; i < sz; ++i) {
+        const f_column_format_t *format = (const f_column_format_t *)vector_at_c(properties->column_formats, i);
+        if (format->col == col)
+            return i;
+    }
+    return INVALID_VEC_INDEX;
+}
+
+FT_INTERNAL
+f_status set_column_number_format(f_table_properties_t *properties, size_t col, const char *fmt_spec)
+{
+    assert(properties);
+
+    size_t index = column_format_index(properties, col);
+    if (fmt_spec == NULL) {
+        if (index != INVALID_VEC_INDEX)
+            vector_erase(properties->column_formats, index);
+        return FT_SUCCESS;
+    }
+
+    f_column_format_t format;
+    memset(&format, 0, sizeof(format));
+    format.col = col;
+    int has_any_fmt = 0;
+    size_t type = 0;
+    for (type = F_NUM_I64; type <= F_NUM_F64; ++type) {
+        format.has_fmt[type] = FT_IS_SUCCESS(
+                                   number_format_from_spec(fmt_spec, (enum f_number_type)type,
+                                           format.fmt[type], FT_NUMBER_FMT_SZ));
+        has_any_fmt |= format.has_fmt[type];
+    }
+    if (!has_any_fmt)
+        return FT_EINVAL;
+
+    if (index != INVALID_VEC_INDEX) {
+        memcpy(vector_at(properties->column_formats, index), &format, sizeof(format));
+        return FT_SUCCESS;
+    }
+
+    if (properties->column_formats == NULL) {
+        properties->column_formats = create_vector(sizeof(f_column_format_t), DEFAULT_VECTOR_CAPACITY);
+        if (properties->column_formats == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    return vector_push(properties->column_formats, &format);
+}
+
+FT_INTERNAL
+const char *get_column_number_format(const f_table_properties_t *properties, size_t col, enum f_number_type type)
+{
+    assert(properties);
+
+    size_t index = column_format_index(properties, col);
+    if (index == INVALID_VEC_INDEX)
+        return NULL;
+    const f_column_format_t *format = (const f_column_format_t *)vector_at_c(properties->column_formats, index);
+    return format->has_fmt[type] ? format->fmt[type] : NULL;
+}
+
 /********************************************************
    End of file "properties.c"
  ********************************************************/
@@ -5291,11 +8726,42 @@ f_table_properties_t *copy_table_properties(const f_table_properties_t *properti
 /* #include "string_buffer.h" */ /* Commented by amalgamation script */
 /* #include "vector.h" */ /* Commented by amalgamation script */
 
+/*
+ * Row becomes sparse when a cell is created further than this number of
+ * columns after the last cell of the row.
+ */
+#define SPARSE_ROW_MIN_GAP 32
 
 struct f_row {
     f_vector_t *cells;
+    /*
+     * Sorted columns of cells of sparse rows. Columns without cells are
+     * gaps which are considered to be empty cells. NULL for dense rows
+     * (i-th cell is in the i-th column).
+     */
+    f_vector_t *columns;
+    /*
+     * Span map built when the row is printed (NULL if it isn't built yet).
+     * It is dropped by functions which change cells of the row.
+     */
+    struct f_span_map *span_map;
+};
+
+/*
+ * Types and spans of cells of the row (span of master cell is number of
+ * columns of its group, span of other cells is 1). Cells after the last
+ * group are common cells, so only columns up to it are stored (rows without
+ * groups have empty map).
+ */
+struct f_span_map {
+    size_t cols;
+    size_t *spans;
+    unsigned char *types;   /* enum f_cell_type */
 };
 
+/* Map shared by rows without groups */
+static struct f_span_map empty_span_map = {0, NULL, NULL};
+
 static
 f_row_t *create_row_impl(f_vector_t *cells)
 {
@@ -5305,7 +8771,7 @@ f_row_t *create_row_impl(f_vector_t *cells)
     if (cells) {
         row->cells = cells;
     } else {
-        row->cells = create_vector(sizeof(f_cell_t *), DEFAULT_VECTOR_CAPACITY);
+        row->cells = create_vector(sizeof(f_cell_t), DEFAULT_VECTOR_CAPACITY);
         if (row->cells == NULL) {
             F_FREE(row);
             return NULL;
@@ -5320,14 +8786,25 @@ f_row_t *create_row(void)
     return create_row_impl(NULL);
 }
 
+FT_INTERNAL
+f_row_t *create_row_with_capacity(size_t cols)
+{
+    f_vector_t *cells = create_vector(sizeof(f_cell_t), cols);
+    if (cells == NULL)
+        return NULL;
+    f_row_t *row = create_row_impl(cells);
+    if (row == NULL)
+        destroy_vector(cells);
+    return row;
+}
+
 static
 void destroy_each_cell(f_vector_t *cells)
 {
     size_t i = 0;
     size_t cells_n = vector_size(cells);
     for (i = 0; i < cells_n; ++i) {
-        f_cell_t *cell = VECTOR_AT(cells, i, f_cell_t *);
-        destroy_cell(cell);
+        release_cell((f_cell_t *)vector_at(cells, i));
     }
 }
 
@@ -5341,28 +8818,112 @@ void destroy_row(f_row_t *row)
         destroy_each_cell(row->cells);
         destroy_vector(row->cells);
     }
+    if (row->columns)
+        destroy_vector(row->columns);
+    invalidate_span_map(row);
 
     F_FREE(row);
 }
 
+FT_INTERNAL
+void invalidate_span_map(f_row_t *row)
+{
+    if (row->span_map != &empty_span_map)
+        F_FREE(row->span_map);
+    row->span_map = NULL;
+}
+
+#define CELL_COLUMN(row, i) VECTOR_AT_C((row)->columns, (i), size_t)
+
+/*
+ * Returns index of the first cell of the sparse row with column not less
+ * than `col`.
+ */
+static
+size_t sparse_cell_index(const f_row_t *row, size_t col)
+{
+    size_t lo = 0;
+    size_t hi = vector_size(row->columns);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (CELL_COLUMN(row, mid) < col)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Adds `diff` to columns of cells of the sparse row starting from index `from` */
+static
+void shift_sparse_columns(f_row_t *row, size_t from, size_t diff, int backward)
+{
+    size_t n = vector_size(row->columns);
+    size_t i = 0;
+    for (i = from; i < n; ++i) {
+        size_t *column = (size_t *)vector_at(row->columns, i);
+        *column = backward ? *column - diff : *column + diff;
+    }
+}
+
+static
+f_status make_row_sparse(f_row_t *row)
+{
+    assert(row->columns == NULL);
+    size_t n = vector_size(row->cells);
+    f_vector_t *columns = create_vector(sizeof(size_t), MAX(n, DEFAULT_VECTOR_CAPACITY));
+    if (columns == NULL)
+        return FT_MEMORY_ERROR;
+    size_t i = 0;
+    for (i = 0; i < n; ++i)
+        vector_push(columns, &i);
+    row->columns = columns;
+    return FT_SUCCESS;
+}
+
+/* Inserts empty cell to the sparse row at index `idx` for column `col` */
+static
+f_cell_t *insert_sparse_cell(f_row_t *row, size_t idx, size_t col)
+{
+    f_cell_t new_cell;
+    init_cell(&new_cell);
+    if (FT_IS_ERROR(vector_insert(row->columns, &col, idx)))
+        return NULL;
+    if (FT_IS_ERROR(vector_insert(row->cells, &new_cell, idx))) {
+        vector_erase(row->columns, idx);
+        return NULL;
+    }
+    return (f_cell_t *)vector_at(row->cells, idx);
+}
+
 FT_INTERNAL
 f_row_t *copy_row(f_row_t *row)
 {
     assert(row);
-    f_row_t *result = create_row();
+    size_t i = 0;
+    size_t cols_n = vector_size(row->cells);
+    f_row_t *result = create_row_with_capacity(MAX(cols_n, DEFAULT_VECTOR_CAPACITY));
     if (result == NULL)
         return NULL;
 
-    size_t i = 0;
-    size_t cols_n = vector_size(row->cells);
+    if (row->columns) {
+        result->columns = create_vector(sizeof(size_t), MAX(cols_n, DEFAULT_VECTOR_CAPACITY));
+        if (result->columns == NULL) {
+            destroy_row(result);
+            return NULL;
+        }
+    }
+
     for (i = 0; i < cols_n; ++i) {
-        f_cell_t *cell = VECTOR_AT(row->cells, i, f_cell_t *);
-        f_cell_t *new_cell = copy_cell(cell);
-        if (new_cell == NULL) {
+        f_cell_t new_cell;
+        if (FT_IS_ERROR(copy_cell(&new_cell, (const f_cell_t *)vector_at(row->cells, i)))) {
             destroy_row(result);
             return NULL;
         }
+        /* Capacity is reserved, so push doesn't fail */
         vector_push(result->cells, &new_cell);
+        if (row->columns)
+            vector_push(result->columns, vector_at_c(row->columns, i));
     }
 
     return result;
@@ -5373,13 +8934,24 @@ f_row_t *split_row(f_row_t *row, size_t pos)
 {
     assert(row);
 
-    f_vector_t *cells = vector_split(row->cells, pos);
+    invalidate_span_map(row);
+    size_t idx = row->columns ? sparse_cell_index(row, pos) : pos;
+    f_vector_t *cells = vector_split(row->cells, idx);
     if (!cells)
         return NULL;
     f_row_t *tail = create_row_impl(cells);
     if (!tail) {
         destroy_each_cell(cells);
         destroy_vector(cells);
+        return NULL;
+    }
+    if (row->columns) {
+        tail->columns = vector_split(row->columns, idx);
+        if (tail->columns == NULL) {
+            destroy_row(tail);
+            return NULL;
+        }
+        shift_sparse_columns(tail, 0, pos, 1);
     }
     return tail;
 }
@@ -5392,11 +8964,22 @@ int ft_row_erase_range(f_row_t *row, size_t left, size_t right)
     if (cols_n == 0 || (right < left))
         return FT_SUCCESS;
 
-    f_cell_t *cell = NULL;
+    invalidate_span_map(row);
+
+    if (row->columns) {
+        size_t idx = sparse_cell_index(row, left);
+        while (idx < vector_size(row->columns) && CELL_COLUMN(row, idx) <= right) {
+            release_cell((f_cell_t *)vector_at(row->cells, idx));
+            vector_erase(row->cells, idx);
+            vector_erase(row->columns, idx);
+        }
+        shift_sparse_columns(row, idx, right - left + 1, 1);
+        return FT_SUCCESS;
+    }
+
     size_t i = left;
     while (i < cols_n && i <= right) {
-        cell = VECTOR_AT(row->cells, i, f_cell_t *);
-        destroy_cell(cell);
+        release_cell((f_cell_t *)vector_at(row->cells, i));
         ++i;
     }
     size_t n_destroy = MIN(cols_n - 1, right) - left + 1;
@@ -5412,10 +8995,25 @@ size_t columns_in_row(const f_row_t *row)
     if (row == NULL || row->cells == NULL)
         return 0;
 
+    if (row->columns) {
+        size_t n = vector_size(row->columns);
+        return n ? CELL_COLUMN(row, n - 1) + 1 : 0;
+    }
     return vector_size(row->cells);
 }
 
 
+FT_INTERNAL
+f_status row_reserve_cells(f_row_t *row, size_t cols)
+{
+    assert(row);
+    /* Capacity of sparse rows doesn't depend on number of columns */
+    if (row->columns)
+        return FT_SUCCESS;
+    return vector_reserve(row->cells, cols);
+}
+
+
 static
 f_cell_t *get_cell_impl(f_row_t *row, size_t col, enum f_get_policy policy)
 {
@@ -5423,23 +9021,35 @@ f_cell_t *get_cell_impl(f_row_t *row, size_t col, enum f_get_policy policy)
         return NULL;
     }
 
+    if (row->columns == NULL && policy == CREATE_ON_NULL
+        && col >= vector_size(row->cells) + SPARSE_ROW_MIN_GAP) {
+        if (FT_IS_ERROR(make_row_sparse(row)))
+            return NULL;
+    }
+
+    if (row->columns) {
+        size_t idx = sparse_cell_index(row, col);
+        if (idx < vector_size(row->columns) && CELL_COLUMN(row, idx) == col)
+            return (f_cell_t *)vector_at(row->cells, idx);
+        return policy == CREATE_ON_NULL ? insert_sparse_cell(row, idx, col) : NULL;
+    }
+
     switch (policy) {
         case DONT_CREATE_ON_NULL:
             if (col < columns_in_row(row)) {
-                return VECTOR_AT(row->cells, col, f_cell_t *);
+                return (f_cell_t *)vector_at(row->cells, col);
             }
             return NULL;
         case CREATE_ON_NULL:
+            if (col >= columns_in_row(row)
+                && FT_IS_ERROR(vector_reserve(row->cells, col + 1)))
+                return NULL;
             while (col >= columns_in_row(row)) {
-                f_cell_t *new_cell = create_cell();
-                if (new_cell == NULL)
-                    return NULL;
-                if (FT_IS_ERROR(vector_push(row->cells, &new_cell))) {
-                    destroy_cell(new_cell);
-                    return NULL;
-                }
+                f_cell_t new_cell;
+                init_cell(&new_cell);
+                vector_push(row->cells, &new_cell);
             }
-            return VECTOR_AT(row->cells, col, f_cell_t *);
+            return (f_cell_t *)vector_at(row->cells, col);
     }
 
     assert(0 && "Shouldn't be here!");
@@ -5457,7 +9067,10 @@ f_cell_t *get_cell(f_row_t *row, size_t col)
 FT_INTERNAL
 const f_cell_t *get_cell_c(const f_row_t *row, size_t col)
 {
-    return get_cell((f_row_t *)row, col);
+    const f_cell_t *cell = get_cell((f_row_t *)row, col);
+    if (cell == NULL && row && row->columns && col < columns_in_row(row))
+        return get_empty_cell();
+    return cell;
 }
 
 
@@ -5474,22 +9087,64 @@ f_cell_t *create_cell_in_position(f_row_t *row, size_t col)
         return NULL;
     }
 
-    f_cell_t *new_cell = create_cell();
-    if (new_cell == NULL)
-        return NULL;
-    if (FT_IS_ERROR(vector_insert(row->cells, &new_cell, col))) {
-        destroy_cell(new_cell);
-        return NULL;
+    /* Cells after the end of the row are not shifted */
+    if (col >= columns_in_row(row))
+        return get_cell_impl(row, col, CREATE_ON_NULL);
+
+    invalidate_span_map(row);
+
+    if (row->columns) {
+        size_t idx = sparse_cell_index(row, col);
+        shift_sparse_columns(row, idx, 1, 0);
+        f_cell_t *cell = insert_sparse_cell(row, idx, col);
+        if (cell == NULL)
+            shift_sparse_columns(row, idx, 1, 1);
+        return cell;
     }
-    return VECTOR_AT(row->cells, col, f_cell_t *);
+
+    f_cell_t new_cell;
+    init_cell(&new_cell);
+    if (FT_IS_ERROR(vector_insert(row->cells, &new_cell, col)))
+        return NULL;
+    return (f_cell_t *)vector_at(row->cells, col);
 }
 
+/*
+ * Moves cells of `ins_row` to `cur_row` starting from column `pos` either
+ * replacing existing cells or inserting them before existing cells. Replaced
+ * cells are moved to `ins_row`.
+ */
+static
+f_status move_cells_to_sparse_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos, int insert)
+{
+    size_t sz = vector_size(ins_row->cells);
+    size_t i = 0;
+    for (i = 0; i < sz; ++i) {
+        f_cell_t *dst = insert
+                        ? create_cell_in_position(cur_row, pos + i)
+                        : get_cell_and_create_if_not_exists(cur_row, pos + i);
+        if (dst == NULL)
+            return FT_GEN_ERROR;
+        f_cell_t *src = (f_cell_t *)vector_at(ins_row->cells, i);
+        f_cell_t tmp = *dst;
+        *dst = *src;
+        *src = tmp;
+    }
+    return FT_SUCCESS;
+}
 
 FT_INTERNAL
 f_status swap_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
 {
     assert(cur_row);
     assert(ins_row);
+    assert(ins_row->columns == NULL);
+
+    invalidate_span_map(cur_row);
+    invalidate_span_map(ins_row);
+    if (cur_row->columns)
+        return move_cells_to_sparse_row(cur_row, ins_row, pos, 0);
+
     size_t cur_sz = vector_size(cur_row->cells);
     if (cur_sz == 0 && pos == 0) {
         f_row_t tmp;
@@ -5499,6 +9154,12 @@ f_status swap_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
         return FT_SUCCESS;
     }
 
+    if (pos >= cur_sz + SPARSE_ROW_MIN_GAP) {
+        if (FT_IS_ERROR(make_row_sparse(cur_row)))
+            return FT_MEMORY_ERROR;
+        return move_cells_to_sparse_row(cur_row, ins_row, pos, 0);
+    }
+
     // Append empty cells to `cur_row` if needed.
     while (vector_size(cur_row->cells) < pos) {
         create_cell_in_position(cur_row, vector_size(cur_row->cells));
@@ -5513,19 +9174,31 @@ f_status insert_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
 {
     assert(cur_row);
     assert(ins_row);
+    assert(ins_row->columns == NULL);
+
+    invalidate_span_map(cur_row);
+    invalidate_span_map(ins_row);
+    if (cur_row->columns == NULL && pos >= vector_size(cur_row->cells) + SPARSE_ROW_MIN_GAP) {
+        if (FT_IS_ERROR(make_row_sparse(cur_row)))
+            return FT_MEMORY_ERROR;
+    }
+    if (cur_row->columns) {
+        /* Empty cells are left in `ins_row` */
+        return move_cells_to_sparse_row(cur_row, ins_row, pos, 1);
+    }
 
     while (vector_size(cur_row->cells) < pos) {
-        f_cell_t *new_cell = create_cell();
-        if (!new_cell)
+        f_cell_t new_cell;
+        init_cell(&new_cell);
+        if (FT_IS_ERROR(vector_push(cur_row->cells, &new_cell)))
             return FT_GEN_ERROR;
-        vector_push(cur_row->cells, &new_cell);
     }
 
     size_t sz = vector_size(ins_row->cells);
     size_t i = 0;
     for (i = 0; i < sz; ++i) {
-        f_cell_t *cell = VECTOR_AT(ins_row->cells, i, f_cell_t *);
-        if (FT_IS_ERROR(vector_insert(cur_row->cells, &cell, pos + i))) {
+        const f_cell_t *cell = (const f_cell_t *)vector_at(ins_row->cells, i);
+        if (FT_IS_ERROR(vector_insert(cur_row->cells, cell, pos + i))) {
             /* clean up what we have inserted */
             while (i--) {
                 vector_erase(cur_row->cells, pos);
@@ -5538,50 +9211,91 @@ f_status insert_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
     return FT_SUCCESS;
 }
 
+/*
+ * Returns span map of the row building it if needed (or NULL if there is no
+ * memory for it).
+ */
+static
+const struct f_span_map *row_span_map(const f_row_t *row)
+{
+    if (row->span_map)
+        return row->span_map;
+
+    /* Map is a part of the row, so it is cached in const rows */
+    f_row_t *mut_row = (f_row_t *)row;
+    size_t cols = columns_in_row(row);
+    size_t i = 0;
+    size_t map_cols = 0;
+    for (i = 0; i < cols; ++i) {
+        const f_cell_t *cell = get_cell_c(row, i);
+        if (cell && get_cell_type(cell) != COMMON_CELL)
+            map_cols = i + 1;
+    }
+
+    if (map_cols == 0) {
+        mut_row->span_map = &empty_span_map;
+        return mut_row->span_map;
+    }
+
+    struct f_span_map *map = (struct f_span_map *)F_MALLOC(sizeof(struct f_span_map)
+                             + map_cols * (sizeof(size_t) + 1));
+    if (map == NULL)
+        return NULL;
+    map->cols = map_cols;
+    map->spans = (size_t *)(map + 1);
+    map->types = (unsigned char *)(map->spans + map_cols);
+    for (i = 0; i < map_cols; ++i) {
+        const f_cell_t *cell = get_cell_c(row, i);
+        map->types[i] = (unsigned char)(cell ? get_cell_type(cell) : COMMON_CELL);
+    }
+
+    /* Group of master cell consists of it and the following slave cells */
+    size_t following_slaves = 0;
+    for (i = map_cols; i-- > 0;) {
+        map->spans[i] = (map->types[i] == GROUP_MASTER_CELL) ? following_slaves + 1 : 1;
+        following_slaves = (map->types[i] == GROUP_SLAVE_CELL) ? following_slaves + 1 : 0;
+    }
+
+    mut_row->span_map = map;
+    return map;
+}
+
+static
+enum f_cell_type row_cell_type(const f_row_t *row, size_t col)
+{
+    const struct f_span_map *map = row_span_map(row);
+    if (map == NULL) {
+        const f_cell_t *cell = get_cell_c(row, col);
+        return cell ? get_cell_type(cell) : COMMON_CELL;
+    }
+    return col < map->cols ? (enum f_cell_type)map->types[col] : COMMON_CELL;
+}
 
 FT_INTERNAL
 size_t group_cell_number(const f_row_t *row, size_t master_cell_col)
 {
     assert(row);
-    const f_cell_t *master_cell = get_cell_c(row, master_cell_col);
-    if (master_cell == NULL)
+    if (master_cell_col >= columns_in_row(row))
         return 0;
 
-    if (get_cell_type(master_cell) != GROUP_MASTER_CELL)
+    const struct f_span_map *map = row_span_map(row);
+    if (map)
+        return master_cell_col < map->cols ? map->spans[master_cell_col] : 1;
+
+    /* Fallback if the map can't be built */
+    if (get_cell_type(get_cell_c(row, master_cell_col)) != GROUP_MASTER_CELL)
         return 1;
 
-    size_t total_cols = vector_size(row->cells);
+    size_t total_cols = columns_in_row(row);
     size_t slave_col = master_cell_col + 1;
-    while (slave_col < total_cols) {
-        const f_cell_t *cell = get_cell_c(row, slave_col);
-        if (cell && get_cell_type(cell) == GROUP_SLAVE_CELL) {
-            ++slave_col;
-        } else {
-            break;
-        }
+    while (slave_col < total_cols
+           && get_cell_type(get_cell_c(row, slave_col)) == GROUP_SLAVE_CELL) {
+        ++slave_col;
     }
     return slave_col - master_cell_col;
 }
 
 
-FT_INTERNAL
-int get_row_cell_types(const f_row_t *row, enum f_cell_type *types, size_t types_sz)
-{
-    assert(row);
-    assert(types);
-    size_t i = 0;
-    for (i = 0; i < types_sz; ++i) {
-        const f_cell_t *cell = get_cell_c(row, i);
-        if (cell) {
-            types[i] = get_cell_type(cell);
-        } else {
-            types[i] = COMMON_CELL;
-        }
-    }
-    return FT_SUCCESS;
-}
-
-
 FT_INTERNAL
 f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span)
 {
@@ -5590,6 +9304,7 @@ f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span)
     if (hor_span < 2)
         return FT_EINVAL;
 
+    invalidate_span_map(row);
     f_cell_t *main_cell = get_cell_and_create_if_not_exists(row, cell_column);
     if (main_cell == NULL) {
         return FT_GEN_ERROR;
@@ -5612,43 +9327,17 @@ f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span)
 }
 
 static
-int print_row_separator_impl(f_conv_context_t *cntx,
-                             const size_t *col_width_arr, size_t cols,
-                             const f_row_t *upper_row, const f_row_t *lower_row,
-                             enum f_hor_separator_pos separatorPos,
-                             const f_separator_t *sep)
-{
-    assert(cntx);
-
-    int status = FT_GEN_ERROR;
-
-    const f_context_t *context = cntx->cntx;
-
-    /* Get cell types
-     *
-     * Regions above top row and below bottom row areconsidered full of virtual
-     * GROUP_SLAVE_CELL cells
-     */
-    enum f_cell_type *top_row_types = (enum f_cell_type *)F_MALLOC(sizeof(enum f_cell_type) * cols * 2);
-    if (top_row_types == NULL) {
-        return FT_MEMORY_ERROR;
-    }
-    enum f_cell_type *bottom_row_types = top_row_types + cols;
-    if (upper_row) {
-        get_row_cell_types(upper_row, top_row_types, cols);
-    } else {
-        size_t i = 0;
-        for (i = 0; i < cols; ++i)
-            top_row_types[i] = GROUP_SLAVE_CELL;
-    }
-    if (lower_row) {
-        get_row_cell_types(lower_row, bottom_row_types, cols);
-    } else {
-        size_t i = 0;
-        for (i = 0; i < cols; ++i)
-            bottom_row_types[i] = GROUP_SLAVE_CELL;
-    }
+int print_row_separator_impl(f_conv_context_t *cntx,
+                             const size_t *col_width_arr, size_t cols,
+                             const f_row_t *upper_row, const f_row_t *lower_row,
+                             enum f_hor_separator_pos separatorPos,
+                             const f_separator_t *sep)
+{
+    assert(cntx);
+
+    int status = FT_GEN_ERROR;
 
+    const f_context_t *context = cntx->cntx;
 
     f_table_properties_t *properties = context->table_properties;
     fort_entire_table_properties_t *entire_tprops = &properties->entire_table_properties;
@@ -5671,71 +9360,68 @@ int print_row_separator_impl(f_conv_context_t *cntx,
      *  L  I  I  I   IV  I   I   IT  I  I  I  IB    I    I     II    I    I     R
      *  |      C21    |   C22     |   C23             C24           C25         |
     */
-    const char **L = NULL;
-    const char **I = NULL;
-    const char **IV = NULL;
-    const char **R = NULL;
-    const char **IT = NULL;
-    const char **IB = NULL;
-    const char **II = NULL;
-
-    struct fort_border_style *border_style = &properties->border_style;
-
-    typedef const char *(*border_chars_point_t)[BORDER_ITEM_POS_SIZE];
-    const char *(*border_chars)[BORDER_ITEM_POS_SIZE] = NULL;
-    border_chars = (border_chars_point_t)&border_style->border_chars;
+    const f_glyph_t *L = NULL;
+    const f_glyph_t *I = NULL;
+    const f_glyph_t *IV = NULL;
+    const f_glyph_t *R = NULL;
+    const f_glyph_t *IT = NULL;
+    const f_glyph_t *IB = NULL;
+    const f_glyph_t *II = NULL;
+
+    const struct f_border_glyphs *glyphs = border_glyphs(properties);
+    const f_glyph_t *border = glyphs->border;
     if (upper_row_type == FT_ROW_HEADER || lower_row_type == FT_ROW_HEADER) {
-        border_chars = (border_chars_point_t)&border_style->header_border_chars;
+        border = glyphs->header_border;
     }
 
     if (sep && sep->enabled) {
-        L = &(border_style->separator_chars[LH_sip]);
-        I = &(border_style->separator_chars[IH_sip]);
-        IV = &(border_style->separator_chars[II_sip]);
-        R = &(border_style->separator_chars[RH_sip]);
+        L = &glyphs->separator[LH_sip];
+        I = &glyphs->separator[IH_sip];
+        IV = &glyphs->separator[II_sip];
+        R = &glyphs->separator[RH_sip];
 
-        IT = &(border_style->separator_chars[TI_sip]);
-        IB = &(border_style->separator_chars[BI_sip]);
-        II = &(border_style->separator_chars[IH_sip]);
+        IT = &glyphs->separator[TI_sip];
+        IB = &glyphs->separator[BI_sip];
+        II = &glyphs->separator[IH_sip];
 
         if (lower_row == NULL) {
-            L = &(*border_chars)[BL_bip];
-            R = &(*border_chars)[BR_bip];
+            L = &border[BL_bip];
+            R = &border[BR_bip];
         } else if (upper_row == NULL) {
-            L = &(*border_chars)[TL_bip];
-            R = &(*border_chars)[TR_bip];
+            L = &border[TL_bip];
+            R = &border[TR_bip];
         }
     } else {
         switch (separatorPos) {
             case TOP_SEPARATOR:
-                L = &(*border_chars)[TL_bip];
-                I = &(*border_chars)[TT_bip];
-                IV = &(*border_chars)[TV_bip];
-                R = &(*border_chars)[TR_bip];
-
-                IT = &(*border_chars)[TV_bip];
-                IB = &(*border_chars)[TV_bip];
-                II = &(*border_chars)[TT_bip];
+                L = &border[TL_bip];
+                I = &border[TT_bip];
+                IV = &border[TV_bip];
+                R = &border[TR_bip];
+
+                IT = &border[TV_bip];
+                IB = &border[TV_bip];
+                II = &border[TT_bip];
                 break;
             case INSIDE_SEPARATOR:
-                L = &(*border_chars)[LH_bip];
-                I = &(*border_chars)[IH_bip];
-                IV = &(*border_chars)[II_bip];
-                R = &(*border_chars)[RH_bip];
-
-                IT = &(*border_chars)[TI_bip];
-                IB = &(*border_chars)[BI_bip];
-                II = &(*border_chars)[IH_bip];
+                L = &border[LH_bip];
+                I = &border[IH_bip];
+                IV = &border[II_bip];
+                R = &border[RH_bip];
+
+                IT = &border[TI_bip];
+                IB = &border[BI_bip];
+                II = &border[IH_bip];
                 break;
             case BOTTOM_SEPARATOR:
-                L = &(*border_chars)[BL_bip];
-                I = &(*border_chars)[BB_bip];
-                IV = &(*border_chars)[BV_bip];
-                R = &(*border_chars)[BR_bip];
-
-                IT = &(*border_chars)[BV_bip];
-                IB = &(*border_chars)[BV_bip];
-                II = &(*border_chars)[BB_bip];
+                L = &border[BL_bip];
+                I = &border[BB_bip];
+                IV = &border[BV_bip];
+                R = &border[BR_bip];
+
+                IT = &border[BV_bip];
+                IB = &border[BV_bip];
+                II = &border[BB_bip];
                 break;
             default:
                 break;
@@ -5749,45 +9435,48 @@ int print_row_separator_impl(f_conv_context_t *cntx,
      * unsigned char according to
      * https://en.cppreference.com/w/c/string/byte/isprint
      */
-    if ((strlen(*L) == 0 || (strlen(*L) == 1 && !isprint((unsigned char) **L)))
-        && (strlen(*I) == 0 || (strlen(*I) == 1 && !isprint((unsigned char) **I)))
-        && (strlen(*IV) == 0 || (strlen(*IV) == 1 && !isprint((unsigned char) **IV)))
-        && (strlen(*R) == 0 || (strlen(*R) == 1 && !isprint((unsigned char) **R)))) {
+#define NOT_PRINTABLE(glyph) ((glyph)->len == 0 || ((glyph)->len == 1 && !isprint((unsigned char) *(glyph)->str)))
+    if (NOT_PRINTABLE(L) && NOT_PRINTABLE(I) && NOT_PRINTABLE(IV) && NOT_PRINTABLE(R)) {
         status = 0;
         goto clear;
     }
+#undef NOT_PRINTABLE
 
     /* Print left margin */
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->left_margin, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->left_margin));
 
     for (i = 0; i < cols; ++i) {
         if (i == 0) {
-            CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *L));
+            CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, L));
         } else {
-            if ((top_row_types[i] == COMMON_CELL || top_row_types[i] == GROUP_MASTER_CELL)
-                && (bottom_row_types[i] == COMMON_CELL || bottom_row_types[i] == GROUP_MASTER_CELL)) {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IV));
-            } else if (top_row_types[i] == GROUP_SLAVE_CELL && bottom_row_types[i] == GROUP_SLAVE_CELL) {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *II));
-            } else if (top_row_types[i] == GROUP_SLAVE_CELL) {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IT));
+            /*
+             * Regions above top row and below bottom row are considered full
+             * of virtual GROUP_SLAVE_CELL cells
+             */
+            int top_slave = upper_row ? row_cell_type(upper_row, i) == GROUP_SLAVE_CELL : 1;
+            int bottom_slave = lower_row ? row_cell_type(lower_row, i) == GROUP_SLAVE_CELL : 1;
+            if (!top_slave && !bottom_slave) {
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IV));
+            } else if (top_slave && bottom_slave) {
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, II));
+            } else if (top_slave) {
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IT));
             } else {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IB));
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IB));
             }
         }
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, col_width_arr[i], *I));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, col_width_arr[i], I));
     }
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *R));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, R));
 
     /* Print right margin */
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->right_margin, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->right_margin));
 
     CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, FT_NEWLINE));
 
     status = (int)written;
 
 clear:
-    F_FREE(top_row_types);
     return status;
 }
 
@@ -5801,13 +9490,14 @@ int print_row_separator(f_conv_context_t *cntx,
                                     separatorPos, sep);
 }
 
-FT_INTERNAL
-f_row_t *create_row_from_string(const char *str)
+/* Creates row of char or utf-8 cells (depending on fill_cell_from_string_) */
+static
+f_row_t *create_row_from_char_string(const char *str,
+                                     f_status(*fill_cell_from_string_)(f_cell_t *cell, const char *str))
 {
     typedef char char_type;
     char_type *(*strdup_)(const char_type * str) = F_STRDUP;
     const char_type zero_char = '\0';
-    f_status(*fill_cell_from_string_)(f_cell_t *cell, const char *str) = fill_cell_from_string;
     const char_type *const zero_string = "";
 #define STRCHR strchr
 
@@ -5837,19 +9527,18 @@ f_row_t *create_row_from_string(const char *str)
             number_of_separators++;
         }
 
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, base_pos);
+        int status = fill_cell_from_string_(&cell, base_pos);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
@@ -5860,19 +9549,18 @@ f_row_t *create_row_from_string(const char *str)
 
     /* special case if in format string last cell is empty */
     while (vector_size(row->cells) < (number_of_separators + 1)) {
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, zero_string);
+        int status = fill_cell_from_string_(&cell, zero_string);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
     }
@@ -5888,6 +9576,20 @@ clear:
 #undef STRCHR
 }
 
+FT_INTERNAL
+f_row_t *create_row_from_string(const char *str)
+{
+    return create_row_from_char_string(str, fill_cell_from_string);
+}
+
+#ifdef FT_HAVE_UTF8
+static
+f_status fill_cell_from_u8chars(f_cell_t *cell, const char *str)
+{
+    return fill_cell_from_u8string(cell, str);
+}
+#endif /* FT_HAVE_UTF8 */
+
 
 #ifdef FT_HAVE_WCHAR
 FT_INTERNAL
@@ -5926,19 +9628,18 @@ f_row_t *create_row_from_wstring(const wchar_t *str)
             number_of_separators++;
         }
 
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, base_pos);
+        int status = fill_cell_from_string_(&cell, base_pos);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
@@ -5949,19 +9650,18 @@ f_row_t *create_row_from_wstring(const wchar_t *str)
 
     /* special case if in format string last cell is empty */
     while (vector_size(row->cells) < (number_of_separators + 1)) {
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, zero_string);
+        int status = fill_cell_from_string_(&cell, zero_string);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
     }
@@ -5989,7 +9689,7 @@ f_row_t *create_row_from_buffer(const f_string_buffer_t *buffer)
 #endif /* FT_HAVE_WCHAR */
 #ifdef FT_HAVE_UTF8
         case UTF8_BUF:
-            return create_row_from_string((const char *)buffer->str.u8str);
+            return create_row_from_char_string((const char *)buffer->str.u8str, fill_cell_from_u8chars);
 #endif /* FT_HAVE_UTF8 */
         default:
             assert(0);
@@ -6107,7 +9807,7 @@ clear:
 
 
 FT_INTERNAL
-int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_arr, size_t col_width_arr_sz,
+int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, const size_t *col_width_arr, size_t col_width_arr_sz,
                  size_t row_height)
 {
     const f_context_t *context = cntx->cntx;
@@ -6126,14 +9826,12 @@ int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_a
      */
     f_table_properties_t *properties = context->table_properties;
 
-    typedef const char *(*border_chars_point_t)[BORDER_ITEM_POS_SIZE];
     enum ft_row_type row_type = (enum ft_row_type)get_cell_property_hierarchically(properties, context->row, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE);
-    const char *(*bord_chars)[BORDER_ITEM_POS_SIZE] = (row_type == FT_ROW_HEADER)
-            ? (border_chars_point_t)(&properties->border_style.header_border_chars)
-            : (border_chars_point_t)(&properties->border_style.border_chars);
-    const char **L = &(*bord_chars)[LL_bip];
-    const char **IV = &(*bord_chars)[IV_bip];
-    const char **R = &(*bord_chars)[RR_bip];
+    const struct f_border_glyphs *glyphs = border_glyphs(properties);
+    const f_glyph_t *border = (row_type == FT_ROW_HEADER) ? glyphs->header_border : glyphs->border;
+    const f_glyph_t *L = &border[LL_bip];
+    const f_glyph_t *IV = &border[IV_bip];
+    const f_glyph_t *R = &border[RR_bip];
 
 
     size_t written = 0;
@@ -6142,15 +9840,15 @@ int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_a
     fort_entire_table_properties_t *entire_tprops = &context->table_properties->entire_table_properties;
     for (i = 0; i < row_height; ++i) {
         /* Print left margin */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->left_margin, FT_SPACE));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->left_margin));
 
         /* Print left table boundary */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *L));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, L));
         size_t j = 0;
         while (j < col_width_arr_sz) {
             if (j < cols_in_row) {
                 ((f_context_t *)context)->column = j;
-                f_cell_t *cell = VECTOR_AT(row->cells, j, f_cell_t *);
+                f_cell_t *cell = (f_cell_t *)get_cell_c(row, j);
                 size_t cell_vis_width = 0;
 
                 size_t group_slave_sz = group_cell_number(row, j);
@@ -6165,21 +9863,21 @@ int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_a
                 CHCK_RSLT_ADD_TO_WRITTEN(cell_printf(cell, i, cntx, cell_vis_width));
             } else {
                 /* Print empty cell */
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, col_width_arr[j], FT_SPACE));
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, col_width_arr[j]));
             }
 
             /* Print boundary between cells */
             if (j < col_width_arr_sz - 1)
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IV));
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IV));
 
             ++j;
         }
 
         /* Print right table boundary */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *R));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, R));
 
         /* Print right margin */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->right_margin, FT_SPACE));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->right_margin));
 
         /* Print new line character */
         CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, FT_NEWLINE));
@@ -6204,6 +9902,7 @@ clear:
 /* #include "wcwidth.h" */ /* Commented by amalgamation script */
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #ifdef FT_HAVE_WCHAR
 #include <wchar.h>
 #endif
@@ -6227,28 +9926,8 @@ static ptrdiff_t wcs_iter_width(const wchar_t *beg, const wchar_t *end)
 #endif /* FT_HAVE_WCHAR */
 
 
-static size_t buf_str_len(const f_string_buffer_t *buf)
-{
-    assert(buf);
-
-    switch (buf->type) {
-        case CHAR_BUF:
-            return strlen(buf->str.cstr);
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            return wcslen(buf->str.wstr);
-#endif
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            return utf8len(buf->str.u8str);
-#endif
-    }
-
-    assert(0);
-    return 0;
-}
-
-
+/* Lines of buffers are located with f_line_index, these are used by tests */
+#ifdef FT_TEST_BUILD
 FT_INTERNAL
 size_t strchr_count(const char *str, char ch)
 {
@@ -6444,8 +10123,43 @@ void utf8_n_substring(const void *str, utf8_int32_t ch_separator, size_t n, cons
     return;
 }
 #endif /* FT_HAVE_UTF8 */
+#endif /* FT_TEST_BUILD */
+
 
+/* Content of empty buffers (buffers created with zero size borrow it) */
+static const char empty_str[] = "";
+#ifdef FT_HAVE_WCHAR
+static const wchar_t empty_wstr[] = L"";
+#endif
+
+FT_INTERNAL
+void init_string_buffer(f_string_buffer_t *buffer, enum f_string_type type)
+{
+    assert(buffer);
+    buffer->str.cstr = (char *)empty_str;
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        buffer->str.wstr = (wchar_t *)empty_wstr;
+#endif
+    buffer->mem.data_sz = 0;
+    buffer->type = type;
+    buffer->ownership = F_BUF_BORROWED;
+    buffer->free_fn = NULL;
+    buffer->metrics.valid = 0;
+    buffer->metrics.line_index = NULL;
+    buffer->metrics.shared_line_index = 0;
+}
 
+FT_INTERNAL
+int buffer_is_unwritten(const f_string_buffer_t *buffer)
+{
+    assert(buffer);
+#ifdef FT_HAVE_WCHAR
+    if (buffer->str.wstr == empty_wstr)
+        return 1;
+#endif
+    return buffer->str.data == NULL || buffer->str.cstr == empty_str;
+}
 
 FT_INTERNAL
 f_string_buffer_t *create_string_buffer(size_t n_chars, enum f_string_type type)
@@ -6471,13 +10185,22 @@ f_string_buffer_t *create_string_buffer(size_t n_chars, enum f_string_type type)
     f_string_buffer_t *result = (f_string_buffer_t *)F_MALLOC(sizeof(f_string_buffer_t));
     if (result == NULL)
         return NULL;
+    if (sz == 0) {
+        init_string_buffer(result, type);
+        return result;
+    }
     result->str.data = F_MALLOC(sz);
     if (result->str.data == NULL) {
         F_FREE(result);
         return NULL;
     }
-    result->data_sz = sz;
+    result->mem.data_sz = sz;
     result->type = type;
+    result->ownership = F_BUF_OWNED;
+    result->free_fn = NULL;
+    result->metrics.valid = 0;
+    result->metrics.line_index = NULL;
+    result->metrics.shared_line_index = 0;
 
     if (sz) {
         switch (type) {
@@ -6501,56 +10224,295 @@ f_string_buffer_t *create_string_buffer(size_t n_chars, enum f_string_type type)
 }
 
 
+#define WORD_ONES  ((uint64_t)0x0101010101010101ULL)
+#define WORD_HIGHS ((uint64_t)0x8080808080808080ULL)
+
+/*
+ * Checks 8 chars at once that all of them are printable ASCII chars
+ * (0x20 - 0x7E). '\n' and '\0' are not printable, so words with them are
+ * rejected as well.
+ */
+static
+int word_is_printable_ascii(uint64_t word)
+{
+    uint64_t less_than_space = (word - WORD_ONES * 0x20) & ~word & WORD_HIGHS;
+    uint64_t greater_than_tilde = ((word + WORD_ONES * 0x01) | word) & WORD_HIGHS;
+    return (less_than_space | greater_than_tilde) == 0;
+}
+
+/*
+ * Scans at most `len` chars of the string (till the null char) and
+ * optionally copies them to `dst`. Runs of printable ASCII chars are
+ * processed by words.
+ */
+static
+void scan_str(const char *str, size_t len, char *dst, struct f_text_metrics *metrics)
+{
+    size_t i = 0;
+    size_t line_len = 0;
+    int printable_ascii = 1;
+    metrics->lines = 0;
+    metrics->max_line_len = 0;
+    if (len == SIZE_MAX)
+        len = strlen(str);
+    while (i < len) {
+        uint64_t word;
+        if (len - i >= sizeof(word)) {
+            memcpy(&word, str + i, sizeof(word));
+            if (word_is_printable_ascii(word)) {
+                if (dst)
+                    memcpy(dst + i, &word, sizeof(word));
+                i += sizeof(word);
+                line_len += sizeof(word);
+                continue;
+            }
+        }
+
+        char ch = str[i];
+        if (ch == '\0')
+            break;
+        if (dst)
+            dst[i] = ch;
+        ++i;
+        if (ch == '\n') {
+            metrics->lines++;
+            metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+            line_len = 0;
+            continue;
+        }
+        if (ch < 0x20 || ch > 0x7e)
+            printable_ascii = 0;
+        line_len++;
+    }
+    if (dst)
+        dst[i] = '\0';
+    metrics->len = i;
+    metrics->lines = (i == 0) ? 0 : metrics->lines + 1;
+    metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+    metrics->width = metrics->max_line_len;
+    metrics->printable_ascii = printable_ascii;
+    metrics->utf8_errors = 0;
+    metrics->valid = 1;
+}
+
+#ifdef FT_HAVE_UTF8
+/*
+ * The same as scan_str but also validates utf-8 content and computes its
+ * visible width (width of content with ill-formed sequences is left unknown).
+ */
+static
+void scan_u8str(const char *str, size_t len, char *dst, struct f_text_metrics *metrics)
+{
+    size_t i = 0;
+    size_t line_len = 0;
+    size_t line_width = 0;
+    size_t max_width = 0;
+    int printable_ascii = 1;
+    int utf8_errors = 0;
+    metrics->lines = 0;
+    metrics->max_line_len = 0;
+    if (len == SIZE_MAX)
+        len = strlen(str);
+    while (i < len) {
+        uint64_t word;
+        if (len - i >= sizeof(word)) {
+            memcpy(&word, str + i, sizeof(word));
+            if (word_is_printable_ascii(word)) {
+                if (dst)
+                    memcpy(dst + i, &word, sizeof(word));
+                i += sizeof(word);
+                line_len += sizeof(word);
+                line_width += sizeof(word);
+                continue;
+            }
+        }
+
+        unsigned char ch = (unsigned char)str[i];
+        if (ch == '\0')
+            break;
+        if (ch == '\n') {
+            if (dst)
+                dst[i] = '\n';
+            ++i;
+            metrics->lines++;
+            metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+            max_width = MAX(max_width, line_width);
+            line_len = 0;
+            line_width = 0;
+            continue;
+        }
+        if (ch < 0x80) {
+            if (dst)
+                dst[i] = (char)ch;
+            ++i;
+            if (ch < 0x20 || ch > 0x7e)
+                printable_ascii = 0;
+            line_len++;
+            line_width++;
+            continue;
+        }
+
+        uint32_t c = 0;
+        size_t n = utf8_decode((const unsigned char *)str + i, len - i, &c);
+        printable_ascii = 0;
+        if (n == 0) {
+            utf8_errors = 1;
+            n = 1;
+        } else {
+            line_width += utf8_codepoint_width(c);
+        }
+        if (dst)
+            memcpy(dst + i, str + i, n);
+        i += n;
+        line_len += n;
+    }
+    if (dst)
+        dst[i] = '\0';
+    metrics->len = i;
+    metrics->lines = (i == 0) ? 0 : metrics->lines + 1;
+    metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+    metrics->width = utf8_errors ? SIZE_MAX : MAX(max_width, line_width);
+    metrics->printable_ascii = printable_ascii;
+    metrics->utf8_errors = utf8_errors;
+    metrics->valid = 1;
+}
+#endif /* FT_HAVE_UTF8 */
+
+#ifdef FT_HAVE_WCHAR
+static
+void scan_wstr(const wchar_t *str, size_t len, wchar_t *dst, struct f_text_metrics *metrics)
+{
+    size_t i = 0;
+    size_t line_len = 0;
+    int printable_ascii = 1;
+    metrics->lines = 0;
+    metrics->max_line_len = 0;
+    for (i = 0; i < len && str[i] != L'\0'; ++i) {
+        wchar_t ch = str[i];
+        if (dst)
+            dst[i] = ch;
+        if (ch == L'\n') {
+            metrics->lines++;
+            metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+            line_len = 0;
+            continue;
+        }
+        if (ch < 0x20 || ch > 0x7e)
+            printable_ascii = 0;
+        line_len++;
+    }
+    if (dst)
+        dst[i] = L'\0';
+    metrics->len = i;
+    metrics->lines = (i == 0) ? 0 : metrics->lines + 1;
+    metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+    metrics->width = printable_ascii ? metrics->max_line_len : SIZE_MAX;
+    metrics->printable_ascii = printable_ascii;
+    metrics->utf8_errors = 0;
+    metrics->valid = 1;
+}
+#endif /* FT_HAVE_WCHAR */
+
+static
+void drop_line_index(struct f_text_metrics *metrics)
+{
+    /* Index of interned content is released with the table */
+    if (!metrics->shared_line_index)
+        F_FREE(metrics->line_index);
+    metrics->line_index = NULL;
+    metrics->shared_line_index = 0;
+}
+
+static
+const struct f_text_metrics *buffer_metrics(const f_string_buffer_t *buffer)
+{
+    /* Metrics are a cache of the content, so they are updated in const buffers */
+    struct f_text_metrics *metrics = (struct f_text_metrics *)&buffer->metrics;
+    if (metrics->valid && metrics->data == buffer->str.data && metrics->type == buffer->type)
+        return metrics;
+
+    drop_line_index(metrics);
+    switch (buffer->type) {
+        case CHAR_BUF:
+            scan_str(buffer->str.cstr, SIZE_MAX, NULL, metrics);
+            break;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            scan_wstr(buffer->str.wstr, SIZE_MAX, NULL, metrics);
+            break;
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            scan_u8str((const char *)buffer->str.u8str, SIZE_MAX, NULL, metrics);
+            break;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+    }
+    metrics->data = buffer->str.data;
+    metrics->type = buffer->type;
+    return metrics;
+}
+
+FT_INTERNAL
+void release_buffer_data(f_string_buffer_t *buffer)
+{
+    switch (buffer->ownership) {
+        case F_BUF_OWNED:
+            F_FREE(buffer->str.data);
+            break;
+        case F_BUF_ADOPTED:
+            buffer->free_fn(buffer->mem.owner);
+            break;
+        case F_BUF_BORROWED:
+            break;
+    }
+    buffer->str.data = NULL;
+    buffer->ownership = F_BUF_OWNED;
+    buffer->free_fn = NULL;
+    buffer->metrics.valid = 0;
+    drop_line_index(&buffer->metrics);
+}
+
 FT_INTERNAL
 void destroy_string_buffer(f_string_buffer_t *buffer)
 {
     if (buffer == NULL)
         return;
-    F_FREE(buffer->str.data);
-    buffer->str.data = NULL;
+    release_buffer_data(buffer);
     F_FREE(buffer);
 }
 
 FT_INTERNAL
-f_string_buffer_t *copy_string_buffer(const f_string_buffer_t *buffer)
+f_status copy_string_buffer(f_string_buffer_t *result, const f_string_buffer_t *buffer)
 {
+    assert(result);
     assert(buffer);
-    f_string_buffer_t *result = create_string_buffer(buffer->data_sz, buffer->type);
-    if (result == NULL)
-        return NULL;
+    init_string_buffer(result, buffer->type);
     switch (buffer->type) {
         case CHAR_BUF:
-            if (FT_IS_ERROR(fill_buffer_from_string(result, buffer->str.cstr))) {
-                destroy_string_buffer(result);
-                return NULL;
-            }
-            break;
+            return fill_buffer_from_string(result, buffer->str.cstr);
 #ifdef FT_HAVE_WCHAR
         case W_CHAR_BUF:
-            if (FT_IS_ERROR(fill_buffer_from_wstring(result, buffer->str.wstr))) {
-                destroy_string_buffer(result);
-                return NULL;
-            }
-            break;
+            return fill_buffer_from_wstring(result, buffer->str.wstr);
 #endif /* FT_HAVE_WCHAR */
         default:
-            destroy_string_buffer(result);
-            return NULL;
+            return FT_GEN_ERROR;
     }
-    return result;
 }
 
 FT_INTERNAL
 f_status realloc_string_buffer_without_copy(f_string_buffer_t *buffer)
 {
     assert(buffer);
-    char *new_str = (char *)F_MALLOC(buffer->data_sz * 2);
+    size_t new_sz = buffer->mem.data_sz ? buffer->mem.data_sz * 2 : DEFAULT_STR_BUF_SIZE;
+    char *new_str = (char *)F_MALLOC(new_sz);
     if (new_str == NULL) {
         return FT_MEMORY_ERROR;
     }
-    F_FREE(buffer->str.data);
+    release_buffer_data(buffer);
     buffer->str.data = new_str;
-    buffer->data_sz *= 2;
+    buffer->mem.data_sz = new_sz;
     return FT_SUCCESS;
 }
 
@@ -6561,15 +10523,11 @@ f_status fill_buffer_from_string(f_string_buffer_t *buffer, const char *str)
     assert(buffer);
     assert(str);
 
-    char *copy = F_STRDUP(str);
-    if (copy == NULL)
-        return FT_MEMORY_ERROR;
-
-    F_FREE(buffer->str.data);
-    buffer->str.cstr = copy;
-    buffer->type = CHAR_BUF;
-
-    return FT_SUCCESS;
+    /* Content is copied and scanned for metrics in one pass */
+    f_string_view_t view;
+    view.type = CHAR_BUF;
+    view.u.cstr = str;
+    return fill_buffer_from_string_len(buffer, &view, strlen(str));
 }
 
 
@@ -6580,33 +10538,197 @@ f_status fill_buffer_from_wstring(f_string_buffer_t *buffer, const wchar_t *str)
     assert(buffer);
     assert(str);
 
-    wchar_t *copy = F_WCSDUP(str);
+    /* Content is copied and scanned for metrics in one pass */
+    f_string_view_t view;
+    view.type = W_CHAR_BUF;
+    view.u.wstr = str;
+    return fill_buffer_from_string_len(buffer, &view, wcslen(str));
+}
+#endif /* FT_HAVE_WCHAR */
+
+#ifdef FT_HAVE_UTF8
+FT_INTERNAL
+f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str)
+{
+    assert(buffer);
+    assert(str);
+
+    /* Content is copied and scanned for metrics in one pass */
+    f_string_view_t view;
+    view.type = UTF8_BUF;
+    view.u.u8str = str;
+    return fill_buffer_from_string_len(buffer, &view, strlen((const char *)str));
+}
+#endif /* FT_HAVE_UTF8 */
+
+FT_INTERNAL
+f_status fill_buffer_from_string_len(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len)
+{
+    assert(buffer);
+    assert(str && str->u.data);
+
+    size_t char_sz = 1;
+#ifdef FT_HAVE_WCHAR
+    if (str->type == W_CHAR_BUF)
+        char_sz = sizeof(wchar_t);
+#endif /* FT_HAVE_WCHAR */
+    if (len >= SIZE_MAX / char_sz)
+        return FT_EINVAL;
+
+    void *copy = F_MALLOC((len + 1) * char_sz);
     if (copy == NULL)
         return FT_MEMORY_ERROR;
 
-    F_FREE(buffer->str.data);
-    buffer->str.wstr = copy;
-    buffer->type = W_CHAR_BUF;
+    release_buffer_data(buffer);
+    switch (str->type) {
+        case CHAR_BUF:
+            scan_str(str->u.cstr, len, (char *)copy, &buffer->metrics);
+            break;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            scan_wstr(str->u.wstr, len, (wchar_t *)copy, &buffer->metrics);
+            break;
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            scan_u8str((const char *)str->u.u8str, len, (char *)copy, &buffer->metrics);
+            break;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+    }
+    buffer->str.data = copy;
+    buffer->type = str->type;
+    buffer->metrics.data = copy;
+    buffer->metrics.type = str->type;
 
     return FT_SUCCESS;
 }
+
+FT_INTERNAL
+size_t fill_buffer_from_string_at(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len, void *dst)
+{
+    assert(buffer);
+    assert(str && str->u.data);
+    assert(dst);
+
+    release_buffer_data(buffer);
+    switch (str->type) {
+        case CHAR_BUF:
+            scan_str(str->u.cstr, len, (char *)dst, &buffer->metrics);
+            break;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            scan_wstr(str->u.wstr, len, (wchar_t *)dst, &buffer->metrics);
+            break;
 #endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            scan_u8str((const char *)str->u.u8str, len, (char *)dst, &buffer->metrics);
+            break;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+    }
+    buffer->str.data = dst;
+    buffer->type = str->type;
+    buffer->ownership = F_BUF_BORROWED;
+    buffer->metrics.data = dst;
+    buffer->metrics.type = str->type;
+    return buffer->metrics.len;
+}
+
+FT_INTERNAL
+void fill_buffer_from_interned(f_string_buffer_t *buffer, const void *data, const struct f_text_metrics *metrics)
+{
+    assert(buffer);
+    assert(data && metrics && metrics->data == data);
+
+    release_buffer_data(buffer);
+    buffer->str.data = (void *)data;
+    buffer->type = metrics->type;
+    buffer->ownership = F_BUF_BORROWED;
+    buffer->metrics = *metrics;
+    buffer->metrics.shared_line_index = 1;
+}
+
+FT_INTERNAL
+void fill_buffer_from_external(f_string_buffer_t *buffer, const f_string_view_t *str,
+                               void (*free_fn)(void *ptr), void *owner)
+{
+    assert(buffer);
+    assert(str && str->u.data);
+
+    release_buffer_data(buffer);
+    buffer->str.data = (void *)str->u.data;
+    buffer->type = str->type;
+    buffer->ownership = free_fn ? F_BUF_ADOPTED : F_BUF_BORROWED;
+    buffer->free_fn = free_fn;
+    buffer->mem.owner = owner ? owner : (void *)str->u.data;
+}
+
+FT_INTERNAL
+void fill_buffer_from_allocated(f_string_buffer_t *buffer, void *data, enum f_string_type type)
+{
+    assert(buffer);
+    assert(data);
+
+    release_buffer_data(buffer);
+    buffer->str.data = data;
+    buffer->type = type;
+}
 
 #ifdef FT_HAVE_UTF8
 FT_INTERNAL
-f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str)
+f_status buffer_check_utf8(f_string_buffer_t *buffer, enum ft_invalid_utf8_handling handling)
 {
     assert(buffer);
-    assert(str);
+    if (buffer->type != UTF8_BUF || handling == FT_INVALID_UTF8_KEEP)
+        return FT_SUCCESS;
 
-    void *copy = F_UTF8DUP(str);
-    if (copy == NULL)
+    const struct f_text_metrics *metrics = buffer_metrics(buffer);
+    if (!metrics->utf8_errors)
+        return FT_SUCCESS;
+
+    if (handling == FT_INVALID_UTF8_REJECT) {
+        /* Ownership of rejected external content stays with the caller */
+        if (buffer->ownership == F_BUF_ADOPTED)
+            buffer->ownership = F_BUF_BORROWED;
+        release_buffer_data(buffer);
+        init_string_buffer(buffer, UTF8_BUF);
+        return FT_EINVAL;
+    }
+
+    /* Each byte of ill-formed sequences is replaced with 3 bytes of U+FFFD */
+    size_t len = metrics->len;
+    if (len >= SIZE_MAX / 3)
         return FT_MEMORY_ERROR;
+    char *result = (char *)F_MALLOC(len * 3 + 1);
+    if (result == NULL)
+        return FT_MEMORY_ERROR;
+
+    const unsigned char *str = (const unsigned char *)buffer->str.u8str;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < len) {
+        uint32_t c = 0;
+        size_t n = (str[i] < 0x80) ? 1 : utf8_decode(str + i, len - i, &c);
+        if (n == 0) {
+            memcpy(result + j, "\xef\xbf\xbd", 3);
+            j += 3;
+            i += 1;
+            continue;
+        }
+        memcpy(result + j, str + i, n);
+        i += n;
+        j += n;
+    }
+    result[j] = '\0';
 
-    F_FREE(buffer->str.u8str);
-    buffer->str.u8str = copy;
+    release_buffer_data(buffer);
+    buffer->str.u8str = result;
     buffer->type = UTF8_BUF;
-
+    buffer_metrics(buffer);
     return FT_SUCCESS;
 }
 #endif /* FT_HAVE_UTF8 */
@@ -6614,22 +10736,10 @@ f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str)
 FT_INTERNAL
 size_t buffer_text_visible_height(const f_string_buffer_t *buffer)
 {
-    if (buffer == NULL || buffer->str.data == NULL || buf_str_len(buffer) == 0) {
+    if (buffer == NULL || buffer->str.data == NULL) {
         return 0;
     }
-    if (buffer->type == CHAR_BUF)
-        return 1 + strchr_count(buffer->str.cstr, '\n');
-#ifdef FT_HAVE_WCHAR
-    else if (buffer->type == W_CHAR_BUF)
-        return 1 + wstrchr_count(buffer->str.wstr, L'\n');
-#endif /* FT_HAVE_WCHAR */
-#ifdef FT_HAVE_UTF8
-    else if (buffer->type == UTF8_BUF)
-        return 1 + utf8chr_count(buffer->str.u8str, '\n');
-#endif /* FT_HAVE_WCHAR */
-
-    assert(0);
-    return 0;
+    return buffer_metrics(buffer)->lines;
 }
 
 FT_INTERNAL
@@ -6641,7 +10751,7 @@ size_t string_buffer_cod_width_capacity(const f_string_buffer_t *buffer)
 FT_INTERNAL
 size_t string_buffer_raw_capacity(const f_string_buffer_t *buffer)
 {
-    return buffer->data_sz;
+    return buffer->mem.data_sz;
 }
 
 #ifdef FT_HAVE_UTF8
@@ -6663,94 +10773,134 @@ size_t utf8_width(const void *beg, const void *end)
             return width;
     }
 
-    size_t sz = (size_t)((const char *)end - (const char *)beg);
-    char *tmp = (char *)F_MALLOC(sizeof(char) * (sz + 1));
-    // @todo: add check to tmp
-    assert(tmp);
-
-    memcpy(tmp, beg, sz);
-    tmp[sz] = '\0';
-    size_t result = utf8width(tmp);
-    F_FREE(tmp);
-    return result;
+    return utf8_range_width(beg, end);
 }
 #endif /* FT_HAVE_WCHAR */
 
+/*
+ * Returns offset of the first newline in content of the buffer starting from
+ * `pos` (or `len` if there are no more newlines).
+ */
+static
+size_t next_newline(const f_string_buffer_t *buffer, size_t pos, size_t len)
+{
+    const void *nl = NULL;
+    switch (buffer->type) {
+        case CHAR_BUF:
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF: /* '\n' can't be a part of multibyte utf-8 sequences */
+#endif /* FT_HAVE_UTF8 */
+            nl = memchr(buffer->str.cstr + pos, '\n', len - pos);
+            return nl ? (size_t)((const char *)nl - buffer->str.cstr) : len;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            nl = wmemchr(buffer->str.wstr + pos, L'\n', len - pos);
+            return nl ? (size_t)((const wchar_t *)nl - buffer->str.wstr) : len;
+#endif /* FT_HAVE_WCHAR */
+        default:
+            assert(0);
+            return len;
+    }
+}
+
+/*
+ * Returns index of lines of the buffer content building it if necessary.
+ * Content of one line doesn't need the index, so NULL is returned for it
+ * (and if memory for the index can't be allocated).
+ */
 FT_INTERNAL
-size_t buffer_text_visible_width(const f_string_buffer_t *buffer)
+struct f_line_index *buffer_line_index(const f_string_buffer_t *buffer)
 {
-    size_t max_length = 0;
-    if (buffer->type == CHAR_BUF) {
-        size_t n = 0;
-        while (1) {
-            const char *beg = NULL;
-            const char *end = NULL;
-            str_n_substring(buffer->str.cstr, '\n', n, &beg, &end);
-            if (beg == NULL || end == NULL)
-                return max_length;
+    /* Index is a part of metrics, so it is built in const buffers */
+    struct f_text_metrics *metrics = (struct f_text_metrics *)buffer_metrics(buffer);
+    if (metrics->line_index || metrics->lines < 2)
+        return metrics->line_index;
 
-            max_length = MAX(max_length, (size_t)(end - beg));
-            ++n;
-        }
-#ifdef FT_HAVE_WCHAR
-    } else if (buffer->type == W_CHAR_BUF) {
-        size_t n = 0;
-        while (1) {
-            const wchar_t *beg = NULL;
-            const wchar_t *end = NULL;
-            wstr_n_substring(buffer->str.wstr, L'\n', n, &beg, &end);
-            if (beg == NULL || end == NULL)
-                return max_length;
+    struct f_line_index *index = (struct f_line_index *)F_MALLOC(
+                                     sizeof(struct f_line_index) + metrics->lines * sizeof(size_t));
+    if (index == NULL)
+        return NULL;
 
-            int line_width = mk_wcswidth(beg, (size_t)(end - beg));
-            if (line_width < 0) /* For safety */
-                line_width = 0;
-            max_length = MAX(max_length, (size_t)line_width);
+    size_t n = 0;
+    index->count = metrics->lines;
+    index->offsets[0] = 0;
+    for (n = 1; n < index->count; ++n)
+        index->offsets[n] = next_newline(buffer, index->offsets[n - 1], metrics->len) + 1;
+    index->offsets[index->count] = metrics->len + 1;
+    metrics->line_index = index;
+    return index;
+}
 
-            ++n;
-        }
-#endif /* FT_HAVE_WCHAR */
-#ifdef FT_HAVE_UTF8
-    } else if (buffer->type == UTF8_BUF) {
-        size_t n = 0;
-        while (1) {
-            const void *beg = NULL;
-            const void *end = NULL;
-            utf8_n_substring(buffer->str.u8str, '\n', n, &beg, &end);
-            if (beg == NULL || end == NULL)
-                return max_length;
+/*
+ * Computes range [beg, end) of code units of line `n` of the buffer content.
+ * Returns 0 if there is no such line.
+ */
+static
+int buffer_line_range(const f_string_buffer_t *buffer, size_t n, size_t *beg, size_t *end)
+{
+    const struct f_text_metrics *metrics = buffer_metrics(buffer);
+    if (n >= metrics->lines)
+        return 0;
 
-            max_length = MAX(max_length, (size_t)utf8_width(beg, end));
-            ++n;
-        }
-#endif /* FT_HAVE_WCHAR */
+    const struct f_line_index *index = buffer_line_index(buffer);
+    if (index) {
+        *beg = index->offsets[n];
+        *end = index->offsets[n + 1] - 1;
+        return 1;
     }
 
-    return max_length; /* shouldn't be here */
+    /* Content with one line or the index can't be allocated */
+    size_t pos = 0;
+    while (n--)
+        pos = next_newline(buffer, pos, metrics->len) + 1;
+    *beg = pos;
+    *end = next_newline(buffer, pos, metrics->len);
+    return 1;
 }
 
-
 static void
 buffer_substring(const f_string_buffer_t *buffer, size_t buffer_row, const void **begin, const void **end,  ptrdiff_t *str_it_width)
 {
+    size_t beg_off = 0;
+    size_t end_off = 0;
+    *begin = NULL;
+    *end = NULL;
+    if (!buffer_line_range(buffer, buffer_row, &beg_off, &end_off))
+        return;
+
+    const struct f_text_metrics *metrics = buffer_metrics(buffer);
+    int printable_ascii = metrics->printable_ascii;
+    (void)printable_ascii;  /* unused if wchar and utf-8 support is disabled */
     switch (buffer->type) {
         case CHAR_BUF:
-            str_n_substring(buffer->str.cstr, '\n', buffer_row, (const char **)begin, (const char **)end);
-            if ((*(const char **)begin) && (*(const char **)end))
-                *str_it_width = str_iter_width(*(const char **)begin, *(const char **)end);
+            *begin = buffer->str.cstr + beg_off;
+            *end = buffer->str.cstr + end_off;
+            *str_it_width = str_iter_width(*(const char **)begin, *(const char **)end);
             break;
 #ifdef FT_HAVE_WCHAR
         case W_CHAR_BUF:
-            wstr_n_substring(buffer->str.wstr, L'\n', buffer_row, (const wchar_t **)begin, (const wchar_t **)end);
-            if ((*(const wchar_t **)begin) && (*(const wchar_t **)end))
-                *str_it_width = wcs_iter_width(*(const wchar_t **)begin, *(const wchar_t **)end);
+            *begin = buffer->str.wstr + beg_off;
+            *end = buffer->str.wstr + end_off;
+            *str_it_width = printable_ascii
+                            ? (ptrdiff_t)(end_off - beg_off)
+                            : wcs_iter_width(*(const wchar_t **)begin, *(const wchar_t **)end);
             break;
 #endif /* FT_HAVE_WCHAR */
 #ifdef FT_HAVE_UTF8
         case UTF8_BUF:
-            utf8_n_substring(buffer->str.u8str, '\n', buffer_row, begin, end);
-            if ((*(const char **)begin) && (*(const char **)end))
-                *str_it_width = utf8_width(*begin, *end);
+            *begin = (const char *)buffer->str.u8str + beg_off;
+            *end = (const char *)buffer->str.u8str + end_off;
+            if (_custom_u8strwid) {
+                *str_it_width = (ptrdiff_t)utf8_width(*begin, *end);
+            } else if (printable_ascii) {
+                /* Each char of ASCII string is one byte wide */
+                *str_it_width = (ptrdiff_t)(end_off - beg_off);
+            } else if (metrics->lines == 1 && metrics->width != SIZE_MAX) {
+                /* Width of one line content is computed when it is written */
+                *str_it_width = (ptrdiff_t)metrics->width;
+            } else {
+                *str_it_width = (ptrdiff_t)utf8_width(*begin, *end);
+            }
             break;
 #endif /* FT_HAVE_UTF8 */
         default:
@@ -6758,28 +10908,69 @@ buffer_substring(const f_string_buffer_t *buffer, size_t buffer_row, const void
     }
 }
 
+/* Computes width of the widest line of the content */
+static
+size_t buffer_lines_width(const f_string_buffer_t *buffer)
+{
+    size_t max_length = 0;
+    size_t n = 0;
+    size_t lines = buffer_metrics(buffer)->lines;
+    for (n = 0; n < lines; ++n) {
+        const void *beg = NULL;
+        const void *end = NULL;
+        ptrdiff_t line_width = 0;
+        buffer_substring(buffer, n, &beg, &end, &line_width);
+        if (line_width < 0) /* For safety */
+            line_width = 0;
+        max_length = MAX(max_length, (size_t)line_width);
+    }
+    return max_length;
+}
+
+FT_INTERNAL
+size_t buffer_text_visible_width(const f_string_buffer_t *buffer)
+{
+    /* Width is a part of metrics, so it is cached in const buffers */
+    struct f_text_metrics *metrics = (struct f_text_metrics *)buffer_metrics(buffer);
+#ifdef FT_HAVE_UTF8
+    /* Custom width function may be changed later, so its results aren't cached */
+    if (buffer->type == UTF8_BUF && _custom_u8strwid)
+        return buffer_lines_width(buffer);
+#endif /* FT_HAVE_UTF8 */
 
-static int
-buffer_print_range(f_conv_context_t *cntx, const void *beg, const void *end)
+    /*
+     * Width of char and printable ASCII content (and of valid utf-8 content)
+     * is computed when metrics are, width of other content is computed once
+     * (it is requested for each printed line).
+     */
+    if (metrics->width == SIZE_MAX)
+        metrics->width = buffer_lines_width(buffer);
+    return metrics->width;
+}
+
+FT_INTERNAL
+size_t buffer_text_extra_code_units(const f_string_buffer_t *buffer)
 {
-    size_t len;
-    switch (cntx->b_type) {
-        case CHAR_BUF:
-            len = (size_t)((const char *)end - (const char *)beg);
-            return ft_nprint(cntx, (const char *)beg, len);
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            len = (size_t)((const wchar_t *)end - (const wchar_t *)beg);
-            return ft_nwprint(cntx, (const wchar_t *)beg, len);
-#endif /* FT_HAVE_WCHAR */
 #ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            return ft_nu8print(cntx, beg, end);
+    if (buffer->type == UTF8_BUF) {
+        const struct f_text_metrics *metrics = buffer_metrics(buffer);
+        return metrics->printable_ascii ? 0 : metrics->max_line_len;
+    }
 #endif /* FT_HAVE_UTF8 */
-        default:
-            assert(0);
-            return -1;
+#ifdef FT_HAVE_WCHAR
+    if (buffer->type == W_CHAR_BUF) {
+        const struct f_text_metrics *metrics = buffer_metrics(buffer);
+        if (metrics->printable_ascii)
+            return 0;
+        /* Widths of lines of multiline content are not known separately */
+        if (metrics->lines > 1)
+            return metrics->max_line_len;
+        size_t width = buffer_text_visible_width(buffer);
+        return metrics->len > width ? metrics->len - width : 0;
     }
+#endif /* FT_HAVE_WCHAR */
+    (void)buffer;
+    return 0;
 }
 
 
@@ -6834,12 +11025,12 @@ int buffer_printf(f_string_buffer_t *buffer, size_t buffer_row, f_conv_context_t
 
     size_t padding = content_width - (size_t)str_it_width;
 
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, left, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, left));
     CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, content_style_tag));
-    CHCK_RSLT_ADD_TO_WRITTEN(buffer_print_range(cntx, beg, end));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_range(cntx, beg, end, buffer->type));
     CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, reset_content_style_tag));
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, padding, FT_SPACE));
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, right, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, padding));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, right));
     return (int)written;
 
 clear:
@@ -6852,14 +11043,14 @@ size_t string_buffer_width_capacity(const f_string_buffer_t *buffer)
     assert(buffer);
     switch (buffer->type) {
         case CHAR_BUF:
-            return buffer->data_sz;
+            return buffer->mem.data_sz;
 #ifdef FT_HAVE_WCHAR
         case W_CHAR_BUF:
-            return buffer->data_sz / sizeof(wchar_t);
+            return buffer->mem.data_sz / sizeof(wchar_t);
 #endif
 #ifdef FT_HAVE_UTF8
         case UTF8_BUF:
-            return buffer->data_sz / 4;
+            return buffer->mem.data_sz / 4;
 #endif
         default:
             assert(0);
@@ -6876,42 +11067,372 @@ void *buffer_get_data(f_string_buffer_t *buffer)
 }
 
 FT_INTERNAL
-int buffer_check_align(f_string_buffer_t *buffer)
+int buffer_check_align(f_string_buffer_t *buffer)
+{
+    assert(buffer);
+    assert(buffer->str.data);
+
+    switch (buffer->type) {
+        case CHAR_BUF:
+            return 1;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            return (((uintptr_t)buffer->str.data) & (sizeof(wchar_t) - 1)) == 0;
+#endif
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            return 1;
+#endif
+        default:
+            assert(0);
+            return 0;
+    }
+}
+
+/********************************************************
+   End of file "string_buffer.c"
+ ********************************************************/
+
+
+/********************************************************
+   Begin of file "table.c"
+ ********************************************************/
+
+/* #include "table.h" */ /* Commented by amalgamation script */
+/* #include "string_buffer.h" */ /* Commented by amalgamation script */
+/* #include "cell.h" */ /* Commented by amalgamation script */
+/* #include "vector.h" */ /* Commented by amalgamation script */
+/* #include "row.h" */ /* Commented by amalgamation script */
+
+FT_INTERNAL
+f_virtual_data_t *create_virtual_data(size_t rows, size_t cols, ft_cell_provider_t provider, void *ctx)
+{
+    assert(provider);
+
+    f_virtual_data_t *virt = (f_virtual_data_t *)F_CALLOC(1, sizeof(f_virtual_data_t));
+    if (virt == NULL)
+        return NULL;
+    virt->rows = rows;
+    virt->cols = cols;
+    virt->provider = provider;
+    virt->ctx = ctx;
+
+    size_t i = 0;
+    for (i = 0; i < 2; ++i) {
+        virt->scratch_rows[i] = create_row();
+        if (virt->scratch_rows[i] == NULL)
+            goto clear;
+        if (cols && get_cell_and_create_if_not_exists(virt->scratch_rows[i], cols - 1) == NULL)
+            goto clear;
+    }
+    return virt;
+
+clear:
+    destroy_virtual_data(virt);
+    return NULL;
+}
+
+
+FT_INTERNAL
+void destroy_virtual_data(f_virtual_data_t *virt)
+{
+    if (virt == NULL)
+        return;
+    destroy_row(virt->scratch_rows[0]);
+    destroy_row(virt->scratch_rows[1]);
+    if (virt->spans)
+        destroy_vector(virt->spans);
+    F_FREE(virt);
+}
+
+
+FT_INTERNAL
+f_virtual_data_t *copy_virtual_data(const f_virtual_data_t *virt)
+{
+    assert(virt);
+    f_virtual_data_t *result = create_virtual_data(virt->rows, virt->cols, virt->provider, virt->ctx);
+    if (result == NULL || virt->spans == NULL)
+        return result;
+    result->spans = copy_vector(virt->spans);
+    if (result->spans == NULL) {
+        destroy_virtual_data(result);
+        return NULL;
+    }
+    return result;
+}
+
+
+/* Returns index of the first span of the virtual table not less than (row, col) */
+static
+size_t virtual_span_lower_bound(const f_vector_t *spans, size_t row, size_t col)
+{
+    size_t lo = 0;
+    size_t hi = vector_size(spans);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const struct f_virtual_span *span = &VECTOR_AT_C(spans, mid, const struct f_virtual_span);
+        if (span->row < row || (span->row == row && span->col < col))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+FT_INTERNAL
+f_status virtual_data_set_cell_span(f_virtual_data_t *virt, size_t row, size_t col, size_t hor_span)
+{
+    assert(virt);
+
+    if (virt->spans == NULL) {
+        virt->spans = create_vector(sizeof(struct f_virtual_span), DEFAULT_VECTOR_CAPACITY);
+        if (virt->spans == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    size_t pos = virtual_span_lower_bound(virt->spans, row, col);
+    if (pos < vector_size(virt->spans)) {
+        struct f_virtual_span *span = &VECTOR_AT(virt->spans, pos, struct f_virtual_span);
+        if (span->row == row && span->col == col) {
+            span->hor_span = hor_span;
+            return FT_SUCCESS;
+        }
+    }
+    struct f_virtual_span span;
+    span.row = row;
+    span.col = col;
+    span.hor_span = hor_span;
+    return vector_insert(virt->spans, &span, pos);
+}
+
+
+/* Sets types of cells of the scratch row according to spans of the row */
+static
+void apply_virtual_spans(const f_virtual_data_t *virt, f_row_t *scratch, size_t row)
+{
+    size_t col = 0;
+    for (col = 0; col < virt->cols; ++col)
+        set_cell_type(get_cell(scratch, col), COMMON_CELL);
+    if (virt->spans == NULL)
+        return;
+
+    size_t i = virtual_span_lower_bound(virt->spans, row, 0);
+    for (; i < vector_size(virt->spans); ++i) {
+        const struct f_virtual_span *span = &VECTOR_AT_C(virt->spans, i, const struct f_virtual_span);
+        if (span->row != row)
+            break;
+        for (col = span->col; col < virt->cols && col - span->col < span->hor_span; ++col)
+            set_cell_type(get_cell(scratch, col), col == span->col ? GROUP_MASTER_CELL : GROUP_SLAVE_CELL);
+    }
+}
+
+
+/*
+ * Requests content of the row from the provider. Result is stored in one of
+ * the scratch rows, so it stays valid till the request of the row `row + 2`.
+ */
+static
+const f_row_t *get_virtual_row_c(const ft_table_t *table, size_t row)
+{
+    f_virtual_data_t *virt = table->virt;
+    if (row >= virt->rows)
+        return NULL;
+
+    f_row_t *scratch = virt->scratch_rows[row % 2];
+    size_t col = 0;
+    for (col = 0; col < virt->cols; ++col) {
+        f_cell_t *cell = get_cell(scratch, col);
+        const char *content = virt->provider(row, col, virt->ctx);
+        if (FT_IS_ERROR(fill_cell_from_string(cell, content ? content : "")))
+            return NULL;
+    }
+    apply_virtual_spans(virt, scratch, row);
+    invalidate_span_map(scratch);
+    return scratch;
+}
+
+
+FT_INTERNAL
+void *alloc_text_slab(ft_table_t *table, size_t sz)
+{
+    assert(table);
+
+    if (table->text_slabs == NULL) {
+        table->text_slabs = create_vector(sizeof(void *), DEFAULT_VECTOR_CAPACITY);
+        if (table->text_slabs == NULL)
+            return NULL;
+    }
+    void *slab = F_MALLOC(sz ? sz : 1);
+    if (slab == NULL)
+        return NULL;
+    if (FT_IS_ERROR(vector_push(table->text_slabs, &slab))) {
+        F_FREE(slab);
+        return NULL;
+    }
+    return slab;
+}
+
+
+FT_INTERNAL
+void destroy_text_slabs(ft_table_t *table)
+{
+    assert(table);
+
+    if (table->text_slabs == NULL)
+        return;
+    size_t i = 0;
+    size_t n = vector_size(table->text_slabs);
+    for (i = 0; i < n; ++i) {
+        F_FREE(VECTOR_AT(table->text_slabs, i, void *));
+    }
+    destroy_vector(table->text_slabs);
+    table->text_slabs = NULL;
+}
+
+
+/*
+ * Interned string. Content follows the entry in the same block of memory
+ * (size of the entry is a multiple of alignment of its fields, so content is
+ * aligned for wchar_t too).
+ */
+struct f_intern_entry {
+    size_t hash;
+    struct f_text_metrics metrics;
+};
+
+#define INTERN_POOL_INIT_CAPACITY 64
+
+static
+size_t hash_content(const void *data, size_t sz, enum f_string_type type)
+{
+    /* FNV-1a */
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t hash = UINT64_C(14695981039346656037) ^ (uint64_t)type;
+    size_t i = 0;
+    for (i = 0; i < sz; ++i) {
+        hash ^= p[i];
+        hash *= UINT64_C(1099511628211);
+    }
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+static
+f_status grow_intern_pool(f_intern_pool_t *pool)
+{
+    size_t new_capacity = pool->capacity ? pool->capacity * 2 : INTERN_POOL_INIT_CAPACITY;
+    struct f_intern_entry **new_slots =
+        (struct f_intern_entry **)F_CALLOC(new_capacity, sizeof(struct f_intern_entry *));
+    if (new_slots == NULL)
+        return FT_MEMORY_ERROR;
+
+    size_t i = 0;
+    for (i = 0; i < pool->capacity; ++i) {
+        struct f_intern_entry *entry = pool->slots[i];
+        if (entry == NULL)
+            continue;
+        size_t pos = entry->hash & (new_capacity - 1);
+        while (new_slots[pos])
+            pos = (pos + 1) & (new_capacity - 1);
+        new_slots[pos] = entry;
+    }
+    F_FREE(pool->slots);
+    pool->bytes += (new_capacity - pool->capacity) * sizeof(struct f_intern_entry *);
+    pool->slots = new_slots;
+    pool->capacity = new_capacity;
+    return FT_SUCCESS;
+}
+
+FT_INTERNAL
+f_status fill_buffer_from_pool(ft_table_t *table, f_string_buffer_t *buffer, const f_string_view_t *str, size_t len)
+{
+    assert(table);
+    assert(buffer);
+    assert(str && str->u.data);
+
+    size_t char_sz = 1;
+#ifdef FT_HAVE_WCHAR
+    if (str->type == W_CHAR_BUF)
+        char_sz = sizeof(wchar_t);
+#endif /* FT_HAVE_WCHAR */
+    if (len >= (SIZE_MAX - sizeof(struct f_intern_entry)) / char_sz - 1)
+        return FT_EINVAL;
+
+    if (table->intern_pool == NULL) {
+        table->intern_pool = (f_intern_pool_t *)F_CALLOC(1, sizeof(f_intern_pool_t));
+        if (table->intern_pool == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    f_intern_pool_t *pool = table->intern_pool;
+    if (2 * (pool->count + 1) > pool->capacity && FT_IS_ERROR(grow_intern_pool(pool)))
+        return FT_MEMORY_ERROR;
+
+    size_t sz = len * char_sz;
+    size_t hash = hash_content(str->u.data, sz, str->type);
+    size_t pos = hash & (pool->capacity - 1);
+    pool->lookups++;
+    for (; pool->slots[pos]; pos = (pos + 1) & (pool->capacity - 1)) {
+        const struct f_intern_entry *entry = pool->slots[pos];
+        if (entry->hash == hash && entry->metrics.type == str->type
+            && entry->metrics.len == len && memcmp(entry->metrics.data, str->u.data, sz) == 0) {
+            pool->hits++;
+            fill_buffer_from_interned(buffer, entry->metrics.data, &entry->metrics);
+            return FT_SUCCESS;
+        }
+    }
+
+    size_t entry_sz = sizeof(struct f_intern_entry) + (len + 1) * char_sz;
+    struct f_intern_entry *entry = (struct f_intern_entry *)alloc_text_slab(table, entry_sz);
+    if (entry == NULL)
+        return FT_MEMORY_ERROR;
+    entry->hash = hash;
+    fill_buffer_from_string_at(buffer, str, len, entry + 1);
+
+    /* Index of lines is built once and shared by all cells with the content */
+    const struct f_line_index *index = buffer_line_index(buffer);
+    if (index)
+        pool->bytes += sizeof(struct f_line_index) + index->count * sizeof(size_t);
+    entry->metrics = buffer->metrics;
+    buffer->metrics.shared_line_index = 1;
+
+    pool->slots[pos] = entry;
+    pool->count++;
+    pool->bytes += entry_sz;
+    return FT_SUCCESS;
+}
+
+
+FT_INTERNAL
+void destroy_intern_pool(ft_table_t *table)
 {
-    assert(buffer);
-    assert(buffer->str.data);
+    assert(table);
 
-    switch (buffer->type) {
-        case CHAR_BUF:
-            return 1;
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            return (((uintptr_t)buffer->str.data) & (sizeof(wchar_t) - 1)) == 0;
-#endif
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            return 1;
-#endif
-        default:
-            assert(0);
-            return 0;
+    f_intern_pool_t *pool = table->intern_pool;
+    if (pool == NULL)
+        return;
+    size_t i = 0;
+    for (i = 0; i < pool->capacity; ++i) {
+        if (pool->slots[i])
+            F_FREE(pool->slots[i]->metrics.line_index);
     }
+    F_FREE(pool->slots);
+    F_FREE(pool);
+    table->intern_pool = NULL;
 }
 
-/********************************************************
-   End of file "string_buffer.c"
- ********************************************************/
-
 
-/********************************************************
-   Begin of file "table.c"
- ********************************************************/
+FT_INTERNAL
+const ft_allocator_t *use_table_allocator(const ft_table_t *table)
+{
+    /*
+     * Calls for tables without their own allocator can be made from callbacks
+     * of tables with one (e.g. sink of ft_print_to), so allocator of such
+     * tables is set explicitly.
+     */
+    if (table == NULL || table->allocator.malloc_fn == NULL)
+        return use_global_allocator();
+    return use_allocator(&table->allocator);
+}
 
-/* #include "table.h" */ /* Commented by amalgamation script */
-/* #include "string_buffer.h" */ /* Commented by amalgamation script */
-/* #include "cell.h" */ /* Commented by amalgamation script */
-/* #include "vector.h" */ /* Commented by amalgamation script */
-/* #include "row.h" */ /* Commented by amalgamation script */
 
 FT_INTERNAL
 f_separator_t *create_separator(int enabled)
@@ -6954,7 +11475,10 @@ f_row_t *get_row_impl(ft_table_t *table, size_t row, enum f_get_policy policy)
             return NULL;
         case CREATE_ON_NULL:
             while (row >= vector_size(table->rows)) {
-                f_row_t *new_row = create_row();
+                /* Rows skipped with ft_set_cur_cell don't reserve memory for cells */
+                size_t capacity = (row == vector_size(table->rows))
+                                  ? MAX(table->reserved_cols, DEFAULT_VECTOR_CAPACITY) : 0;
+                f_row_t *new_row = create_row_with_capacity(capacity);
                 if (new_row == NULL)
                     return NULL;
                 if (FT_IS_ERROR(vector_push(table->rows, &new_row))) {
@@ -6980,6 +11504,8 @@ f_row_t *get_row(ft_table_t *table, size_t row)
 FT_INTERNAL
 const f_row_t *get_row_c(const ft_table_t *table, size_t row)
 {
+    if (table && table->virt)
+        return get_virtual_row_c(table, row);
     return get_row((ft_table_t *)table, row);
 }
 
@@ -6991,7 +11517,7 @@ f_row_t *get_row_and_create_if_not_exists(ft_table_t *table, size_t row)
 }
 
 FT_INTERNAL
-f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table)
+f_cell_t *get_cur_cell_and_create_if_not_exists(ft_table_t *table)
 {
     assert(table);
 
@@ -7013,6 +11539,13 @@ f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table
             break;
     }
 
+    return cell;
+}
+
+FT_INTERNAL
+f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table)
+{
+    f_cell_t *cell = get_cur_cell_and_create_if_not_exists(table);
     if (cell == NULL)
         return NULL;
 
@@ -7028,7 +11561,10 @@ f_status get_table_sizes(const ft_table_t *table, size_t *rows, size_t *cols)
 {
     *rows = 0;
     *cols = 0;
-    if (table && table->rows) {
+    if (table && table->virt) {
+        *rows = table->virt->rows;
+        *cols = table->virt->cols;
+    } else if (table && table->rows) {
         *rows = vector_size(table->rows);
         size_t row_index = 0;
         for (row_index = 0; row_index < vector_size(table->rows); ++row_index) {
@@ -7042,17 +11578,88 @@ f_status get_table_sizes(const ft_table_t *table, size_t *rows, size_t *cols)
 }
 
 
+/*
+ * Returns height of the cell. Absent cells are considered to be empty.
+ */
+static
+size_t cell_height_in_row(const f_cell_t *cell, const f_context_t *context)
+{
+    if (cell)
+        return hint_height_cell(cell, context);
+
+    size_t cell_empty_string_height = get_cell_property_hierarchically(context->table_properties, context->row, context->column, FT_CPROP_EMPTY_STR_HEIGHT);
+    if (cell_empty_string_height) {
+        size_t cell_top_padding = get_cell_property_hierarchically(context->table_properties, context->row, context->column, FT_CPROP_TOP_PADDING);
+        size_t cell_bottom_padding = get_cell_property_hierarchically(context->table_properties, context->row, context->column, FT_CPROP_BOTTOM_PADDING);
+        return cell_empty_string_height + cell_top_padding + cell_bottom_padding;
+    }
+    return 0;
+}
+
+
+struct f_group_cell_info {
+    size_t row;
+    size_t col;
+    size_t span;
+    size_t hint_width;
+    size_t invis_width;   /* width of invisible codes of the master cell */
+};
+
+static
+int group_cell_info_cmp(const void *lhs, const void *rhs)
+{
+    const struct f_group_cell_info *l = (const struct f_group_cell_info *)lhs;
+    const struct f_group_cell_info *r = (const struct f_group_cell_info *)rhs;
+    if (l->col != r->col)
+        return l->col < r->col ? -1 : 1;
+    if (l->row != r->row)
+        return l->row < r->row ? -1 : 1;
+    return 0;
+}
+
+
+/*
+ * Widens columns of the group of cells so that they fit content of its master
+ * cell of width `hint_width`.
+ */
+static
+void fit_group_cell(size_t *col_width_arr, const struct f_group_cell_info *info, size_t hint_width)
+{
+    size_t col = info->col;
+    size_t slave_col = col + info->span;
+    size_t group_width = col_width_arr[col];
+    size_t i;
+    for (i = col + 1; i < slave_col; ++i)
+        group_width += col_width_arr[i] + FORT_COL_SEPARATOR_LENGTH;
+    if (group_width >= hint_width)
+        return;
+
+    /*
+     * Lacking width is distributed evenly among columns of the group,
+     * remainder goes to the first columns (the same widths as if
+     * columns were widened one by one in turn).
+     */
+    size_t lack = hint_width - group_width;
+    for (i = col; i < slave_col; ++i)
+        col_width_arr[i] += lack / info->span + (i - col < lack % info->span ? 1 : 0);
+}
+
+
+/*
+ * Computes visible widths of columns, widths of columns in codepoints (with
+ * invisible elements, e.g. style tags) and heights of rows in one pass over
+ * the table. Any of vis_col_width_arr_p and cod_col_width_arr_p may be NULL
+ * if the corresponding widths are not needed.
+ */
 FT_INTERNAL
-f_status table_rows_and_cols_geometry(const ft_table_t *table,
-                                      size_t **col_width_arr_p, size_t *col_width_arr_sz,
-                                      size_t **row_height_arr_p, size_t *row_height_arr_sz,
-                                      enum f_geometry_type geom)
+f_status table_full_geometry(const ft_table_t *table,
+                             size_t **vis_col_width_arr_p, size_t **cod_col_width_arr_p, size_t *cols_p,
+                             size_t **row_height_arr_p, size_t *rows_p)
 {
     if (table == NULL) {
         return FT_GEN_ERROR;
     }
 
-    size_t max_invis_codepoints = 0;
     size_t cols = 0;
     size_t rows = 0;
     int status = get_table_sizes(table, &rows, &cols);
@@ -7061,98 +11668,99 @@ f_status table_rows_and_cols_geometry(const ft_table_t *table,
 
     size_t *col_width_arr = (size_t *)F_CALLOC(cols, sizeof(size_t));
     size_t *row_height_arr = (size_t *)F_CALLOC(rows, sizeof(size_t));
+    size_t *max_invis_arr = NULL;
+    size_t *cod_col_width_arr = NULL;
+    f_vector_t *group_cells = NULL;
     if (col_width_arr == NULL || row_height_arr == NULL) {
-        F_FREE(col_width_arr);
-        F_FREE(row_height_arr);
-        return FT_GEN_ERROR;
+        status = FT_GEN_ERROR;
+        goto clear;
+    }
+
+    if (cod_col_width_arr_p) {
+        max_invis_arr = (size_t *)F_CALLOC(cols, sizeof(size_t));
+        if (max_invis_arr == NULL) {
+            status = FT_GEN_ERROR;
+            goto clear;
+        }
     }
 
-    int combined_cells_found = 0;
+    /*
+     * Table is traversed row by row so that each row is requested only once
+     * (it matters for virtual tables). Master cells of groups are collected
+     * and processed after widths of all common cells are known.
+     */
     f_context_t context;
     context.table_properties = (table->properties ? table->properties : &g_table_properties);
     size_t col = 0;
-    for (col = 0; col < cols; ++col) {
-        col_width_arr[col] = 0;
-        size_t row = 0;
-        for (row = 0; row < rows; ++row) {
-            const f_row_t *row_p = get_row_c(table, row);
+    size_t row = 0;
+    for (row = 0; row < rows; ++row) {
+        const f_row_t *row_p = get_row_c(table, row);
+        context.row = row;
+        for (col = 0; col < cols; ++col) {
             const f_cell_t *cell = get_cell_c(row_p, col);
             context.column = col;
-            context.row = row;
             if (cell) {
+                size_t inv_codepoints = max_invis_arr ? cell_invis_codes_width(cell, &context) : 0;
                 switch (get_cell_type(cell)) {
                     case COMMON_CELL:
                         col_width_arr[col] = MAX(col_width_arr[col], cell_vis_width(cell, &context));
                         break;
-                    case GROUP_MASTER_CELL:
-                        combined_cells_found = 1;
+                    case GROUP_MASTER_CELL: {
+                        struct f_group_cell_info info;
+                        info.row = row;
+                        info.col = col;
+                        info.span = group_cell_number(row_p, col);
+                        info.hint_width = cell_vis_width(cell, &context);
+                        info.invis_width = inv_codepoints;
+                        if (group_cells == NULL) {
+                            group_cells = create_vector(sizeof(struct f_group_cell_info), DEFAULT_VECTOR_CAPACITY);
+                            if (group_cells == NULL) {
+                                status = FT_MEMORY_ERROR;
+                                goto clear;
+                            }
+                        }
+                        status = vector_push(group_cells, &info);
+                        if (FT_IS_ERROR(status))
+                            goto clear;
                         break;
+                    }
                     case GROUP_SLAVE_CELL:
                         ; /* Do nothing */
                         break;
                 }
-                row_height_arr[row] = MAX(row_height_arr[row], hint_height_cell(cell, &context));
-            } else {
-                size_t cell_empty_string_height = get_cell_property_hierarchically(context.table_properties, context.row, context.column, FT_CPROP_EMPTY_STR_HEIGHT);
-                if (cell_empty_string_height) {
-                    size_t cell_top_padding = get_cell_property_hierarchically(context.table_properties, context.row, context.column, FT_CPROP_TOP_PADDING);
-                    size_t cell_bottom_padding = get_cell_property_hierarchically(context.table_properties, context.row, context.column, FT_CPROP_BOTTOM_PADDING);
-                    row_height_arr[row] = MAX(row_height_arr[row], cell_empty_string_height + cell_top_padding + cell_bottom_padding);
-                }
+                if (max_invis_arr)
+                    max_invis_arr[col] = MAX(max_invis_arr[col], inv_codepoints);
             }
+            row_height_arr[row] = MAX(row_height_arr[row], cell_height_in_row(cell, &context));
         }
+    }
 
-        if (geom == INTERN_REPR_GEOMETRY) {
-            max_invis_codepoints = 0;
-            for (row = 0; row < rows; ++row) {
-                const f_row_t *row_p = get_row_c(table, row);
-                const f_cell_t *cell = get_cell_c(row_p, col);
-                if (!cell)
-                    continue;
-                context.column = col;
-                context.row = row;
-                size_t inv_codepoints = cell_invis_codes_width(cell, &context);
-                max_invis_codepoints = MAX(max_invis_codepoints, inv_codepoints);
-            }
-            col_width_arr[col] += max_invis_codepoints;
+    if (max_invis_arr) {
+        cod_col_width_arr = (size_t *)F_CALLOC(cols, sizeof(size_t));
+        if (cod_col_width_arr == NULL) {
+            status = FT_GEN_ERROR;
+            goto clear;
         }
+        for (col = 0; col < cols; ++col)
+            cod_col_width_arr[col] = col_width_arr[col] + max_invis_arr[col];
     }
 
-    if (combined_cells_found) {
-        for (col = 0; col < cols; ++col) {
-            size_t row = 0;
-            for (row = 0; row < rows; ++row) {
-                const f_row_t *row_p = get_row_c(table, row);
-                const f_cell_t *cell = get_cell_c(row_p, col);
-                context.column = col;
-                context.row = row;
-                if (cell) {
-                    if (get_cell_type(cell) == GROUP_MASTER_CELL) {
-                        size_t hint_width = cell_vis_width(cell, &context);
-                        if (geom == INTERN_REPR_GEOMETRY) {
-                            hint_width += cell_invis_codes_width(cell, &context);
-                        }
-                        size_t slave_col = col + group_cell_number(row_p, col);
-                        size_t cur_adj_col = col;
-                        size_t group_width = col_width_arr[col];
-                        size_t i;
-                        for (i = col + 1; i < slave_col; ++i)
-                            group_width += col_width_arr[i] + FORT_COL_SEPARATOR_LENGTH;
-                        /* adjust col. widths */
-                        while (1) {
-                            if (group_width >= hint_width)
-                                break;
-                            col_width_arr[cur_adj_col] += 1;
-                            group_width++;
-                            cur_adj_col++;
-                            if (cur_adj_col == slave_col)
-                                cur_adj_col = col;
-                        }
-                    }
-                }
-            }
+    if (group_cells) {
+        /* Groups are processed column by column, top to bottom. */
+        size_t groups_n = vector_size(group_cells);
+        qsort(vector_at(group_cells, 0), groups_n, sizeof(struct f_group_cell_info), group_cell_info_cmp);
+
+        size_t k = 0;
+        for (k = 0; k < groups_n; ++k) {
+            const struct f_group_cell_info *info = &VECTOR_AT_C(group_cells, k, const struct f_group_cell_info);
+            fit_group_cell(col_width_arr, info, info->hint_width);
+            if (cod_col_width_arr)
+                fit_group_cell(cod_col_width_arr, info, info->hint_width + info->invis_width);
         }
+        destroy_vector(group_cells);
+        group_cells = NULL;
     }
+    F_FREE(max_invis_arr);
 
     /* todo: Maybe it is better to move min width checking to a particular cell
      * width checking. At the moment min width includes paddings. Maybe it is
@@ -7167,38 +11775,55 @@ f_status table_rows_and_cols_geometry(const ft_table_t *table,
     }
     */
 
-    *col_width_arr_p = col_width_arr;
-    *col_width_arr_sz = cols;
+    if (vis_col_width_arr_p)
+        *vis_col_width_arr_p = col_width_arr;
+    else
+        F_FREE(col_width_arr);
+    if (cod_col_width_arr_p)
+        *cod_col_width_arr_p = cod_col_width_arr;
+    *cols_p = cols;
     *row_height_arr_p = row_height_arr;
-    *row_height_arr_sz = rows;
+    *rows_p = rows;
     return FT_SUCCESS;
+
+clear:
+    if (group_cells)
+        destroy_vector(group_cells);
+    F_FREE(max_invis_arr);
+    F_FREE(cod_col_width_arr);
+    F_FREE(col_width_arr);
+    F_FREE(row_height_arr);
+    return status;
 }
 
 
-/*
- * Returns geometry in characters
- */
 FT_INTERNAL
-f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
+f_status table_rows_and_cols_geometry(const ft_table_t *table,
+                                      size_t **col_width_arr_p, size_t *col_width_arr_sz,
+                                      size_t **row_height_arr_p, size_t *row_height_arr_sz,
+                                      enum f_geometry_type geom)
 {
-    if (table == NULL)
-        return FT_GEN_ERROR;
+    if (geom == INTERN_REPR_GEOMETRY)
+        return table_full_geometry(table, NULL, col_width_arr_p, col_width_arr_sz,
+                                   row_height_arr_p, row_height_arr_sz);
+    return table_full_geometry(table, col_width_arr_p, NULL, col_width_arr_sz,
+                               row_height_arr_p, row_height_arr_sz);
+}
 
-    *height = 0;
-    *width = 0;
-    size_t cols = 0;
-    size_t rows = 0;
-    size_t *col_width_arr = NULL;
-    size_t *row_height_arr = NULL;
 
-    int status = table_rows_and_cols_geometry(table, &col_width_arr, &cols, &row_height_arr, &rows, INTERN_REPR_GEOMETRY);
-    if (FT_IS_ERROR(status))
-        return status;
+FT_INTERNAL
+f_status table_geometry_for_rows(const ft_table_t *table,
+                                 const size_t *cod_col_width_arr, size_t cols,
+                                 const size_t *row_height_arr, size_t rows,
+                                 size_t *height, size_t *width)
+{
+    if (table == NULL)
+        return FT_GEN_ERROR;
 
     *width = 1 + (cols == 0 ? 1 : cols) + 1; /* for boundaries (that take 1 symbol) + newline   */
     size_t i = 0;
     for (i = 0; i < cols; ++i) {
-        *width += col_width_arr[i];
+        *width += cod_col_width_arr[i];
     }
 
     /* todo: add check for non printable horizontal row separators */
@@ -7206,8 +11831,6 @@ f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
     for (i = 0; i < rows; ++i) {
         *height += row_height_arr[i];
     }
-    F_FREE(col_width_arr);
-    F_FREE(row_height_arr);
 
     f_table_properties_t *properties = table->properties;
     if (properties) {
@@ -7225,6 +11848,93 @@ f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
     return FT_SUCCESS;
 }
 
+
+/*
+ * Returns geometry in characters
+ */
+FT_INTERNAL
+f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
+{
+    if (table == NULL)
+        return FT_GEN_ERROR;
+
+    *height = 0;
+    *width = 0;
+    size_t cols = 0;
+    size_t rows = 0;
+    size_t *col_width_arr = NULL;
+    size_t *row_height_arr = NULL;
+
+    int status = table_rows_and_cols_geometry(table, &col_width_arr, &cols, &row_height_arr, &rows, INTERN_REPR_GEOMETRY);
+    if (FT_IS_ERROR(status))
+        return status;
+
+    status = table_geometry_for_rows(table, col_width_arr, cols, row_height_arr, rows, height, width);
+    F_FREE(col_width_arr);
+    F_FREE(row_height_arr);
+    return status;
+}
+
+
+/*
+ * Geometry caches are valid only for the generation of geometry they were
+ * computed for. Generation is changed with the default properties, which are
+ * not thread-safe either.
+ */
+static size_t g_geometry_generation = 0;
+
+FT_INTERNAL
+void invalidate_all_geometry_caches(void)
+{
+    ++g_geometry_generation;
+}
+
+FT_INTERNAL
+void destroy_geometry_cache(ft_table_t *table)
+{
+    f_geometry_cache_t *cache = &table->geometry_cache;
+    F_FREE(cache->vis_col_width_arr);
+    F_FREE(cache->cod_col_width_arr);
+    F_FREE(cache->row_height_arr);
+    cache->vis_col_width_arr = NULL;
+    cache->cod_col_width_arr = NULL;
+    cache->row_height_arr = NULL;
+    cache->valid = 0;
+}
+
+
+FT_INTERNAL
+void invalidate_geometry_cache(ft_table_t *table)
+{
+    assert(table);
+    table->geometry_cache.valid = 0;
+}
+
+
+FT_INTERNAL
+const f_geometry_cache_t *table_geometry_cache(const ft_table_t *table)
+{
+    assert(table);
+    f_geometry_cache_t *cache = (f_geometry_cache_t *) &table->geometry_cache;
+    if (cache->valid && cache->generation == g_geometry_generation)
+        return cache;
+
+    destroy_geometry_cache((ft_table_t *)table);
+
+    size_t rows = 0;
+    size_t cols = 0;
+    int status = table_full_geometry(table, &cache->vis_col_width_arr, &cache->cod_col_width_arr, &cols,
+                                     &cache->row_height_arr, &rows);
+    if (FT_IS_ERROR(status))
+        return NULL;
+
+    cache->cols = cols;
+    cache->rows = rows;
+    cache->generation = g_geometry_generation;
+    cache->valid = 1;
+    return cache;
+}
+
 FT_INTERNAL
 f_status table_internal_codepoints_geometry(const ft_table_t *table, size_t *height, size_t *width)
 {
@@ -7257,10 +11967,12 @@ static int vector_reallocate_(f_vector_t *vector, size_t new_capacity)
     assert(vector);
     assert(new_capacity > vector->m_capacity);
 
+    size_t old_size = MAX(vector->m_capacity * vector->m_item_size, 1);
     size_t new_size = new_capacity * vector->m_item_size;
-    vector->m_data = F_REALLOC(vector->m_data, new_size);
-    if (vector->m_data == NULL)
+    void *new_data = F_REALLOC(vector->m_data, old_size, new_size);
+    if (new_data == NULL)
         return -1;
+    vector->m_data = new_data;
     return 0;
 }
 
@@ -7313,6 +12025,22 @@ size_t vector_capacity(const f_vector_t *vector)
 }
 
 
+FT_INTERNAL
+f_status vector_reserve(f_vector_t *vector, size_t capacity)
+{
+    assert(vector);
+
+    if (capacity <= vector->m_capacity)
+        return FT_SUCCESS;
+    if (capacity > SIZE_MAX / vector->m_item_size)
+        return FT_EINVAL;
+    if (vector_reallocate_(vector, capacity) == -1)
+        return FT_MEMORY_ERROR;
+    vector->m_capacity = capacity;
+    return FT_SUCCESS;
+}
+
+
 FT_INTERNAL
 int vector_push(f_vector_t *vector, const void *item)
 {
@@ -7320,9 +12048,10 @@ int vector_push(f_vector_t *vector, const void *item)
     assert(item);
 
     if (vector->m_size == vector->m_capacity) {
-        if (vector_reallocate_(vector, vector->m_capacity * 2) == -1)
+        size_t new_capacity = MAX(vector->m_capacity * 2, 1);
+        if (vector_reallocate_(vector, new_capacity) == -1)
             return FT_GEN_ERROR;
-        vector->m_capacity = vector->m_capacity * 2;
+        vector->m_capacity = new_capacity;
     }
 
     size_t offset = vector->m_size * vector->m_item_size;
@@ -7340,6 +12069,8 @@ int vector_insert(f_vector_t *vector, const void *item, size_t pos)
     assert(item);
     size_t needed_capacity = MAX(pos + 1, vector->m_size + 1);
     if (vector->m_capacity < needed_capacity) {
+        /* Grow geometrically so that repeated inserts are amortized O(1) */
+        needed_capacity = MAX(needed_capacity, vector->m_capacity * 2);
         if (vector_reallocate_(vector, needed_capacity) == -1)
             return FT_GEN_ERROR;
         vector->m_capacity = needed_capacity;
@@ -7479,8 +12210,7 @@ int vector_erase(f_vector_t *vector, size_t index)
     return FT_SUCCESS;
 }
 
-#ifdef FT_TEST_BUILD
-
+FT_INTERNAL
 f_vector_t *copy_vector(f_vector_t *v)
 {
     if (v == NULL)
@@ -7496,6 +12226,8 @@ f_vector_t *copy_vector(f_vector_t *v)
     return new_vector;
 }
 
+#ifdef FT_TEST_BUILD
+
 size_t vector_index_of(const f_vector_t *vector, const void *item)
 {
     assert(vector);
@@ -7584,35 +12316,24 @@ size_t vector_index_of(const f_vector_t *vector, const void *item)
  */
 
 /* #include "wcwidth.h" */ /* Commented by amalgamation script */
+/* #include "width_table.h" */ /* Commented by amalgamation script */
 
-#ifdef FT_HAVE_WCHAR
-
-
-struct interval {
-    int32_t first;
-    int32_t last;
-};
+#if defined(FT_HAVE_WCHAR) || defined(FT_HAVE_UTF8)
 
-/* auxiliary function for binary search in interval table */
-static int bisearch(int32_t ucs, const struct interval *table, int max)
+/*
+ * Looks up width of the codepoint in the width table of the width function.
+ * Returns 0, 1, 2 or 3 (3 means -1).
+ */
+static int lookup_width(const uint8_t *function_planes, uint32_t ucs)
 {
-    int min = 0;
-
-    if (ucs < table[0].first || ucs > table[max].last)
-        return 0;
-    while (max >= min) {
-        int mid = (min + max) / 2;
-        if (ucs > table[mid].last)
-            min = mid + 1;
-        else if (ucs < table[mid].first)
-            max = mid - 1;
-        else
-            return 1;
-    }
-
-    return 0;
+    const uint8_t *plane = width_planes[function_planes[ucs >> 16]];
+    const uint8_t *block = width_blocks[plane[(ucs >> 8) & 0xFF]];
+    return (block[(ucs & 0xFF) >> 2] >> ((ucs & 3) * 2)) & 3;
 }
 
+#endif /* defined(FT_HAVE_WCHAR) || defined(FT_HAVE_UTF8) */
+
+#ifdef FT_HAVE_WCHAR
 
 /* The following two functions define the column width of an ISO 10646
  * character as follows:
@@ -7644,63 +12365,13 @@ static int bisearch(int32_t ucs, const struct interval *table, int max)
  *
  * This implementation assumes that wchar_t characters are encoded
  * in ISO 10646.
+ *
+ * Widths of all codepoints are stored in staged lookup tables generated by
+ * gen_width_table.py (see width_table.h).
  */
 
 static int mk_wcwidth(wchar_t wcs)
 {
-    /* sorted list of non-overlapping intervals of non-spacing characters */
-    /* generated by "uniset +cat=Me +cat=Mn +cat=Cf -00AD +1160-11FF +200B c" */
-    static const struct interval combining[] = {
-        { 0x0300, 0x036F }, { 0x0483, 0x0486 }, { 0x0488, 0x0489 },
-        { 0x0591, 0x05BD }, { 0x05BF, 0x05BF }, { 0x05C1, 0x05C2 },
-        { 0x05C4, 0x05C5 }, { 0x05C7, 0x05C7 }, { 0x0600, 0x0603 },
-        { 0x0610, 0x0615 }, { 0x064B, 0x065E }, { 0x0670, 0x0670 },
-        { 0x06D6, 0x06E4 }, { 0x06E7, 0x06E8 }, { 0x06EA, 0x06ED },
-        { 0x070F, 0x070F }, { 0x0711, 0x0711 }, { 0x0730, 0x074A },
-        { 0x07A6, 0x07B0 }, { 0x07EB, 0x07F3 }, { 0x0901, 0x0902 },
-        { 0x093C, 0x093C }, { 0x0941, 0x0948 }, { 0x094D, 0x094D },
-        { 0x0951, 0x0954 }, { 0x0962, 0x0963 }, { 0x0981, 0x0981 },
-        { 0x09BC, 0x09BC }, { 0x09C1, 0x09C4 }, { 0x09CD, 0x09CD },
-        { 0x09E2, 0x09E3 }, { 0x0A01, 0x0A02 }, { 0x0A3C, 0x0A3C },
-        { 0x0A41, 0x0A42 }, { 0x0A47, 0x0A48 }, { 0x0A4B, 0x0A4D },
-        { 0x0A70, 0x0A71 }, { 0x0A81, 0x0A82 }, { 0x0ABC, 0x0ABC },
-        { 0x0AC1, 0x0AC5 }, { 0x0AC7, 0x0AC8 }, { 0x0ACD, 0x0ACD },
-        { 0x0AE2, 0x0AE3 }, { 0x0B01, 0x0B01 }, { 0x0B3C, 0x0B3C },
-        { 0x0B3F, 0x0B3F }, { 0x0B41, 0x0B43 }, { 0x0B4D, 0x0B4D },
-        { 0x0B56, 0x0B56 }, { 0x0B82, 0x0B82 }, { 0x0BC0, 0x0BC0 },
-        { 0x0BCD, 0x0BCD }, { 0x0C3E, 0x0C40 }, { 0x0C46, 0x0C48 },
-        { 0x0C4A, 0x0C4D }, { 0x0C55, 0x0C56 }, { 0x0CBC, 0x0CBC },
-        { 0x0CBF, 0x0CBF }, { 0x0CC6, 0x0CC6 }, { 0x0CCC, 0x0CCD },
-        { 0x0CE2, 0x0CE3 }, { 0x0D41, 0x0D43 }, { 0x0D4D, 0x0D4D },
-        { 0x0DCA, 0x0DCA }, { 0x0DD2, 0x0DD4 }, { 0x0DD6, 0x0DD6 },
-        { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E },
-        { 0x0EB1, 0x0EB1 }, { 0x0EB4, 0x0EB9 }, { 0x0EBB, 0x0EBC },
-        { 0x0EC8, 0x0ECD }, { 0x0F18, 0x0F19 }, { 0x0F35, 0x0F35 },
-        { 0x0F37, 0x0F37 }, { 0x0F39, 0x0F39 }, { 0x0F71, 0x0F7E },
-        { 0x0F80, 0x0F84 }, { 0x0F86, 0x0F87 }, { 0x0F90, 0x0F97 },
-        { 0x0F99, 0x0FBC }, { 0x0FC6, 0x0FC6 }, { 0x102D, 0x1030 },
-        { 0x1032, 0x1032 }, { 0x1036, 0x1037 }, { 0x1039, 0x1039 },
-        { 0x1058, 0x1059 }, { 0x1160, 0x11FF }, { 0x135F, 0x135F },
-        { 0x1712, 0x1714 }, { 0x1732, 0x1734 }, { 0x1752, 0x1753 },
-        { 0x1772, 0x1773 }, { 0x17B4, 0x17B5 }, { 0x17B7, 0x17BD },
-        { 0x17C6, 0x17C6 }, { 0x17C9, 0x17D3 }, { 0x17DD, 0x17DD },
-        { 0x180B, 0x180D }, { 0x18A9, 0x18A9 }, { 0x1920, 0x1922 },
-        { 0x1927, 0x1928 }, { 0x1932, 0x1932 }, { 0x1939, 0x193B },
-        { 0x1A17, 0x1A18 }, { 0x1B00, 0x1B03 }, { 0x1B34, 0x1B34 },
-        { 0x1B36, 0x1B3A }, { 0x1B3C, 0x1B3C }, { 0x1B42, 0x1B42 },
-        { 0x1B6B, 0x1B73 }, { 0x1DC0, 0x1DCA }, { 0x1DFE, 0x1DFF },
-        { 0x200B, 0x200F }, { 0x202A, 0x202E }, { 0x2060, 0x2063 },
-        { 0x206A, 0x206F }, { 0x20D0, 0x20EF }, { 0x302A, 0x302F },
-        { 0x3099, 0x309A }, { 0xA806, 0xA806 }, { 0xA80B, 0xA80B },
-        { 0xA825, 0xA826 }, { 0xFB1E, 0xFB1E }, { 0xFE00, 0xFE0F },
-        { 0xFE20, 0xFE23 }, { 0xFEFF, 0xFEFF }, { 0xFFF9, 0xFFFB },
-        { 0x10A01, 0x10A03 }, { 0x10A05, 0x10A06 }, { 0x10A0C, 0x10A0F },
-        { 0x10A38, 0x10A3A }, { 0x10A3F, 0x10A3F }, { 0x1D167, 0x1D169 },
-        { 0x1D173, 0x1D182 }, { 0x1D185, 0x1D18B }, { 0x1D1AA, 0x1D1AD },
-        { 0x1D242, 0x1D244 }, { 0xE0001, 0xE0001 }, { 0xE0020, 0xE007F },
-        { 0xE0100, 0xE01EF }
-    };
-
     /* We convert wchar_t to int32_t to avoid compiler warnings
      * about implicit integer conversions
      * https://github.com/seleznevae/libfort/issues/20
@@ -7709,33 +12380,16 @@ static int mk_wcwidth(wchar_t wcs)
      */
     int32_t ucs = (int32_t)wcs;
 
-    /* test for 8-bit control characters */
-    if (ucs == 0)
-        return 0;
-    if (ucs < 32 || (ucs >= 0x7f && ucs < 0xa0))
+    /* Printable ASCII chars are the most common case */
+    if (ucs >= 0x20 && ucs < 0x7f)
+        return 1;
+    if (ucs < 0)
         return -1;
+    if (ucs > FT_WIDTH_MAX_CODEPOINT)
+        return 1;
 
-    /* binary search in table of non-spacing characters */
-    if (bisearch(ucs, combining,
-                 sizeof(combining) / sizeof(struct interval) - 1))
-        return 0;
-
-    /* if we arrive here, ucs is not a combining or C0/C1 control character */
-
-    return 1 +
-           (ucs >= 0x1100 &&
-            (ucs <= 0x115f ||                    /* Hangul Jamo init. consonants */
-             ucs == 0x2329 || ucs == 0x232a ||
-             (ucs >= 0x2e80 && ucs <= 0xa4cf &&
-              ucs != 0x303f) ||                  /* CJK ... Yi */
-             (ucs >= 0xac00 && ucs <= 0xd7a3) || /* Hangul Syllables */
-             (ucs >= 0xf900 && ucs <= 0xfaff) || /* CJK Compatibility Ideographs */
-             (ucs >= 0xfe10 && ucs <= 0xfe19) || /* Vertical forms */
-             (ucs >= 0xfe30 && ucs <= 0xfe6f) || /* CJK Compatibility Forms */
-             (ucs >= 0xff00 && ucs <= 0xff60) || /* Fullwidth Forms */
-             (ucs >= 0xffe0 && ucs <= 0xffe6) ||
-             (ucs >= 0x20000 && ucs <= 0x2fffd) ||
-             (ucs >= 0x30000 && ucs <= 0x3fffd)));
+    int width = lookup_width(wc_width_planes, (uint32_t)ucs);
+    return width == 3 ? -1 : width;
 }
 
 
@@ -7756,6 +12410,40 @@ int mk_wcswidth(const wchar_t *pwcs, size_t n)
 }
 #endif /* FT_HAVE_WCHAR */
 
+#ifdef FT_HAVE_UTF8
+FT_INTERNAL
+size_t utf8_range_width(const void *beg, const void *end)
+{
+    size_t width = 0;
+    utf8_int32_t c = 0;
+    const unsigned char *it = (const unsigned char *)beg;
+
+    while ((const void *)it < end) {
+        /* ASCII chars are decoded without utf8codepoint */
+        if (*it < 0x80) {
+            if (*it == 0)
+                break;
+            width += 1;
+            ++it;
+            continue;
+        }
+        it = (const unsigned char *)utf8codepoint(it, &c);
+        if (c == 0)
+            break;
+        width += utf8_codepoint_width((uint32_t)c);
+    }
+    return width;
+}
+
+FT_INTERNAL
+size_t utf8_codepoint_width(uint32_t c)
+{
+    if (c > FT_WIDTH_MAX_CODEPOINT)
+        return 1;
+    return (size_t)lookup_width(u8_width_planes, c);
+}
+#endif /* FT_HAVE_UTF8 */
+
 /********************************************************
    End of file "wcwidth.c"
  ********************************************************/
@@ -34,11 +34,17 @@ SOFTWARE.
 #ifndef LIBFORT_HPP
 #define LIBFORT_HPP
 
+#include <cstring>
 #include <iomanip>
+#include <iterator>
+#include <ostream>
 #include <sstream>
 #include <string>
 #include <stdexcept>
 #include <type_traits>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 #include "fort.h"
 
@@ -73,6 +79,18 @@ enum class add_strategy {
     insert  = FT_STRATEGY_INSERT
 };
 
+/**
+ * Handling of invalid UTF-8.
+ *
+ * Determines what happens when content written to utf8_table contains
+ * ill-formed UTF-8 sequences. Default is 'keep'.
+ */
+enum class invalid_utf8 {
+    keep    = FT_INVALID_UTF8_KEEP,
+    reject  = FT_INVALID_UTF8_REJECT,
+    replace = FT_INVALID_UTF8_REPLACE
+};
+
 /**
  * Colors.
  */
@@ -172,6 +190,34 @@ constexpr bool is_stream_manipulator_impl() noexcept
            || std::is_same<Tdec, typename std::decay<decltype(std::setprecision(0))>::type>::value
            || std::is_same<Tdec, typename std::decay<decltype(std::setw(0))>::type>::value;
 }
+
+// Types written to the table by operator<< without std::ostream
+template <typename T>
+struct is_fast_integer
+    : std::integral_constant<bool, std::is_integral<T>::value
+      && !std::is_same<T, char>::value
+      && !std::is_same<T, signed char>::value
+      && !std::is_same<T, unsigned char>::value
+      && !std::is_same<T, wchar_t>::value
+      && !std::is_same<T, char16_t>::value
+      && !std::is_same<T, char32_t>::value> {};
+
+template <typename T>
+struct is_fast_string
+    : std::integral_constant<bool, std::is_same<T, const char *>::value
+      || std::is_same<T, char *>::value
+      || std::is_same<T, std::string>::value
+#if __cplusplus >= 201703L
+      || std::is_same<T, std::string_view>::value
+#endif
+      || std::is_same<T, char>::value> {};
+
+template <typename T>
+struct has_fast_write
+    : std::integral_constant<bool, is_fast_integer<typename std::decay<T>::type>::value
+      || std::is_same<typename std::decay<T>::type, float>::value
+      || std::is_same<typename std::decay<T>::type, double>::value
+      || is_fast_string<typename std::decay<T>::type>::value> {};
 }
 
 /**
@@ -555,6 +601,43 @@ public:
 #endif
     }
 
+    /**
+     * Print string representation of the table to the stream.
+     *
+     * Output is written to the stream buffer by chunks, so string
+     * representation of the whole table is never kept in memory.
+     *
+     * @param os
+     *   Output stream.
+     * @return
+     *   - True: Success; table was printed.
+     *   - False: Error; badbit is set for the stream.
+     */
+    bool render_to(std::ostream &os) const
+    {
+        std::ostream::sentry sentry(os);
+        if (!sentry)
+            return false;
+
+        auto write_fn = [](const void *data, std::size_t len, void *ctx) -> int {
+            std::streambuf *buf = static_cast<std::streambuf *>(ctx);
+            std::streamsize n = static_cast<std::streamsize>(len);
+            return buf->sputn(static_cast<const char *>(data), n) == n ? 0 : -1;
+        };
+#ifdef FT_HAVE_UTF8
+        int status = (TT == table_type::character)
+                     ? ft_print_to(table_, write_fn, os.rdbuf())
+                     : ft_u8print_to(table_, write_fn, os.rdbuf());
+#else
+        int status = ft_print_to(table_, write_fn, os.rdbuf());
+#endif
+        if (FT_IS_ERROR(status)) {
+            os.setstate(std::ios_base::badbit);
+            return false;
+        }
+        return true;
+    }
+
     /**
      * Write provided object to the table.
      *
@@ -567,23 +650,31 @@ public:
      *   - Reference to the current table.
      */
     template <typename T>
-    table &operator<<(const T &arg)
+    typename std::enable_if<!detail::has_fast_write<T>::value, table &>::type
+    operator<<(const T &arg)
     {
-        constexpr bool is_manip = fort::is_stream_manipulator<typename std::decay<T>::type>();
-        stream_ << arg;
-        if (stream_.tellp() >= 0 && !is_manip) {
-#ifdef FT_HAVE_UTF8
-            if (TT == table_type::character) {
-                ft_nwrite(table_, 1, stream_.str().c_str());
-            } else {
-                ft_u8nwrite(table_, 1, (const void *)stream_.str().c_str());
-            }
-#else
-            ft_nwrite(table_, 1, stream_.str().c_str());
-#endif
+        return write_streamed(arg);
+    }
 
-            stream_.str(std::string());
-        }
+    /**
+     * Write string or number to the table.
+     *
+     * Strings are written to the current cell directly and numbers are
+     * stored in it as typed values (see ft_write_i64), so std::ostream is
+     * used only if manipulators changed its format.
+     *
+     * @param arg
+     *   String or number that would be inserted in the current cell.
+     * @return
+     *   - Reference to the current table.
+     */
+    template <typename T>
+    typename std::enable_if<detail::has_fast_write<T>::value, table &>::type
+    operator<<(const T &arg)
+    {
+        if (!stream_has_default_format())
+            return write_streamed(arg);
+        write_fast(arg);
         return *this;
     }
 
@@ -599,15 +690,15 @@ public:
     }
 
     /**
-     * Write string to the the table.
+     * Write string to the table.
      *
      * Write specified string to the current cell.
      *
      * @param str
      *   String to write.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     bool write(const char *str)
     {
@@ -623,7 +714,7 @@ public:
     }
 
     /**
-     * Write string to the the table and go to the next line.
+     * Write string to the table and go to the next line.
      *
      * Write specified string to the current cell and move current position to
      * the first cell of the next line(row).
@@ -631,8 +722,8 @@ public:
      * @param str
      *   String to write.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     bool write_ln(const char *str)
     {
@@ -648,23 +739,23 @@ public:
     }
 
     /**
-     * Write string to the the table.
+     * Write string to the table.
      *
      * Write specified string to the current cell.
      *
      * @param str
      *   String to write.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     bool write(const std::string &str)
     {
-        return write(str.c_str());
+        return write_len(str.data(), str.size());
     }
 
     /**
-     * Write string to the the table and go to the next line.
+     * Write string to the table and go to the next line.
      *
      * Write specified string to the current cell and move current position to
      * the first cell of the next line(row).
@@ -672,12 +763,114 @@ public:
      * @param str
      *   String to write.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     bool write_ln(const std::string &str)
     {
-        return write_ln(str.c_str());
+        return write_len(str.data(), str.size()) && FT_IS_SUCCESS(ft_ln(table_));
+    }
+
+    /**
+     * Write string to the table without copying it.
+     *
+     * The string is moved to the cell and is released when the cell content
+     * is replaced or the table is destroyed.
+     *
+     * @param str
+     *   String to write.
+     * @return
+     *   - true: Success; data were written
+     *   - false: In case of error
+     */
+    bool write(std::string &&str)
+    {
+        std::string *owner = new std::string(std::move(str));
+        bool status = false;
+#ifdef FT_HAVE_UTF8
+        if (TT == table_type::character) {
+            status = FT_IS_SUCCESS(ft_write_owned_by(table_, owner->c_str(), owner->size(),
+                                                     delete_string, owner));
+        } else {
+            status = FT_IS_SUCCESS(ft_u8write_owned_by(table_, (const void *)owner->c_str(), owner->size(),
+                                                       delete_string, owner));
+        }
+#else
+        status = FT_IS_SUCCESS(ft_write_owned_by(table_, owner->c_str(), owner->size(),
+                                                 delete_string, owner));
+#endif
+        if (!status)
+            delete owner;
+        return status;
+    }
+
+    /**
+     * Write string to the table without copying it and go to the next line.
+     *
+     * @param str
+     *   String to write.
+     * @return
+     *   - true: Success; data were written
+     *   - false: In case of error
+     */
+    bool write_ln(std::string &&str)
+    {
+        return write(std::move(str)) && FT_IS_SUCCESS(ft_ln(table_));
+    }
+
+#if __cplusplus >= 201703L
+    /**
+     * Write string to the table.
+     *
+     * @param str
+     *   String to write.
+     * @return
+     *   - true: Success; data were written
+     *   - false: In case of error
+     */
+    bool write(std::string_view str)
+    {
+        return write_len(str.data(), str.size());
+    }
+
+    /**
+     * Write string to the table and go to the next line.
+     *
+     * @param str
+     *   String to write.
+     * @return
+     *   - true: Success; data were written
+     *   - false: In case of error
+     */
+    bool write_ln(std::string_view str)
+    {
+        return write(str) && FT_IS_SUCCESS(ft_ln(table_));
+    }
+#endif
+
+    /**
+     * Write numbers to the column of the table.
+     *
+     * Numbers are written to cells [first_row, first_row + values.size()) of
+     * column `col`. Current position of the table is not changed.
+     *
+     * @param col
+     *   Column of the cells.
+     * @param first_row
+     *   Row of the first cell.
+     * @param values
+     *   Contiguous container of numbers (std::vector, std::array ...).
+     * @param fmt_spec
+     *   Format specification of the numbers (see ft_write_column_i64).
+     * @return
+     *   - true: Success; data were written
+     *   - false: In case of error
+     */
+    template <typename Container>
+    bool write_column(std::size_t col, std::size_t first_row, const Container &values,
+                      const char *fmt_spec = NULL)
+    {
+        return write_column_impl(col, first_row, values.data(), values.size(), fmt_spec);
     }
 
 #ifdef __cpp_variadic_templates
@@ -692,8 +885,8 @@ public:
      * @param strings
      *   Strings to write.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     template <typename T, typename ...Ts>
     bool write(const T &str, const Ts &...strings)
@@ -713,8 +906,8 @@ public:
      * @param strings
      *   Strings to write.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     template <typename T, typename ...Ts>
     bool write_ln(const T &str, const Ts &...strings)
@@ -818,8 +1011,8 @@ public:
      * @param first, last
      *   Range of elements.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     template <typename InputIt>
     bool range_write(InputIt first, InputIt last)
@@ -840,8 +1033,8 @@ public:
      * @param first, last
      *   Range of elements.
      * @return
-     *   - 0: Success; data were written
-     *   - (<0): In case of error
+     *   - true: Success; data were written
+     *   - false: In case of error
      */
     template <typename InputIt>
     bool range_write_ln(InputIt first, InputIt last)
@@ -868,6 +1061,23 @@ public:
         return FT_IS_SUCCESS(ft_set_border_style(table_, style));
     }
 
+    /**
+     * Set format of numbers stored in the column.
+     *
+     * @param col
+     *   Column of the table.
+     * @param fmt_spec
+     *   Format specification of the numbers (see ft_set_column_format) or
+     *   NULL to restore the default format.
+     * @return
+     *   - True: Success; format was set.
+     *   - False: Error
+     */
+    bool set_column_format(std::size_t col, const char *fmt_spec)
+    {
+        return FT_IS_SUCCESS(ft_set_column_format(table_, col, fmt_spec));
+    }
+
     /**
      * Set current cell position.
      *
@@ -955,7 +1165,179 @@ public:
                                              FT_TPROP_ADDING_STRATEGY,
                                              static_cast<int>(value)));
     }
+
+    /**
+     * Set handling of invalid UTF-8 content.
+     *
+     * @param value
+     *   Handling of ill-formed UTF-8 sequences.
+     * @return
+     *   - true: Success; table property was changed.
+     *   - false: In case of error.
+     */
+    bool set_invalid_utf8_handling(fort::invalid_utf8 value)
+    {
+        return FT_IS_SUCCESS(ft_set_tbl_prop(table_,
+                                             FT_TPROP_INVALID_UTF8,
+                                             static_cast<int>(value)));
+    }
+
+    /**
+     * Enable interning of strings written to the table.
+     *
+     * Identical strings written to the table are stored once (see
+     * intern_stats).
+     *
+     * @param value
+     *   True to intern strings.
+     * @return
+     *   - true: Success; table property was changed.
+     *   - false: In case of error.
+     */
+    bool set_intern_strings(bool value)
+    {
+        return FT_IS_SUCCESS(ft_set_tbl_prop(table_,
+                                             FT_TPROP_INTERN_STRINGS,
+                                             value ? 1 : 0));
+    }
+
+    /**
+     * Get statistics of strings interned by the table.
+     *
+     * @return
+     *   Statistics of interned strings.
+     */
+    ft_intern_stats_t intern_stats() const
+    {
+        ft_intern_stats_t stats;
+        ft_get_intern_stats(table_, &stats);
+        return stats;
+    }
 private:
+    bool write_column_impl(std::size_t col, std::size_t first_row, const int64_t *values,
+                           std::size_t n, const char *fmt_spec)
+    {
+        return FT_IS_SUCCESS(ft_write_column_i64(table_, col, first_row, values, n, fmt_spec));
+    }
+
+    bool write_column_impl(std::size_t col, std::size_t first_row, const uint64_t *values,
+                           std::size_t n, const char *fmt_spec)
+    {
+        return FT_IS_SUCCESS(ft_write_column_u64(table_, col, first_row, values, n, fmt_spec));
+    }
+
+    bool write_column_impl(std::size_t col, std::size_t first_row, const double *values,
+                           std::size_t n, const char *fmt_spec)
+    {
+        return FT_IS_SUCCESS(ft_write_column_f64(table_, col, first_row, values, n, fmt_spec));
+    }
+
+    /* Other numeric types are converted by chunks to one of the types above */
+    template <typename T>
+    bool write_column_impl(std::size_t col, std::size_t first_row, const T *values,
+                           std::size_t n, const char *fmt_spec)
+    {
+        static_assert(std::is_arithmetic<T>::value, "Column values should be numbers");
+        using value_t = typename std::conditional<std::is_floating_point<T>::value, double,
+              typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type>::type;
+
+        const std::size_t chunk_sz = 256;
+        value_t chunk[chunk_sz];
+        for (std::size_t i = 0; i < n; i += chunk_sz) {
+            std::size_t count = (n - i < chunk_sz) ? n - i : chunk_sz;
+            for (std::size_t j = 0; j < count; ++j)
+                chunk[j] = static_cast<value_t>(values[i + j]);
+            if (!write_column_impl(col, first_row + i, static_cast<const value_t *>(chunk), count, fmt_spec))
+                return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    table &write_streamed(const T &arg)
+    {
+        constexpr bool is_manip = fort::is_stream_manipulator<typename std::decay<T>::type>();
+        stream_ << arg;
+        if (stream_.tellp() >= 0 && !is_manip) {
+            const std::string str = stream_.str();
+            write_len(str.data(), str.size());
+            stream_.str(std::string());
+        }
+        return *this;
+    }
+
+    bool stream_has_default_format() const
+    {
+        return stream_.width() == 0
+               && stream_.precision() == 6
+               && stream_.flags() == (std::ios_base::skipws | std::ios_base::dec);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_signed<T>::value, bool>::type
+    write_fast(T value)
+    {
+        return FT_IS_SUCCESS(ft_write_i64(table_, static_cast<int64_t>(value)));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_unsigned<T>::value, bool>::type
+    write_fast(T value)
+    {
+        return FT_IS_SUCCESS(ft_write_u64(table_, static_cast<uint64_t>(value)));
+    }
+
+    bool write_fast(float value)
+    {
+        return FT_IS_SUCCESS(ft_write_f64(table_, value));
+    }
+
+    bool write_fast(double value)
+    {
+        return FT_IS_SUCCESS(ft_write_f64(table_, value));
+    }
+
+    bool write_fast(char ch)
+    {
+        return write_len(&ch, 1);
+    }
+
+    bool write_fast(const char *str)
+    {
+        return write_len(str, std::strlen(str));
+    }
+
+    bool write_fast(const std::string &str)
+    {
+        return write_len(str.data(), str.size());
+    }
+
+#if __cplusplus >= 201703L
+    bool write_fast(std::string_view str)
+    {
+        return write_len(str.data(), str.size());
+    }
+#endif
+
+    bool write_len(const char *str, std::size_t len)
+    {
+#ifdef FT_HAVE_UTF8
+        if (TT == table_type::character) {
+            return FT_IS_SUCCESS(ft_write_len(table_, str, len));
+        } else {
+            return FT_IS_SUCCESS(ft_u8write_len(table_, (const void *)str, len));
+        }
+#else
+        return FT_IS_SUCCESS(ft_write_len(table_, str, len));
+#endif
+    }
+
+    /* Releases string moved to a cell by write(std::string &&) */
+    static void delete_string(void *str)
+    {
+        delete static_cast<std::string *>(str);
+    }
+
     ft_table_t *table_;
     mutable std::stringstream stream_;
     friend class property_owner<table>;
@@ -991,6 +1373,13 @@ public:
             return operator=(str.c_str());
         }
 
+        table_cell &operator=(std::string &&str)
+        {
+            ft_set_cur_cell(ps_table_->table_, ps_row_idx_, ps_coll_idx_);
+            ps_table_->write(std::move(str));
+            return *this;
+        }
+
         /**
          * Set column span for the specified cell of the table.
          *
@@ -1092,6 +1481,149 @@ public:
         std::size_t bottom_right_col_;
     };
 
+    /**
+     * Range of lines of string representation of the table.
+     *
+     * Lines are printed lazily while the range is iterated, so string
+     * representation of the whole table is never kept in memory. The table
+     * should not be changed while the range is iterated.
+     */
+    class line_range
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = std::string;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const std::string *;
+            using reference = const std::string &;
+
+            iterator() = default;
+
+            explicit iterator(line_range *range)
+                : range_(range)
+            {
+                next();
+            }
+
+            reference operator*() const
+            {
+                return line_;
+            }
+
+            pointer operator->() const
+            {
+                return &line_;
+            }
+
+            iterator &operator++()
+            {
+                next();
+                return *this;
+            }
+
+            bool operator==(const iterator &other) const
+            {
+                return range_ == other.range_;
+            }
+
+            bool operator!=(const iterator &other) const
+            {
+                return range_ != other.range_;
+            }
+
+        private:
+            void next()
+            {
+                if (line_.empty())
+                    line_.resize(line_.capacity() ? line_.capacity() : 128);
+                else
+                    line_.resize(line_.capacity());
+                std::size_t len = 0;
+                int status = ft_line_iter_next(range_->iter_, &line_[0], line_.size() + 1, &len);
+                if (status == FT_EINVAL) {
+                    line_.resize(len);
+                    status = ft_line_iter_next(range_->iter_, &line_[0], line_.size() + 1, &len);
+                }
+                if (FT_IS_ERROR(status))
+                    throw std::runtime_error("Error during table to string conversion");
+                if (status == 0) {
+                    range_ = nullptr;
+                    line_.clear();
+                    return;
+                }
+                line_.resize(len);
+            }
+
+            line_range *range_ = nullptr;
+            std::string line_;
+        };
+
+        explicit line_range(const table &tbl)
+            : tbl_(&tbl) {}
+
+        line_range(const line_range &) = delete;
+        line_range &operator=(const line_range &) = delete;
+
+        line_range(line_range &&other) noexcept
+            : tbl_(other.tbl_), iter_(other.iter_)
+        {
+            other.iter_ = nullptr;
+        }
+
+        ~line_range()
+        {
+            ft_line_iter_end(iter_);
+        }
+
+        /**
+         * Start iteration over lines.
+         *
+         * Each call restarts printing of the table.
+         */
+        iterator begin()
+        {
+            ft_line_iter_end(iter_);
+#ifdef FT_HAVE_UTF8
+            iter_ = (TT == table_type::character)
+                    ? ft_line_iter_begin(tbl_->table_)
+                    : ft_u8line_iter_begin(tbl_->table_);
+#else
+            iter_ = ft_line_iter_begin(tbl_->table_);
+#endif
+            if (iter_ == nullptr)
+                throw std::runtime_error("Error during table to string conversion");
+            return iterator(this);
+        }
+
+        iterator end()
+        {
+            return iterator();
+        }
+
+    private:
+        const table *tbl_;
+        ft_line_iter_t *iter_ = nullptr;
+    };
+
+    /**
+     * Get range of lines of string representation of the table.
+     *
+     * @code
+     *     for (const auto &line : tbl.lines())
+     *         std::cout << line << std::endl;
+     * @endcode
+     *
+     * @return
+     *   Range of lines without new line characters.
+     */
+    line_range lines() const
+    {
+        return line_range(*this);
+    }
+
 
     class default_properties: public property_owner_t
     {
@@ -1184,6 +1716,28 @@ public:
         return ft_col_count(table_);
     }
 
+    /**
+     * Reserve memory for rows and cells of the table.
+     *
+     * Size of the table is not changed, but table of the known size is filled
+     * without reallocations.
+     *
+     * @param rows
+     *   Number of rows.
+     * @param cols
+     *   Number of columns.
+     * @param cell_props
+     *   Number of cells with properties.
+     * @return
+     *   - True: Success; memory was reserved.
+     *   - False: Error
+     */
+    bool reserve(std::size_t rows, std::size_t cols, std::size_t cell_props = 0)
+    {
+        return FT_IS_SUCCESS(ft_reserve(table_, rows, cols))
+               && FT_IS_SUCCESS(ft_reserve_cell_props(table_, cell_props));
+    }
+
     /**
      * Get current cell.
      *
@@ -1248,6 +1802,18 @@ public:
     }
 };
 
+/**
+ * Print string representation of the table to the stream.
+ *
+ * @see table::render_to
+ */
+template <table_type TT>
+std::ostream &operator<<(std::ostream &os, const table<TT> &tbl)
+{
+    tbl.render_to(os);
+    return os;
+}
+
 /**
  * Formatted table containing common char content.
  *
@@ -3,51 +3,64 @@
 #include "string_buffer.h"
 #include <assert.h>
 
-struct f_cell {
-    f_string_buffer_t *str_buffer;
-    enum f_cell_type cell_type;
+static const char empty_cell_str[] = "";
+
+/* Metrics of the content are precomputed, so the cell is never written */
+static const f_cell_t empty_cell = {
+    {
+        {(char *)empty_cell_str}, {0}, CHAR_BUF, F_BUF_BORROWED, NULL,
+        {0, 0, 0, 0, empty_cell_str, NULL, 0, 1, 0, CHAR_BUF, 1}
+    },
+    COMMON_CELL, F_CELL_TEXT, {0}
 };
 
 FT_INTERNAL
-f_cell_t *create_cell(void)
+const f_cell_t *get_empty_cell(void)
 {
-    f_cell_t *cell = (f_cell_t *)F_CALLOC(sizeof(f_cell_t), 1);
-    if (cell == NULL)
-        return NULL;
-    cell->str_buffer = create_string_buffer(DEFAULT_STR_BUF_SIZE, CHAR_BUF);
-    if (cell->str_buffer == NULL) {
-        F_FREE(cell);
-        return NULL;
-    }
+    return &empty_cell;
+}
+
+FT_INTERNAL
+void init_cell(f_cell_t *cell)
+{
+    assert(cell);
+    /* Empty buffer doesn't allocate memory for the content */
+    init_string_buffer(&cell->str_buffer, CHAR_BUF);
     cell->cell_type = COMMON_CELL;
-    return cell;
+    cell->value_type = F_CELL_TEXT;
+    memset(&cell->value, 0, sizeof(cell->value));
 }
 
 FT_INTERNAL
-void destroy_cell(f_cell_t *cell)
+void release_cell(f_cell_t *cell)
 {
-    if (cell == NULL)
-        return;
-    destroy_string_buffer(cell->str_buffer);
-    F_FREE(cell);
+    assert(cell);
+    release_buffer_data(&cell->str_buffer);
 }
 
 FT_INTERNAL
-f_cell_t *copy_cell(f_cell_t *cell)
+int cell_is_unwritten(const f_cell_t *cell)
 {
     assert(cell);
+    return cell->value_type == F_CELL_TEXT && buffer_is_unwritten(&cell->str_buffer);
+}
 
-    f_cell_t *result = create_cell();
-    if (result == NULL)
-        return NULL;
-    destroy_string_buffer(result->str_buffer);
-    result->str_buffer = copy_string_buffer(cell->str_buffer);
-    if (result->str_buffer == NULL) {
-        destroy_cell(result);
-        return NULL;
+FT_INTERNAL
+f_status copy_cell(f_cell_t *result, const f_cell_t *cell)
+{
+    assert(result);
+    assert(cell);
+
+    init_cell(result);
+    f_status status = copy_string_buffer(&result->str_buffer, &cell->str_buffer);
+    if (FT_IS_ERROR(status)) {
+        release_cell(result);
+        return status;
     }
     result->cell_type = cell->cell_type;
-    return result;
+    result->value_type = cell->value_type;
+    result->value = cell->value;
+    return FT_SUCCESS;
 }
 
 FT_INTERNAL
@@ -64,6 +77,92 @@ enum f_cell_type get_cell_type(const f_cell_t *cell)
     return cell->cell_type;
 }
 
+FT_INTERNAL
+f_status set_cell_value(f_cell_t *cell, enum f_cell_value_type type, const union f_number *value)
+{
+    assert(cell);
+    assert(type != F_CELL_TEXT);
+    assert(value);
+
+    /* Text of typed cells is produced only while the table is printed */
+    f_string_view_t empty;
+    empty.type = CHAR_BUF;
+    empty.u.cstr = "";
+    fill_buffer_from_external(&cell->str_buffer, &empty, NULL, NULL);
+
+    cell->value_type = type;
+    cell->value = *value;
+    return FT_SUCCESS;
+}
+
+static
+enum f_number_type cell_number_type(const f_cell_t *cell)
+{
+    switch (cell->value_type) {
+        case F_CELL_I64:
+            return F_NUM_I64;
+        case F_CELL_F64:
+            return F_NUM_F64;
+        default:
+            return F_NUM_U64;
+    }
+}
+
+/*
+ * Writes text of the typed value of the cell to buf. Returns the same value
+ * as snprintf.
+ */
+static
+int cell_value_to_str(const f_cell_t *cell, const f_context_t *context, char *buf, size_t buf_sz)
+{
+    if (cell->value_type == F_CELL_BOOL) {
+        const char *str = cell->value.u64 ? "true" : "false";
+        size_t len = strlen(str);
+        if (len < buf_sz)
+            memcpy(buf, str, len + 1);
+        return (int)len;
+    }
+
+    enum f_number_type type = cell_number_type(cell);
+    const char *fmt = get_column_number_format(context->table_properties, context->column, type);
+    return format_number(buf, buf_sz, fmt, type, &cell->value);
+}
+
+/*
+ * Width of the text of the typed value. Text of integers in the default
+ * format is not produced at all.
+ */
+static
+size_t cell_value_width(const f_cell_t *cell, const f_context_t *context)
+{
+    enum f_number_type type = cell_number_type(cell);
+    const char *fmt = get_column_number_format(context->table_properties, context->column, type);
+    if (fmt == NULL) {
+        switch (cell->value_type) {
+            case F_CELL_I64:
+                return i64_str_len(cell->value.i64);
+            case F_CELL_U64:
+                return u64_str_len(cell->value.u64);
+            case F_CELL_BOOL:
+                return cell->value.u64 ? 4 : 5;
+            default:
+                break;
+        }
+    }
+
+    char buf[FT_NUMBER_BUF_SZ];
+    int len = cell_value_to_str(cell, context, buf, sizeof(buf));
+    return len < 0 ? 0 : (size_t)len;
+}
+
+static
+size_t cell_text_height(const f_cell_t *cell)
+{
+    if (cell->value_type != F_CELL_TEXT)
+        return 1;
+    return buffer_text_visible_height(&cell->str_buffer);
+}
+
 FT_INTERNAL
 size_t cell_vis_width(const f_cell_t *cell, const f_context_t *context)
 {
@@ -82,8 +181,10 @@ size_t cell_vis_width(const f_cell_t *cell, const f_context_t *context)
     size_t padding_left = get_cell_property_hierarchically(properties, row, column, FT_CPROP_LEFT_PADDING);
     size_t padding_right = get_cell_property_hierarchically(properties, row, column, FT_CPROP_RIGHT_PADDING);
     size_t result = padding_left + padding_right;
-    if (cell->str_buffer && cell->str_buffer->str.data) {
-        result += buffer_text_visible_width(cell->str_buffer);
+    if (cell->value_type != F_CELL_TEXT) {
+        result += cell_value_width(cell, context);
+    } else if (cell->str_buffer.str.data) {
+        result += buffer_text_visible_width(&cell->str_buffer);
     }
     result = MAX(result, (size_t)get_cell_property_hierarchically(properties, row, column, FT_CPROP_MIN_WIDTH));
     return result;
@@ -115,6 +216,9 @@ size_t cell_invis_codes_width(const f_cell_t *cell, const f_context_t *context)
     char reset_content_style_tag[TEXT_STYLE_TAG_MAX_SIZE];
     get_reset_style_tag_for_content(properties, row, column, reset_content_style_tag, TEXT_STYLE_TAG_MAX_SIZE);
     result += strlen(reset_content_style_tag);
+
+    if (cell->value_type == F_CELL_TEXT && cell->str_buffer.str.data)
+        result += buffer_text_extra_code_units(&cell->str_buffer);
     return result;
 }
 
@@ -132,13 +236,73 @@ size_t hint_height_cell(const f_cell_t *cell, const f_context_t *context)
     size_t empty_string_height = get_cell_property_hierarchically(properties, row, column, FT_CPROP_EMPTY_STR_HEIGHT);
 
     size_t result = padding_top + padding_bottom;
-    if (cell->str_buffer && cell->str_buffer->str.data) {
-        size_t text_height = buffer_text_visible_height(cell->str_buffer);
+    if (cell->str_buffer.str.data) {
+        size_t text_height = cell_text_height(cell);
         result += text_height == 0 ? empty_string_height : text_height;
     }
     return result;
 }
 
+/*
+ * Prints text of the typed value of the cell as content of a buffer of the
+ * output type.
+ */
+static
+int cell_value_printf(const f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t vis_width,
+                      const char *content_style_tag, const char *reset_content_style_tag)
+{
+    char str_buf[FT_NUMBER_BUF_SZ];
+    char *str = str_buf;
+    int result = -1;
+
+    int len = cell_value_to_str(cell, cntx->cntx, str_buf, sizeof(str_buf));
+    if (len < 0)
+        return -1;
+    if ((size_t)len >= sizeof(str_buf)) {
+        /* Number formatted with user spec can be very long */
+        str = (char *)F_MALLOC((size_t)len + 1);
+        if (str == NULL)
+            return -1;
+        cell_value_to_str(cell, cntx->cntx, str, (size_t)len + 1);
+    }
+
+    f_string_buffer_t buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = cntx->b_type;
+    buffer.ownership = F_BUF_BORROWED;
+    buffer.str.cstr = str;
+    buffer.mem.data_sz = (size_t)len + 1;
+
+#ifdef FT_HAVE_WCHAR
+    wchar_t wstr_buf[FT_NUMBER_BUF_SZ];
+    wchar_t *wstr = NULL;
+    if (cntx->b_type == W_CHAR_BUF) {
+        wstr = wstr_buf;
+        if ((size_t)len >= FT_NUMBER_BUF_SZ) {
+            wstr = (wchar_t *)F_MALLOC(((size_t)len + 1) * sizeof(wchar_t));
+            if (wstr == NULL)
+                goto clear;
+        }
+        /* Text of numbers is ASCII */
+        int i = 0;
+        for (i = 0; i <= len; ++i)
+            wstr[i] = (wchar_t)(unsigned char)str[i];
+        buffer.str.wstr = wstr;
+        buffer.mem.data_sz = ((size_t)len + 1) * sizeof(wchar_t);
+    }
+#endif /* FT_HAVE_WCHAR */
+
+    result = buffer_printf(&buffer, row, cntx, vis_width, content_style_tag, reset_content_style_tag);
+
+#ifdef FT_HAVE_WCHAR
+clear:
+    if (wstr != NULL && wstr != wstr_buf)
+        F_FREE(wstr);
+#endif /* FT_HAVE_WCHAR */
+    if (str != str_buf)
+        F_FREE(str);
+    return result;
+}
 
 FT_INTERNAL
 int cell_printf(f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t vis_width)
@@ -199,26 +363,28 @@ int cell_printf(f_cell_t *cell, size_t row, f_conv_context_t *cntx, size_t vis_w
 
     if (row >= hint_height_cell(cell, context)
         || row < padding_top
-        || row >= (padding_top + buffer_text_visible_height(cell->str_buffer))) {
+        || row >= (padding_top + cell_text_height(cell))) {
         WRITE_CELL_STYLE_TAG;
         WRITE_CONTENT_STYLE_TAG;
         WRITE_RESET_CONTENT_STYLE_TAG;
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, buf_len - TOTAL_WRITTEN - R3, FT_SPACE));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, buf_len - TOTAL_WRITTEN - R3));
         WRITE_RESET_CELL_STYLE_TAG;
 
         return (int)TOTAL_WRITTEN;
     }
 
     WRITE_CELL_STYLE_TAG;
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, L2, FT_SPACE));
-    if (cell->str_buffer) {
-        CHCK_RSLT_ADD_TO_WRITTEN(buffer_printf(cell->str_buffer, row - padding_top, cntx, vis_width - L2 - R2, content_style_tag, reset_content_style_tag));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, L2));
+    if (cell->value_type != F_CELL_TEXT) {
+        CHCK_RSLT_ADD_TO_WRITTEN(cell_value_printf(cell, row - padding_top, cntx, vis_width - L2 - R2, content_style_tag, reset_content_style_tag));
+    } else if (cell->str_buffer.str.data) {
+        CHCK_RSLT_ADD_TO_WRITTEN(buffer_printf(&cell->str_buffer, row - padding_top, cntx, vis_width - L2 - R2, content_style_tag, reset_content_style_tag));
     } else {
         WRITE_CONTENT_STYLE_TAG;
         WRITE_RESET_CONTENT_STYLE_TAG;
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, vis_width - L2 - R2, FT_SPACE));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, vis_width - L2 - R2));
     }
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, R2, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, R2));
     WRITE_RESET_CELL_STYLE_TAG;
 
     return (int)TOTAL_WRITTEN;
@@ -239,7 +405,8 @@ f_status fill_cell_from_string(f_cell_t *cell, const char *str)
     assert(str);
     assert(cell);
 
-    return fill_buffer_from_string(cell->str_buffer, str);
+    cell->value_type = F_CELL_TEXT;
+    return fill_buffer_from_string(&cell->str_buffer, str);
 }
 
 #ifdef FT_HAVE_WCHAR
@@ -249,17 +416,19 @@ f_status fill_cell_from_wstring(f_cell_t *cell, const wchar_t *str)
     assert(str);
     assert(cell);
 
-    return fill_buffer_from_wstring(cell->str_buffer, str);
+    cell->value_type = F_CELL_TEXT;
+    return fill_buffer_from_wstring(&cell->str_buffer, str);
 }
 #endif
 
 #ifdef FT_HAVE_UTF8
-static
+FT_INTERNAL
 f_status fill_cell_from_u8string(f_cell_t *cell, const void *str)
 {
     assert(str);
     assert(cell);
-    return fill_buffer_from_u8string(cell->str_buffer, str);
+    cell->value_type = F_CELL_TEXT;
+    return fill_buffer_from_u8string(&cell->str_buffer, str);
 }
 #endif /* FT_HAVE_UTF8 */
 
@@ -267,8 +436,8 @@ FT_INTERNAL
 f_string_buffer_t *cell_get_string_buffer(f_cell_t *cell)
 {
     assert(cell);
-    assert(cell->str_buffer);
-    return cell->str_buffer;
+    cell->value_type = F_CELL_TEXT;
+    return &cell->str_buffer;
 }
 
 FT_INTERNAL
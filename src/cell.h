@@ -2,15 +2,54 @@
 #define CELL_H
 
 #include "fort_utils.h"
+#include "string_buffer.h"
 
+/*
+ * Type of the cell content. Typed values are formatted only while the table
+ * is printed.
+ */
+enum f_cell_value_type {
+    F_CELL_TEXT = 0,
+    F_CELL_I64,
+    F_CELL_U64,
+    F_CELL_F64,
+    F_CELL_BOOL
+};
+
+/*
+ * Cells are stored by value in contiguous arrays of rows (see row.c), so
+ * pointers to cells are invalidated when cells are added to or removed from
+ * the row.
+ */
+struct f_cell {
+    f_string_buffer_t str_buffer;
+    enum f_cell_type cell_type;
+    enum f_cell_value_type value_type;
+    union f_number value;  /* typed value (bool is stored in u64) */
+};
+
+/*
+ * Returns empty cell which represents gaps of sparse rows. The cell must not
+ * be modified.
+ */
+FT_INTERNAL
+const f_cell_t *get_empty_cell(void);
+
+/* Initializes empty cell; it doesn't allocate memory */
+FT_INTERNAL
+void init_cell(f_cell_t *cell);
+
+/* Frees content of the cell */
 FT_INTERNAL
-f_cell_t *create_cell(void);
+void release_cell(f_cell_t *cell);
 
+/* Returns 1 if nothing was written to the cell since it was initialized */
 FT_INTERNAL
-void destroy_cell(f_cell_t *cell);
+int cell_is_unwritten(const f_cell_t *cell);
 
+/* Initializes `result` with a copy of `cell` */
 FT_INTERNAL
-f_cell_t *copy_cell(f_cell_t *cell);
+f_status copy_cell(f_cell_t *result, const f_cell_t *cell);
 
 FT_INTERNAL
 size_t cell_vis_width(const f_cell_t *cell, const f_context_t *context);
@@ -38,10 +77,22 @@ FT_INTERNAL
 f_status fill_cell_from_wstring(f_cell_t *cell, const wchar_t *str);
 #endif
 
+#ifdef FT_HAVE_UTF8
+FT_INTERNAL
+f_status fill_cell_from_u8string(f_cell_t *cell, const void *str);
+#endif /* FT_HAVE_UTF8 */
+
 FT_INTERNAL
 f_status fill_cell_from_buffer(f_cell_t *cell, const f_string_buffer_t *buf);
 
+/*
+ * Returns buffer to write text content of the cell. Typed value of the cell
+ * is dropped.
+ */
 FT_INTERNAL
 f_string_buffer_t *cell_get_string_buffer(f_cell_t *cell);
 
+FT_INTERNAL
+f_status set_cell_value(f_cell_t *cell, enum f_cell_value_type type, const union f_number *value);
+
 #endif /* CELL_H */
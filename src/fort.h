@@ -277,6 +277,80 @@ typedef struct ft_table ft_table_t;
  */
 ft_table_t *ft_create_table(void);
 
+/**
+ * Memory allocator used by libfort.
+ *
+ * All functions get `ctx` as the last argument. calloc_fn and realloc_fn are
+ * optional: if they are NULL, they are emulated with malloc_fn and free_fn.
+ * free_fn is never called with NULL pointer.
+ */
+typedef struct ft_allocator {
+    void *(*malloc_fn)(size_t size, void *ctx);
+    void *(*calloc_fn)(size_t nmemb, size_t size, void *ctx);
+    /* old_size is the size of the block pointed by ptr (0 if ptr is NULL) */
+    void *(*realloc_fn)(void *ptr, size_t old_size, size_t size, void *ctx);
+    void (*free_fn)(void *ptr, void *ctx);
+    void *ctx;
+} ft_allocator_t;
+
+/**
+ * Create formatted table which uses its own allocator.
+ *
+ * All memory of the table (including the table itself, its copies and
+ * results of conversions to string) is allocated and released with
+ * `allocator` regardless of the global allocator (see ft_set_allocator).
+ *
+ * @param allocator
+ *   Allocator of the table (it is copied to the table). malloc_fn and free_fn
+ *   should be set.
+ * @return
+ *   The pointer to the new allocated ft_table_t, on success. NULL on error.
+ */
+ft_table_t *ft_create_table_with_allocator(const ft_allocator_t *allocator);
+
+/**
+ * Function providing content of the cells of a virtual table.
+ *
+ * @param row
+ *   Row of the requested cell.
+ * @param col
+ *   Column of the requested cell.
+ * @param ctx
+ *   User data passed to ft_create_virtual_table.
+ * @return
+ *   Content of the cell or NULL for an empty cell. Returned string should stay
+ *   valid until the next invocation of the provider.
+ */
+typedef const char *(*ft_cell_provider_t)(size_t row, size_t col, void *ctx);
+
+/**
+ * Create virtual table.
+ *
+ * Virtual table doesn't store content of its cells. Content is requested
+ * from the provider cell by cell while the table is converted to string, so
+ * memory used by the table depends only on the number of columns and on
+ * the properties and cell spans set for it. Rendering of rows with
+ * ft_render_rows also caches height of each row of the table (one size_t per
+ * row) till the table is changed. Provider can be invoked several times for
+ * the same cell during one conversion.
+ *
+ * Cell properties, separators and cell spans can be set for virtual tables as
+ * for ordinary ones. Functions changing content of the table (ft_write,
+ * ft_printf, ft_erase_range ...) fail for virtual tables.
+ *
+ * @param rows
+ *   Number of rows in the table.
+ * @param cols
+ *   Number of columns in the table.
+ * @param provider
+ *   Function providing content of the cells.
+ * @param ctx
+ *   User data passed to the provider.
+ * @return
+ *   The pointer to the new allocated ft_table_t, on success. NULL on error.
+ */
+ft_table_t *ft_create_virtual_table(size_t rows, size_t cols, ft_cell_provider_t provider, void *ctx);
+
 /**
  * Destroy formatted table.
  *
@@ -380,6 +454,69 @@ size_t ft_row_count(const ft_table_t *table);
  */
 size_t ft_col_count(const ft_table_t *table);
 
+/**
+ * Reserve memory for rows and cells of the table.
+ *
+ * Size of the table is not changed. Rows of the table are reserved for `rows`
+ * rows, every row (including rows added later) is reserved for `cols` cells.
+ * So table of the known size is filled without reallocations.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param rows
+ *   Number of rows.
+ * @param cols
+ *   Number of columns.
+ * @return
+ *   - 0: Success; memory was reserved.
+ *   - (<0): In case of error.
+ */
+int ft_reserve(ft_table_t *table, size_t rows, size_t cols);
+
+/**
+ * Reserve memory for properties of `n` cells.
+ *
+ * Useful when properties are set for many separate cells (see
+ * ft_set_cell_prop).
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param n
+ *   Number of cells with properties.
+ * @return
+ *   - 0: Success; memory was reserved.
+ *   - (<0): In case of error.
+ */
+int ft_reserve_cell_props(ft_table_t *table, size_t n);
+
+/**
+ * Statistics of strings interned by the table.
+ *
+ * If table property FT_TPROP_INTERN_STRINGS is set to 1, identical strings
+ * written to cells of the table are stored once (with their precomputed
+ * width and lines). It is useful for columns with a few distinct values.
+ */
+struct ft_intern_stats {
+    size_t lookups;  /**< Number of interned writes. */
+    size_t hits;     /**< Number of writes of already stored strings. */
+    size_t strings;  /**< Number of distinct stored strings. */
+    size_t bytes;    /**< Memory used by stored strings. */
+};
+typedef struct ft_intern_stats ft_intern_stats_t;
+
+/**
+ * Get statistics of strings interned by the table.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param stats
+ *   Pointer to the structure to be filled with statistics.
+ * @return
+ *   - 0: Success; stats were filled.
+ *   - (<0): In case of error.
+ */
+int ft_get_intern_stats(const ft_table_t *table, ft_intern_stats_t *stats);
+
 /**
  *  Erase range of cells.
  *
@@ -488,6 +625,72 @@ int ft_printf_ln_impl(ft_table_t *table, const char *fmt, ...) FT_PRINTF_ATTRIBU
  */
 void ft_set_default_printf_field_separator(char separator);
 
+/**
+ * Compiled format string of {@link ft_printf}.
+ */
+typedef struct ft_row_format ft_row_format_t;
+
+/**
+ * Compile format string for {@link ft_printf_compiled}.
+ *
+ * Format string is split to cells by the current field separator and
+ * conversion specifications of every cell are parsed once, so printing rows
+ * with the same format doesn't repeat this work.
+ *
+ * @param fmt
+ *   Format string (see {@link ft_printf}). Positional arguments ("%1$d") are
+ *   not supported.
+ * @return
+ *   - Compiled format that should be destroyed with ft_destroy_row_format.
+ *   - NULL: In case of error or unsupported conversion specification.
+ */
+ft_row_format_t *ft_compile_row_format(const char *fmt);
+
+/**
+ * Destroy compiled format.
+ *
+ * @param format
+ *   Compiled format returned by ft_compile_row_format.
+ */
+void ft_destroy_row_format(ft_row_format_t *format);
+
+/**
+ * Write data formatted according to the compiled format string to a variety
+ * of table cells.
+ *
+ * Every cell of the format is printed directly to its cell. Unlike
+ * {@link ft_printf} field separators in the printed data don't split it to
+ * more cells.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param format
+ *   Compiled format.
+ * @param ...
+ *   Arguments specifying data to print (see {@link ft_printf}).
+ * @return
+ *   - Number of printed cells
+ *   - (<0): In case of error
+ */
+int ft_printf_compiled(ft_table_t *table, const ft_row_format_t *format, ...);
+
+/**
+ * Write data formatted according to the compiled format string to a variety
+ * of table cells and move current position to the first cell of the next
+ * line(row).
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param format
+ *   Compiled format.
+ * @param ...
+ *   Arguments specifying data to print (see {@link ft_printf}).
+ * @return
+ *   - Number of printed cells
+ *   - (<0): In case of error
+ */
+int ft_printf_compiled_ln(ft_table_t *table, const ft_row_format_t *format, ...);
+
 
 /**
  * Write strings to the table.
@@ -576,6 +779,164 @@ int ft_nwrite(ft_table_t *table, size_t count, const char *cell_content, ...);
 int ft_nwrite_ln(ft_table_t *table, size_t count, const char *cell_content, ...);
 
 
+/**
+ * Write string of the specified length to the current cell.
+ *
+ * The string doesn't have to be null-terminated. The content is copied and
+ * analyzed in one pass, so it is never rescanned to find its length.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param cell_content
+ *   String to write.
+ * @param len
+ *   Number of chars to write. Writing stops at the null character if it is
+ *   met earlier.
+ * @return
+ *   - 0: Success; data were written
+ *   - (<0): In case of error
+ */
+int ft_write_len(ft_table_t *table, const char *cell_content, size_t len);
+
+/**
+ * Write string to the current cell without copying it.
+ *
+ * Table only keeps pointer to the string, so the string should stay valid
+ * and unchanged until the cell content is replaced or the table is
+ * destroyed. Copies of the table (ft_copy_table) have their own copy of the
+ * string.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param cell_content
+ *   String to write.
+ * @return
+ *   - 0: Success; data were written
+ *   - (<0): In case of error
+ */
+int ft_write_borrowed(ft_table_t *table, const char *cell_content);
+
+/**
+ * Write string to the current cell passing ownership of it to the table.
+ *
+ * Table doesn't copy the string and releases it with free_fn when the cell
+ * content is replaced or the table is destroyed. In case of error ownership
+ * is not transferred.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param cell_content
+ *   String to write.
+ * @param len
+ *   Length of the string; cell_content[len] should be the null character.
+ * @param free_fn
+ *   Function to release the string.
+ * @return
+ *   - 0: Success; data were written
+ *   - (<0): In case of error
+ */
+int ft_write_owned(ft_table_t *table, char *cell_content, size_t len, void (*free_fn)(void *ptr));
+
+/**
+ * Write string that belongs to another object passing ownership of the object
+ * to the table.
+ *
+ * The same as ft_write_owned, but the table releases `owner` (e.g. string
+ * object of other language whose data is cell_content) with free_fn instead
+ * of the string itself.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param cell_content
+ *   String to write.
+ * @param len
+ *   Length of the string; cell_content[len] should be the null character.
+ * @param free_fn
+ *   Function to release the owner of the string.
+ * @param owner
+ *   Object that owns the string.
+ * @return
+ *   - 0: Success; data were written
+ *   - (<0): In case of error
+ */
+int ft_write_owned_by(ft_table_t *table, const char *cell_content, size_t len,
+                      void (*free_fn)(void *owner), void *owner);
+
+/**
+ * Write numbers to the column of the table.
+ *
+ * Numbers are written to cells [first_row, first_row + n) of column `col`
+ * replacing their old content. Current position of the table is not changed.
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param col
+ *   Column of the cells.
+ * @param first_row
+ *   Row of the first cell.
+ * @param values
+ *   Array of numbers.
+ * @param n
+ *   Number of elements in values.
+ * @param fmt_spec
+ *   printf like conversion specification without length modifier (e.g.
+ *   "%5d", "%x" or "%.2f") that can be surrounded by text ("%.1f%%").
+ *   Specification without text may be given without '%' (".2f").
+ *   If NULL, numbers are stored as typed values (see ft_write_i64).
+ * @return
+ *   - 0: Success; data were written
+ *   - (<0): In case of error
+ */
+int ft_write_column_i64(ft_table_t *table, size_t col, size_t first_row,
+                        const int64_t *values, size_t n, const char *fmt_spec);
+int ft_write_column_u64(ft_table_t *table, size_t col, size_t first_row,
+                        const uint64_t *values, size_t n, const char *fmt_spec);
+int ft_write_column_f64(ft_table_t *table, size_t col, size_t first_row,
+                        const double *values, size_t n, const char *fmt_spec);
+
+/**
+ * Write number to the current cell.
+ *
+ * Number is stored as is and converted to text only when the table is
+ * printed with the format of the column (see ft_set_column_format).
+ * Integers are printed in decimal notation and floating point numbers as
+ * with "%g" by default. Boolean values are printed as "true" and "false".
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param value
+ *   Value to write.
+ * @return
+ *   - 0: Success; data were written
+ *   - (<0): In case of error
+ */
+int ft_write_i64(ft_table_t *table, int64_t value);
+int ft_write_u64(ft_table_t *table, uint64_t value);
+int ft_write_f64(ft_table_t *table, double value);
+int ft_write_bool(ft_table_t *table, int value);
+
+/**
+ * Set format of numbers stored in the column.
+ *
+ * Format is used for numbers written with ft_write_i64, ft_write_u64,
+ * ft_write_f64 and numbers written with ft_write_column_* without format
+ * specification. Format applies to numbers of the types it suits (e.g.
+ * "%.2f" is not used for integers).
+ *
+ * @param table
+ *   Pointer to formatted table.
+ * @param col
+ *   Column of the table.
+ * @param fmt_spec
+ *   printf like conversion specification without length modifier (see
+ *   ft_write_column_i64) or NULL to restore the default format.
+ * @return
+ *   - 0: Success; format was set
+ *   - (<0): In case of error
+ */
+int ft_set_column_format(ft_table_t *table, size_t col, const char *fmt_spec);
+
+
 
 /**
  * Write strings from the array to the table.
@@ -678,6 +1039,13 @@ int ft_add_separator(ft_table_t *table);
  * - Calling ft_destroy_table;
  * - Other invocations of ft_to_string.
  *
+ * Cells written with char, wide and utf-8 functions may be mixed in one
+ * table. Content of other type than output is converted while it is printed:
+ * utf-8 output functions (ft_to_u8string, ft_u8print_to, etc.) encode wide
+ * content to UTF-8, wide output functions decode UTF-8 content and char
+ * content (with the current locale). ft_to_string copies utf-8 content as it
+ * is, but tables with wide content can't be converted by ft_to_string.
+ *
  * @param table
  *   Formatted table.
  * @return
@@ -687,6 +1055,118 @@ int ft_add_separator(ft_table_t *table);
 const char *ft_to_string(const ft_table_t *table);
 
 
+/**
+ * Convert part of the table (rows [first_row, first_row + count)) to string
+ * representation.
+ *
+ * Rows are printed with the column widths of the whole table, so output of
+ * consecutive calls can be used as pages of the same table. Printed part
+ * always has top and bottom borders of the table. Column widths and row
+ * heights are computed once and cached until the table is changed (the cache
+ * takes one size_t per row of the table). Content of virtual
+ * tables is considered to be unchanged between calls.
+ *
+ * ft_table_t has ownership of the returned pointer (see ft_to_string).
+ *
+ * @param table
+ *   Formatted table.
+ * @param first_row
+ *   Index of the first printed row.
+ * @param count
+ *   Number of printed rows. It is truncated to the number of rows left in
+ *   the table.
+ * @return
+ *   - The pointer to the string representation of the rows, on success.
+ *     If range doesn't contain rows empty string is returned.
+ *   - NULL on error.
+ */
+const char *ft_render_rows(const ft_table_t *table, size_t first_row, size_t count);
+
+/**
+ * Callback receiving output of the table.
+ *
+ * @param data
+ *   Part of the output (it is not null-terminated).
+ * @param len
+ *   Length of the data in code units (chars for ft_print_to and
+ *   ft_u8print_to, wchar_t for ft_wprint_to).
+ * @param ctx
+ *   User context passed to ft_print_to.
+ * @return
+ *   - (>=0): Success
+ *   - (<0): Error; printing is stopped
+ */
+typedef int (*ft_output_fn)(const void *data, size_t len, void *ctx);
+
+/**
+ * Print string representation of the table to the callback.
+ *
+ * Output is passed to the callback by chunks of limited size, so string
+ * representation of the whole table is never kept in memory.
+ *
+ * @param table
+ *   Formatted table.
+ * @param write_fn
+ *   Callback receiving output.
+ * @param ctx
+ *   User context passed to write_fn.
+ * @return
+ *   - 0: Success
+ *   - (<0): In case of error
+ */
+int ft_print_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx);
+
+/**
+ * Iterator over lines of string representation of the table.
+ */
+typedef struct ft_line_iter ft_line_iter_t;
+
+/**
+ * Start iteration over lines of string representation of the table.
+ *
+ * Lines are printed lazily, so only a few lines of the table are kept in
+ * memory. The table should not be changed until the iteration is finished
+ * with ft_line_iter_end.
+ *
+ * @param table
+ *   Formatted table.
+ * @return
+ *   - Line iterator, on success.
+ *   - NULL on error.
+ */
+ft_line_iter_t *ft_line_iter_begin(const ft_table_t *table);
+
+/**
+ * Get the next line of string representation of the table.
+ *
+ * @param iter
+ *   Line iterator.
+ * @param buf
+ *   Buffer for the line. Line is written without new line char and is
+ *   null-terminated.
+ * @param buf_sz
+ *   Size of the buffer.
+ * @param len
+ *   If not NULL, length of the line is written to it (also when the buffer
+ *   is too small).
+ * @return
+ *   - 1: Line was written to the buffer.
+ *   - 0: There are no more lines.
+ *   - FT_EINVAL: Buffer is too small for the line (iterator isn't moved,
+ *     so call can be repeated with a bigger buffer).
+ *   - (<0): In case of other errors.
+ */
+int ft_line_iter_next(ft_line_iter_t *iter, char *buf, size_t buf_sz, size_t *len);
+
+/**
+ * Finish iteration and destroy the iterator.
+ *
+ * @param iter
+ *   Line iterator.
+ */
+void ft_line_iter_end(ft_line_iter_t *iter);
+
+
 
 
 
@@ -899,6 +1379,8 @@ int ft_set_cell_prop(ft_table_t *table, size_t row, size_t col, uint32_t propert
 #define FT_TPROP_RIGHT_MARGIN    (0x01U << 2)
 #define FT_TPROP_BOTTOM_MARGIN   (0x01U << 3)
 #define FT_TPROP_ADDING_STRATEGY (0x01U << 4)
+#define FT_TPROP_INVALID_UTF8    (0x01U << 5)
+#define FT_TPROP_INTERN_STRINGS  (0x01U << 6)
 /** @} */
 
 /**
@@ -912,6 +1394,19 @@ enum ft_adding_strategy {
     FT_STRATEGY_INSERT        /**< Insert new conten. Old content is shifted. */
 };
 
+/**
+ * Handling of invalid UTF-8.
+ *
+ * Determines what happens when content written to the table with UTF-8
+ * functions (ft_u8write, ft_u8printf, etc.) contains ill-formed UTF-8
+ * sequences. Default is FT_INVALID_UTF8_KEEP.
+ */
+enum ft_invalid_utf8_handling {
+    FT_INVALID_UTF8_KEEP = 0,  /**< Keep content as is. */
+    FT_INVALID_UTF8_REJECT,    /**< Fail with FT_EINVAL; the cell is left empty. */
+    FT_INVALID_UTF8_REPLACE    /**< Replace each byte of ill-formed sequences with U+FFFD. */
+};
+
 
 /**
  * Set default table property.
@@ -973,9 +1468,32 @@ int ft_set_cell_span(ft_table_t *table, size_t row, size_t col, size_t hor_span)
  * @note
  *   To return memory allocation/deallocation functions to their standard values
  *   set f_malloc and f_free to NULL.
+ * @note
+ *   This function is not thread-safe (see ft_set_allocator).
  */
 void ft_set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr));
 
+/**
+ * Set global allocator to be used instead of standard memory functions.
+ *
+ * Global allocator is used by all tables except tables created with their own
+ * allocator (see ft_create_table_with_allocator). Allocator should not be
+ * changed while there are tables created with the previous one.
+ *
+ * @note
+ *   This function is not thread-safe: it should not be called while other
+ *   threads use libfort. Tables with their own allocators may be used in
+ *   different threads (each table by one thread at a time).
+ *
+ * @param allocator
+ *   Allocator (it is copied). If allocator is NULL standard memory functions
+ *   are used.
+ * @return
+ *   - 0: Success; allocator was set.
+ *   - FT_EINVAL: malloc_fn or free_fn of the allocator is NULL.
+ */
+int ft_set_allocator(const ft_allocator_t *allocator);
+
 
 /**
  * Return string describing the `error_code`.
@@ -1003,6 +1521,12 @@ int ft_wprintf_ln(ft_table_t *table, const wchar_t *fmt, ...);
 int ft_nwwrite(ft_table_t *table, size_t n, const wchar_t *cell_content, ...);
 int ft_nwwrite_ln(ft_table_t *table, size_t n, const wchar_t *cell_content, ...);
 
+int ft_wwrite_len(ft_table_t *table, const wchar_t *cell_content, size_t len);
+int ft_wwrite_borrowed(ft_table_t *table, const wchar_t *cell_content);
+int ft_wwrite_owned(ft_table_t *table, wchar_t *cell_content, size_t len, void (*free_fn)(void *ptr));
+int ft_wwrite_owned_by(ft_table_t *table, const wchar_t *cell_content, size_t len,
+                       void (*free_fn)(void *owner), void *owner);
+
 int ft_row_wwrite(ft_table_t *table, size_t cols, const wchar_t *row_cells[]);
 int ft_row_wwrite_ln(ft_table_t *table, size_t cols, const wchar_t *row_cells[]);
 
@@ -1010,6 +1534,8 @@ int ft_table_wwrite(ft_table_t *table, size_t rows, size_t cols, const wchar_t *
 int ft_table_wwrite_ln(ft_table_t *table, size_t rows, size_t cols, const wchar_t *table_cells[]);
 
 const wchar_t *ft_to_wstring(const ft_table_t *table);
+const wchar_t *ft_wrender_rows(const ft_table_t *table, size_t first_row, size_t count);
+int ft_wprint_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx);
 #endif
 
 
@@ -1022,10 +1548,19 @@ const wchar_t *ft_to_wstring(const ft_table_t *table);
 int ft_u8nwrite(ft_table_t *table, size_t n, const void *cell_content, ...);
 int ft_u8nwrite_ln(ft_table_t *table, size_t n, const void *cell_content, ...);
 
+int ft_u8write_len(ft_table_t *table, const void *cell_content, size_t len);
+int ft_u8write_borrowed(ft_table_t *table, const void *cell_content);
+int ft_u8write_owned(ft_table_t *table, void *cell_content, size_t len, void (*free_fn)(void *ptr));
+int ft_u8write_owned_by(ft_table_t *table, const void *cell_content, size_t len,
+                        void (*free_fn)(void *owner), void *owner);
+
 int ft_u8printf(ft_table_t *table, const char *fmt, ...) FT_PRINTF_ATTRIBUTE_FORMAT(2, 3);
 int ft_u8printf_ln(ft_table_t *table, const char *fmt, ...) FT_PRINTF_ATTRIBUTE_FORMAT(2, 3);
 
 const void *ft_to_u8string(const ft_table_t *table);
+const void *ft_u8render_rows(const ft_table_t *table, size_t first_row, size_t count);
+int ft_u8print_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx);
+ft_line_iter_t *ft_u8line_iter_begin(const ft_table_t *table);
 
 /**
  * Set custom function to compute visible width of UTF-8 string.
@@ -37,10 +37,12 @@ SOFTWARE.
 #include "string_buffer.h"
 #include "table.h"
 #include "row.h"
+#include "cell.h"
 #include "properties.h"
 
 
-ft_table_t *ft_create_table(void)
+static
+ft_table_t *create_table_impl(void)
 {
     ft_table_t *result = (ft_table_t *)F_CALLOC(1, sizeof(ft_table_t));
     if (result == NULL)
@@ -68,6 +70,51 @@ ft_table_t *ft_create_table(void)
     result->conv_buffer = NULL;
     result->cur_row = 0;
     result->cur_col = 0;
+    result->virt = NULL;
+    result->text_slabs = NULL;
+    result->intern_pool = NULL;
+    result->reserved_cols = 0;
+    return result;
+}
+
+ft_table_t *ft_create_table(void)
+{
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    ft_table_t *result = create_table_impl();
+    use_allocator(prev_allocator);
+    return result;
+}
+
+ft_table_t *ft_create_table_with_allocator(const ft_allocator_t *allocator)
+{
+    if (allocator == NULL || allocator->malloc_fn == NULL || allocator->free_fn == NULL)
+        return NULL;
+
+    const ft_allocator_t *prev_allocator = use_allocator(allocator);
+    ft_table_t *result = create_table_impl();
+    use_allocator(prev_allocator);
+    if (result)
+        result->allocator = *allocator;
+    return result;
+}
+
+
+ft_table_t *ft_create_virtual_table(size_t rows, size_t cols, ft_cell_provider_t provider, void *ctx)
+{
+    if (provider == NULL)
+        return NULL;
+
+    ft_table_t *result = ft_create_table();
+    if (result == NULL)
+        return NULL;
+
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    result->virt = create_virtual_data(rows, cols, provider, ctx);
+    use_allocator(prev_allocator);
+    if (result->virt == NULL) {
+        ft_destroy_table(result);
+        return NULL;
+    }
     return result;
 }
 
@@ -79,6 +126,10 @@ void ft_destroy_table(ft_table_t *table)
     if (table == NULL)
         return;
 
+    /* Allocator is copied as it is released with the table */
+    ft_allocator_t allocator = table->allocator;
+    const ft_allocator_t *prev_allocator = allocator.malloc_fn ? use_allocator(&allocator) : use_global_allocator();
+
     if (table->rows) {
         size_t row_n = vector_size(table->rows);
         for (i = 0; i < row_n; ++i) {
@@ -95,17 +146,24 @@ void ft_destroy_table(ft_table_t *table)
     }
     destroy_table_properties(table->properties);
     destroy_string_buffer(table->conv_buffer);
+    destroy_virtual_data(table->virt);
+    destroy_geometry_cache(table);
+    destroy_intern_pool(table);
+    destroy_text_slabs(table);
     F_FREE(table);
+    use_allocator(prev_allocator);
 }
 
-ft_table_t *ft_copy_table(ft_table_t *table)
+static
+ft_table_t *ft_copy_table_impl(ft_table_t *table)
 {
     if (table == NULL)
         return NULL;
 
-    ft_table_t *result = ft_create_table();
+    ft_table_t *result = create_table_impl();
     if (result == NULL)
         return NULL;
+    result->allocator = table->allocator;
 
     size_t i = 0;
     size_t rows_n = vector_size(table->rows);
@@ -142,6 +200,14 @@ ft_table_t *ft_copy_table(ft_table_t *table)
         return NULL;
     }
 
+    if (table->virt) {
+        result->virt = copy_virtual_data(table->virt);
+        if (result->virt == NULL) {
+            ft_destroy_table(result);
+            return NULL;
+        }
+    }
+
     /* todo: copy conv_buffer  ??  */
 
     result->cur_row = table->cur_row;
@@ -149,6 +215,14 @@ ft_table_t *ft_copy_table(ft_table_t *table)
     return result;
 }
 
+ft_table_t *ft_copy_table(ft_table_t *table)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    ft_table_t *result = ft_copy_table_impl(table);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 static int split_cur_row(ft_table_t *table, f_row_t **tail_of_cur_row)
 {
     if (table->cur_row >= vector_size(table->rows)) {
@@ -172,10 +246,12 @@ static int split_cur_row(ft_table_t *table, f_row_t **tail_of_cur_row)
     return 0;
 }
 
-int ft_ln(ft_table_t *table)
+static
+int ft_ln_impl(ft_table_t *table)
 {
     assert(table);
     fort_entire_table_properties_t *table_props = &table->properties->entire_table_properties;
+    invalidate_geometry_cache(table);
     switch (table_props->add_strategy) {
         case FT_STRATEGY_INSERT: {
             f_row_t *new_row = NULL;
@@ -202,6 +278,14 @@ int ft_ln(ft_table_t *table)
     return FT_SUCCESS;
 }
 
+int ft_ln(ft_table_t *table)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_ln_impl(table);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 size_t ft_cur_row(const ft_table_t *table)
 {
     assert(table);
@@ -230,12 +314,16 @@ int ft_is_empty(const ft_table_t *table)
 size_t ft_row_count(const ft_table_t *table)
 {
     assert(table && table->rows);
+    if (table->virt)
+        return table->virt->rows;
     return vector_size(table->rows);
 }
 
 size_t ft_col_count(const ft_table_t *table)
 {
     assert(table && table->rows);
+    if (table->virt)
+        return table->virt->cols;
     size_t i = 0;
     size_t cols_n = 0;
     size_t rows_n = vector_size(table->rows);
@@ -247,13 +335,78 @@ size_t ft_col_count(const ft_table_t *table)
     return cols_n;
 }
 
-int ft_erase_range(ft_table_t *table,
-                   size_t top_left_row, size_t top_left_col,
-                   size_t bottom_right_row, size_t bottom_right_col)
+static
+int ft_reserve_impl(ft_table_t *table, size_t rows, size_t cols)
+{
+    assert(table && table->rows);
+    if (table->virt)
+        return FT_EINVAL;
+
+    int status = vector_reserve(table->rows, rows);
+    if (FT_IS_ERROR(status))
+        return status;
+
+    size_t i = 0;
+    size_t rows_n = vector_size(table->rows);
+    for (i = 0; i < rows_n; ++i) {
+        status = row_reserve_cells(VECTOR_AT(table->rows, i, f_row_t *), cols);
+        if (FT_IS_ERROR(status))
+            return status;
+    }
+    table->reserved_cols = cols;
+    return FT_SUCCESS;
+}
+
+int ft_reserve(ft_table_t *table, size_t rows, size_t cols)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_reserve_impl(table, rows, cols);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+static
+int ft_reserve_cell_props_impl(ft_table_t *table, size_t n)
+{
+    assert(table);
+    if (table->properties == NULL || table->properties->cell_properties == NULL)
+        return FT_GEN_ERROR;
+    return vector_reserve(table->properties->cell_properties, n);
+}
+
+int ft_reserve_cell_props(ft_table_t *table, size_t n)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_reserve_cell_props_impl(table, n);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_get_intern_stats(const ft_table_t *table, ft_intern_stats_t *stats)
+{
+    if (table == NULL || stats == NULL)
+        return FT_EINVAL;
+
+    const f_intern_pool_t *pool = table->intern_pool;
+    stats->lookups = pool ? pool->lookups : 0;
+    stats->hits = pool ? pool->hits : 0;
+    stats->strings = pool ? pool->count : 0;
+    stats->bytes = pool ? pool->bytes : 0;
+    return FT_SUCCESS;
+}
+
+static
+int ft_erase_range_impl(ft_table_t *table,
+                        size_t top_left_row, size_t top_left_col,
+                        size_t bottom_right_row, size_t bottom_right_col)
 {
     assert(table && table->rows);
     int status = FT_SUCCESS;
 
+    if (table->virt)
+        return FT_EINVAL;
+
+    invalidate_geometry_cache(table);
     size_t rows_n = vector_size(table->rows);
 
     if (top_left_row == FT_CUR_ROW)
@@ -304,21 +457,62 @@ int ft_erase_range(ft_table_t *table,
     return FT_SUCCESS;
 }
 
+int ft_erase_range(ft_table_t *table,
+                   size_t top_left_row, size_t top_left_col,
+                   size_t bottom_right_row, size_t bottom_right_col)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_erase_range_impl(table, top_left_row, top_left_col, bottom_right_row, bottom_right_col);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+
+/* Applies FT_TPROP_INVALID_UTF8 property of the table to the written content */
+static f_status check_written_content(const ft_table_t *table, f_string_buffer_t *buf)
+{
+#ifdef FT_HAVE_UTF8
+    return buffer_check_utf8(buf, table->properties->entire_table_properties.invalid_utf8);
+#else
+    (void)table;
+    (void)buf;
+    return FT_SUCCESS;
+#endif /* FT_HAVE_UTF8 */
+}
+
+/*
+ * Fills buffer of the cell with first `len` code units of the content. The
+ * content is interned if FT_TPROP_INTERN_STRINGS property of the table is set.
+ */
+static f_status fill_cell_content(ft_table_t *table, f_string_buffer_t *buf,
+                                  const f_string_view_t *content, size_t len)
+{
+    if (table->properties->entire_table_properties.intern_strings)
+        return fill_buffer_from_pool(table, buf, content, len);
+    return fill_buffer_from_string_len(buf, content, len);
+}
 
-static int ft_row_printf_impl_(ft_table_t *table, size_t row, const struct f_string_view *fmt, va_list *va)
+static int ft_row_printf_body_(ft_table_t *table, size_t row, const struct f_string_view *fmt, va_list *va)
 {
     size_t i = 0;
     size_t new_cols = 0;
 
-    if (table == NULL)
+    if (table == NULL || table->virt)
         return -1;
 
+    invalidate_geometry_cache(table);
     f_row_t *new_row = create_row_from_fmt_string(fmt, va);
 
     if (new_row == NULL) {
         return -1;
     }
 
+    new_cols = columns_in_row(new_row);
+    for (i = 0; i < new_cols; ++i) {
+        if (FT_IS_ERROR(check_written_content(table, cell_get_string_buffer(get_cell(new_row, i)))))
+            goto clear;
+    }
+
     f_row_t **cur_row_p = NULL;
     size_t sz = vector_size(table->rows);
     if (row >= sz) {
@@ -336,7 +530,6 @@ static int ft_row_printf_impl_(ft_table_t *table, size_t row, const struct f_str
     }
     /* todo: clearing pushed items in case of error ?? */
 
-    new_cols = columns_in_row(new_row);
     cur_row_p = &VECTOR_AT(table->rows, row, f_row_t *);
 
     switch (table->properties->entire_table_properties.add_strategy) {
@@ -364,6 +557,14 @@ clear:
     return -1;
 }
 
+static int ft_row_printf_impl_(ft_table_t *table, size_t row, const struct f_string_view *fmt, va_list *va)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_row_printf_body_(table, row, fmt, va);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 #if defined(FT_CLANG_COMPILER) || defined(FT_GCC_COMPILER)
 #define FT_PRINTF ft_printf
 #define FT_PRINTF_LN ft_printf_ln
@@ -408,6 +609,124 @@ int FT_PRINTF_LN(ft_table_t *table, const char *fmt, ...)
 #undef FT_PRINTF
 #undef FT_PRINTF_LN
 
+ft_row_format_t *ft_compile_row_format(const char *fmt)
+{
+    if (fmt == NULL)
+        return NULL;
+    /* Formats are not owned by tables, so they use global allocator */
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    ft_row_format_t *result = create_row_format(fmt);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+void ft_destroy_row_format(ft_row_format_t *format)
+{
+    const ft_allocator_t *prev_allocator = use_global_allocator();
+    destroy_row_format(format);
+    use_allocator(prev_allocator);
+}
+
+static int ft_printf_compiled_body_(ft_table_t *table, const ft_row_format_t *format, va_list *va)
+{
+    if (table == NULL || format == NULL || table->virt)
+        return -1;
+
+    invalidate_geometry_cache(table);
+
+    /* Disable compiler diagnostic (format string is not a string literal) */
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    size_t i = 0;
+    for (i = 0; i < format->n_fields; ++i) {
+        const struct f_row_format_field *field = &format->fields[i];
+        f_string_buffer_t *buf = get_cur_str_buffer_and_create_if_not_exists(table);
+        if (buf == NULL)
+            return -1;
+
+        if (field->is_literal) {
+            content.u.cstr = field->fmt;
+            if (FT_IS_ERROR(fill_cell_content(table, buf, &content, field->len)))
+                return -1;
+            table->cur_col++;
+            continue;
+        }
+
+        /* Field is measured first and then formatted right into memory of the cell */
+        va_list field_va;
+        va_copy(field_va, *va);
+        int len = vsnprintf(NULL, 0, field->fmt, field_va);
+        va_end(field_va);
+        if (len < 0)
+            return -1;
+
+        char *str = (char *)F_MALLOC((size_t)len + 1);
+        if (str == NULL)
+            return -1;
+        va_copy(field_va, *va);
+        vsnprintf(str, (size_t)len + 1, field->fmt, field_va);
+        va_end(field_va);
+
+        if (table->properties->entire_table_properties.intern_strings) {
+            /* Interned content is copied to the string pool of the table */
+            content.u.cstr = str;
+            int status = fill_buffer_from_pool(table, buf, &content, (size_t)len);
+            F_FREE(str);
+            if (FT_IS_ERROR(status))
+                return -1;
+        } else {
+            fill_buffer_from_allocated(buf, str, CHAR_BUF);
+        }
+
+        skip_printf_args(va, format->arg_types + field->first_arg, field->n_args);
+        table->cur_col++;
+    }
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic pop
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic pop
+#endif
+    return (int)format->n_fields;
+}
+
+static int ft_printf_compiled_impl_(ft_table_t *table, const ft_row_format_t *format, va_list *va)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_printf_compiled_body_(table, format, va);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_printf_compiled(ft_table_t *table, const ft_row_format_t *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    int result = ft_printf_compiled_impl_(table, format, &va);
+    va_end(va);
+    return result;
+}
+
+int ft_printf_compiled_ln(ft_table_t *table, const ft_row_format_t *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    int result = ft_printf_compiled_impl_(table, format, &va);
+    if (result >= 0) {
+        ft_ln(table);
+    }
+    va_end(va);
+    return result;
+}
+
 #ifdef FT_HAVE_WCHAR
 int ft_wprintf(ft_table_t *table, const wchar_t *fmt, ...)
 {
@@ -447,43 +766,73 @@ void ft_set_default_printf_field_separator(char separator)
     g_col_separator = separator;
 }
 
-static int ft_write_impl_(ft_table_t *table, const f_string_view_t *cell_content)
+/*
+ * Writes content to the current cell. If `external` is set the content is
+ * not copied: it is borrowed (free_fn is NULL) or adopted by the table
+ * (together with its owner if it is not NULL).
+ */
+static int ft_write_body_(ft_table_t *table, const f_string_view_t *cell_content,
+                          int external, void (*free_fn)(void *ptr), void *owner)
 {
     assert(table);
+    if (table->virt)
+        return FT_EINVAL;
+
+    invalidate_geometry_cache(table);
     f_string_buffer_t *buf = get_cur_str_buffer_and_create_if_not_exists(table);
     if (buf == NULL)
         return FT_GEN_ERROR;
 
     int status = FT_SUCCESS;
+    if (external) {
+        fill_buffer_from_external(buf, cell_content, free_fn, owner);
+        status = check_written_content(table, buf);
+        if (FT_IS_SUCCESS(status))
+            table->cur_col++;
+        return status;
+    }
+    size_t len = 0;
     switch (cell_content->type) {
         case CHAR_BUF:
-            status = fill_buffer_from_string(buf, cell_content->u.cstr);
+            len = strlen(cell_content->u.cstr);
             break;
 #ifdef FT_HAVE_WCHAR
         case W_CHAR_BUF:
-            status = fill_buffer_from_wstring(buf, cell_content->u.wstr);
+            len = wcslen(cell_content->u.wstr);
             break;
 #endif
 #ifdef FT_HAVE_UTF8
         case UTF8_BUF:
-            status = fill_buffer_from_u8string(buf, cell_content->u.u8str);
+            len = strlen((const char *)cell_content->u.u8str);
             break;
 #endif
         default:
-            status = FT_GEN_ERROR;
+            return FT_GEN_ERROR;
     }
+    status = fill_cell_content(table, buf, cell_content, len);
+    if (FT_IS_SUCCESS(status))
+        status = check_written_content(table, buf);
     if (FT_IS_SUCCESS(status)) {
         table->cur_col++;
     }
     return status;
 }
 
+static int ft_write_impl_(ft_table_t *table, const f_string_view_t *cell_content,
+                          int external, void (*free_fn)(void *ptr), void *owner)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_body_(table, cell_content, external, free_fn, owner);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 static int ft_write_impl(ft_table_t *table, const char *cell_content)
 {
     f_string_view_t content;
     content.type = CHAR_BUF;
     content.u.cstr = cell_content;
-    return ft_write_impl_(table, &content);
+    return ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
 }
 
 #ifdef FT_HAVE_UTF8
@@ -492,7 +841,7 @@ static int ft_u8write_impl(ft_table_t *table, const void *cell_content)
     f_string_view_t content;
     content.type = UTF8_BUF;
     content.u.u8str = cell_content;
-    return ft_write_impl_(table, &content);
+    return ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
 }
 #endif /* FT_HAVE_UTF8 */
 
@@ -502,75 +851,430 @@ static int ft_wwrite_impl(ft_table_t *table, const wchar_t *cell_content)
     f_string_view_t content;
     content.type = W_CHAR_BUF;
     content.u.wstr = cell_content;
-    return ft_write_impl_(table, &content);
+    return ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
 }
 #endif
-
-
-int ft_nwrite(ft_table_t *table, size_t count, const char *cell_content, ...)
+/*
+ * Writes first `len` code units of the content to the current cell.
+ */
+static int ft_write_len_body_(ft_table_t *table, const f_string_view_t *cell_content, size_t len)
 {
-    size_t i = 0;
     assert(table);
-    int status = ft_write_impl(table, cell_content);
-    if (FT_IS_ERROR(status))
-        return status;
+    if (table->virt || cell_content->u.data == NULL)
+        return FT_EINVAL;
 
-    va_list va;
-    va_start(va, cell_content);
-    --count;
-    for (i = 0; i < count; ++i) {
-        const char *cell = va_arg(va, const char *);
-        status = ft_write_impl(table, cell);
-        if (FT_IS_ERROR(status)) {
-            va_end(va);
-            return status;
-        }
+    invalidate_geometry_cache(table);
+    f_string_buffer_t *buf = get_cur_str_buffer_and_create_if_not_exists(table);
+    if (buf == NULL)
+        return FT_GEN_ERROR;
+
+    int status = fill_cell_content(table, buf, cell_content, len);
+    if (FT_IS_SUCCESS(status))
+        status = check_written_content(table, buf);
+    if (FT_IS_SUCCESS(status)) {
+        table->cur_col++;
     }
-    va_end(va);
     return status;
 }
 
-int ft_nwrite_ln(ft_table_t *table, size_t count, const char *cell_content, ...)
+static int ft_write_len_impl_(ft_table_t *table, const f_string_view_t *cell_content, size_t len)
 {
-    size_t i = 0;
-    assert(table);
-    int status = ft_write_impl(table, cell_content);
-    if (FT_IS_ERROR(status))
-        return status;
-
-    va_list va;
-    va_start(va, cell_content);
-    --count;
-    for (i = 0; i < count; ++i) {
-        const char *cell = va_arg(va, const char *);
-        status = ft_write_impl(table, cell);
-        if (FT_IS_ERROR(status)) {
-            va_end(va);
-            return status;
-        }
-    }
-    va_end(va);
-
-    ft_ln(table);
-    return status;
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_len_body_(table, cell_content, len);
+    use_allocator(prev_allocator);
+    return result;
 }
 
-
-
+int ft_write_len(ft_table_t *table, const char *cell_content, size_t len)
+{
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_len_impl_(table, &content, len);
+}
 
 #ifdef FT_HAVE_WCHAR
+int ft_wwrite_len(ft_table_t *table, const wchar_t *cell_content, size_t len)
+{
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_len_impl_(table, &content, len);
+}
+#endif
 
-int ft_nwwrite(ft_table_t *table, size_t n, const wchar_t *cell_content, ...)
+#ifdef FT_HAVE_UTF8
+int ft_u8write_len(ft_table_t *table, const void *cell_content, size_t len)
+{
+    f_string_view_t content;
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_len_impl_(table, &content, len);
+}
+#endif /* FT_HAVE_UTF8 */
+static int ft_write_value_body_(ft_table_t *table, enum f_cell_value_type type, const union f_number *value)
 {
-    size_t i = 0;
     assert(table);
-    int status = ft_wwrite_impl(table, cell_content);
-    if (FT_IS_ERROR(status))
-        return status;
+    if (table->virt)
+        return FT_EINVAL;
 
-    va_list va;
-    va_start(va, cell_content);
-    --n;
+    invalidate_geometry_cache(table);
+    f_cell_t *cell = get_cur_cell_and_create_if_not_exists(table);
+    if (cell == NULL)
+        return FT_GEN_ERROR;
+
+    int status = set_cell_value(cell, type, value);
+    if (FT_IS_SUCCESS(status)) {
+        table->cur_col++;
+    }
+    return status;
+}
+
+static int ft_write_value_impl_(ft_table_t *table, enum f_cell_value_type type, const union f_number *value)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_value_body_(table, type, value);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_write_i64(ft_table_t *table, int64_t value)
+{
+    union f_number number;
+    number.i64 = value;
+    return ft_write_value_impl_(table, F_CELL_I64, &number);
+}
+
+int ft_write_u64(ft_table_t *table, uint64_t value)
+{
+    union f_number number;
+    number.u64 = value;
+    return ft_write_value_impl_(table, F_CELL_U64, &number);
+}
+
+int ft_write_f64(ft_table_t *table, double value)
+{
+    union f_number number;
+    number.f64 = value;
+    return ft_write_value_impl_(table, F_CELL_F64, &number);
+}
+
+int ft_write_bool(ft_table_t *table, int value)
+{
+    union f_number number;
+    number.u64 = value ? 1 : 0;
+    return ft_write_value_impl_(table, F_CELL_BOOL, &number);
+}
+
+static
+int ft_set_column_format_impl(ft_table_t *table, size_t col, const char *fmt_spec)
+{
+    assert(table);
+
+    if (table->properties == NULL) {
+        table->properties = create_table_properties();
+        if (table->properties == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    invalidate_geometry_cache(table);
+    return set_column_number_format(table->properties, col, fmt_spec);
+}
+
+int ft_set_column_format(ft_table_t *table, size_t col, const char *fmt_spec)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_column_format_impl(table, col, fmt_spec);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+/*
+ * Writes numbers to cells [first_row, first_row + n) of the column. Numbers
+ * without format specification are stored as typed values.
+ */
+static int ft_write_column_body_(ft_table_t *table, size_t col, size_t first_row,
+                                 const void *values, size_t n, const char *fmt_spec,
+                                 enum f_number_type type)
+{
+    assert(table);
+    if (table->virt || (values == NULL && n != 0))
+        return FT_EINVAL;
+
+    char fmt_buf[FT_NUMBER_FMT_SZ];
+    const char *fmt = NULL;
+    if (fmt_spec) {
+        if (FT_IS_ERROR(number_format_from_spec(fmt_spec, type, fmt_buf, sizeof(fmt_buf))))
+            return FT_EINVAL;
+        fmt = fmt_buf;
+    }
+
+    invalidate_geometry_cache(table);
+
+    char str_buf[FT_NUMBER_BUF_SZ];
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    size_t i = 0;
+    for (i = 0; i < n; ++i) {
+        union f_number value;
+        switch (type) {
+            case F_NUM_I64:
+                value.i64 = ((const int64_t *)values)[i];
+                break;
+            case F_NUM_U64:
+                value.u64 = ((const uint64_t *)values)[i];
+                break;
+            case F_NUM_F64:
+                value.f64 = ((const double *)values)[i];
+                break;
+        }
+
+        f_row_t *row = get_row_and_create_if_not_exists(table, first_row + i);
+        if (row == NULL)
+            return FT_GEN_ERROR;
+        f_cell_t *cell = get_cell_and_create_if_not_exists(row, col);
+        if (cell == NULL)
+            return FT_GEN_ERROR;
+
+        if (fmt == NULL) {
+            static const enum f_cell_value_type value_types[] = {F_CELL_I64, F_CELL_U64, F_CELL_F64};
+            int status = set_cell_value(cell, value_types[type], &value);
+            if (FT_IS_ERROR(status))
+                return status;
+            continue;
+        }
+
+        int len = format_number(str_buf, sizeof(str_buf), fmt, type, &value);
+        if (len < 0)
+            return FT_GEN_ERROR;
+
+        int status = FT_SUCCESS;
+        if ((size_t)len < sizeof(str_buf)) {
+            content.u.cstr = str_buf;
+            status = fill_cell_content(table, cell_get_string_buffer(cell), &content, (size_t)len);
+        } else {
+            /* Number formatted with user spec can be very long */
+            char *long_str = (char *)F_MALLOC((size_t)len + 1);
+            if (long_str == NULL)
+                return FT_MEMORY_ERROR;
+            format_number(long_str, (size_t)len + 1, fmt, type, &value);
+            content.u.cstr = long_str;
+            status = fill_cell_content(table, cell_get_string_buffer(cell), &content, (size_t)len);
+            F_FREE(long_str);
+        }
+        if (FT_IS_ERROR(status))
+            return status;
+    }
+    return FT_SUCCESS;
+}
+
+static int ft_write_column_impl_(ft_table_t *table, size_t col, size_t first_row,
+                                 const void *values, size_t n, const char *fmt_spec,
+                                 enum f_number_type type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_write_column_body_(table, col, first_row, values, n, fmt_spec, type);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_write_column_i64(ft_table_t *table, size_t col, size_t first_row,
+                        const int64_t *values, size_t n, const char *fmt_spec)
+{
+    return ft_write_column_impl_(table, col, first_row, values, n, fmt_spec, F_NUM_I64);
+}
+
+int ft_write_column_u64(ft_table_t *table, size_t col, size_t first_row,
+                        const uint64_t *values, size_t n, const char *fmt_spec)
+{
+    return ft_write_column_impl_(table, col, first_row, values, n, fmt_spec, F_NUM_U64);
+}
+
+int ft_write_column_f64(ft_table_t *table, size_t col, size_t first_row,
+                        const double *values, size_t n, const char *fmt_spec)
+{
+    return ft_write_column_impl_(table, col, first_row, values, n, fmt_spec, F_NUM_F64);
+}
+
+int ft_write_borrowed(ft_table_t *table, const char *cell_content)
+{
+    assert(table);
+    if (cell_content == NULL)
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, NULL, NULL);
+}
+
+int ft_write_owned(ft_table_t *table, char *cell_content, size_t len, void (*free_fn)(void *ptr))
+{
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || cell_content[len] != '\0')
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, NULL);
+}
+
+int ft_write_owned_by(ft_table_t *table, const char *cell_content, size_t len,
+                      void (*free_fn)(void *owner), void *owner)
+{
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || owner == NULL || cell_content[len] != '\0')
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = CHAR_BUF;
+    content.u.cstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, owner);
+}
+
+#ifdef FT_HAVE_WCHAR
+int ft_wwrite_borrowed(ft_table_t *table, const wchar_t *cell_content)
+{
+    assert(table);
+    if (cell_content == NULL)
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, NULL, NULL);
+}
+
+int ft_wwrite_owned(ft_table_t *table, wchar_t *cell_content, size_t len, void (*free_fn)(void *ptr))
+{
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || cell_content[len] != L'\0')
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, NULL);
+}
+
+int ft_wwrite_owned_by(ft_table_t *table, const wchar_t *cell_content, size_t len,
+                       void (*free_fn)(void *owner), void *owner)
+{
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || owner == NULL || cell_content[len] != L'\0')
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = W_CHAR_BUF;
+    content.u.wstr = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, owner);
+}
+#endif
+
+#ifdef FT_HAVE_UTF8
+int ft_u8write_borrowed(ft_table_t *table, const void *cell_content)
+{
+    assert(table);
+    if (cell_content == NULL)
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, NULL, NULL);
+}
+
+int ft_u8write_owned(ft_table_t *table, void *cell_content, size_t len, void (*free_fn)(void *ptr))
+{
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || ((const char *)cell_content)[len] != '\0')
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, NULL);
+}
+
+int ft_u8write_owned_by(ft_table_t *table, const void *cell_content, size_t len,
+                        void (*free_fn)(void *owner), void *owner)
+{
+    assert(table);
+    if (cell_content == NULL || free_fn == NULL || owner == NULL || ((const char *)cell_content)[len] != '\0')
+        return FT_EINVAL;
+
+    f_string_view_t content;
+    content.type = UTF8_BUF;
+    content.u.u8str = cell_content;
+    return ft_write_impl_(table, &content, F_TRUE, free_fn, owner);
+}
+#endif /* FT_HAVE_UTF8 */
+
+
+int ft_nwrite(ft_table_t *table, size_t count, const char *cell_content, ...)
+{
+    size_t i = 0;
+    assert(table);
+    int status = ft_write_impl(table, cell_content);
+    if (FT_IS_ERROR(status))
+        return status;
+
+    va_list va;
+    va_start(va, cell_content);
+    --count;
+    for (i = 0; i < count; ++i) {
+        const char *cell = va_arg(va, const char *);
+        status = ft_write_impl(table, cell);
+        if (FT_IS_ERROR(status)) {
+            va_end(va);
+            return status;
+        }
+    }
+    va_end(va);
+    return status;
+}
+
+int ft_nwrite_ln(ft_table_t *table, size_t count, const char *cell_content, ...)
+{
+    size_t i = 0;
+    assert(table);
+    int status = ft_write_impl(table, cell_content);
+    if (FT_IS_ERROR(status))
+        return status;
+
+    va_list va;
+    va_start(va, cell_content);
+    --count;
+    for (i = 0; i < count; ++i) {
+        const char *cell = va_arg(va, const char *);
+        status = ft_write_impl(table, cell);
+        if (FT_IS_ERROR(status)) {
+            va_end(va);
+            return status;
+        }
+    }
+    va_end(va);
+
+    ft_ln(table);
+    return status;
+}
+
+
+
+
+#ifdef FT_HAVE_WCHAR
+
+int ft_nwwrite(ft_table_t *table, size_t n, const wchar_t *cell_content, ...)
+{
+    size_t i = 0;
+    assert(table);
+    int status = ft_wwrite_impl(table, cell_content);
+    if (FT_IS_ERROR(status))
+        return status;
+
+    va_list va;
+    va_start(va, cell_content);
+    --n;
     for (i = 0; i < n; ++i) {
         const wchar_t *cell = va_arg(va, const wchar_t *);
         status = ft_wwrite_impl(table, cell);
@@ -610,20 +1314,150 @@ int ft_nwwrite_ln(ft_table_t *table, size_t n, const wchar_t *cell_content, ...)
 #endif
 
 
-int ft_row_write(ft_table_t *table, size_t cols, const char *cells[])
+/*
+ * Writes cells one by one (used when cells are inserted into the table).
+ */
+static int ft_cells_write_impl_(ft_table_t *table, size_t rows, size_t cols,
+                                const void *const cells[], enum f_string_type type)
 {
     size_t i = 0;
+    size_t j = 0;
+    f_string_view_t content;
+    content.type = type;
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < cols; ++j) {
+            content.u.data = cells[i * cols + j];
+            int status = ft_write_impl_(table, &content, F_FALSE, NULL, NULL);
+            if (FT_IS_ERROR(status)) {
+                /* todo: maybe current pos in case of error should be equal
+                 * to the one before function call?
+                 */
+                return status;
+            }
+        }
+        if (i != rows - 1)
+            ft_ln(table);
+    }
+    return FT_SUCCESS;
+}
+
+/* Returns length of content of a cell passed to bulk write functions */
+static size_t bulk_cell_len(const void *cell, enum f_string_type type)
+{
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        return wcslen((const wchar_t *)cell);
+#else
+    (void)type;
+#endif
+    return strlen((const char *)cell);
+}
+
+/* Returns 1 if cell of the table wasn't written yet (or doesn't exist) */
+static int bulk_cell_is_unwritten(ft_table_t *table, size_t row, size_t col)
+{
+    f_cell_t *cell = get_cell(get_row(table, row), col);
+    return cell == NULL || cell_is_unwritten(cell);
+}
+
+/*
+ * Writes `rows` x `cols` cells starting from the current cell (next rows
+ * start from the first column as after ft_ln). Vectors of rows and cells are
+ * reserved once and content of cells that weren't written yet is copied to
+ * one text slab of the table. Cells that already have content are rewritten
+ * one by one, so that rewriting the same cells doesn't pile up slabs.
+ */
+static int ft_bulk_write_body_(ft_table_t *table, size_t rows, size_t cols,
+                               const void *const cells[], enum f_string_type type)
+{
     assert(table);
-    for (i = 0; i < cols; ++i) {
-        int status = ft_write_impl(table, cells[i]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal to the one before function call? */
-            return status;
+    if (table->virt)
+        return FT_EINVAL;
+    if (rows == 0)
+        return FT_SUCCESS;
+    if (cols == 0 || table->properties->entire_table_properties.add_strategy != FT_STRATEGY_REPLACE
+        || table->properties->entire_table_properties.intern_strings)
+        return ft_cells_write_impl_(table, rows, cols, cells, type);
+    if (rows > SIZE_MAX / cols)
+        return FT_EINVAL;
+
+    size_t char_sz = 1;
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        char_sz = sizeof(wchar_t);
+#endif
+    size_t i = 0;
+    size_t j = 0;
+    size_t first_col = table->cur_col;
+    size_t slab_len = 0;
+    for (i = 0; i < rows; ++i) {
+        size_t col = (i == 0) ? first_col : 0;
+        for (j = 0; j < cols; ++j) {
+            if (cells[i * cols + j] == NULL)
+                return FT_EINVAL;
+            if (bulk_cell_is_unwritten(table, table->cur_row + i, col + j))
+                slab_len += bulk_cell_len(cells[i * cols + j], type) + 1;
         }
     }
+    if (slab_len > SIZE_MAX / char_sz)
+        return FT_EINVAL;
+
+    invalidate_geometry_cache(table);
+    char *slab = NULL;
+    if (slab_len) {
+        slab = (char *)alloc_text_slab(table, slab_len * char_sz);
+        if (slab == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    if (FT_IS_ERROR(vector_reserve(table->rows, table->cur_row + rows)))
+        return FT_MEMORY_ERROR;
+
+    f_string_view_t content;
+    content.type = type;
+    for (i = 0; i < rows; ++i) {
+        f_row_t *row = get_row_and_create_if_not_exists(table, table->cur_row + i);
+        if (row == NULL)
+            return FT_GEN_ERROR;
+        size_t col = (i == 0) ? first_col : 0;
+        /* Cells written after a gap may be stored sparsely, see row.c */
+        if (col <= columns_in_row(row) && FT_IS_ERROR(row_reserve_cells(row, col + cols)))
+            return FT_MEMORY_ERROR;
+        for (j = 0; j < cols; ++j) {
+            f_cell_t *cell = get_cell_and_create_if_not_exists(row, col + j);
+            if (cell == NULL)
+                return FT_GEN_ERROR;
+            content.u.data = cells[i * cols + j];
+            if (!cell_is_unwritten(cell)) {
+                f_string_buffer_t *buf = cell_get_string_buffer(cell);
+                f_status status = fill_cell_content(table, buf, &content, bulk_cell_len(content.u.data, type));
+                if (FT_IS_ERROR(status))
+                    return status;
+                continue;
+            }
+            size_t len = fill_buffer_from_string_at(cell_get_string_buffer(cell), &content, SIZE_MAX, slab);
+            slab += (len + 1) * char_sz;
+        }
+    }
+    table->cur_row += rows - 1;
+    table->cur_col = (rows == 1 ? first_col : 0) + cols;
     return FT_SUCCESS;
 }
 
+static int ft_bulk_write_impl_(ft_table_t *table, size_t rows, size_t cols,
+                               const void *const cells[], enum f_string_type type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_bulk_write_body_(table, rows, cols, cells, type);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_row_write(ft_table_t *table, size_t cols, const char *cells[])
+{
+    assert(table);
+    return ft_bulk_write_impl_(table, 1, cols, (const void *const *)cells, CHAR_BUF);
+}
+
 int ft_row_write_ln(ft_table_t *table, size_t cols, const char *cells[])
 {
     assert(table);
@@ -637,18 +1471,8 @@ int ft_row_write_ln(ft_table_t *table, size_t cols, const char *cells[])
 #ifdef FT_HAVE_WCHAR
 int ft_row_wwrite(ft_table_t *table, size_t cols, const wchar_t *cells[])
 {
-    size_t i = 0;
     assert(table);
-    for (i = 0; i < cols; ++i) {
-        int status = ft_wwrite_impl(table, cells[i]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal
-             * to the one before function call?
-             */
-            return status;
-        }
-    }
-    return FT_SUCCESS;
+    return ft_bulk_write_impl_(table, 1, cols, (const void *const *)cells, W_CHAR_BUF);
 }
 
 int ft_row_wwrite_ln(ft_table_t *table, size_t cols, const wchar_t *cells[])
@@ -666,20 +1490,8 @@ int ft_row_wwrite_ln(ft_table_t *table, size_t cols, const wchar_t *cells[])
 
 int ft_table_write(ft_table_t *table, size_t rows, size_t cols, const char *table_cells[])
 {
-    size_t i = 0;
     assert(table);
-    for (i = 0; i < rows; ++i) {
-        int status = ft_row_write(table, cols, (const char **)&table_cells[i * cols]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal
-             * to the one before function call?
-             */
-            return status;
-        }
-        if (i != rows - 1)
-            ft_ln(table);
-    }
-    return FT_SUCCESS;
+    return ft_bulk_write_impl_(table, rows, cols, (const void *const *)table_cells, CHAR_BUF);
 }
 
 int ft_table_write_ln(ft_table_t *table, size_t rows, size_t cols, const char *table_cells[])
@@ -696,20 +1508,8 @@ int ft_table_write_ln(ft_table_t *table, size_t rows, size_t cols, const char *t
 #ifdef FT_HAVE_WCHAR
 int ft_table_wwrite(ft_table_t *table, size_t rows, size_t cols, const wchar_t *table_cells[])
 {
-    size_t i = 0;
     assert(table);
-    for (i = 0; i < rows; ++i) {
-        int status = ft_row_wwrite(table, cols, (const wchar_t **)&table_cells[i * cols]);
-        if (FT_IS_ERROR(status)) {
-            /* todo: maybe current pos in case of error should be equal
-             * to the one before function call?
-             */
-            return status;
-        }
-        if (i != rows - 1)
-            ft_ln(table);
-    }
-    return FT_SUCCESS;
+    return ft_bulk_write_impl_(table, rows, cols, (const void *const *)table_cells, W_CHAR_BUF);
 }
 
 int ft_table_wwrite_ln(ft_table_t *table, size_t rows, size_t cols, const wchar_t *table_cells[])
@@ -726,21 +1526,82 @@ int ft_table_wwrite_ln(ft_table_t *table, size_t rows, size_t cols, const wchar_
 static
 const char *empty_str_arr[] = {"", (const char *)L"", ""};
 
+/* Prints `lines` lines of the table margin */
 static
-const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type)
+int print_margin_lines(f_conv_context_t *cntx, size_t lines, size_t cod_width)
 {
-    assert(table);
+    int tmp = 0;
+    size_t i = 0;
+    for (i = 0; i < lines; ++i) {
+        FT_CHECK(print_n_spaces(cntx, cod_width - 1/* minus new_line*/));
+        FT_CHECK(print_n_strings(cntx, 1, FT_NEWLINE));
+    }
+    return 0;
 
-    const char *result = NULL;
+clear:
+    return -1;
+}
 
-    /* Determine size of table string representation */
-    size_t cod_height = 0;
-    size_t cod_width = 0;
-    int status = table_internal_codepoints_geometry(table, &cod_height, &cod_width);
-    if (FT_IS_ERROR(status)) {
-        return NULL;
-    }
+/*
+ * Prints row of the table with the separator above it. Separator above
+ * first printed row (first_row) is the top border of the table.
+ */
+static
+int print_table_row(f_conv_context_t *cntx, const ft_table_t *table,
+                    const size_t *col_vis_width_arr, size_t cols, size_t row_height,
+                    size_t row, size_t first_row, const f_row_t **prev_row)
+{
+    int tmp = 0;
+    size_t sep_size = vector_size(table->separators);
+    f_separator_t *cur_sep = (row < sep_size && (row != first_row || row == 0)) ? VECTOR_AT(table->separators, row, f_separator_t *) : NULL;
+    const f_row_t *cur_row = get_row_c(table, row);
+    if (cur_row == NULL)
+        return -1;
+    enum f_hor_separator_pos separatorPos = (row == first_row) ? TOP_SEPARATOR : INSIDE_SEPARATOR;
+    cntx->cntx->row = row;
+    FT_CHECK(print_row_separator(cntx, col_vis_width_arr, cols, *prev_row, cur_row, separatorPos, cur_sep));
+    FT_CHECK(snprintf_row(cur_row, cntx, col_vis_width_arr, cols, row_height));
+    *prev_row = cur_row;
+    return 0;
+
+clear:
+    return -1;
+}
+
+/* Prints separator below the last printed row (row - 1) */
+static
+int print_bottom_separator(f_conv_context_t *cntx, const ft_table_t *table,
+                           const size_t *col_vis_width_arr, size_t cols,
+                           size_t row, const f_row_t *prev_row)
+{
+    size_t sep_size = vector_size(table->separators);
+    f_separator_t *cur_sep = (row < sep_size && row == ft_row_count(table)) ? VECTOR_AT(table->separators, row, f_separator_t *) : NULL;
+    cntx->cntx->row = row;
+    return print_row_separator(cntx, col_vis_width_arr, cols, prev_row, NULL, BOTTOM_SEPARATOR, cur_sep);
+}
+
+/* Minimal number of lines kept in the buffer when output is streamed */
+#define FT_STREAM_CHUNK_LINES 32
+
+/*
+ * Prints rows [first_row, first_row + count) of the table into its conversion
+ * buffer. Top and bottom borders of the printed part are borders of the table,
+ * so any row range is printed as a complete table.
+ *
+ * If sink is not NULL output is streamed to it through the conversion buffer
+ * that holds only a few lines of the table.
+ */
+static
+const void *ft_print_rows_impl(const ft_table_t *table, enum f_string_type b_type,
+                               const size_t *col_vis_width_arr, size_t cols,
+                               const size_t *row_vis_height_arr,
+                               size_t first_row, size_t count,
+                               size_t cod_height, size_t cod_width,
+                               f_output_sink_t *sink)
+{
     size_t n_codepoints = cod_height * cod_width + 1;
+    if (sink && cod_height > FT_STREAM_CHUNK_LINES)
+        n_codepoints = FT_STREAM_CHUNK_LINES * cod_width + 1;
 
     /* Allocate string buffer for string representation */
     if (table->conv_buffer == NULL) {
@@ -748,6 +1609,12 @@ const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type
         if (table->conv_buffer == NULL)
             return NULL;
     }
+    /*
+     * The buffer may be left by conversion to string of another type. Its
+     * capacity is measured in code units of the new type (4 bytes per
+     * codepoint of utf-8 output).
+     */
+    table->conv_buffer->type = b_type;
     while (string_buffer_cod_width_capacity(table->conv_buffer) < n_codepoints) {
         if (FT_IS_ERROR(realloc_string_buffer_without_copy(table->conv_buffer))) {
             return NULL;
@@ -757,83 +1624,352 @@ const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type
         return NULL;
     char *buffer = (char *)buffer_get_data(table->conv_buffer);
 
-    size_t cols = 0;
-    size_t rows = 0;
-    size_t *col_vis_width_arr = NULL;
-    size_t *row_vis_height_arr = NULL;
-    status = table_rows_and_cols_geometry(table, &col_vis_width_arr, &cols, &row_vis_height_arr, &rows, VISIBLE_GEOMETRY);
-    if (FT_IS_ERROR(status))
-        return NULL;
-
-    if (rows == 0) {
-        F_FREE(col_vis_width_arr);
-        F_FREE(row_vis_height_arr);
-        return empty_str_arr[b_type];
-    }
-
     int tmp = 0;
     size_t i = 0;
     f_context_t context;
     context.table_properties = (table->properties ? table->properties : &g_table_properties);
-    f_row_t *prev_row = NULL;
-    f_row_t *cur_row = NULL;
-    f_separator_t *cur_sep = NULL;
-    size_t sep_size = vector_size(table->separators);
+    const f_row_t *prev_row = NULL;
+    size_t last_row = first_row + count;
 
     f_conv_context_t cntx;
     cntx.u.buf = buffer;
     cntx.raw_avail = string_buffer_raw_capacity(table->conv_buffer);
     cntx.cntx = &context;
     cntx.b_type = b_type;
-
-    /* Print top margin */
-    for (i = 0; i < context.table_properties->entire_table_properties.top_margin; ++i) {
-        FT_CHECK(print_n_strings(&cntx, cod_width - 1/* minus new_line*/, FT_SPACE));
-        FT_CHECK(print_n_strings(&cntx, 1, FT_NEWLINE));
+    cntx.emitter = get_emitter(b_type);
+    cntx.sink = sink;
+    if (sink) {
+        /* Buffer may be bigger after previous conversions to string */
+        size_t raw_cod_sz = cntx.raw_avail / string_buffer_cod_width_capacity(table->conv_buffer);
+        cntx.raw_avail = MIN(cntx.raw_avail, n_codepoints * raw_cod_sz);
+        sink->chunk = buffer;
+        sink->chunk_sz = cntx.raw_avail;
     }
 
-    for (i = 0; i < rows; ++i) {
-        cur_sep = (i < sep_size) ? VECTOR_AT(table->separators, i, f_separator_t *) : NULL;
-        cur_row = VECTOR_AT(table->rows, i, f_row_t *);
-        enum f_hor_separator_pos separatorPos = (i == 0) ? TOP_SEPARATOR : INSIDE_SEPARATOR;
-        context.row = i;
-        FT_CHECK(print_row_separator(&cntx, col_vis_width_arr, cols, prev_row, cur_row, separatorPos, cur_sep));
-        FT_CHECK(snprintf_row(cur_row, &cntx, col_vis_width_arr, cols, row_vis_height_arr[i]));
-        prev_row = cur_row;
+    FT_CHECK(print_margin_lines(&cntx, context.table_properties->entire_table_properties.top_margin, cod_width));
+    for (i = first_row; i < last_row; ++i) {
+        FT_CHECK(print_table_row(&cntx, table, col_vis_width_arr, cols, row_vis_height_arr[i - first_row],
+                                 i, first_row, &prev_row));
     }
-    cur_row = NULL;
-    cur_sep = (i < sep_size) ? VECTOR_AT(table->separators, i, f_separator_t *) : NULL;
-    context.row = i;
-    FT_CHECK(print_row_separator(&cntx, col_vis_width_arr, cols, prev_row, cur_row, BOTTOM_SEPARATOR, cur_sep));
+    FT_CHECK(print_bottom_separator(&cntx, table, col_vis_width_arr, cols, last_row, prev_row));
+    FT_CHECK(print_margin_lines(&cntx, context.table_properties->entire_table_properties.bottom_margin, cod_width));
 
-    /* Print bottom margin */
-    for (i = 0; i < context.table_properties->entire_table_properties.bottom_margin; ++i) {
-        FT_CHECK(print_n_strings(&cntx, cod_width - 1/* minus new_line*/, FT_SPACE));
-        FT_CHECK(print_n_strings(&cntx, 1, FT_NEWLINE));
-    }
+    if (sink)
+        FT_CHECK(flush_output_sink(&cntx));
 
-    result = buffer;
+    return buffer;
 
 clear:
+    return NULL;
+}
+
+static
+const void *ft_to_string_body(const ft_table_t *table, enum f_string_type b_type,
+                              f_output_sink_t *sink)
+{
+    assert(table);
+
+    const void *result = NULL;
+
+    /* Determine size of table string representation */
+    size_t cod_height = 0;
+    size_t cod_width = 0;
+    int status = table_internal_codepoints_geometry(table, &cod_height, &cod_width);
+    if (FT_IS_ERROR(status)) {
+        return NULL;
+    }
+
+    size_t cols = 0;
+    size_t rows = 0;
+    size_t *col_vis_width_arr = NULL;
+    size_t *row_vis_height_arr = NULL;
+    status = table_rows_and_cols_geometry(table, &col_vis_width_arr, &cols, &row_vis_height_arr, &rows, VISIBLE_GEOMETRY);
+    if (FT_IS_ERROR(status))
+        return NULL;
+
+    if (rows == 0) {
+        result = empty_str_arr[b_type];
+    } else {
+        result = ft_print_rows_impl(table, b_type, col_vis_width_arr, cols, row_vis_height_arr,
+                                    0, rows, cod_height, cod_width, sink);
+    }
+
     F_FREE(col_vis_width_arr);
     F_FREE(row_vis_height_arr);
     return result;
 }
 
+static
+const void *ft_to_string_impl(const ft_table_t *table, enum f_string_type b_type,
+                              f_output_sink_t *sink)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    const void *result = ft_to_string_body(table, b_type, sink);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+static
+const void *ft_render_rows_body(const ft_table_t *table, size_t first_row, size_t count,
+                                enum f_string_type b_type)
+{
+    assert(table);
+
+    size_t rows = ft_row_count(table);
+    if (first_row >= rows || count == 0)
+        return empty_str_arr[b_type];
+    if (count > rows - first_row)
+        count = rows - first_row;
+
+    const f_geometry_cache_t *geometry = table_geometry_cache(table);
+    if (geometry == NULL)
+        return NULL;
+
+    size_t cod_height = 0;
+    size_t cod_width = 0;
+    const size_t *row_height_arr = geometry->row_height_arr + first_row;
+    if (FT_IS_ERROR(table_geometry_for_rows(table, geometry->cod_col_width_arr, geometry->cols,
+                                            row_height_arr, count, &cod_height, &cod_width)))
+        return NULL;
+
+    return ft_print_rows_impl(table, b_type, geometry->vis_col_width_arr, geometry->cols,
+                              row_height_arr, first_row, count, cod_height, cod_width, NULL);
+}
+
+static
+const void *ft_render_rows_impl(const ft_table_t *table, size_t first_row, size_t count,
+                                enum f_string_type b_type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    const void *result = ft_render_rows_body(table, first_row, count, b_type);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 const char *ft_to_string(const ft_table_t *table)
 {
-    return (const char *)ft_to_string_impl(table, CHAR_BUF);
+    return (const char *)ft_to_string_impl(table, CHAR_BUF, NULL);
 }
 
 #ifdef FT_HAVE_WCHAR
 const wchar_t *ft_to_wstring(const ft_table_t *table)
 {
-    return (const wchar_t *)ft_to_string_impl(table, W_CHAR_BUF);
+    return (const wchar_t *)ft_to_string_impl(table, W_CHAR_BUF, NULL);
 }
 #endif
 
+static
+int ft_print_to_body(const ft_table_t *table, enum f_string_type b_type, size_t char_sz,
+                     ft_output_fn write_fn, void *ctx)
+{
+    assert(table);
+    if (write_fn == NULL)
+        return FT_EINVAL;
 
-int ft_add_separator(ft_table_t *table)
+    f_output_sink_t sink;
+    sink.write_fn = write_fn;
+    sink.ctx = ctx;
+    sink.chunk = NULL;
+    sink.chunk_sz = 0;
+    sink.char_sz = char_sz;
+    if (ft_to_string_impl(table, b_type, &sink) == NULL)
+        return FT_GEN_ERROR;
+    return FT_SUCCESS;
+}
+
+static
+int ft_print_to_impl(const ft_table_t *table, enum f_string_type b_type, size_t char_sz,
+                     ft_output_fn write_fn, void *ctx)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_print_to_body(table, b_type, char_sz, write_fn, ctx);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+int ft_print_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx)
+{
+    return ft_print_to_impl(table, CHAR_BUF, sizeof(char), write_fn, ctx);
+}
+
+#ifdef FT_HAVE_WCHAR
+int ft_wprint_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx)
+{
+    return ft_print_to_impl(table, W_CHAR_BUF, sizeof(wchar_t), write_fn, ctx);
+}
+#endif
+
+/*
+ * Iterator over lines of the string representation of the table. Output is
+ * printed by blocks (top margin, every row with the separator above it,
+ * bottom separator with bottom margin), so only lines of one block are kept
+ * in memory.
+ */
+struct ft_line_iter {
+    const ft_table_t *table;
+    f_context_t context;
+    size_t *col_vis_width_arr;
+    size_t cols;
+    size_t *row_vis_height_arr;
+    size_t rows;
+    size_t cod_width;
+    size_t step;            /* next block: 0 - top margin, i - row (i - 1) */
+    const f_row_t *prev_row;
+    f_string_buffer_t *buffer;
+    const char *pos;        /* lines of the current block not returned yet */
+    const char *end;
+};
+
+static
+ft_line_iter_t *ft_line_iter_begin_body(const ft_table_t *table, enum f_string_type b_type)
+{
+    assert(table);
+
+    ft_line_iter_t *iter = (ft_line_iter_t *)F_CALLOC(sizeof(ft_line_iter_t), 1);
+    if (iter == NULL)
+        return NULL;
+
+    size_t cod_height = 0;
+    if (FT_IS_ERROR(table_internal_codepoints_geometry(table, &cod_height, &iter->cod_width)))
+        goto clear;
+    if (FT_IS_ERROR(table_rows_and_cols_geometry(table, &iter->col_vis_width_arr, &iter->cols,
+                    &iter->row_vis_height_arr, &iter->rows, VISIBLE_GEOMETRY)))
+        goto clear;
+    iter->buffer = create_string_buffer(iter->cod_width + 1, b_type);
+    if (iter->buffer == NULL)
+        goto clear;
+
+    iter->table = table;
+    iter->context.table_properties = (table->properties ? table->properties : &g_table_properties);
+    return iter;
+
+clear:
+    ft_line_iter_end(iter);
+    return NULL;
+}
+
+static
+ft_line_iter_t *ft_line_iter_begin_impl(const ft_table_t *table, enum f_string_type b_type)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    ft_line_iter_t *result = ft_line_iter_begin_body(table, b_type);
+    use_allocator(prev_allocator);
+    return result;
+}
+
+/*
+ * Prints next block of lines. Returns 0 if there are no more blocks.
+ */
+static
+int ft_line_iter_print_block(ft_line_iter_t *iter)
+{
+    size_t rows = iter->rows;
+    if (rows == 0 || iter->step > rows + 1)
+        return 0;
+
+    const fort_entire_table_properties_t *table_props = &iter->context.table_properties->entire_table_properties;
+    size_t lines = 0;
+    if (iter->step == 0)
+        lines = table_props->top_margin;
+    else if (iter->step <= rows)
+        lines = iter->row_vis_height_arr[iter->step - 1] + 1;
+    else
+        lines = table_props->bottom_margin + 1;
+
+    while (string_buffer_cod_width_capacity(iter->buffer) < lines * iter->cod_width + 1) {
+        if (FT_IS_ERROR(realloc_string_buffer_without_copy(iter->buffer)))
+            return -1;
+    }
+
+    int tmp = 0;
+    f_conv_context_t cntx;
+    cntx.u.buf = (char *)buffer_get_data(iter->buffer);
+    cntx.raw_avail = string_buffer_raw_capacity(iter->buffer);
+    cntx.cntx = &iter->context;
+    cntx.b_type = iter->buffer->type;
+    cntx.emitter = get_emitter(cntx.b_type);
+    cntx.sink = NULL;
+
+    if (iter->step == 0) {
+        FT_CHECK(print_margin_lines(&cntx, table_props->top_margin, iter->cod_width));
+    } else if (iter->step <= rows) {
+        FT_CHECK(print_table_row(&cntx, iter->table, iter->col_vis_width_arr, iter->cols,
+                                 iter->row_vis_height_arr[iter->step - 1], iter->step - 1, 0, &iter->prev_row));
+    } else {
+        FT_CHECK(print_bottom_separator(&cntx, iter->table, iter->col_vis_width_arr, iter->cols,
+                                        rows, iter->prev_row));
+        FT_CHECK(print_margin_lines(&cntx, table_props->bottom_margin, iter->cod_width));
+    }
+
+    iter->pos = (const char *)buffer_get_data(iter->buffer);
+    iter->end = cntx.u.buf;
+    iter->step++;
+    return 1;
+
+clear:
+    return -1;
+}
+
+ft_line_iter_t *ft_line_iter_begin(const ft_table_t *table)
+{
+    return ft_line_iter_begin_impl(table, CHAR_BUF);
+}
+
+int ft_line_iter_next(ft_line_iter_t *iter, char *buf, size_t buf_sz, size_t *len)
+{
+    if (iter == NULL || (buf == NULL && buf_sz != 0))
+        return FT_EINVAL;
+
+    while (iter->pos == iter->end) {
+        const ft_allocator_t *prev_allocator = use_table_allocator(iter->table);
+        int status = ft_line_iter_print_block(iter);
+        use_allocator(prev_allocator);
+        if (status < 0)
+            return FT_GEN_ERROR;
+        if (status == 0)
+            return 0;
+    }
+
+    const char *new_line = (const char *)memchr(iter->pos, '\n', (size_t)(iter->end - iter->pos));
+    size_t line_len = (size_t)((new_line ? new_line : iter->end) - iter->pos);
+    if (len)
+        *len = line_len;
+    if (buf_sz <= line_len)
+        return FT_EINVAL;
+
+    memcpy(buf, iter->pos, line_len);
+    buf[line_len] = '\0';
+    iter->pos = new_line ? new_line + 1 : iter->end;
+    return 1;
+}
+
+void ft_line_iter_end(ft_line_iter_t *iter)
+{
+    if (iter == NULL)
+        return;
+    const ft_allocator_t *prev_allocator = use_table_allocator(iter->table);
+    F_FREE(iter->col_vis_width_arr);
+    F_FREE(iter->row_vis_height_arr);
+    destroy_string_buffer(iter->buffer);
+    F_FREE(iter);
+    use_allocator(prev_allocator);
+}
+
+const char *ft_render_rows(const ft_table_t *table, size_t first_row, size_t count)
+{
+    return (const char *)ft_render_rows_impl(table, first_row, count, CHAR_BUF);
+}
+
+#ifdef FT_HAVE_WCHAR
+const wchar_t *ft_wrender_rows(const ft_table_t *table, size_t first_row, size_t count)
+{
+    return (const wchar_t *)ft_render_rows_impl(table, first_row, count, W_CHAR_BUF);
+}
+#endif
+
+
+static
+int ft_add_separator_impl(ft_table_t *table)
 {
     assert(table);
     assert(table->separators);
@@ -858,6 +1994,14 @@ int ft_add_separator(ft_table_t *table)
     return FT_SUCCESS;
 }
 
+int ft_add_separator(ft_table_t *table)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_add_separator_impl(table);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 static const struct fort_border_style *built_in_styles[] = {
     &FORT_BASIC_STYLE,
     &FORT_BASIC2_STYLE,
@@ -907,6 +2051,7 @@ static void set_border_props_for_props(f_table_properties_t *properties, const s
     if (style >= built_in_external_styles && style < (built_in_external_styles + BUILT_IN_STYLES_SZ)) {
         size_t pos = (size_t)(style - built_in_external_styles);
         memcpy(&(properties->border_style), built_in_styles[pos], sizeof(struct fort_border_style));
+        prepare_border_glyphs(properties);
         return;
     }
 
@@ -957,16 +2102,20 @@ static void set_border_props_for_props(f_table_properties_t *properties, const s
 #undef BOR_CHARS
 #undef H_BOR_CHARS
 #undef SEP_CHARS
+
+    prepare_border_glyphs(properties);
 }
 
 
 int ft_set_default_border_style(const struct ft_border_style *style)
 {
     set_border_props_for_props(&g_table_properties, style);
+    invalidate_all_geometry_caches();
     return FT_SUCCESS;
 }
 
-int ft_set_border_style(ft_table_t *table, const struct ft_border_style *style)
+static
+int ft_set_border_style_impl(ft_table_t *table, const struct ft_border_style *style)
 {
     assert(table);
     if (table->properties == NULL) {
@@ -975,14 +2124,25 @@ int ft_set_border_style(ft_table_t *table, const struct ft_border_style *style)
             return FT_MEMORY_ERROR;
     }
     set_border_props_for_props(table->properties, style);
+    invalidate_geometry_cache(table);
     return FT_SUCCESS;
 }
 
+int ft_set_border_style(ft_table_t *table, const struct ft_border_style *style)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_border_style_impl(table, style);
+    use_allocator(prev_allocator);
+    return result;
+}
 
 
-int ft_set_cell_prop(ft_table_t *table, size_t row, size_t col, uint32_t property, int value)
+
+static
+int ft_set_cell_prop_impl(ft_table_t *table, size_t row, size_t col, uint32_t property, int value)
 {
     assert(table);
+    invalidate_geometry_cache(table);
 
     if (table->properties == NULL) {
         table->properties = create_table_properties();
@@ -1004,20 +2164,32 @@ int ft_set_cell_prop(ft_table_t *table, size_t row, size_t col, uint32_t propert
     return set_cell_property(table->properties->cell_properties, row, col, property, value);
 }
 
+int ft_set_cell_prop(ft_table_t *table, size_t row, size_t col, uint32_t property, int value)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_cell_prop_impl(table, row, col, property, value);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 int ft_set_default_cell_prop(uint32_t property, int value)
 {
+    invalidate_all_geometry_caches();
     return set_default_cell_property(property, value);
 }
 
 
 int ft_set_default_tbl_prop(uint32_t property, int value)
 {
+    invalidate_all_geometry_caches();
     return set_default_entire_table_property(property, value);
 }
 
-int ft_set_tbl_prop(ft_table_t *table, uint32_t property, int value)
+static
+int ft_set_tbl_prop_impl(ft_table_t *table, uint32_t property, int value)
 {
     assert(table);
+    invalidate_geometry_cache(table);
 
     if (table->properties == NULL) {
         table->properties = create_table_properties();
@@ -1027,11 +2199,24 @@ int ft_set_tbl_prop(ft_table_t *table, uint32_t property, int value)
     return set_entire_table_property(table->properties, property, value);
 }
 
+int ft_set_tbl_prop(ft_table_t *table, uint32_t property, int value)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_tbl_prop_impl(table, property, value);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 void ft_set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr))
 {
     set_memory_funcs(f_malloc, f_free);
 }
 
+int ft_set_allocator(const ft_allocator_t *allocator)
+{
+    return set_allocator(allocator);
+}
+
 const char *ft_strerror(int error_code)
 {
     switch (error_code) {
@@ -1051,17 +2236,23 @@ const char *ft_strerror(int error_code)
     }
 }
 
-int ft_set_cell_span(ft_table_t *table, size_t row, size_t col, size_t hor_span)
+static
+int ft_set_cell_span_impl(ft_table_t *table, size_t row, size_t col, size_t hor_span)
 {
     assert(table);
     if (hor_span < 2)
         return FT_EINVAL;
 
+    invalidate_geometry_cache(table);
+
     if (row == FT_CUR_ROW)
         row = table->cur_row;
     if (row == FT_CUR_COLUMN)
         col = table->cur_col;
 
+    if (table->virt)
+        return virtual_data_set_cell_span(table->virt, row, col, hor_span);
+
     f_row_t *row_p = get_row_and_create_if_not_exists(table, row);
     if (row_p == NULL)
         return FT_GEN_ERROR;
@@ -1069,6 +2260,14 @@ int ft_set_cell_span(ft_table_t *table, size_t row, size_t col, size_t hor_span)
     return row_set_cell_span(row_p, col, hor_span);
 }
 
+int ft_set_cell_span(ft_table_t *table, size_t row, size_t col, size_t hor_span)
+{
+    const ft_allocator_t *prev_allocator = use_table_allocator(table);
+    int result = ft_set_cell_span_impl(table, row, col, hor_span);
+    use_allocator(prev_allocator);
+    return result;
+}
+
 #ifdef FT_HAVE_UTF8
 
 int ft_u8nwrite(ft_table_t *table, size_t n, const void *cell_content, ...)
@@ -1155,12 +2354,28 @@ int ft_u8printf_ln(ft_table_t *table, const char *fmt, ...)
 
 const void *ft_to_u8string(const ft_table_t *table)
 {
-    return (const void *)ft_to_string_impl(table, UTF8_BUF);
+    return (const void *)ft_to_string_impl(table, UTF8_BUF, NULL);
+}
+
+const void *ft_u8render_rows(const ft_table_t *table, size_t first_row, size_t count)
+{
+    return (const void *)ft_render_rows_impl(table, first_row, count, UTF8_BUF);
+}
+
+int ft_u8print_to(const ft_table_t *table, ft_output_fn write_fn, void *ctx)
+{
+    return ft_print_to_impl(table, UTF8_BUF, sizeof(char), write_fn, ctx);
+}
+
+ft_line_iter_t *ft_u8line_iter_begin(const ft_table_t *table)
+{
+    return ft_line_iter_begin_impl(table, UTF8_BUF);
 }
 
 void ft_set_u8strwid_func(int (*u8strwid)(const void *beg, const void *end, size_t *width))
 {
     buffer_set_u8strwid_func(u8strwid);
+    invalidate_all_geometry_caches();
 }
 
 #endif /* FT_HAVE_UTF8 */
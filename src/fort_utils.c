@@ -14,69 +14,141 @@ char g_col_separator = FORT_DEFAULT_COL_SEPARATOR;
  *               LIBFORT helpers
  *****************************************************************************/
 
-#if defined(FT_GCC_COMPILER) || defined(FT_CLANG_COMPILER)
-void *(*fort_malloc)(size_t size) = &malloc;
-void (*fort_free)(void *ptr) = &free;
-void *(*fort_calloc)(size_t nmemb, size_t size) = &calloc;
-void *(*fort_realloc)(void *ptr, size_t size) = &realloc;
-#else
-static void *local_malloc(size_t size)
+static void *std_malloc(size_t size, void *ctx)
 {
+    (void)ctx;
     return malloc(size);
 }
 
-static void local_free(void *ptr)
+static void *std_calloc(size_t nmemb, size_t size, void *ctx)
 {
-    free(ptr);
+    (void)ctx;
+    return calloc(nmemb, size);
 }
 
-static void *local_calloc(size_t nmemb, size_t size)
+static void *std_realloc(void *ptr, size_t old_size, size_t size, void *ctx)
 {
-    return calloc(nmemb, size);
+    (void)old_size;
+    (void)ctx;
+    return realloc(ptr, size);
 }
 
-static void *local_realloc(void *ptr, size_t size)
+static void std_free(void *ptr, void *ctx)
 {
-    return realloc(ptr, size);
+    (void)ctx;
+    free(ptr);
 }
 
-void *(*fort_malloc)(size_t size) = &local_malloc;
-void (*fort_free)(void *ptr) = &local_free;
-void *(*fort_calloc)(size_t nmemb, size_t size) = &local_calloc;
-void *(*fort_realloc)(void *ptr, size_t size) = &local_realloc;
-#endif
+static const ft_allocator_t std_allocator = {
+    &std_malloc, &std_calloc, &std_realloc, &std_free, NULL
+};
+
+/* Global allocator (see ft_set_allocator) */
+static ft_allocator_t g_allocator = {
+    &std_malloc, &std_calloc, &std_realloc, &std_free, NULL
+};
+
+/*
+ * Tables with their own allocators make it current for the time of calls of
+ * public functions (see use_table_allocator), so it is kept per thread: calls
+ * for different tables in different threads don't affect each other.
+ */
+FT_THREAD_LOCAL const ft_allocator_t *fort_allocator = &g_allocator;
+
+FT_INTERNAL
+void *fort_malloc(size_t size)
+{
+    return fort_allocator->malloc_fn(size, fort_allocator->ctx);
+}
+
+FT_INTERNAL
+void fort_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    fort_allocator->free_fn(ptr, fort_allocator->ctx);
+}
 
-static void *custom_fort_calloc(size_t nmemb, size_t size)
+FT_INTERNAL
+void *fort_calloc(size_t nmemb, size_t size)
 {
+    if (fort_allocator->calloc_fn)
+        return fort_allocator->calloc_fn(nmemb, size, fort_allocator->ctx);
+
+    if (size && nmemb > SIZE_MAX / size)
+        return NULL;
     size_t total_size = nmemb * size;
-    void *result = F_MALLOC(total_size);
+    void *result = fort_malloc(total_size);
     if (result != NULL)
         memset(result, 0, total_size);
     return result;
 }
 
-static void *custom_fort_realloc(void *ptr, size_t size)
+FT_INTERNAL
+void *fort_realloc(void *ptr, size_t old_size, size_t size)
 {
+    if (fort_allocator->realloc_fn)
+        return fort_allocator->realloc_fn(ptr, old_size, size, fort_allocator->ctx);
+
     if (ptr == NULL)
-        return F_MALLOC(size);
+        return fort_malloc(size);
     if (size == 0) {
-        F_FREE(ptr);
+        fort_free(ptr);
         return NULL;
     }
 
-    void *new_chunk = F_MALLOC(size);
+    void *new_chunk = fort_malloc(size);
     if (new_chunk == NULL)
         return NULL;
 
-    /*
-     * In theory we should copy MIN(size, size allocated for ptr) bytes,
-     * but this is rather dummy implementation so we don't care about it
-     */
-    memcpy(new_chunk, ptr, size);
-    F_FREE(ptr);
+    memcpy(new_chunk, ptr, MIN(old_size, size));
+    fort_free(ptr);
     return new_chunk;
 }
 
+FT_INTERNAL
+const ft_allocator_t *use_allocator(const ft_allocator_t *allocator)
+{
+    assert(allocator);
+    const ft_allocator_t *prev = fort_allocator;
+    fort_allocator = allocator;
+    return prev;
+}
+
+FT_INTERNAL
+const ft_allocator_t *use_global_allocator(void)
+{
+    return use_allocator(&g_allocator);
+}
+
+FT_INTERNAL
+f_status set_allocator(const ft_allocator_t *allocator)
+{
+    if (allocator == NULL) {
+        g_allocator = std_allocator;
+        return FT_SUCCESS;
+    }
+    if (allocator->malloc_fn == NULL || allocator->free_fn == NULL)
+        return FT_EINVAL;
+    g_allocator = *allocator;
+    return FT_SUCCESS;
+}
+
+/* Functions set by ft_set_memory_funcs */
+static void *(*user_malloc)(size_t size) = NULL;
+static void (*user_free)(void *ptr) = NULL;
+
+static void *user_malloc_adapter(size_t size, void *ctx)
+{
+    (void)ctx;
+    return user_malloc(size);
+}
+
+static void user_free_adapter(void *ptr, void *ctx)
+{
+    (void)ctx;
+    user_free(ptr);
+}
 
 FT_INTERNAL
 void set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr))
@@ -85,24 +157,16 @@ void set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr))
            || (f_malloc != NULL && f_free != NULL) /* Use custom functions */);
 
     if (f_malloc == NULL && f_free == NULL) {
-#if defined(FT_GCC_COMPILER) || defined(FT_CLANG_COMPILER)
-        fort_malloc = &malloc;
-        fort_free = &free;
-        fort_calloc = &calloc;
-        fort_realloc = &realloc;
-#else
-        fort_malloc = &local_malloc;
-        fort_free = &local_free;
-        fort_calloc = &local_calloc;
-        fort_realloc = &local_realloc;
-#endif
+        set_allocator(NULL);
     } else {
-        fort_malloc = f_malloc;
-        fort_free = f_free;
-        fort_calloc = &custom_fort_calloc;
-        fort_realloc = &custom_fort_realloc;
+        /* calloc and realloc are emulated with f_malloc and f_free */
+        ft_allocator_t allocator = {
+            &user_malloc_adapter, NULL, NULL, &user_free_adapter, NULL
+        };
+        user_malloc = f_malloc;
+        user_free = f_free;
+        set_allocator(&allocator);
     }
-
 }
 
 FT_INTERNAL
@@ -120,6 +184,182 @@ char *fort_strdup(const char *str)
     return str_copy;
 }
 
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Writes decimal representation of value to buf (at least 21 chars long) */
+FT_INTERNAL
+size_t u64_to_str(uint64_t value, char *buf)
+{
+    char tmp[20];
+    char *pos = tmp + sizeof(tmp);
+    while (value >= 100) {
+        size_t i = (size_t)(value % 100) * 2;
+        value /= 100;
+        *--pos = digit_pairs[i + 1];
+        *--pos = digit_pairs[i];
+    }
+    if (value >= 10) {
+        size_t i = (size_t)value * 2;
+        *--pos = digit_pairs[i + 1];
+        *--pos = digit_pairs[i];
+    } else {
+        *--pos = (char)('0' + value);
+    }
+
+    size_t len = (size_t)(tmp + sizeof(tmp) - pos);
+    memcpy(buf, pos, len);
+    buf[len] = '\0';
+    return len;
+}
+
+FT_INTERNAL
+size_t i64_to_str(int64_t value, char *buf)
+{
+    if (value < 0) {
+        buf[0] = '-';
+        /* Negate as unsigned to handle INT64_MIN */
+        return 1 + u64_to_str((uint64_t)0 - (uint64_t)value, buf + 1);
+    }
+    return u64_to_str((uint64_t)value, buf);
+}
+
+FT_INTERNAL
+size_t u64_str_len(uint64_t value)
+{
+    size_t len = 1;
+    while (value >= 10000) {
+        value /= 10000;
+        len += 4;
+    }
+    if (value >= 1000)
+        return len + 3;
+    if (value >= 100)
+        return len + 2;
+    if (value >= 10)
+        return len + 1;
+    return len;
+}
+
+FT_INTERNAL
+size_t i64_str_len(int64_t value)
+{
+    if (value < 0)
+        return 1 + u64_str_len((uint64_t)0 - (uint64_t)value);
+    return u64_str_len((uint64_t)value);
+}
+
+FT_INTERNAL
+f_status number_format_from_spec(const char *spec, enum f_number_type type, char *fmt, size_t fmt_sz)
+{
+    assert(spec);
+    const char *conversions = NULL;
+    switch (type) {
+        case F_NUM_I64:
+            conversions = "di";
+            break;
+        case F_NUM_U64:
+            conversions = "uxXo";
+            break;
+        case F_NUM_F64:
+            conversions = "fFeEgGaA";
+            break;
+    }
+
+    size_t n_conversions = 0;
+    size_t i = 0;
+    const char *pos = spec;
+    /* Specification without text may be given without '%' (e.g. ".2f") */
+    int bare_spec = (strchr(spec, '%') == NULL);
+    while (*pos) {
+        /* Room for '%', "ll", conversion and '\0' */
+        if (i + 4 >= fmt_sz)
+            return FT_EINVAL;
+        if (bare_spec) {
+            fmt[i++] = '%';
+        } else {
+            if (*pos != '%') {
+                fmt[i++] = *pos++;
+                continue;
+            }
+            fmt[i++] = *pos++;
+            if (*pos == '%') {
+                fmt[i++] = *pos++;
+                continue;
+            }
+        }
+
+        /* flags, width and precision */
+        while (*pos && strchr("-+ #0123456789.", *pos)) {
+            if (i + 3 >= fmt_sz)
+                return FT_EINVAL;
+            fmt[i++] = *pos++;
+        }
+        if (*pos == '\0' || strchr(conversions, *pos) == NULL)
+            return FT_EINVAL;
+        if (type != F_NUM_F64) {
+            fmt[i++] = 'l';
+            fmt[i++] = 'l';
+        }
+        fmt[i++] = *pos++;
+        n_conversions++;
+        if (bare_spec && *pos)
+            return FT_EINVAL;
+    }
+    fmt[i] = '\0';
+    return n_conversions == 1 ? FT_SUCCESS : FT_EINVAL;
+}
+
+FT_INTERNAL
+int format_number(char *buf, size_t buf_sz, const char *fmt,
+                  enum f_number_type type, const union f_number *value)
+{
+    if (fmt == NULL && buf_sz >= FT_NUMBER_BUF_SZ) {
+        switch (type) {
+            case F_NUM_I64:
+                return (int)i64_to_str(value->i64, buf);
+            case F_NUM_U64:
+                return (int)u64_to_str(value->u64, buf);
+            case F_NUM_F64:
+                break;
+        }
+    }
+
+    /* Disable compiler diagnostic (format string is not a string literal) */
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    switch (type) {
+        case F_NUM_I64:
+            return snprintf(buf, buf_sz, fmt ? fmt : "%lld", (long long)value->i64);
+        case F_NUM_U64:
+            return snprintf(buf, buf_sz, fmt ? fmt : "%llu", (unsigned long long)value->u64);
+        case F_NUM_F64:
+            return snprintf(buf, buf_sz, fmt ? fmt : "%g", value->f64);
+    }
+#if defined(FT_CLANG_COMPILER)
+#pragma clang diagnostic pop
+#endif
+#if defined(FT_GCC_COMPILER)
+#pragma GCC diagnostic pop
+#endif
+    return -1;
+}
+
 #if defined(FT_HAVE_WCHAR)
 FT_INTERNAL
 wchar_t *fort_wcsdup(const wchar_t *str)
@@ -230,45 +470,217 @@ size_t number_of_columns_in_format_buffer(const f_string_buffer_t *fmt)
     return 0;
 }
 
+/*
+ * Parses conversion specification at `spec` (the char after '%'). Pushes
+ * types of its arguments to `arg_types` (it should have room for 3 of them)
+ * and returns pointer to the char after the specification or NULL if it is
+ * not supported.
+ */
 static
-int snprint_n_strings_impl(char *buf, size_t length, size_t n, const char *str)
+const char *parse_printf_conversion(const char *spec, enum f_printf_arg_type *arg_types, size_t *n_args)
 {
-    size_t str_len = strlen(str);
-    if (length <= n * str_len)
-        return -1;
+    const char *pos = spec;
+    if (*pos == '%')
+        return pos + 1;
 
-    if (n == 0)
-        return 0;
+    while (*pos && strchr("-+ #0'", *pos))
+        ++pos;
+    if (*pos == '*') {
+        arg_types[(*n_args)++] = F_ARG_INT;
+        ++pos;
+    } else {
+        while (*pos >= '0' && *pos <= '9')
+            ++pos;
+    }
+    if (*pos == '.') {
+        ++pos;
+        if (*pos == '*') {
+            arg_types[(*n_args)++] = F_ARG_INT;
+            ++pos;
+        } else {
+            while (*pos >= '0' && *pos <= '9')
+                ++pos;
+        }
+    }
 
-    /* To ensure valid return value it is safely not print such big strings */
-    if (n * str_len > INT_MAX)
-        return -1;
+    enum f_printf_arg_type int_type = F_ARG_INT;
+    int long_modifier = 0;
+    switch (*pos) {
+        case 'h':
+            pos += (pos[1] == 'h') ? 2 : 1;
+            break;
+        case 'l':
+            if (pos[1] == 'l') {
+                int_type = F_ARG_LLONG;
+                pos += 2;
+            } else {
+                int_type = F_ARG_LONG;
+                long_modifier = 1;
+                pos += 1;
+            }
+            break;
+        case 'j':
+            int_type = F_ARG_INTMAX;
+            ++pos;
+            break;
+        case 'z':
+            int_type = F_ARG_SIZE;
+            ++pos;
+            break;
+        case 't':
+            int_type = F_ARG_PTRDIFF;
+            ++pos;
+            break;
+        case 'L':
+            long_modifier = 2;
+            ++pos;
+            break;
+        default:
+            break;
+    }
 
-    if (str_len == 0)
-        return 0;
+    switch (*pos) {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            arg_types[(*n_args)++] = int_type;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            arg_types[(*n_args)++] = (long_modifier == 2) ? F_ARG_LDOUBLE : F_ARG_DOUBLE;
+            break;
+        case 'c':
+            arg_types[(*n_args)++] = long_modifier ? F_ARG_WINT : F_ARG_INT;
+            break;
+        case 's':
+        case 'p':
+        case 'n':
+            arg_types[(*n_args)++] = F_ARG_PTR;
+            break;
+        default:
+            return NULL;
+    }
+    return pos + 1;
+}
 
-    int status = snprintf(buf, length, "%0*d", (int)(n * str_len), 0);
-    if (status < 0)
-        return status;
+FT_INTERNAL
+ft_row_format_t *create_row_format(const char *fmt)
+{
+    assert(fmt);
+
+    ft_row_format_t *format = (ft_row_format_t *)F_CALLOC(sizeof(ft_row_format_t), 1);
+    if (format == NULL)
+        return NULL;
+
+    format->fmt = F_STRDUP(fmt);
+    if (format->fmt == NULL)
+        goto clear;
+
+    /* Every conversion has at most 3 arguments (width, precision, value) */
+    size_t fmt_len = strlen(fmt);
+    size_t n_conversions = 0;
+    const char *pos = fmt;
+    for (pos = fmt; *pos; ++pos) {
+        if (*pos == '%')
+            n_conversions++;
+    }
+    format->n_fields = columns_number_in_fmt_string(fmt);
+    format->fields = (struct f_row_format_field *)F_CALLOC(sizeof(struct f_row_format_field), format->n_fields);
+    format->arg_types = (enum f_printf_arg_type *)F_CALLOC(sizeof(enum f_printf_arg_type), 3 * n_conversions + 1);
+    if (format->fields == NULL || format->arg_types == NULL)
+        goto clear;
 
     size_t i = 0;
-    for (i = 0; i < n; ++i) {
-        const char *str_p = str;
-        while (*str_p)
-            *(buf++) = *(str_p++);
+    char *field_beg = format->fmt;
+    for (i = 0; i < format->n_fields; ++i) {
+        struct f_row_format_field *field = &format->fields[i];
+        char *field_end = strchr(field_beg, g_col_separator);
+        if (field_end == NULL)
+            field_end = format->fmt + fmt_len;
+        *field_end = '\0';
+
+        field->fmt = field_beg;
+        field->len = (size_t)(field_end - field_beg);
+        field->first_arg = format->n_args;
+        field->is_literal = (strchr(field_beg, '%') == NULL);
+        pos = field_beg;
+        while ((pos = strchr(pos, '%')) != NULL) {
+            pos = parse_printf_conversion(pos + 1, format->arg_types, &format->n_args);
+            if (pos == NULL)
+                goto clear;
+        }
+        field->n_args = format->n_args - field->first_arg;
+        field_beg = field_end + 1;
     }
-    return (int)(n * str_len);
+    return format;
+
+clear:
+    destroy_row_format(format);
+    return NULL;
 }
 
-static
-int snprint_n_strings(f_conv_context_t *cntx, size_t n, const char *str)
+FT_INTERNAL
+void destroy_row_format(ft_row_format_t *format)
 {
-    int w = snprint_n_strings_impl(cntx->u.buf, cntx->raw_avail, n, str);
-    if (w >= 0) {
-        cntx->u.buf += w;
-        cntx->raw_avail -= w;
+    if (format == NULL)
+        return;
+    F_FREE(format->fmt);
+    F_FREE(format->fields);
+    F_FREE(format->arg_types);
+    F_FREE(format);
+}
+
+FT_INTERNAL
+void skip_printf_args(va_list *va, const enum f_printf_arg_type *arg_types, size_t n)
+{
+    size_t i = 0;
+    for (i = 0; i < n; ++i) {
+        switch (arg_types[i]) {
+            case F_ARG_INT:
+                (void)va_arg(*va, int);
+                break;
+            case F_ARG_LONG:
+                (void)va_arg(*va, long);
+                break;
+            case F_ARG_LLONG:
+                (void)va_arg(*va, long long);
+                break;
+            case F_ARG_INTMAX:
+                (void)va_arg(*va, intmax_t);
+                break;
+            case F_ARG_SIZE:
+                (void)va_arg(*va, size_t);
+                break;
+            case F_ARG_PTRDIFF:
+                (void)va_arg(*va, ptrdiff_t);
+                break;
+            case F_ARG_WINT:
+#ifdef FT_HAVE_WCHAR
+                (void)va_arg(*va, wint_t);
+#else
+                (void)va_arg(*va, int);
+#endif
+                break;
+            case F_ARG_DOUBLE:
+                (void)va_arg(*va, double);
+                break;
+            case F_ARG_LDOUBLE:
+                (void)va_arg(*va, long double);
+                break;
+            case F_ARG_PTR:
+                (void)va_arg(*va, void *);
+                break;
+        }
     }
-    return w;
 }
 
 #if defined(FT_HAVE_WCHAR)
@@ -276,56 +688,139 @@ static
 int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str);
 #endif
 
-#if defined(FT_HAVE_UTF8)
-static
-int u8nprint_n_strings(void *buf, size_t length, size_t n, const void *str);
-#endif
 
 
 FT_INTERNAL
-int print_n_strings(f_conv_context_t *cntx, size_t n, const char *str)
+int flush_output_sink(f_conv_context_t *cntx)
 {
-    int cod_w;
-    int raw_written;
+    f_output_sink_t *sink = cntx->sink;
+    assert(sink);
 
-    switch (cntx->b_type) {
-        case CHAR_BUF:
-            raw_written = snprint_n_strings(cntx, n, str);
-            cod_w = raw_written;
-            return cod_w;
+    size_t raw_len = (size_t)(cntx->u.buf - sink->chunk);
+    if (raw_len && sink->write_fn(sink->chunk, raw_len / sink->char_sz, sink->ctx) < 0)
+        return -1;
+    cntx->u.buf = sink->chunk;
+    cntx->raw_avail = sink->chunk_sz;
+    return 0;
+}
+
+/*
+ * Makes room for `raw_len` bytes (and the terminating null char) in the
+ * output buffer if output is streamed.
+ */
+static
+int reserve_output(f_conv_context_t *cntx, size_t raw_len)
+{
+    if (cntx->sink == NULL || cntx->raw_avail >= raw_len + cntx->sink->char_sz)
+        return 0;
+    return flush_output_sink(cntx);
+}
+
+/*
+ * Decodes glyph of one utf-8 codepoint to wide char. Returns 0 if the glyph
+ * isn't one well-formed codepoint (or it doesn't fit wchar_t).
+ */
 #ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            cod_w = wsnprint_n_string(cntx->u.wbuf, cntx->raw_avail, n, str);
-            if (cod_w < 0)
-                return cod_w;
-            raw_written = sizeof(wchar_t) * cod_w;
+static
+wchar_t glyph_to_wchar(const unsigned char *s, size_t len)
+{
+    static const unsigned long min_cp[] = {0, 0, 0x80, 0x800, 0x10000};
+    size_t i = 0;
+    unsigned long cp = 0;
+
+    if (len == 1)
+        return (s[0] < 0x80) ? (wchar_t)s[0] : 0;
+    if (len == 2 && (s[0] & 0xE0) == 0xC0)
+        cp = s[0] & 0x1F;
+    else if (len == 3 && (s[0] & 0xF0) == 0xE0)
+        cp = s[0] & 0x0F;
+    else if (len == 4 && (s[0] & 0xF8) == 0xF0)
+        cp = s[0] & 0x07;
+    else
+        return 0;
+    for (i = 1; i < len; ++i) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    if (cp < min_cp[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)
+        || cp > (unsigned long)WCHAR_MAX)
+        return 0;
+    return (wchar_t)cp;
+}
+#endif /* FT_HAVE_WCHAR */
 
-            cntx->u.buf += raw_written;
-            cntx->raw_avail -= raw_written;
-            return cod_w;
+FT_INTERNAL
+void init_glyph(f_glyph_t *glyph, const char *str)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    size_t i = 0;
+    size_t cod_len = 0;
+    int ascii = 1;
+    for (i = 0; s[i]; ++i) {
+        if (s[i] >= 0x80)
+            ascii = 0;
+        if ((s[i] & 0xC0) != 0x80)
+            cod_len++;
+    }
+    glyph->str = str;
+    glyph->len = i;
+    glyph->cod_len = cod_len;
+    glyph->ascii = ascii;
+#ifdef FT_HAVE_WCHAR
+    glyph->wch = (cod_len == 1) ? glyph_to_wchar(s, i) : 0;
 #endif /* FT_HAVE_WCHAR */
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            /* Everying is very strange and differs with W_CHAR_BUF */
-            raw_written = u8nprint_n_strings(cntx->u.buf, cntx->raw_avail, n, str);
-            if (raw_written < 0) {
-                fprintf(stderr, " raw_written = %d\n", raw_written);
-                return raw_written;
-            }
+}
 
-            cntx->u.buf += raw_written;
-            cntx->raw_avail -= raw_written;
-            return utf8len(str) * n;
-#endif /* FT_HAVE_UTF8 */
-        default:
-            assert(0);
-            return -1;
+/* Copies `n` glyphs to `buf` (there should be room for them and null char) */
+static
+void copy_n_glyphs(char *buf, size_t n, const f_glyph_t *glyph)
+{
+    if (glyph->len == 1) {
+        memset(buf, glyph->str[0], n);
+        buf[n] = '\0';
+        return;
+    }
+    size_t i = 0;
+    for (i = 0; i < n; ++i) {
+        memcpy(buf, glyph->str, glyph->len);
+        buf += glyph->len;
     }
+    *buf = '\0';
 }
 
+#ifdef FT_HAVE_WCHAR
+/* Prints wide form of the glyph, returns number of printed wide chars */
+static
+int wprint_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph)
+{
+    /* Non utf-8 glyphs are converted with the current locale */
+    if (glyph->wch == 0 && !glyph->ascii)
+        return wsnprint_n_string(cntx->u.wbuf, cntx->raw_avail, n, glyph->str);
+
+    size_t wlen = glyph->wch ? n : n * glyph->len;
+    if (wlen > INT_MAX || cntx->raw_avail < (wlen + 1) * sizeof(wchar_t))
+        return -1;
+
+    wchar_t *wbuf = cntx->u.wbuf;
+    size_t i = 0;
+    if (glyph->wch) {
+        for (i = 0; i < n; ++i)
+            wbuf[i] = glyph->wch;
+    } else {
+        for (i = 0; i < wlen; ++i)
+            wbuf[i] = (wchar_t)glyph->str[i % glyph->len];
+    }
+    wbuf[wlen] = L'\0';
+    return (int)wlen;
+}
+#endif /* FT_HAVE_WCHAR */
+
 FT_INTERNAL
 int ft_nprint(f_conv_context_t *cntx, const char *str, size_t strlen)
 {
+    if (reserve_output(cntx, strlen) < 0)
+        return -1;
     if (cntx->raw_avail + 1/* for 0 */ < strlen)
         return -1;
 
@@ -339,6 +834,8 @@ int ft_nprint(f_conv_context_t *cntx, const char *str, size_t strlen)
 #ifdef FT_HAVE_WCHAR
 int ft_nwprint(f_conv_context_t *cntx, const wchar_t *str, size_t strlen)
 {
+    if (reserve_output(cntx, strlen * sizeof(wchar_t)) < 0)
+        return -1;
     if (cntx->raw_avail + 1/* for 0 */ < strlen)
         return -1;
 
@@ -362,6 +859,8 @@ int ft_nu8print(f_conv_context_t *cntx, const void *beg, const void *end)
     const char *bc = (const char *)beg;
     const char *ec = (const char *)end;
     size_t raw_len = ec - bc;
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
     if (cntx->raw_avail + 1 < raw_len)
         return -1;
 
@@ -373,6 +872,353 @@ int ft_nu8print(f_conv_context_t *cntx, const void *beg, const void *end)
 }
 #endif /* FT_HAVE_UTF8 */
 
+
+#ifdef FT_HAVE_UTF8
+FT_INTERNAL
+size_t utf8_decode(const unsigned char *str, size_t len, uint32_t *c)
+{
+    unsigned char b0 = str[0];
+    if (b0 >= 0xc2 && b0 <= 0xdf) {
+        if (len < 2 || (str[1] & 0xc0) != 0x80)
+            return 0;
+        *c = ((uint32_t)(b0 & 0x1f) << 6) | (str[1] & 0x3f);
+        return 2;
+    }
+    if (b0 >= 0xe0 && b0 <= 0xef) {
+        if (len < 3 || (str[1] & 0xc0) != 0x80 || (str[2] & 0xc0) != 0x80)
+            return 0;
+        if ((b0 == 0xe0 && str[1] < 0xa0) || (b0 == 0xed && str[1] > 0x9f))
+            return 0;
+        *c = ((uint32_t)(b0 & 0x0f) << 12) | ((uint32_t)(str[1] & 0x3f) << 6) | (str[2] & 0x3f);
+        return 3;
+    }
+    if (b0 >= 0xf0 && b0 <= 0xf4) {
+        if (len < 4 || (str[1] & 0xc0) != 0x80 || (str[2] & 0xc0) != 0x80 || (str[3] & 0xc0) != 0x80)
+            return 0;
+        if ((b0 == 0xf0 && str[1] < 0x90) || (b0 == 0xf4 && str[1] > 0x8f))
+            return 0;
+        *c = ((uint32_t)(b0 & 0x07) << 18) | ((uint32_t)(str[1] & 0x3f) << 12)
+             | ((uint32_t)(str[2] & 0x3f) << 6) | (str[3] & 0x3f);
+        return 4;
+    }
+    return 0;
+}
+#endif /* FT_HAVE_UTF8 */
+
+/*
+ * Bodies of printing functions are written once for all types of output and
+ * take the type as a parameter. Emitters instantiate them with constant type
+ * (FT_DEFINE_EMITTER), so checks of the type are resolved at compile time.
+ */
+static FT_INLINE
+int emit_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph, enum f_string_type type)
+{
+    /* Every char of the glyph is printed as at most one code unit */
+    if (cntx->sink && reserve_output(cntx, n * glyph->len * cntx->sink->char_sz) < 0)
+        return -1;
+
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF) {
+        int cod_w = wprint_n_glyphs(cntx, n, glyph);
+        if (cod_w < 0)
+            return cod_w;
+        cntx->u.buf += sizeof(wchar_t) * cod_w;
+        cntx->raw_avail -= sizeof(wchar_t) * cod_w;
+        return cod_w;
+    }
+#endif /* FT_HAVE_WCHAR */
+
+    size_t raw_len = n * glyph->len;
+    /* To ensure valid return value it is safely not print such big strings */
+    if (cntx->raw_avail <= raw_len || raw_len > INT_MAX)
+        return -1;
+    copy_n_glyphs(cntx->u.buf, n, glyph);
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    return (int)(type == CHAR_BUF ? raw_len : n * glyph->cod_len);
+}
+
+static FT_INLINE
+int emit_n_spaces(f_conv_context_t *cntx, size_t n, enum f_string_type type)
+{
+    size_t unit_sz = 1;
+    (void)type;  /* unused if wchar support is disabled */
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        unit_sz = sizeof(wchar_t);
+#endif /* FT_HAVE_WCHAR */
+    size_t raw_len = n * unit_sz;
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
+    if (cntx->raw_avail < raw_len + unit_sz || n > INT_MAX)
+        return -1;
+
+    if (unit_sz == 1) {
+        memset(cntx->u.buf, ' ', n);
+        cntx->u.buf[n] = '\0';
+    }
+#ifdef FT_HAVE_WCHAR
+    else {
+        size_t i = 0;
+        for (i = 0; i < n; ++i)
+            cntx->u.wbuf[i] = L' ';
+        cntx->u.wbuf[n] = L'\0';
+    }
+#endif /* FT_HAVE_WCHAR */
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    return (int)n;
+}
+
+#ifdef FT_HAVE_WCHAR
+/*
+ * Converts char string [beg, end) to wide chars with the current locale (only
+ * counts them if `dst` is NULL). Invalid sequences are replaced with U+FFFD.
+ */
+static
+size_t mbs_to_wcs(wchar_t *dst, const char *beg, const char *end)
+{
+    mbstate_t state;
+    memset(&state, 0, sizeof(state));
+    size_t n = 0;
+    while (beg < end) {
+        wchar_t wch = 0;
+        size_t sz = 1;
+        if ((unsigned char)*beg < 0x80) {
+            wch = (wchar_t)*beg;
+        } else {
+            sz = mbrtowc(&wch, beg, (size_t)(end - beg), &state);
+            if (sz == (size_t) -1 || sz == (size_t) -2 || sz == 0) {
+                memset(&state, 0, sizeof(state));
+                wch = (wchar_t)0xFFFD;
+                sz = 1;
+            }
+        }
+        if (dst)
+            dst[n] = wch;
+        n++;
+        beg += sz;
+    }
+    return n;
+}
+#endif /* FT_HAVE_WCHAR */
+
+#if defined(FT_HAVE_WCHAR) && defined(FT_HAVE_UTF8)
+/*
+ * Decodes utf-8 string [beg, end) to wide chars (only counts them if `dst` is
+ * NULL). Ill-formed bytes are replaced with U+FFFD, codepoints after U+FFFF
+ * are written as surrogate pairs if wchar_t is 16 bit.
+ */
+static
+size_t u8_to_wcs(wchar_t *dst, const char *beg, const char *end)
+{
+    const unsigned char *s = (const unsigned char *)beg;
+    size_t len = (size_t)(end - beg);
+    size_t i = 0;
+    size_t n = 0;
+    while (i < len) {
+        uint32_t c = s[i];
+        size_t sz = 1;
+        if (c >= 0x80) {
+            sz = utf8_decode(s + i, len - i, &c);
+            if (sz == 0) {
+                c = 0xFFFD;
+                sz = 1;
+            }
+        }
+        i += sz;
+        if (sizeof(wchar_t) == 2 && c > 0xFFFF) {
+            if (dst) {
+                dst[n] = (wchar_t)(0xD800 + ((c - 0x10000) >> 10));
+                dst[n + 1] = (wchar_t)(0xDC00 + ((c - 0x10000) & 0x3FF));
+            }
+            n += 2;
+        } else {
+            if (dst)
+                dst[n] = (wchar_t)c;
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Encodes wide chars [beg, end) to utf-8 (only counts bytes if `dst` is NULL).
+ * Surrogate pairs of 16 bit wchar_t are combined, other values that aren't
+ * codepoints are replaced with U+FFFD.
+ */
+static
+size_t wcs_to_u8(char *dst, const wchar_t *beg, const wchar_t *end)
+{
+    size_t n = 0;
+    for (; beg < end; ++beg) {
+        utf8_int32_t c = (utf8_int32_t)*beg;
+        if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF
+            && beg + 1 < end && beg[1] >= 0xDC00 && beg[1] <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + ((utf8_int32_t)beg[1] - 0xDC00);
+            ++beg;
+        } else if (c < 0 || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+            c = 0xFFFD;
+        }
+        if (dst)
+            utf8catcodepoint(dst + n, c, 4);
+        n += utf8codepointsize(c);
+    }
+    return n;
+}
+
+/* Prints wide content to utf-8 output */
+static
+int print_u8_from_wcs(f_conv_context_t *cntx, const wchar_t *beg, const wchar_t *end)
+{
+    size_t raw_len = wcs_to_u8(NULL, beg, end);
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
+    if (cntx->raw_avail <= raw_len || raw_len > INT_MAX)
+        return -1;
+
+    wcs_to_u8(cntx->u.buf, beg, end);
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    *cntx->u.buf = '\0';
+    return (int)raw_len;
+}
+#endif /* defined(FT_HAVE_WCHAR) && defined(FT_HAVE_UTF8) */
+
+#ifdef FT_HAVE_WCHAR
+/* Prints char or utf-8 content to wide output */
+static
+int print_wcs_from_bytes(f_conv_context_t *cntx, const char *beg, const char *end,
+                         enum f_string_type content_type)
+{
+    size_t (*decode)(wchar_t *dst, const char *beg, const char *end) = mbs_to_wcs;
+#ifdef FT_HAVE_UTF8
+    if (content_type == UTF8_BUF)
+        decode = u8_to_wcs;
+#endif /* FT_HAVE_UTF8 */
+    (void)content_type;  /* unused if utf-8 support is disabled */
+
+    size_t len = decode(NULL, beg, end);
+    size_t raw_len = len * sizeof(wchar_t);
+    if (reserve_output(cntx, raw_len) < 0)
+        return -1;
+    if (cntx->raw_avail < raw_len + sizeof(wchar_t) || len > INT_MAX)
+        return -1;
+
+    decode(cntx->u.wbuf, beg, end);
+    cntx->u.wbuf[len] = L'\0';
+    cntx->u.buf += raw_len;
+    cntx->raw_avail -= raw_len;
+    return (int)len;
+}
+#endif /* FT_HAVE_WCHAR */
+
+static FT_INLINE
+int emit_range(f_conv_context_t *cntx, const void *beg, const void *end,
+               enum f_string_type content_type, enum f_string_type type)
+{
+    (void)type;  /* unused if wchar and utf-8 support is disabled */
+    (void)content_type;
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF) {
+        if (content_type == W_CHAR_BUF)
+            return ft_nwprint(cntx, (const wchar_t *)beg, (size_t)((const wchar_t *)end - (const wchar_t *)beg));
+        return print_wcs_from_bytes(cntx, (const char *)beg, (const char *)end, content_type);
+    }
+    if (content_type == W_CHAR_BUF) {
+#ifdef FT_HAVE_UTF8
+        if (type == UTF8_BUF)
+            return print_u8_from_wcs(cntx, (const wchar_t *)beg, (const wchar_t *)end);
+#endif /* FT_HAVE_UTF8 */
+        return -1;
+    }
+#endif /* FT_HAVE_WCHAR */
+
+    /* Char and utf-8 content is printed to char and utf-8 output as it is */
+#ifdef FT_HAVE_UTF8
+    if (type == UTF8_BUF)
+        return ft_nu8print(cntx, beg, end);
+#endif /* FT_HAVE_UTF8 */
+    return ft_nprint(cntx, (const char *)beg, (size_t)((const char *)end - (const char *)beg));
+}
+
+#define FT_DEFINE_EMITTER(name, type) \
+    static int name##_print_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph) \
+    { \
+        return emit_n_glyphs(cntx, n, glyph, type); \
+    } \
+    static int name##_print_n_spaces(f_conv_context_t *cntx, size_t n) \
+    { \
+        return emit_n_spaces(cntx, n, type); \
+    } \
+    static int name##_print_range(f_conv_context_t *cntx, const void *beg, const void *end, \
+                                  enum f_string_type content_type) \
+    { \
+        return emit_range(cntx, beg, end, content_type, type); \
+    } \
+    static const f_emitter_t name = { \
+        name##_print_n_glyphs, \
+        name##_print_n_spaces, \
+        name##_print_range \
+    };
+
+FT_DEFINE_EMITTER(char_emitter, CHAR_BUF)
+#ifdef FT_HAVE_WCHAR
+FT_DEFINE_EMITTER(wchar_emitter, W_CHAR_BUF)
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+FT_DEFINE_EMITTER(utf8_emitter, UTF8_BUF)
+#endif /* FT_HAVE_UTF8 */
+
+#undef FT_DEFINE_EMITTER
+
+FT_INTERNAL
+const f_emitter_t *get_emitter(enum f_string_type type)
+{
+    switch (type) {
+        case CHAR_BUF:
+            return &char_emitter;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            return &wchar_emitter;
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            return &utf8_emitter;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+            return NULL;
+    }
+}
+
+FT_INTERNAL
+int print_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph)
+{
+    return cntx->emitter->print_n_glyphs(cntx, n, glyph);
+}
+
+FT_INTERNAL
+int print_n_strings(f_conv_context_t *cntx, size_t n, const char *str)
+{
+    f_glyph_t glyph;
+    init_glyph(&glyph, str);
+    return cntx->emitter->print_n_glyphs(cntx, n, &glyph);
+}
+
+FT_INTERNAL
+int print_n_spaces(f_conv_context_t *cntx, size_t n)
+{
+    return cntx->emitter->print_n_spaces(cntx, n);
+}
+
+FT_INTERNAL
+int print_range(f_conv_context_t *cntx, const void *beg, const void *end,
+                enum f_string_type content_type)
+{
+    return cntx->emitter->print_range(cntx, beg, end, content_type);
+}
+
 #if defined(FT_HAVE_WCHAR)
 #define WCS_SIZE 64
 
@@ -399,6 +1245,8 @@ int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str)
                 /* for simplicity */
                 if ((wcs_len == (size_t) - 1) || wcs_len > 1) {
                     return -1;
+                } else if (length < (n + 1) * sizeof(wchar_t) || n > INT_MAX) {
+                    return -1;
                 } else {
                     wcs[wcs_len] = L'\0';
                     size_t k = n;
@@ -407,7 +1255,7 @@ int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str)
                         ++buf;
                         --k;
                     }
-                    buf[n] = L'\0';
+                    *buf = L'\0';
                     return (int)n;
                 }
             }
@@ -442,31 +1290,4 @@ int wsnprint_n_string(wchar_t *buf, size_t length, size_t n, const char *str)
 #endif
 
 
-#if defined(FT_HAVE_UTF8)
-static
-int u8nprint_n_strings(void *buf, size_t length, size_t n, const void *str)
-{
-    size_t str_size = utf8size(str) - 1; /* str_size - raw size in bytes, excluding \0 */
-    if (length <= n * str_size)
-        return -1;
 
-    if (n == 0)
-        return 0;
-
-    /* To ensure valid return value it is safely not print such big strings */
-    if (n * str_size > INT_MAX)
-        return -1;
-
-    if (str_size == 0)
-        return 0;
-
-    size_t i = n;
-    while (i) {
-        memcpy(buf, str, str_size);
-        buf = (char *)buf + str_size;
-        --i;
-    }
-    *(char *)buf = '\0';
-    return (int)(n * str_size);
-}
-#endif
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include "fort.h"
 
 /* Define FT_INTERNAL to make internal libfort functions static
@@ -22,6 +23,20 @@
 #endif /* FT_AMALGAMED_SORCE */
 
 
+/* Storage class of per thread state */
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define FT_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define FT_THREAD_LOCAL _Thread_local
+#elif defined(FT_GCC_COMPILER) || defined(FT_CLANG_COMPILER)
+#define FT_THREAD_LOCAL __thread
+#elif defined(FT_MICROSOFT_COMPILER)
+#define FT_THREAD_LOCAL __declspec(thread)
+#else
+#define FT_THREAD_LOCAL
+#endif
+
+
 #define FORT_DEFAULT_COL_SEPARATOR '|'
 extern char g_col_separator;
 
@@ -35,8 +50,7 @@ extern char g_col_separator;
 #define F_REALLOC fort_realloc
 #define F_STRDUP fort_strdup
 #define F_WCSDUP fort_wcsdup
-/* @todo: replace with custom impl !!!*/
-#define F_UTF8DUP utf8dup
+#define F_UTF8DUP(str) fort_strdup((const char *)(str))
 
 #define F_CREATE(type) ((type *)F_CALLOC(sizeof(type), 1))
 
@@ -87,6 +101,23 @@ enum f_string_type {
 #endif /* FT_HAVE_WCHAR */
 };
 
+enum f_number_type {
+    F_NUM_I64,
+    F_NUM_U64,
+    F_NUM_F64
+};
+
+union f_number {
+    int64_t i64;
+    uint64_t u64;
+    double f64;
+};
+
+/* Size of buffer enough for numbers formatted with default format */
+#define FT_NUMBER_BUF_SZ 32
+/* Size of buffer for printf format of a number converted from user spec */
+#define FT_NUMBER_FMT_SZ 64
+
 struct f_string_view {
     union {
         const char *cstr;
@@ -141,6 +172,19 @@ struct f_context {
 };
 typedef struct f_context f_context_t;
 
+/*
+ * Destination of streamed output. Output is printed to the chunk buffer
+ * which is passed to the user callback every time it becomes full.
+ */
+struct f_output_sink {
+    ft_output_fn write_fn;
+    void *ctx;
+    char *chunk;
+    size_t chunk_sz;    /* raw size of the chunk buffer */
+    size_t char_sz;     /* raw size of a code unit */
+};
+typedef struct f_output_sink f_output_sink_t;
+
 struct f_conv_context {
     union {
         char *buf;
@@ -154,18 +198,64 @@ struct f_conv_context {
     size_t raw_avail;
     struct f_context *cntx;
     enum f_string_type b_type;
+    const struct f_emitter *emitter;   /* printing functions for b_type */
+    f_output_sink_t *sink;  /* NULL if output is printed to one buffer */
 };
 typedef struct f_conv_context f_conv_context_t;
 
+/*
+ * Printing functions instantiated for one type of output (see fort_utils.c).
+ * Emitter is selected once per conversion (get_emitter), so printing
+ * functions don't dispatch on type of output for every printed string.
+ */
+struct f_glyph;
+struct f_emitter {
+    int (*print_n_glyphs)(f_conv_context_t *cntx, size_t n, const struct f_glyph *glyph);
+    int (*print_n_spaces)(f_conv_context_t *cntx, size_t n);
+    int (*print_range)(f_conv_context_t *cntx, const void *beg, const void *end,
+                       enum f_string_type content_type);
+};
+typedef struct f_emitter f_emitter_t;
+
 
 /*****************************************************************************
  *               LIBFORT helpers
  *****************************************************************************/
 
-extern void *(*fort_malloc)(size_t size);
-extern void (*fort_free)(void *ptr);
-extern void *(*fort_calloc)(size_t nmemb, size_t size);
-extern void *(*fort_realloc)(void *ptr, size_t size);
+/*
+ * Allocator used at the moment by the current thread (global one or allocator
+ * of the table processed by the thread).
+ */
+extern FT_THREAD_LOCAL const ft_allocator_t *fort_allocator;
+
+FT_INTERNAL
+void *fort_malloc(size_t size);
+
+FT_INTERNAL
+void fort_free(void *ptr);
+
+FT_INTERNAL
+void *fort_calloc(size_t nmemb, size_t size);
+
+FT_INTERNAL
+void *fort_realloc(void *ptr, size_t old_size, size_t size);
+
+/*
+ * Makes allocator current. Returns allocator that was current before (it
+ * should be restored after the operation).
+ */
+FT_INTERNAL
+const ft_allocator_t *use_allocator(const ft_allocator_t *allocator);
+
+/*
+ * Makes global allocator current (e.g. for objects that are not owned by
+ * tables with their own allocators). Returns allocator that was current.
+ */
+FT_INTERNAL
+const ft_allocator_t *use_global_allocator(void);
+
+FT_INTERNAL
+f_status set_allocator(const ft_allocator_t *allocator);
 
 FT_INTERNAL
 void set_memory_funcs(void *(*f_malloc)(size_t size), void (*f_free)(void *ptr));
@@ -181,6 +271,47 @@ size_t number_of_columns_in_format_string(const f_string_view_t *fmt);
 FT_INTERNAL
 size_t number_of_columns_in_format_buffer(const f_string_buffer_t *fmt);
 
+/* Types of printf arguments after default argument promotions */
+enum f_printf_arg_type {
+    F_ARG_INT,
+    F_ARG_LONG,
+    F_ARG_LLONG,
+    F_ARG_INTMAX,
+    F_ARG_SIZE,
+    F_ARG_PTRDIFF,
+    F_ARG_WINT,
+    F_ARG_DOUBLE,
+    F_ARG_LDOUBLE,
+    F_ARG_PTR
+};
+
+struct f_row_format_field {
+    const char *fmt;      /* printf format of the cell */
+    size_t len;           /* length of fmt */
+    size_t first_arg;     /* index of the first argument of the cell */
+    size_t n_args;
+    int is_literal;       /* fmt has no conversion specifications */
+};
+
+/* Format string of ft_printf split to cells with parsed argument types */
+struct ft_row_format {
+    char *fmt;
+    struct f_row_format_field *fields;
+    size_t n_fields;
+    enum f_printf_arg_type *arg_types;
+    size_t n_args;
+};
+
+FT_INTERNAL
+ft_row_format_t *create_row_format(const char *fmt);
+
+FT_INTERNAL
+void destroy_row_format(ft_row_format_t *format);
+
+/* Skips arguments of the specified types in the argument list */
+FT_INTERNAL
+void skip_printf_args(va_list *va, const enum f_printf_arg_type *arg_types, size_t n);
+
 #if defined(FT_HAVE_WCHAR)
 FT_INTERNAL
 wchar_t *fort_wcsdup(const wchar_t *str);
@@ -188,9 +319,94 @@ wchar_t *fort_wcsdup(const wchar_t *str);
 
 
 
+FT_INTERNAL
+size_t u64_to_str(uint64_t value, char *buf);
+
+FT_INTERNAL
+size_t i64_to_str(int64_t value, char *buf);
+
+/* Number of chars in decimal representation of value */
+FT_INTERNAL
+size_t u64_str_len(uint64_t value);
+
+FT_INTERNAL
+size_t i64_str_len(int64_t value);
+
+/*
+ * Converts format specification of a number (printf conversion
+ * specification without length modifier, e.g. "%08d" or "%.2f", that can be
+ * surrounded by text, or the same specification without '%' and text, e.g.
+ * ".2f") to printf format string.
+ */
+FT_INTERNAL
+f_status number_format_from_spec(const char *spec, enum f_number_type type, char *fmt, size_t fmt_sz);
+
+/*
+ * Formats number with format returned by number_format_from_spec (or with
+ * the default format if fmt is NULL). Returns the same value as snprintf.
+ */
+FT_INTERNAL
+int format_number(char *buf, size_t buf_sz, const char *fmt,
+                  enum f_number_type type, const union f_number *value);
+
+/*
+ * String printed many times (e.g. border char) prepared for printing: it is
+ * measured and converted to wide char once instead of on every print.
+ */
+struct f_glyph {
+    const char *str;
+    size_t len;           /* length in bytes */
+    size_t cod_len;       /* number of codepoints of utf-8 string */
+    int ascii;            /* string has only ASCII chars */
+#ifdef FT_HAVE_WCHAR
+    wchar_t wch;          /* glyph of one utf-8 codepoint as wide char, 0 otherwise */
+#endif /* FT_HAVE_WCHAR */
+};
+typedef struct f_glyph f_glyph_t;
+
+FT_INTERNAL
+void init_glyph(f_glyph_t *glyph, const char *str);
+
+/* Prints glyph `n` times, returns number of printed codepoints (or -1) */
+FT_INTERNAL
+int print_n_glyphs(f_conv_context_t *cntx, size_t n, const f_glyph_t *glyph);
+
 FT_INTERNAL
 int print_n_strings(f_conv_context_t *cntx, size_t n, const char *str);
 
+FT_INTERNAL
+int print_n_spaces(f_conv_context_t *cntx, size_t n);
+
+/*
+ * Prints content of type `content_type` between `beg` and `end`, content of
+ * other type than output is transcoded while it is printed (wide content
+ * can't be printed to char strings). Returns number of printed code units
+ * (or -1).
+ */
+FT_INTERNAL
+int print_range(f_conv_context_t *cntx, const void *beg, const void *end,
+                enum f_string_type content_type);
+
+FT_INTERNAL
+const f_emitter_t *get_emitter(enum f_string_type type);
+
+#ifdef FT_HAVE_UTF8
+/*
+ * Decodes well-formed utf-8 sequence of 2-4 bytes at the beginning of `str`
+ * (at most `len` bytes). Returns length of the sequence or 0 if it is
+ * ill-formed (overlong forms, surrogates and codepoints after U+10FFFF are
+ * ill-formed too).
+ */
+FT_INTERNAL
+size_t utf8_decode(const unsigned char *str, size_t len, uint32_t *c);
+#endif /* FT_HAVE_UTF8 */
+
+/*
+ * Passes content of the chunk buffer of streamed output to the sink.
+ */
+FT_INTERNAL
+int flush_output_sink(f_conv_context_t *cntx);
+
 
 FT_INTERNAL
 int ft_nprint(f_conv_context_t *cntx, const char *str, size_t strlen);
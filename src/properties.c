@@ -875,6 +875,8 @@ fort_entire_table_properties_t g_entire_table_properties = {
     0, /* right_margin */
     0, /* bottom_margin */
     FT_STRATEGY_REPLACE, /* add_strategy */
+    FT_INVALID_UTF8_KEEP, /* invalid_utf8 */
+    0, /* intern_strings */
 };
 
 static f_status set_entire_table_property_internal(fort_entire_table_properties_t *properties, uint32_t property, int value)
@@ -891,6 +893,14 @@ static f_status set_entire_table_property_internal(fort_entire_table_properties_
         properties->bottom_margin = value;
     } else if (PROP_IS_SET(property, FT_TPROP_ADDING_STRATEGY)) {
         properties->add_strategy = (enum ft_adding_strategy)value;
+    } else if (PROP_IS_SET(property, FT_TPROP_INVALID_UTF8)) {
+        if (value > FT_INVALID_UTF8_REPLACE)
+            return FT_EINVAL;
+        properties->invalid_utf8 = (enum ft_invalid_utf8_handling)value;
+    } else if (PROP_IS_SET(property, FT_TPROP_INTERN_STRINGS)) {
+        if (value > 1)
+            return FT_EINVAL;
+        properties->intern_strings = value;
     } else {
         return FT_EINVAL;
     }
@@ -920,26 +930,46 @@ FT_INTERNAL
 size_t max_border_elem_strlen(struct f_table_properties *properties)
 {
     assert(properties);
-    size_t result = 1;
-    int i = 0;
-    for (i = 0; i < BORDER_ITEM_POS_SIZE; ++i) {
-        result = MAX(result, strlen(properties->border_style.border_chars[i]));
-    }
+    return border_glyphs(properties)->max_len;
+}
 
+
+FT_INTERNAL
+void prepare_border_glyphs(f_table_properties_t *properties)
+{
+    assert(properties);
+    const struct fort_border_style *style = &properties->border_style;
+    struct f_border_glyphs *glyphs = &properties->border_glyphs;
+    size_t max_len = 1;
+    int i = 0;
     for (i = 0; i < BORDER_ITEM_POS_SIZE; ++i) {
-        result = MAX(result, strlen(properties->border_style.header_border_chars[i]));
+        init_glyph(&glyphs->border[i], style->border_chars[i]);
+        init_glyph(&glyphs->header_border[i], style->header_border_chars[i]);
+        max_len = MAX(max_len, MAX(glyphs->border[i].len, glyphs->header_border[i].len));
     }
-
     for (i = 0; i < SEPARATOR_ITEM_POS_SIZE; ++i) {
-        result = MAX(result, strlen(properties->border_style.separator_chars[i]));
+        init_glyph(&glyphs->separator[i], style->separator_chars[i]);
+        max_len = MAX(max_len, glyphs->separator[i].len);
     }
-    return result;
+    glyphs->max_len = max_len;
+    glyphs->ready = 1;
+}
+
+
+FT_INTERNAL
+const struct f_border_glyphs *border_glyphs(f_table_properties_t *properties)
+{
+    assert(properties);
+    if (!properties->border_glyphs.ready)
+        prepare_border_glyphs(properties);
+    return &properties->border_glyphs;
 }
 
 
 f_table_properties_t g_table_properties = {
     /* border_style */
     BASIC_STYLE,
+    {0},      /* border_glyphs (prepared on demand) */
     NULL,     /* cell_properties */
     /* entire_table_properties */
     {
@@ -948,7 +978,10 @@ f_table_properties_t g_table_properties = {
         0, /* right_margin */
         0,  /* bottom_margin */
         FT_STRATEGY_REPLACE, /* add_strategy */
-    }
+        FT_INVALID_UTF8_KEEP, /* invalid_utf8 */
+        0, /* intern_strings */
+    },
+    NULL,     /* column_formats */
 };
 
 
@@ -960,12 +993,14 @@ f_table_properties_t *create_table_properties(void)
         return NULL;
     }
     memcpy(properties, &g_table_properties, sizeof(f_table_properties_t));
+    prepare_border_glyphs(properties);
     properties->cell_properties = create_cell_prop_container();
     if (properties->cell_properties == NULL) {
         destroy_table_properties(properties);
         return NULL;
     }
     memcpy(&properties->entire_table_properties, &g_entire_table_properties, sizeof(fort_entire_table_properties_t));
+    properties->column_formats = NULL;
     return properties;
 }
 
@@ -978,6 +1013,9 @@ void destroy_table_properties(f_table_properties_t *properties)
     if (properties->cell_properties != NULL) {
         destroy_cell_prop_container(properties->cell_properties);
     }
+    if (properties->column_formats != NULL) {
+        destroy_vector(properties->column_formats);
+    }
     F_FREE(properties);
 }
 
@@ -1015,8 +1053,93 @@ f_table_properties_t *copy_table_properties(const f_table_properties_t *properti
     }
 
     memcpy(&new_opt->border_style, &properties->border_style, sizeof(struct fort_border_style));
+    memcpy(&new_opt->border_glyphs, &properties->border_glyphs, sizeof(struct f_border_glyphs));
     memcpy(&new_opt->entire_table_properties,
            &properties->entire_table_properties, sizeof(fort_entire_table_properties_t));
 
+    if (properties->column_formats) {
+        size_t sz = vector_size(properties->column_formats);
+        new_opt->column_formats = create_vector(sizeof(f_column_format_t), DEFAULT_VECTOR_CAPACITY);
+        if (new_opt->column_formats == NULL) {
+            destroy_table_properties(new_opt);
+            return NULL;
+        }
+        size_t i = 0;
+        for (i = 0; i < sz; ++i) {
+            if (FT_IS_ERROR(vector_push(new_opt->column_formats, vector_at(properties->column_formats, i)))) {
+                destroy_table_properties(new_opt);
+                return NULL;
+            }
+        }
+    }
+
     return new_opt;
 }
+
+
+static
+size_t column_format_index(const f_table_properties_t *properties, size_t col)
+{
+    if (properties->column_formats == NULL)
+        return INVALID_VEC_INDEX;
+
+    size_t i = 0;
+    size_t sz = vector_size(properties->column_formats);
+    for (i = 0; i < sz; ++i) {
+        const f_column_format_t *format = (const f_column_format_t *)vector_at_c(properties->column_formats, i);
+        if (format->col == col)
+            return i;
+    }
+    return INVALID_VEC_INDEX;
+}
+
+FT_INTERNAL
+f_status set_column_number_format(f_table_properties_t *properties, size_t col, const char *fmt_spec)
+{
+    assert(properties);
+
+    size_t index = column_format_index(properties, col);
+    if (fmt_spec == NULL) {
+        if (index != INVALID_VEC_INDEX)
+            vector_erase(properties->column_formats, index);
+        return FT_SUCCESS;
+    }
+
+    f_column_format_t format;
+    memset(&format, 0, sizeof(format));
+    format.col = col;
+    int has_any_fmt = 0;
+    size_t type = 0;
+    for (type = F_NUM_I64; type <= F_NUM_F64; ++type) {
+        format.has_fmt[type] = FT_IS_SUCCESS(
+                                   number_format_from_spec(fmt_spec, (enum f_number_type)type,
+                                           format.fmt[type], FT_NUMBER_FMT_SZ));
+        has_any_fmt |= format.has_fmt[type];
+    }
+    if (!has_any_fmt)
+        return FT_EINVAL;
+
+    if (index != INVALID_VEC_INDEX) {
+        memcpy(vector_at(properties->column_formats, index), &format, sizeof(format));
+        return FT_SUCCESS;
+    }
+
+    if (properties->column_formats == NULL) {
+        properties->column_formats = create_vector(sizeof(f_column_format_t), DEFAULT_VECTOR_CAPACITY);
+        if (properties->column_formats == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    return vector_push(properties->column_formats, &format);
+}
+
+FT_INTERNAL
+const char *get_column_number_format(const f_table_properties_t *properties, size_t col, enum f_number_type type)
+{
+    assert(properties);
+
+    size_t index = column_format_index(properties, col);
+    if (index == INVALID_VEC_INDEX)
+        return NULL;
+    const f_column_format_t *format = (const f_column_format_t *)vector_at_c(properties->column_formats, index);
+    return format->has_fmt[type] ? format->fmt[type] : NULL;
+}
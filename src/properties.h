@@ -178,6 +178,8 @@ struct fort_entire_table_properties {
     unsigned int right_margin;
     unsigned int bottom_margin;
     enum ft_adding_strategy add_strategy;
+    enum ft_invalid_utf8_handling invalid_utf8;
+    int intern_strings;
 };
 typedef struct fort_entire_table_properties fort_entire_table_properties_t;
 extern fort_entire_table_properties_t g_entire_table_properties;
@@ -188,16 +190,58 @@ f_status set_entire_table_property(f_table_properties_t *table_properties, uint3
 FT_INTERNAL
 f_status set_default_entire_table_property(uint32_t property, int value);
 
+/*
+ * Formats of numbers stored in the cells of a column. Format specification
+ * is converted to printf formats for every number type it suits.
+ */
+struct f_column_format {
+    size_t col;
+    char fmt[3][FT_NUMBER_FMT_SZ];    /* indexed by enum f_number_type */
+    int has_fmt[3];
+};
+typedef struct f_column_format f_column_format_t;
+
+/*
+ * Chars of the border style prepared for printing. They are prepared when the
+ * style is set (see prepare_border_glyphs).
+ */
+struct f_border_glyphs {
+    int ready;
+    size_t max_len;       /* maximum length of glyphs in bytes */
+    f_glyph_t border[BORDER_ITEM_POS_SIZE];
+    f_glyph_t header_border[BORDER_ITEM_POS_SIZE];
+    f_glyph_t separator[SEPARATOR_ITEM_POS_SIZE];
+};
+
 struct f_table_properties {
     struct fort_border_style border_style;
+    struct f_border_glyphs border_glyphs;
     f_cell_prop_container_t *cell_properties;
     fort_entire_table_properties_t entire_table_properties;
+    f_vector_t *column_formats;
 };
 extern f_table_properties_t g_table_properties;
 
+FT_INTERNAL
+f_status set_column_number_format(f_table_properties_t *properties, size_t col, const char *fmt_spec);
+
+/*
+ * Returns printf format for numbers of the type in the column or NULL if
+ * the default format should be used.
+ */
+FT_INTERNAL
+const char *get_column_number_format(const f_table_properties_t *properties, size_t col, enum f_number_type type);
+
 FT_INTERNAL
 size_t max_border_elem_strlen(struct f_table_properties *);
 
+FT_INTERNAL
+void prepare_border_glyphs(f_table_properties_t *properties);
+
+/* Returns glyphs of the border style preparing them if necessary */
+FT_INTERNAL
+const struct f_border_glyphs *border_glyphs(f_table_properties_t *properties);
+
 FT_INTERNAL
 f_table_properties_t *create_table_properties(void);
 
@@ -5,11 +5,42 @@
 #include "string_buffer.h"
 #include "vector.h"
 
+/*
+ * Row becomes sparse when a cell is created further than this number of
+ * columns after the last cell of the row.
+ */
+#define SPARSE_ROW_MIN_GAP 32
 
 struct f_row {
     f_vector_t *cells;
+    /*
+     * Sorted columns of cells of sparse rows. Columns without cells are
+     * gaps which are considered to be empty cells. NULL for dense rows
+     * (i-th cell is in the i-th column).
+     */
+    f_vector_t *columns;
+    /*
+     * Span map built when the row is printed (NULL if it isn't built yet).
+     * It is dropped by functions which change cells of the row.
+     */
+    struct f_span_map *span_map;
+};
+
+/*
+ * Types and spans of cells of the row (span of master cell is number of
+ * columns of its group, span of other cells is 1). Cells after the last
+ * group are common cells, so only columns up to it are stored (rows without
+ * groups have empty map).
+ */
+struct f_span_map {
+    size_t cols;
+    size_t *spans;
+    unsigned char *types;   /* enum f_cell_type */
 };
 
+/* Map shared by rows without groups */
+static struct f_span_map empty_span_map = {0, NULL, NULL};
+
 static
 f_row_t *create_row_impl(f_vector_t *cells)
 {
@@ -19,7 +50,7 @@ f_row_t *create_row_impl(f_vector_t *cells)
     if (cells) {
         row->cells = cells;
     } else {
-        row->cells = create_vector(sizeof(f_cell_t *), DEFAULT_VECTOR_CAPACITY);
+        row->cells = create_vector(sizeof(f_cell_t), DEFAULT_VECTOR_CAPACITY);
         if (row->cells == NULL) {
             F_FREE(row);
             return NULL;
@@ -34,14 +65,25 @@ f_row_t *create_row(void)
     return create_row_impl(NULL);
 }
 
+FT_INTERNAL
+f_row_t *create_row_with_capacity(size_t cols)
+{
+    f_vector_t *cells = create_vector(sizeof(f_cell_t), cols);
+    if (cells == NULL)
+        return NULL;
+    f_row_t *row = create_row_impl(cells);
+    if (row == NULL)
+        destroy_vector(cells);
+    return row;
+}
+
 static
 void destroy_each_cell(f_vector_t *cells)
 {
     size_t i = 0;
     size_t cells_n = vector_size(cells);
     for (i = 0; i < cells_n; ++i) {
-        f_cell_t *cell = VECTOR_AT(cells, i, f_cell_t *);
-        destroy_cell(cell);
+        release_cell((f_cell_t *)vector_at(cells, i));
     }
 }
 
@@ -55,28 +97,112 @@ void destroy_row(f_row_t *row)
         destroy_each_cell(row->cells);
         destroy_vector(row->cells);
     }
+    if (row->columns)
+        destroy_vector(row->columns);
+    invalidate_span_map(row);
 
     F_FREE(row);
 }
 
+FT_INTERNAL
+void invalidate_span_map(f_row_t *row)
+{
+    if (row->span_map != &empty_span_map)
+        F_FREE(row->span_map);
+    row->span_map = NULL;
+}
+
+#define CELL_COLUMN(row, i) VECTOR_AT_C((row)->columns, (i), size_t)
+
+/*
+ * Returns index of the first cell of the sparse row with column not less
+ * than `col`.
+ */
+static
+size_t sparse_cell_index(const f_row_t *row, size_t col)
+{
+    size_t lo = 0;
+    size_t hi = vector_size(row->columns);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (CELL_COLUMN(row, mid) < col)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Adds `diff` to columns of cells of the sparse row starting from index `from` */
+static
+void shift_sparse_columns(f_row_t *row, size_t from, size_t diff, int backward)
+{
+    size_t n = vector_size(row->columns);
+    size_t i = 0;
+    for (i = from; i < n; ++i) {
+        size_t *column = (size_t *)vector_at(row->columns, i);
+        *column = backward ? *column - diff : *column + diff;
+    }
+}
+
+static
+f_status make_row_sparse(f_row_t *row)
+{
+    assert(row->columns == NULL);
+    size_t n = vector_size(row->cells);
+    f_vector_t *columns = create_vector(sizeof(size_t), MAX(n, DEFAULT_VECTOR_CAPACITY));
+    if (columns == NULL)
+        return FT_MEMORY_ERROR;
+    size_t i = 0;
+    for (i = 0; i < n; ++i)
+        vector_push(columns, &i);
+    row->columns = columns;
+    return FT_SUCCESS;
+}
+
+/* Inserts empty cell to the sparse row at index `idx` for column `col` */
+static
+f_cell_t *insert_sparse_cell(f_row_t *row, size_t idx, size_t col)
+{
+    f_cell_t new_cell;
+    init_cell(&new_cell);
+    if (FT_IS_ERROR(vector_insert(row->columns, &col, idx)))
+        return NULL;
+    if (FT_IS_ERROR(vector_insert(row->cells, &new_cell, idx))) {
+        vector_erase(row->columns, idx);
+        return NULL;
+    }
+    return (f_cell_t *)vector_at(row->cells, idx);
+}
+
 FT_INTERNAL
 f_row_t *copy_row(f_row_t *row)
 {
     assert(row);
-    f_row_t *result = create_row();
+    size_t i = 0;
+    size_t cols_n = vector_size(row->cells);
+    f_row_t *result = create_row_with_capacity(MAX(cols_n, DEFAULT_VECTOR_CAPACITY));
     if (result == NULL)
         return NULL;
 
-    size_t i = 0;
-    size_t cols_n = vector_size(row->cells);
+    if (row->columns) {
+        result->columns = create_vector(sizeof(size_t), MAX(cols_n, DEFAULT_VECTOR_CAPACITY));
+        if (result->columns == NULL) {
+            destroy_row(result);
+            return NULL;
+        }
+    }
+
     for (i = 0; i < cols_n; ++i) {
-        f_cell_t *cell = VECTOR_AT(row->cells, i, f_cell_t *);
-        f_cell_t *new_cell = copy_cell(cell);
-        if (new_cell == NULL) {
+        f_cell_t new_cell;
+        if (FT_IS_ERROR(copy_cell(&new_cell, (const f_cell_t *)vector_at(row->cells, i)))) {
             destroy_row(result);
             return NULL;
         }
+        /* Capacity is reserved, so push doesn't fail */
         vector_push(result->cells, &new_cell);
+        if (row->columns)
+            vector_push(result->columns, vector_at_c(row->columns, i));
     }
 
     return result;
@@ -87,13 +213,24 @@ f_row_t *split_row(f_row_t *row, size_t pos)
 {
     assert(row);
 
-    f_vector_t *cells = vector_split(row->cells, pos);
+    invalidate_span_map(row);
+    size_t idx = row->columns ? sparse_cell_index(row, pos) : pos;
+    f_vector_t *cells = vector_split(row->cells, idx);
     if (!cells)
         return NULL;
     f_row_t *tail = create_row_impl(cells);
     if (!tail) {
         destroy_each_cell(cells);
         destroy_vector(cells);
+        return NULL;
+    }
+    if (row->columns) {
+        tail->columns = vector_split(row->columns, idx);
+        if (tail->columns == NULL) {
+            destroy_row(tail);
+            return NULL;
+        }
+        shift_sparse_columns(tail, 0, pos, 1);
     }
     return tail;
 }
@@ -106,11 +243,22 @@ int ft_row_erase_range(f_row_t *row, size_t left, size_t right)
     if (cols_n == 0 || (right < left))
         return FT_SUCCESS;
 
-    f_cell_t *cell = NULL;
+    invalidate_span_map(row);
+
+    if (row->columns) {
+        size_t idx = sparse_cell_index(row, left);
+        while (idx < vector_size(row->columns) && CELL_COLUMN(row, idx) <= right) {
+            release_cell((f_cell_t *)vector_at(row->cells, idx));
+            vector_erase(row->cells, idx);
+            vector_erase(row->columns, idx);
+        }
+        shift_sparse_columns(row, idx, right - left + 1, 1);
+        return FT_SUCCESS;
+    }
+
     size_t i = left;
     while (i < cols_n && i <= right) {
-        cell = VECTOR_AT(row->cells, i, f_cell_t *);
-        destroy_cell(cell);
+        release_cell((f_cell_t *)vector_at(row->cells, i));
         ++i;
     }
     size_t n_destroy = MIN(cols_n - 1, right) - left + 1;
@@ -126,10 +274,25 @@ size_t columns_in_row(const f_row_t *row)
     if (row == NULL || row->cells == NULL)
         return 0;
 
+    if (row->columns) {
+        size_t n = vector_size(row->columns);
+        return n ? CELL_COLUMN(row, n - 1) + 1 : 0;
+    }
     return vector_size(row->cells);
 }
 
 
+FT_INTERNAL
+f_status row_reserve_cells(f_row_t *row, size_t cols)
+{
+    assert(row);
+    /* Capacity of sparse rows doesn't depend on number of columns */
+    if (row->columns)
+        return FT_SUCCESS;
+    return vector_reserve(row->cells, cols);
+}
+
+
 static
 f_cell_t *get_cell_impl(f_row_t *row, size_t col, enum f_get_policy policy)
 {
@@ -137,23 +300,35 @@ f_cell_t *get_cell_impl(f_row_t *row, size_t col, enum f_get_policy policy)
         return NULL;
     }
 
+    if (row->columns == NULL && policy == CREATE_ON_NULL
+        && col >= vector_size(row->cells) + SPARSE_ROW_MIN_GAP) {
+        if (FT_IS_ERROR(make_row_sparse(row)))
+            return NULL;
+    }
+
+    if (row->columns) {
+        size_t idx = sparse_cell_index(row, col);
+        if (idx < vector_size(row->columns) && CELL_COLUMN(row, idx) == col)
+            return (f_cell_t *)vector_at(row->cells, idx);
+        return policy == CREATE_ON_NULL ? insert_sparse_cell(row, idx, col) : NULL;
+    }
+
     switch (policy) {
         case DONT_CREATE_ON_NULL:
             if (col < columns_in_row(row)) {
-                return VECTOR_AT(row->cells, col, f_cell_t *);
+                return (f_cell_t *)vector_at(row->cells, col);
             }
             return NULL;
         case CREATE_ON_NULL:
+            if (col >= columns_in_row(row)
+                && FT_IS_ERROR(vector_reserve(row->cells, col + 1)))
+                return NULL;
             while (col >= columns_in_row(row)) {
-                f_cell_t *new_cell = create_cell();
-                if (new_cell == NULL)
-                    return NULL;
-                if (FT_IS_ERROR(vector_push(row->cells, &new_cell))) {
-                    destroy_cell(new_cell);
-                    return NULL;
-                }
+                f_cell_t new_cell;
+                init_cell(&new_cell);
+                vector_push(row->cells, &new_cell);
             }
-            return VECTOR_AT(row->cells, col, f_cell_t *);
+            return (f_cell_t *)vector_at(row->cells, col);
     }
 
     assert(0 && "Shouldn't be here!");
@@ -171,7 +346,10 @@ f_cell_t *get_cell(f_row_t *row, size_t col)
 FT_INTERNAL
 const f_cell_t *get_cell_c(const f_row_t *row, size_t col)
 {
-    return get_cell((f_row_t *)row, col);
+    const f_cell_t *cell = get_cell((f_row_t *)row, col);
+    if (cell == NULL && row && row->columns && col < columns_in_row(row))
+        return get_empty_cell();
+    return cell;
 }
 
 
@@ -188,22 +366,64 @@ f_cell_t *create_cell_in_position(f_row_t *row, size_t col)
         return NULL;
     }
 
-    f_cell_t *new_cell = create_cell();
-    if (new_cell == NULL)
-        return NULL;
-    if (FT_IS_ERROR(vector_insert(row->cells, &new_cell, col))) {
-        destroy_cell(new_cell);
-        return NULL;
+    /* Cells after the end of the row are not shifted */
+    if (col >= columns_in_row(row))
+        return get_cell_impl(row, col, CREATE_ON_NULL);
+
+    invalidate_span_map(row);
+
+    if (row->columns) {
+        size_t idx = sparse_cell_index(row, col);
+        shift_sparse_columns(row, idx, 1, 0);
+        f_cell_t *cell = insert_sparse_cell(row, idx, col);
+        if (cell == NULL)
+            shift_sparse_columns(row, idx, 1, 1);
+        return cell;
     }
-    return VECTOR_AT(row->cells, col, f_cell_t *);
+
+    f_cell_t new_cell;
+    init_cell(&new_cell);
+    if (FT_IS_ERROR(vector_insert(row->cells, &new_cell, col)))
+        return NULL;
+    return (f_cell_t *)vector_at(row->cells, col);
 }
 
+/*
+ * Moves cells of `ins_row` to `cur_row` starting from column `pos` either
+ * replacing existing cells or inserting them before existing cells. Replaced
+ * cells are moved to `ins_row`.
+ */
+static
+f_status move_cells_to_sparse_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos, int insert)
+{
+    size_t sz = vector_size(ins_row->cells);
+    size_t i = 0;
+    for (i = 0; i < sz; ++i) {
+        f_cell_t *dst = insert
+                        ? create_cell_in_position(cur_row, pos + i)
+                        : get_cell_and_create_if_not_exists(cur_row, pos + i);
+        if (dst == NULL)
+            return FT_GEN_ERROR;
+        f_cell_t *src = (f_cell_t *)vector_at(ins_row->cells, i);
+        f_cell_t tmp = *dst;
+        *dst = *src;
+        *src = tmp;
+    }
+    return FT_SUCCESS;
+}
 
 FT_INTERNAL
 f_status swap_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
 {
     assert(cur_row);
     assert(ins_row);
+    assert(ins_row->columns == NULL);
+
+    invalidate_span_map(cur_row);
+    invalidate_span_map(ins_row);
+    if (cur_row->columns)
+        return move_cells_to_sparse_row(cur_row, ins_row, pos, 0);
+
     size_t cur_sz = vector_size(cur_row->cells);
     if (cur_sz == 0 && pos == 0) {
         f_row_t tmp;
@@ -213,6 +433,12 @@ f_status swap_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
         return FT_SUCCESS;
     }
 
+    if (pos >= cur_sz + SPARSE_ROW_MIN_GAP) {
+        if (FT_IS_ERROR(make_row_sparse(cur_row)))
+            return FT_MEMORY_ERROR;
+        return move_cells_to_sparse_row(cur_row, ins_row, pos, 0);
+    }
+
     // Append empty cells to `cur_row` if needed.
     while (vector_size(cur_row->cells) < pos) {
         create_cell_in_position(cur_row, vector_size(cur_row->cells));
@@ -227,19 +453,31 @@ f_status insert_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
 {
     assert(cur_row);
     assert(ins_row);
+    assert(ins_row->columns == NULL);
+
+    invalidate_span_map(cur_row);
+    invalidate_span_map(ins_row);
+    if (cur_row->columns == NULL && pos >= vector_size(cur_row->cells) + SPARSE_ROW_MIN_GAP) {
+        if (FT_IS_ERROR(make_row_sparse(cur_row)))
+            return FT_MEMORY_ERROR;
+    }
+    if (cur_row->columns) {
+        /* Empty cells are left in `ins_row` */
+        return move_cells_to_sparse_row(cur_row, ins_row, pos, 1);
+    }
 
     while (vector_size(cur_row->cells) < pos) {
-        f_cell_t *new_cell = create_cell();
-        if (!new_cell)
+        f_cell_t new_cell;
+        init_cell(&new_cell);
+        if (FT_IS_ERROR(vector_push(cur_row->cells, &new_cell)))
             return FT_GEN_ERROR;
-        vector_push(cur_row->cells, &new_cell);
     }
 
     size_t sz = vector_size(ins_row->cells);
     size_t i = 0;
     for (i = 0; i < sz; ++i) {
-        f_cell_t *cell = VECTOR_AT(ins_row->cells, i, f_cell_t *);
-        if (FT_IS_ERROR(vector_insert(cur_row->cells, &cell, pos + i))) {
+        const f_cell_t *cell = (const f_cell_t *)vector_at(ins_row->cells, i);
+        if (FT_IS_ERROR(vector_insert(cur_row->cells, cell, pos + i))) {
             /* clean up what we have inserted */
             while (i--) {
                 vector_erase(cur_row->cells, pos);
@@ -252,50 +490,91 @@ f_status insert_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos)
     return FT_SUCCESS;
 }
 
+/*
+ * Returns span map of the row building it if needed (or NULL if there is no
+ * memory for it).
+ */
+static
+const struct f_span_map *row_span_map(const f_row_t *row)
+{
+    if (row->span_map)
+        return row->span_map;
+
+    /* Map is a part of the row, so it is cached in const rows */
+    f_row_t *mut_row = (f_row_t *)row;
+    size_t cols = columns_in_row(row);
+    size_t i = 0;
+    size_t map_cols = 0;
+    for (i = 0; i < cols; ++i) {
+        const f_cell_t *cell = get_cell_c(row, i);
+        if (cell && get_cell_type(cell) != COMMON_CELL)
+            map_cols = i + 1;
+    }
+
+    if (map_cols == 0) {
+        mut_row->span_map = &empty_span_map;
+        return mut_row->span_map;
+    }
+
+    struct f_span_map *map = (struct f_span_map *)F_MALLOC(sizeof(struct f_span_map)
+                             + map_cols * (sizeof(size_t) + 1));
+    if (map == NULL)
+        return NULL;
+    map->cols = map_cols;
+    map->spans = (size_t *)(map + 1);
+    map->types = (unsigned char *)(map->spans + map_cols);
+    for (i = 0; i < map_cols; ++i) {
+        const f_cell_t *cell = get_cell_c(row, i);
+        map->types[i] = (unsigned char)(cell ? get_cell_type(cell) : COMMON_CELL);
+    }
+
+    /* Group of master cell consists of it and the following slave cells */
+    size_t following_slaves = 0;
+    for (i = map_cols; i-- > 0;) {
+        map->spans[i] = (map->types[i] == GROUP_MASTER_CELL) ? following_slaves + 1 : 1;
+        following_slaves = (map->types[i] == GROUP_SLAVE_CELL) ? following_slaves + 1 : 0;
+    }
+
+    mut_row->span_map = map;
+    return map;
+}
+
+static
+enum f_cell_type row_cell_type(const f_row_t *row, size_t col)
+{
+    const struct f_span_map *map = row_span_map(row);
+    if (map == NULL) {
+        const f_cell_t *cell = get_cell_c(row, col);
+        return cell ? get_cell_type(cell) : COMMON_CELL;
+    }
+    return col < map->cols ? (enum f_cell_type)map->types[col] : COMMON_CELL;
+}
 
 FT_INTERNAL
 size_t group_cell_number(const f_row_t *row, size_t master_cell_col)
 {
     assert(row);
-    const f_cell_t *master_cell = get_cell_c(row, master_cell_col);
-    if (master_cell == NULL)
+    if (master_cell_col >= columns_in_row(row))
         return 0;
 
-    if (get_cell_type(master_cell) != GROUP_MASTER_CELL)
+    const struct f_span_map *map = row_span_map(row);
+    if (map)
+        return master_cell_col < map->cols ? map->spans[master_cell_col] : 1;
+
+    /* Fallback if the map can't be built */
+    if (get_cell_type(get_cell_c(row, master_cell_col)) != GROUP_MASTER_CELL)
         return 1;
 
-    size_t total_cols = vector_size(row->cells);
+    size_t total_cols = columns_in_row(row);
     size_t slave_col = master_cell_col + 1;
-    while (slave_col < total_cols) {
-        const f_cell_t *cell = get_cell_c(row, slave_col);
-        if (cell && get_cell_type(cell) == GROUP_SLAVE_CELL) {
-            ++slave_col;
-        } else {
-            break;
-        }
+    while (slave_col < total_cols
+           && get_cell_type(get_cell_c(row, slave_col)) == GROUP_SLAVE_CELL) {
+        ++slave_col;
     }
     return slave_col - master_cell_col;
 }
 
 
-FT_INTERNAL
-int get_row_cell_types(const f_row_t *row, enum f_cell_type *types, size_t types_sz)
-{
-    assert(row);
-    assert(types);
-    size_t i = 0;
-    for (i = 0; i < types_sz; ++i) {
-        const f_cell_t *cell = get_cell_c(row, i);
-        if (cell) {
-            types[i] = get_cell_type(cell);
-        } else {
-            types[i] = COMMON_CELL;
-        }
-    }
-    return FT_SUCCESS;
-}
-
-
 FT_INTERNAL
 f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span)
 {
@@ -304,6 +583,7 @@ f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span)
     if (hor_span < 2)
         return FT_EINVAL;
 
+    invalidate_span_map(row);
     f_cell_t *main_cell = get_cell_and_create_if_not_exists(row, cell_column);
     if (main_cell == NULL) {
         return FT_GEN_ERROR;
@@ -338,32 +618,6 @@ int print_row_separator_impl(f_conv_context_t *cntx,
 
     const f_context_t *context = cntx->cntx;
 
-    /* Get cell types
-     *
-     * Regions above top row and below bottom row areconsidered full of virtual
-     * GROUP_SLAVE_CELL cells
-     */
-    enum f_cell_type *top_row_types = (enum f_cell_type *)F_MALLOC(sizeof(enum f_cell_type) * cols * 2);
-    if (top_row_types == NULL) {
-        return FT_MEMORY_ERROR;
-    }
-    enum f_cell_type *bottom_row_types = top_row_types + cols;
-    if (upper_row) {
-        get_row_cell_types(upper_row, top_row_types, cols);
-    } else {
-        size_t i = 0;
-        for (i = 0; i < cols; ++i)
-            top_row_types[i] = GROUP_SLAVE_CELL;
-    }
-    if (lower_row) {
-        get_row_cell_types(lower_row, bottom_row_types, cols);
-    } else {
-        size_t i = 0;
-        for (i = 0; i < cols; ++i)
-            bottom_row_types[i] = GROUP_SLAVE_CELL;
-    }
-
-
     f_table_properties_t *properties = context->table_properties;
     fort_entire_table_properties_t *entire_tprops = &properties->entire_table_properties;
 
@@ -385,71 +639,68 @@ int print_row_separator_impl(f_conv_context_t *cntx,
      *  L  I  I  I   IV  I   I   IT  I  I  I  IB    I    I     II    I    I     R
      *  |      C21    |   C22     |   C23             C24           C25         |
     */
-    const char **L = NULL;
-    const char **I = NULL;
-    const char **IV = NULL;
-    const char **R = NULL;
-    const char **IT = NULL;
-    const char **IB = NULL;
-    const char **II = NULL;
-
-    struct fort_border_style *border_style = &properties->border_style;
-
-    typedef const char *(*border_chars_point_t)[BORDER_ITEM_POS_SIZE];
-    const char *(*border_chars)[BORDER_ITEM_POS_SIZE] = NULL;
-    border_chars = (border_chars_point_t)&border_style->border_chars;
+    const f_glyph_t *L = NULL;
+    const f_glyph_t *I = NULL;
+    const f_glyph_t *IV = NULL;
+    const f_glyph_t *R = NULL;
+    const f_glyph_t *IT = NULL;
+    const f_glyph_t *IB = NULL;
+    const f_glyph_t *II = NULL;
+
+    const struct f_border_glyphs *glyphs = border_glyphs(properties);
+    const f_glyph_t *border = glyphs->border;
     if (upper_row_type == FT_ROW_HEADER || lower_row_type == FT_ROW_HEADER) {
-        border_chars = (border_chars_point_t)&border_style->header_border_chars;
+        border = glyphs->header_border;
     }
 
     if (sep && sep->enabled) {
-        L = &(border_style->separator_chars[LH_sip]);
-        I = &(border_style->separator_chars[IH_sip]);
-        IV = &(border_style->separator_chars[II_sip]);
-        R = &(border_style->separator_chars[RH_sip]);
+        L = &glyphs->separator[LH_sip];
+        I = &glyphs->separator[IH_sip];
+        IV = &glyphs->separator[II_sip];
+        R = &glyphs->separator[RH_sip];
 
-        IT = &(border_style->separator_chars[TI_sip]);
-        IB = &(border_style->separator_chars[BI_sip]);
-        II = &(border_style->separator_chars[IH_sip]);
+        IT = &glyphs->separator[TI_sip];
+        IB = &glyphs->separator[BI_sip];
+        II = &glyphs->separator[IH_sip];
 
         if (lower_row == NULL) {
-            L = &(*border_chars)[BL_bip];
-            R = &(*border_chars)[BR_bip];
+            L = &border[BL_bip];
+            R = &border[BR_bip];
         } else if (upper_row == NULL) {
-            L = &(*border_chars)[TL_bip];
-            R = &(*border_chars)[TR_bip];
+            L = &border[TL_bip];
+            R = &border[TR_bip];
         }
     } else {
         switch (separatorPos) {
             case TOP_SEPARATOR:
-                L = &(*border_chars)[TL_bip];
-                I = &(*border_chars)[TT_bip];
-                IV = &(*border_chars)[TV_bip];
-                R = &(*border_chars)[TR_bip];
-
-                IT = &(*border_chars)[TV_bip];
-                IB = &(*border_chars)[TV_bip];
-                II = &(*border_chars)[TT_bip];
+                L = &border[TL_bip];
+                I = &border[TT_bip];
+                IV = &border[TV_bip];
+                R = &border[TR_bip];
+
+                IT = &border[TV_bip];
+                IB = &border[TV_bip];
+                II = &border[TT_bip];
                 break;
             case INSIDE_SEPARATOR:
-                L = &(*border_chars)[LH_bip];
-                I = &(*border_chars)[IH_bip];
-                IV = &(*border_chars)[II_bip];
-                R = &(*border_chars)[RH_bip];
-
-                IT = &(*border_chars)[TI_bip];
-                IB = &(*border_chars)[BI_bip];
-                II = &(*border_chars)[IH_bip];
+                L = &border[LH_bip];
+                I = &border[IH_bip];
+                IV = &border[II_bip];
+                R = &border[RH_bip];
+
+                IT = &border[TI_bip];
+                IB = &border[BI_bip];
+                II = &border[IH_bip];
                 break;
             case BOTTOM_SEPARATOR:
-                L = &(*border_chars)[BL_bip];
-                I = &(*border_chars)[BB_bip];
-                IV = &(*border_chars)[BV_bip];
-                R = &(*border_chars)[BR_bip];
-
-                IT = &(*border_chars)[BV_bip];
-                IB = &(*border_chars)[BV_bip];
-                II = &(*border_chars)[BB_bip];
+                L = &border[BL_bip];
+                I = &border[BB_bip];
+                IV = &border[BV_bip];
+                R = &border[BR_bip];
+
+                IT = &border[BV_bip];
+                IB = &border[BV_bip];
+                II = &border[BB_bip];
                 break;
             default:
                 break;
@@ -463,45 +714,48 @@ int print_row_separator_impl(f_conv_context_t *cntx,
      * unsigned char according to
      * https://en.cppreference.com/w/c/string/byte/isprint
      */
-    if ((strlen(*L) == 0 || (strlen(*L) == 1 && !isprint((unsigned char) **L)))
-        && (strlen(*I) == 0 || (strlen(*I) == 1 && !isprint((unsigned char) **I)))
-        && (strlen(*IV) == 0 || (strlen(*IV) == 1 && !isprint((unsigned char) **IV)))
-        && (strlen(*R) == 0 || (strlen(*R) == 1 && !isprint((unsigned char) **R)))) {
+#define NOT_PRINTABLE(glyph) ((glyph)->len == 0 || ((glyph)->len == 1 && !isprint((unsigned char) *(glyph)->str)))
+    if (NOT_PRINTABLE(L) && NOT_PRINTABLE(I) && NOT_PRINTABLE(IV) && NOT_PRINTABLE(R)) {
         status = 0;
         goto clear;
     }
+#undef NOT_PRINTABLE
 
     /* Print left margin */
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->left_margin, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->left_margin));
 
     for (i = 0; i < cols; ++i) {
         if (i == 0) {
-            CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *L));
+            CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, L));
         } else {
-            if ((top_row_types[i] == COMMON_CELL || top_row_types[i] == GROUP_MASTER_CELL)
-                && (bottom_row_types[i] == COMMON_CELL || bottom_row_types[i] == GROUP_MASTER_CELL)) {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IV));
-            } else if (top_row_types[i] == GROUP_SLAVE_CELL && bottom_row_types[i] == GROUP_SLAVE_CELL) {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *II));
-            } else if (top_row_types[i] == GROUP_SLAVE_CELL) {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IT));
+            /*
+             * Regions above top row and below bottom row are considered full
+             * of virtual GROUP_SLAVE_CELL cells
+             */
+            int top_slave = upper_row ? row_cell_type(upper_row, i) == GROUP_SLAVE_CELL : 1;
+            int bottom_slave = lower_row ? row_cell_type(lower_row, i) == GROUP_SLAVE_CELL : 1;
+            if (!top_slave && !bottom_slave) {
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IV));
+            } else if (top_slave && bottom_slave) {
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, II));
+            } else if (top_slave) {
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IT));
             } else {
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IB));
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IB));
             }
         }
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, col_width_arr[i], *I));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, col_width_arr[i], I));
     }
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *R));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, R));
 
     /* Print right margin */
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->right_margin, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->right_margin));
 
     CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, FT_NEWLINE));
 
     status = (int)written;
 
 clear:
-    F_FREE(top_row_types);
     return status;
 }
 
@@ -515,13 +769,14 @@ int print_row_separator(f_conv_context_t *cntx,
                                     separatorPos, sep);
 }
 
-FT_INTERNAL
-f_row_t *create_row_from_string(const char *str)
+/* Creates row of char or utf-8 cells (depending on fill_cell_from_string_) */
+static
+f_row_t *create_row_from_char_string(const char *str,
+                                     f_status(*fill_cell_from_string_)(f_cell_t *cell, const char *str))
 {
     typedef char char_type;
     char_type *(*strdup_)(const char_type * str) = F_STRDUP;
     const char_type zero_char = '\0';
-    f_status(*fill_cell_from_string_)(f_cell_t *cell, const char *str) = fill_cell_from_string;
     const char_type *const zero_string = "";
 #define STRCHR strchr
 
@@ -551,19 +806,18 @@ f_row_t *create_row_from_string(const char *str)
             number_of_separators++;
         }
 
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, base_pos);
+        int status = fill_cell_from_string_(&cell, base_pos);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
@@ -574,19 +828,18 @@ f_row_t *create_row_from_string(const char *str)
 
     /* special case if in format string last cell is empty */
     while (vector_size(row->cells) < (number_of_separators + 1)) {
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, zero_string);
+        int status = fill_cell_from_string_(&cell, zero_string);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
     }
@@ -602,6 +855,20 @@ clear:
 #undef STRCHR
 }
 
+FT_INTERNAL
+f_row_t *create_row_from_string(const char *str)
+{
+    return create_row_from_char_string(str, fill_cell_from_string);
+}
+
+#ifdef FT_HAVE_UTF8
+static
+f_status fill_cell_from_u8chars(f_cell_t *cell, const char *str)
+{
+    return fill_cell_from_u8string(cell, str);
+}
+#endif /* FT_HAVE_UTF8 */
+
 
 #ifdef FT_HAVE_WCHAR
 FT_INTERNAL
@@ -640,19 +907,18 @@ f_row_t *create_row_from_wstring(const wchar_t *str)
             number_of_separators++;
         }
 
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, base_pos);
+        int status = fill_cell_from_string_(&cell, base_pos);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
@@ -663,19 +929,18 @@ f_row_t *create_row_from_wstring(const wchar_t *str)
 
     /* special case if in format string last cell is empty */
     while (vector_size(row->cells) < (number_of_separators + 1)) {
-        f_cell_t *cell = create_cell();
-        if (cell == NULL)
-            goto clear;
+        f_cell_t cell;
+        init_cell(&cell);
 
-        int status = fill_cell_from_string_(cell, zero_string);
+        int status = fill_cell_from_string_(&cell, zero_string);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
 
         status = vector_push(row->cells, &cell);
         if (FT_IS_ERROR(status)) {
-            destroy_cell(cell);
+            release_cell(&cell);
             goto clear;
         }
     }
@@ -703,7 +968,7 @@ f_row_t *create_row_from_buffer(const f_string_buffer_t *buffer)
 #endif /* FT_HAVE_WCHAR */
 #ifdef FT_HAVE_UTF8
         case UTF8_BUF:
-            return create_row_from_string((const char *)buffer->str.u8str);
+            return create_row_from_char_string((const char *)buffer->str.u8str, fill_cell_from_u8chars);
 #endif /* FT_HAVE_UTF8 */
         default:
             assert(0);
@@ -821,7 +1086,7 @@ clear:
 
 
 FT_INTERNAL
-int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_arr, size_t col_width_arr_sz,
+int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, const size_t *col_width_arr, size_t col_width_arr_sz,
                  size_t row_height)
 {
     const f_context_t *context = cntx->cntx;
@@ -840,14 +1105,12 @@ int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_a
      */
     f_table_properties_t *properties = context->table_properties;
 
-    typedef const char *(*border_chars_point_t)[BORDER_ITEM_POS_SIZE];
     enum ft_row_type row_type = (enum ft_row_type)get_cell_property_hierarchically(properties, context->row, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE);
-    const char *(*bord_chars)[BORDER_ITEM_POS_SIZE] = (row_type == FT_ROW_HEADER)
-            ? (border_chars_point_t)(&properties->border_style.header_border_chars)
-            : (border_chars_point_t)(&properties->border_style.border_chars);
-    const char **L = &(*bord_chars)[LL_bip];
-    const char **IV = &(*bord_chars)[IV_bip];
-    const char **R = &(*bord_chars)[RR_bip];
+    const struct f_border_glyphs *glyphs = border_glyphs(properties);
+    const f_glyph_t *border = (row_type == FT_ROW_HEADER) ? glyphs->header_border : glyphs->border;
+    const f_glyph_t *L = &border[LL_bip];
+    const f_glyph_t *IV = &border[IV_bip];
+    const f_glyph_t *R = &border[RR_bip];
 
 
     size_t written = 0;
@@ -856,15 +1119,15 @@ int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_a
     fort_entire_table_properties_t *entire_tprops = &context->table_properties->entire_table_properties;
     for (i = 0; i < row_height; ++i) {
         /* Print left margin */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->left_margin, FT_SPACE));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->left_margin));
 
         /* Print left table boundary */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *L));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, L));
         size_t j = 0;
         while (j < col_width_arr_sz) {
             if (j < cols_in_row) {
                 ((f_context_t *)context)->column = j;
-                f_cell_t *cell = VECTOR_AT(row->cells, j, f_cell_t *);
+                f_cell_t *cell = (f_cell_t *)get_cell_c(row, j);
                 size_t cell_vis_width = 0;
 
                 size_t group_slave_sz = group_cell_number(row, j);
@@ -879,21 +1142,21 @@ int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_a
                 CHCK_RSLT_ADD_TO_WRITTEN(cell_printf(cell, i, cntx, cell_vis_width));
             } else {
                 /* Print empty cell */
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, col_width_arr[j], FT_SPACE));
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, col_width_arr[j]));
             }
 
             /* Print boundary between cells */
             if (j < col_width_arr_sz - 1)
-                CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *IV));
+                CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, IV));
 
             ++j;
         }
 
         /* Print right table boundary */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, *R));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_glyphs(cntx, 1, R));
 
         /* Print right margin */
-        CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, entire_tprops->right_margin, FT_SPACE));
+        CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, entire_tprops->right_margin));
 
         /* Print new line character */
         CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, FT_NEWLINE));
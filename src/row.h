@@ -12,6 +12,9 @@
 FT_INTERNAL
 f_row_t *create_row(void);
 
+FT_INTERNAL
+f_row_t *create_row_with_capacity(size_t cols);
+
 FT_INTERNAL
 void destroy_row(f_row_t *row);
 
@@ -34,6 +37,9 @@ f_row_t *create_row_from_fmt_string(const struct f_string_view  *fmt, va_list *v
 FT_INTERNAL
 size_t columns_in_row(const f_row_t *row);
 
+FT_INTERNAL
+f_status row_reserve_cells(f_row_t *row, size_t cols);
+
 FT_INTERNAL
 f_cell_t *get_cell(f_row_t *row, size_t col);
 
@@ -55,8 +61,12 @@ f_status insert_row(f_row_t *cur_row, f_row_t *ins_row, size_t pos);
 FT_INTERNAL
 size_t group_cell_number(const f_row_t *row, size_t master_cell_col);
 
+/*
+ * Drops span map of the row. It should be called if types of cells of the
+ * row are changed with set_cell_type.
+ */
 FT_INTERNAL
-int get_row_cell_types(const f_row_t *row, enum f_cell_type *types, size_t types_sz);
+void invalidate_span_map(f_row_t *row);
 
 FT_INTERNAL
 f_status row_set_cell_span(f_row_t *row, size_t cell_column, size_t hor_span);
@@ -68,7 +78,7 @@ int print_row_separator(f_conv_context_t *cntx,
                         enum f_hor_separator_pos separatorPos, const f_separator_t *sep);
 
 FT_INTERNAL
-int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, size_t *col_width_arr, size_t col_width_arr_sz,
+int snprintf_row(const f_row_t *row, f_conv_context_t *cntx, const size_t *col_width_arr, size_t col_width_arr_sz,
                  size_t row_height);
 
 #ifdef FT_HAVE_WCHAR
@@ -3,6 +3,7 @@
 #include "wcwidth.h"
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #ifdef FT_HAVE_WCHAR
 #include <wchar.h>
 #endif
@@ -26,28 +27,8 @@ static ptrdiff_t wcs_iter_width(const wchar_t *beg, const wchar_t *end)
 #endif /* FT_HAVE_WCHAR */
 
 
-static size_t buf_str_len(const f_string_buffer_t *buf)
-{
-    assert(buf);
-
-    switch (buf->type) {
-        case CHAR_BUF:
-            return strlen(buf->str.cstr);
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            return wcslen(buf->str.wstr);
-#endif
-#ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            return utf8len(buf->str.u8str);
-#endif
-    }
-
-    assert(0);
-    return 0;
-}
-
-
+/* Lines of buffers are located with f_line_index, these are used by tests */
+#ifdef FT_TEST_BUILD
 FT_INTERNAL
 size_t strchr_count(const char *str, char ch)
 {
@@ -243,8 +224,43 @@ void utf8_n_substring(const void *str, utf8_int32_t ch_separator, size_t n, cons
     return;
 }
 #endif /* FT_HAVE_UTF8 */
+#endif /* FT_TEST_BUILD */
 
 
+/* Content of empty buffers (buffers created with zero size borrow it) */
+static const char empty_str[] = "";
+#ifdef FT_HAVE_WCHAR
+static const wchar_t empty_wstr[] = L"";
+#endif
+
+FT_INTERNAL
+void init_string_buffer(f_string_buffer_t *buffer, enum f_string_type type)
+{
+    assert(buffer);
+    buffer->str.cstr = (char *)empty_str;
+#ifdef FT_HAVE_WCHAR
+    if (type == W_CHAR_BUF)
+        buffer->str.wstr = (wchar_t *)empty_wstr;
+#endif
+    buffer->mem.data_sz = 0;
+    buffer->type = type;
+    buffer->ownership = F_BUF_BORROWED;
+    buffer->free_fn = NULL;
+    buffer->metrics.valid = 0;
+    buffer->metrics.line_index = NULL;
+    buffer->metrics.shared_line_index = 0;
+}
+
+FT_INTERNAL
+int buffer_is_unwritten(const f_string_buffer_t *buffer)
+{
+    assert(buffer);
+#ifdef FT_HAVE_WCHAR
+    if (buffer->str.wstr == empty_wstr)
+        return 1;
+#endif
+    return buffer->str.data == NULL || buffer->str.cstr == empty_str;
+}
 
 FT_INTERNAL
 f_string_buffer_t *create_string_buffer(size_t n_chars, enum f_string_type type)
@@ -270,13 +286,22 @@ f_string_buffer_t *create_string_buffer(size_t n_chars, enum f_string_type type)
     f_string_buffer_t *result = (f_string_buffer_t *)F_MALLOC(sizeof(f_string_buffer_t));
     if (result == NULL)
         return NULL;
+    if (sz == 0) {
+        init_string_buffer(result, type);
+        return result;
+    }
     result->str.data = F_MALLOC(sz);
     if (result->str.data == NULL) {
         F_FREE(result);
         return NULL;
     }
-    result->data_sz = sz;
+    result->mem.data_sz = sz;
     result->type = type;
+    result->ownership = F_BUF_OWNED;
+    result->free_fn = NULL;
+    result->metrics.valid = 0;
+    result->metrics.line_index = NULL;
+    result->metrics.shared_line_index = 0;
 
     if (sz) {
         switch (type) {
@@ -300,56 +325,295 @@ f_string_buffer_t *create_string_buffer(size_t n_chars, enum f_string_type type)
 }
 
 
+#define WORD_ONES  ((uint64_t)0x0101010101010101ULL)
+#define WORD_HIGHS ((uint64_t)0x8080808080808080ULL)
+
+/*
+ * Checks 8 chars at once that all of them are printable ASCII chars
+ * (0x20 - 0x7E). '\n' and '\0' are not printable, so words with them are
+ * rejected as well.
+ */
+static
+int word_is_printable_ascii(uint64_t word)
+{
+    uint64_t less_than_space = (word - WORD_ONES * 0x20) & ~word & WORD_HIGHS;
+    uint64_t greater_than_tilde = ((word + WORD_ONES * 0x01) | word) & WORD_HIGHS;
+    return (less_than_space | greater_than_tilde) == 0;
+}
+
+/*
+ * Scans at most `len` chars of the string (till the null char) and
+ * optionally copies them to `dst`. Runs of printable ASCII chars are
+ * processed by words.
+ */
+static
+void scan_str(const char *str, size_t len, char *dst, struct f_text_metrics *metrics)
+{
+    size_t i = 0;
+    size_t line_len = 0;
+    int printable_ascii = 1;
+    metrics->lines = 0;
+    metrics->max_line_len = 0;
+    if (len == SIZE_MAX)
+        len = strlen(str);
+    while (i < len) {
+        uint64_t word;
+        if (len - i >= sizeof(word)) {
+            memcpy(&word, str + i, sizeof(word));
+            if (word_is_printable_ascii(word)) {
+                if (dst)
+                    memcpy(dst + i, &word, sizeof(word));
+                i += sizeof(word);
+                line_len += sizeof(word);
+                continue;
+            }
+        }
+
+        char ch = str[i];
+        if (ch == '\0')
+            break;
+        if (dst)
+            dst[i] = ch;
+        ++i;
+        if (ch == '\n') {
+            metrics->lines++;
+            metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+            line_len = 0;
+            continue;
+        }
+        if (ch < 0x20 || ch > 0x7e)
+            printable_ascii = 0;
+        line_len++;
+    }
+    if (dst)
+        dst[i] = '\0';
+    metrics->len = i;
+    metrics->lines = (i == 0) ? 0 : metrics->lines + 1;
+    metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+    metrics->width = metrics->max_line_len;
+    metrics->printable_ascii = printable_ascii;
+    metrics->utf8_errors = 0;
+    metrics->valid = 1;
+}
+
+#ifdef FT_HAVE_UTF8
+/*
+ * The same as scan_str but also validates utf-8 content and computes its
+ * visible width (width of content with ill-formed sequences is left unknown).
+ */
+static
+void scan_u8str(const char *str, size_t len, char *dst, struct f_text_metrics *metrics)
+{
+    size_t i = 0;
+    size_t line_len = 0;
+    size_t line_width = 0;
+    size_t max_width = 0;
+    int printable_ascii = 1;
+    int utf8_errors = 0;
+    metrics->lines = 0;
+    metrics->max_line_len = 0;
+    if (len == SIZE_MAX)
+        len = strlen(str);
+    while (i < len) {
+        uint64_t word;
+        if (len - i >= sizeof(word)) {
+            memcpy(&word, str + i, sizeof(word));
+            if (word_is_printable_ascii(word)) {
+                if (dst)
+                    memcpy(dst + i, &word, sizeof(word));
+                i += sizeof(word);
+                line_len += sizeof(word);
+                line_width += sizeof(word);
+                continue;
+            }
+        }
+
+        unsigned char ch = (unsigned char)str[i];
+        if (ch == '\0')
+            break;
+        if (ch == '\n') {
+            if (dst)
+                dst[i] = '\n';
+            ++i;
+            metrics->lines++;
+            metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+            max_width = MAX(max_width, line_width);
+            line_len = 0;
+            line_width = 0;
+            continue;
+        }
+        if (ch < 0x80) {
+            if (dst)
+                dst[i] = (char)ch;
+            ++i;
+            if (ch < 0x20 || ch > 0x7e)
+                printable_ascii = 0;
+            line_len++;
+            line_width++;
+            continue;
+        }
+
+        uint32_t c = 0;
+        size_t n = utf8_decode((const unsigned char *)str + i, len - i, &c);
+        printable_ascii = 0;
+        if (n == 0) {
+            utf8_errors = 1;
+            n = 1;
+        } else {
+            line_width += utf8_codepoint_width(c);
+        }
+        if (dst)
+            memcpy(dst + i, str + i, n);
+        i += n;
+        line_len += n;
+    }
+    if (dst)
+        dst[i] = '\0';
+    metrics->len = i;
+    metrics->lines = (i == 0) ? 0 : metrics->lines + 1;
+    metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+    metrics->width = utf8_errors ? SIZE_MAX : MAX(max_width, line_width);
+    metrics->printable_ascii = printable_ascii;
+    metrics->utf8_errors = utf8_errors;
+    metrics->valid = 1;
+}
+#endif /* FT_HAVE_UTF8 */
+
+#ifdef FT_HAVE_WCHAR
+static
+void scan_wstr(const wchar_t *str, size_t len, wchar_t *dst, struct f_text_metrics *metrics)
+{
+    size_t i = 0;
+    size_t line_len = 0;
+    int printable_ascii = 1;
+    metrics->lines = 0;
+    metrics->max_line_len = 0;
+    for (i = 0; i < len && str[i] != L'\0'; ++i) {
+        wchar_t ch = str[i];
+        if (dst)
+            dst[i] = ch;
+        if (ch == L'\n') {
+            metrics->lines++;
+            metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+            line_len = 0;
+            continue;
+        }
+        if (ch < 0x20 || ch > 0x7e)
+            printable_ascii = 0;
+        line_len++;
+    }
+    if (dst)
+        dst[i] = L'\0';
+    metrics->len = i;
+    metrics->lines = (i == 0) ? 0 : metrics->lines + 1;
+    metrics->max_line_len = MAX(metrics->max_line_len, line_len);
+    metrics->width = printable_ascii ? metrics->max_line_len : SIZE_MAX;
+    metrics->printable_ascii = printable_ascii;
+    metrics->utf8_errors = 0;
+    metrics->valid = 1;
+}
+#endif /* FT_HAVE_WCHAR */
+
+static
+void drop_line_index(struct f_text_metrics *metrics)
+{
+    /* Index of interned content is released with the table */
+    if (!metrics->shared_line_index)
+        F_FREE(metrics->line_index);
+    metrics->line_index = NULL;
+    metrics->shared_line_index = 0;
+}
+
+static
+const struct f_text_metrics *buffer_metrics(const f_string_buffer_t *buffer)
+{
+    /* Metrics are a cache of the content, so they are updated in const buffers */
+    struct f_text_metrics *metrics = (struct f_text_metrics *)&buffer->metrics;
+    if (metrics->valid && metrics->data == buffer->str.data && metrics->type == buffer->type)
+        return metrics;
+
+    drop_line_index(metrics);
+    switch (buffer->type) {
+        case CHAR_BUF:
+            scan_str(buffer->str.cstr, SIZE_MAX, NULL, metrics);
+            break;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            scan_wstr(buffer->str.wstr, SIZE_MAX, NULL, metrics);
+            break;
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            scan_u8str((const char *)buffer->str.u8str, SIZE_MAX, NULL, metrics);
+            break;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+    }
+    metrics->data = buffer->str.data;
+    metrics->type = buffer->type;
+    return metrics;
+}
+
+FT_INTERNAL
+void release_buffer_data(f_string_buffer_t *buffer)
+{
+    switch (buffer->ownership) {
+        case F_BUF_OWNED:
+            F_FREE(buffer->str.data);
+            break;
+        case F_BUF_ADOPTED:
+            buffer->free_fn(buffer->mem.owner);
+            break;
+        case F_BUF_BORROWED:
+            break;
+    }
+    buffer->str.data = NULL;
+    buffer->ownership = F_BUF_OWNED;
+    buffer->free_fn = NULL;
+    buffer->metrics.valid = 0;
+    drop_line_index(&buffer->metrics);
+}
+
 FT_INTERNAL
 void destroy_string_buffer(f_string_buffer_t *buffer)
 {
     if (buffer == NULL)
         return;
-    F_FREE(buffer->str.data);
-    buffer->str.data = NULL;
+    release_buffer_data(buffer);
     F_FREE(buffer);
 }
 
 FT_INTERNAL
-f_string_buffer_t *copy_string_buffer(const f_string_buffer_t *buffer)
+f_status copy_string_buffer(f_string_buffer_t *result, const f_string_buffer_t *buffer)
 {
+    assert(result);
     assert(buffer);
-    f_string_buffer_t *result = create_string_buffer(buffer->data_sz, buffer->type);
-    if (result == NULL)
-        return NULL;
+    init_string_buffer(result, buffer->type);
     switch (buffer->type) {
         case CHAR_BUF:
-            if (FT_IS_ERROR(fill_buffer_from_string(result, buffer->str.cstr))) {
-                destroy_string_buffer(result);
-                return NULL;
-            }
-            break;
+            return fill_buffer_from_string(result, buffer->str.cstr);
 #ifdef FT_HAVE_WCHAR
         case W_CHAR_BUF:
-            if (FT_IS_ERROR(fill_buffer_from_wstring(result, buffer->str.wstr))) {
-                destroy_string_buffer(result);
-                return NULL;
-            }
-            break;
+            return fill_buffer_from_wstring(result, buffer->str.wstr);
 #endif /* FT_HAVE_WCHAR */
         default:
-            destroy_string_buffer(result);
-            return NULL;
+            return FT_GEN_ERROR;
     }
-    return result;
 }
 
 FT_INTERNAL
 f_status realloc_string_buffer_without_copy(f_string_buffer_t *buffer)
 {
     assert(buffer);
-    char *new_str = (char *)F_MALLOC(buffer->data_sz * 2);
+    size_t new_sz = buffer->mem.data_sz ? buffer->mem.data_sz * 2 : DEFAULT_STR_BUF_SIZE;
+    char *new_str = (char *)F_MALLOC(new_sz);
     if (new_str == NULL) {
         return FT_MEMORY_ERROR;
     }
-    F_FREE(buffer->str.data);
+    release_buffer_data(buffer);
     buffer->str.data = new_str;
-    buffer->data_sz *= 2;
+    buffer->mem.data_sz = new_sz;
     return FT_SUCCESS;
 }
 
@@ -360,15 +624,11 @@ f_status fill_buffer_from_string(f_string_buffer_t *buffer, const char *str)
     assert(buffer);
     assert(str);
 
-    char *copy = F_STRDUP(str);
-    if (copy == NULL)
-        return FT_MEMORY_ERROR;
-
-    F_FREE(buffer->str.data);
-    buffer->str.cstr = copy;
-    buffer->type = CHAR_BUF;
-
-    return FT_SUCCESS;
+    /* Content is copied and scanned for metrics in one pass */
+    f_string_view_t view;
+    view.type = CHAR_BUF;
+    view.u.cstr = str;
+    return fill_buffer_from_string_len(buffer, &view, strlen(str));
 }
 
 
@@ -379,33 +639,197 @@ f_status fill_buffer_from_wstring(f_string_buffer_t *buffer, const wchar_t *str)
     assert(buffer);
     assert(str);
 
-    wchar_t *copy = F_WCSDUP(str);
+    /* Content is copied and scanned for metrics in one pass */
+    f_string_view_t view;
+    view.type = W_CHAR_BUF;
+    view.u.wstr = str;
+    return fill_buffer_from_string_len(buffer, &view, wcslen(str));
+}
+#endif /* FT_HAVE_WCHAR */
+
+#ifdef FT_HAVE_UTF8
+FT_INTERNAL
+f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str)
+{
+    assert(buffer);
+    assert(str);
+
+    /* Content is copied and scanned for metrics in one pass */
+    f_string_view_t view;
+    view.type = UTF8_BUF;
+    view.u.u8str = str;
+    return fill_buffer_from_string_len(buffer, &view, strlen((const char *)str));
+}
+#endif /* FT_HAVE_UTF8 */
+
+FT_INTERNAL
+f_status fill_buffer_from_string_len(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len)
+{
+    assert(buffer);
+    assert(str && str->u.data);
+
+    size_t char_sz = 1;
+#ifdef FT_HAVE_WCHAR
+    if (str->type == W_CHAR_BUF)
+        char_sz = sizeof(wchar_t);
+#endif /* FT_HAVE_WCHAR */
+    if (len >= SIZE_MAX / char_sz)
+        return FT_EINVAL;
+
+    void *copy = F_MALLOC((len + 1) * char_sz);
     if (copy == NULL)
         return FT_MEMORY_ERROR;
 
-    F_FREE(buffer->str.data);
-    buffer->str.wstr = copy;
-    buffer->type = W_CHAR_BUF;
+    release_buffer_data(buffer);
+    switch (str->type) {
+        case CHAR_BUF:
+            scan_str(str->u.cstr, len, (char *)copy, &buffer->metrics);
+            break;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            scan_wstr(str->u.wstr, len, (wchar_t *)copy, &buffer->metrics);
+            break;
+#endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            scan_u8str((const char *)str->u.u8str, len, (char *)copy, &buffer->metrics);
+            break;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+    }
+    buffer->str.data = copy;
+    buffer->type = str->type;
+    buffer->metrics.data = copy;
+    buffer->metrics.type = str->type;
 
     return FT_SUCCESS;
 }
+
+FT_INTERNAL
+size_t fill_buffer_from_string_at(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len, void *dst)
+{
+    assert(buffer);
+    assert(str && str->u.data);
+    assert(dst);
+
+    release_buffer_data(buffer);
+    switch (str->type) {
+        case CHAR_BUF:
+            scan_str(str->u.cstr, len, (char *)dst, &buffer->metrics);
+            break;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            scan_wstr(str->u.wstr, len, (wchar_t *)dst, &buffer->metrics);
+            break;
 #endif /* FT_HAVE_WCHAR */
+#ifdef FT_HAVE_UTF8
+        case UTF8_BUF:
+            scan_u8str((const char *)str->u.u8str, len, (char *)dst, &buffer->metrics);
+            break;
+#endif /* FT_HAVE_UTF8 */
+        default:
+            assert(0);
+    }
+    buffer->str.data = dst;
+    buffer->type = str->type;
+    buffer->ownership = F_BUF_BORROWED;
+    buffer->metrics.data = dst;
+    buffer->metrics.type = str->type;
+    return buffer->metrics.len;
+}
+
+FT_INTERNAL
+void fill_buffer_from_interned(f_string_buffer_t *buffer, const void *data, const struct f_text_metrics *metrics)
+{
+    assert(buffer);
+    assert(data && metrics && metrics->data == data);
+
+    release_buffer_data(buffer);
+    buffer->str.data = (void *)data;
+    buffer->type = metrics->type;
+    buffer->ownership = F_BUF_BORROWED;
+    buffer->metrics = *metrics;
+    buffer->metrics.shared_line_index = 1;
+}
+
+FT_INTERNAL
+void fill_buffer_from_external(f_string_buffer_t *buffer, const f_string_view_t *str,
+                               void (*free_fn)(void *ptr), void *owner)
+{
+    assert(buffer);
+    assert(str && str->u.data);
+
+    release_buffer_data(buffer);
+    buffer->str.data = (void *)str->u.data;
+    buffer->type = str->type;
+    buffer->ownership = free_fn ? F_BUF_ADOPTED : F_BUF_BORROWED;
+    buffer->free_fn = free_fn;
+    buffer->mem.owner = owner ? owner : (void *)str->u.data;
+}
+
+FT_INTERNAL
+void fill_buffer_from_allocated(f_string_buffer_t *buffer, void *data, enum f_string_type type)
+{
+    assert(buffer);
+    assert(data);
+
+    release_buffer_data(buffer);
+    buffer->str.data = data;
+    buffer->type = type;
+}
 
 #ifdef FT_HAVE_UTF8
 FT_INTERNAL
-f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str)
+f_status buffer_check_utf8(f_string_buffer_t *buffer, enum ft_invalid_utf8_handling handling)
 {
     assert(buffer);
-    assert(str);
+    if (buffer->type != UTF8_BUF || handling == FT_INVALID_UTF8_KEEP)
+        return FT_SUCCESS;
+
+    const struct f_text_metrics *metrics = buffer_metrics(buffer);
+    if (!metrics->utf8_errors)
+        return FT_SUCCESS;
+
+    if (handling == FT_INVALID_UTF8_REJECT) {
+        /* Ownership of rejected external content stays with the caller */
+        if (buffer->ownership == F_BUF_ADOPTED)
+            buffer->ownership = F_BUF_BORROWED;
+        release_buffer_data(buffer);
+        init_string_buffer(buffer, UTF8_BUF);
+        return FT_EINVAL;
+    }
 
-    void *copy = F_UTF8DUP(str);
-    if (copy == NULL)
+    /* Each byte of ill-formed sequences is replaced with 3 bytes of U+FFFD */
+    size_t len = metrics->len;
+    if (len >= SIZE_MAX / 3)
+        return FT_MEMORY_ERROR;
+    char *result = (char *)F_MALLOC(len * 3 + 1);
+    if (result == NULL)
         return FT_MEMORY_ERROR;
 
-    F_FREE(buffer->str.u8str);
-    buffer->str.u8str = copy;
-    buffer->type = UTF8_BUF;
+    const unsigned char *str = (const unsigned char *)buffer->str.u8str;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < len) {
+        uint32_t c = 0;
+        size_t n = (str[i] < 0x80) ? 1 : utf8_decode(str + i, len - i, &c);
+        if (n == 0) {
+            memcpy(result + j, "\xef\xbf\xbd", 3);
+            j += 3;
+            i += 1;
+            continue;
+        }
+        memcpy(result + j, str + i, n);
+        i += n;
+        j += n;
+    }
+    result[j] = '\0';
 
+    release_buffer_data(buffer);
+    buffer->str.u8str = result;
+    buffer->type = UTF8_BUF;
+    buffer_metrics(buffer);
     return FT_SUCCESS;
 }
 #endif /* FT_HAVE_UTF8 */
@@ -413,22 +837,10 @@ f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str)
 FT_INTERNAL
 size_t buffer_text_visible_height(const f_string_buffer_t *buffer)
 {
-    if (buffer == NULL || buffer->str.data == NULL || buf_str_len(buffer) == 0) {
+    if (buffer == NULL || buffer->str.data == NULL) {
         return 0;
     }
-    if (buffer->type == CHAR_BUF)
-        return 1 + strchr_count(buffer->str.cstr, '\n');
-#ifdef FT_HAVE_WCHAR
-    else if (buffer->type == W_CHAR_BUF)
-        return 1 + wstrchr_count(buffer->str.wstr, L'\n');
-#endif /* FT_HAVE_WCHAR */
-#ifdef FT_HAVE_UTF8
-    else if (buffer->type == UTF8_BUF)
-        return 1 + utf8chr_count(buffer->str.u8str, '\n');
-#endif /* FT_HAVE_WCHAR */
-
-    assert(0);
-    return 0;
+    return buffer_metrics(buffer)->lines;
 }
 
 FT_INTERNAL
@@ -440,7 +852,7 @@ size_t string_buffer_cod_width_capacity(const f_string_buffer_t *buffer)
 FT_INTERNAL
 size_t string_buffer_raw_capacity(const f_string_buffer_t *buffer)
 {
-    return buffer->data_sz;
+    return buffer->mem.data_sz;
 }
 
 #ifdef FT_HAVE_UTF8
@@ -462,94 +874,134 @@ size_t utf8_width(const void *beg, const void *end)
             return width;
     }
 
-    size_t sz = (size_t)((const char *)end - (const char *)beg);
-    char *tmp = (char *)F_MALLOC(sizeof(char) * (sz + 1));
-    // @todo: add check to tmp
-    assert(tmp);
-
-    memcpy(tmp, beg, sz);
-    tmp[sz] = '\0';
-    size_t result = utf8width(tmp);
-    F_FREE(tmp);
-    return result;
+    return utf8_range_width(beg, end);
 }
 #endif /* FT_HAVE_WCHAR */
 
-FT_INTERNAL
-size_t buffer_text_visible_width(const f_string_buffer_t *buffer)
+/*
+ * Returns offset of the first newline in content of the buffer starting from
+ * `pos` (or `len` if there are no more newlines).
+ */
+static
+size_t next_newline(const f_string_buffer_t *buffer, size_t pos, size_t len)
 {
-    size_t max_length = 0;
-    if (buffer->type == CHAR_BUF) {
-        size_t n = 0;
-        while (1) {
-            const char *beg = NULL;
-            const char *end = NULL;
-            str_n_substring(buffer->str.cstr, '\n', n, &beg, &end);
-            if (beg == NULL || end == NULL)
-                return max_length;
-
-            max_length = MAX(max_length, (size_t)(end - beg));
-            ++n;
-        }
-#ifdef FT_HAVE_WCHAR
-    } else if (buffer->type == W_CHAR_BUF) {
-        size_t n = 0;
-        while (1) {
-            const wchar_t *beg = NULL;
-            const wchar_t *end = NULL;
-            wstr_n_substring(buffer->str.wstr, L'\n', n, &beg, &end);
-            if (beg == NULL || end == NULL)
-                return max_length;
-
-            int line_width = mk_wcswidth(beg, (size_t)(end - beg));
-            if (line_width < 0) /* For safety */
-                line_width = 0;
-            max_length = MAX(max_length, (size_t)line_width);
-
-            ++n;
-        }
-#endif /* FT_HAVE_WCHAR */
+    const void *nl = NULL;
+    switch (buffer->type) {
+        case CHAR_BUF:
 #ifdef FT_HAVE_UTF8
-    } else if (buffer->type == UTF8_BUF) {
-        size_t n = 0;
-        while (1) {
-            const void *beg = NULL;
-            const void *end = NULL;
-            utf8_n_substring(buffer->str.u8str, '\n', n, &beg, &end);
-            if (beg == NULL || end == NULL)
-                return max_length;
-
-            max_length = MAX(max_length, (size_t)utf8_width(beg, end));
-            ++n;
-        }
+        case UTF8_BUF: /* '\n' can't be a part of multibyte utf-8 sequences */
+#endif /* FT_HAVE_UTF8 */
+            nl = memchr(buffer->str.cstr + pos, '\n', len - pos);
+            return nl ? (size_t)((const char *)nl - buffer->str.cstr) : len;
+#ifdef FT_HAVE_WCHAR
+        case W_CHAR_BUF:
+            nl = wmemchr(buffer->str.wstr + pos, L'\n', len - pos);
+            return nl ? (size_t)((const wchar_t *)nl - buffer->str.wstr) : len;
 #endif /* FT_HAVE_WCHAR */
+        default:
+            assert(0);
+            return len;
     }
+}
 
-    return max_length; /* shouldn't be here */
+/*
+ * Returns index of lines of the buffer content building it if necessary.
+ * Content of one line doesn't need the index, so NULL is returned for it
+ * (and if memory for the index can't be allocated).
+ */
+FT_INTERNAL
+struct f_line_index *buffer_line_index(const f_string_buffer_t *buffer)
+{
+    /* Index is a part of metrics, so it is built in const buffers */
+    struct f_text_metrics *metrics = (struct f_text_metrics *)buffer_metrics(buffer);
+    if (metrics->line_index || metrics->lines < 2)
+        return metrics->line_index;
+
+    struct f_line_index *index = (struct f_line_index *)F_MALLOC(
+                                     sizeof(struct f_line_index) + metrics->lines * sizeof(size_t));
+    if (index == NULL)
+        return NULL;
+
+    size_t n = 0;
+    index->count = metrics->lines;
+    index->offsets[0] = 0;
+    for (n = 1; n < index->count; ++n)
+        index->offsets[n] = next_newline(buffer, index->offsets[n - 1], metrics->len) + 1;
+    index->offsets[index->count] = metrics->len + 1;
+    metrics->line_index = index;
+    return index;
 }
 
+/*
+ * Computes range [beg, end) of code units of line `n` of the buffer content.
+ * Returns 0 if there is no such line.
+ */
+static
+int buffer_line_range(const f_string_buffer_t *buffer, size_t n, size_t *beg, size_t *end)
+{
+    const struct f_text_metrics *metrics = buffer_metrics(buffer);
+    if (n >= metrics->lines)
+        return 0;
+
+    const struct f_line_index *index = buffer_line_index(buffer);
+    if (index) {
+        *beg = index->offsets[n];
+        *end = index->offsets[n + 1] - 1;
+        return 1;
+    }
+
+    /* Content with one line or the index can't be allocated */
+    size_t pos = 0;
+    while (n--)
+        pos = next_newline(buffer, pos, metrics->len) + 1;
+    *beg = pos;
+    *end = next_newline(buffer, pos, metrics->len);
+    return 1;
+}
 
 static void
 buffer_substring(const f_string_buffer_t *buffer, size_t buffer_row, const void **begin, const void **end,  ptrdiff_t *str_it_width)
 {
+    size_t beg_off = 0;
+    size_t end_off = 0;
+    *begin = NULL;
+    *end = NULL;
+    if (!buffer_line_range(buffer, buffer_row, &beg_off, &end_off))
+        return;
+
+    const struct f_text_metrics *metrics = buffer_metrics(buffer);
+    int printable_ascii = metrics->printable_ascii;
+    (void)printable_ascii;  /* unused if wchar and utf-8 support is disabled */
     switch (buffer->type) {
         case CHAR_BUF:
-            str_n_substring(buffer->str.cstr, '\n', buffer_row, (const char **)begin, (const char **)end);
-            if ((*(const char **)begin) && (*(const char **)end))
-                *str_it_width = str_iter_width(*(const char **)begin, *(const char **)end);
+            *begin = buffer->str.cstr + beg_off;
+            *end = buffer->str.cstr + end_off;
+            *str_it_width = str_iter_width(*(const char **)begin, *(const char **)end);
             break;
 #ifdef FT_HAVE_WCHAR
         case W_CHAR_BUF:
-            wstr_n_substring(buffer->str.wstr, L'\n', buffer_row, (const wchar_t **)begin, (const wchar_t **)end);
-            if ((*(const wchar_t **)begin) && (*(const wchar_t **)end))
-                *str_it_width = wcs_iter_width(*(const wchar_t **)begin, *(const wchar_t **)end);
+            *begin = buffer->str.wstr + beg_off;
+            *end = buffer->str.wstr + end_off;
+            *str_it_width = printable_ascii
+                            ? (ptrdiff_t)(end_off - beg_off)
+                            : wcs_iter_width(*(const wchar_t **)begin, *(const wchar_t **)end);
             break;
 #endif /* FT_HAVE_WCHAR */
 #ifdef FT_HAVE_UTF8
         case UTF8_BUF:
-            utf8_n_substring(buffer->str.u8str, '\n', buffer_row, begin, end);
-            if ((*(const char **)begin) && (*(const char **)end))
-                *str_it_width = utf8_width(*begin, *end);
+            *begin = (const char *)buffer->str.u8str + beg_off;
+            *end = (const char *)buffer->str.u8str + end_off;
+            if (_custom_u8strwid) {
+                *str_it_width = (ptrdiff_t)utf8_width(*begin, *end);
+            } else if (printable_ascii) {
+                /* Each char of ASCII string is one byte wide */
+                *str_it_width = (ptrdiff_t)(end_off - beg_off);
+            } else if (metrics->lines == 1 && metrics->width != SIZE_MAX) {
+                /* Width of one line content is computed when it is written */
+                *str_it_width = (ptrdiff_t)metrics->width;
+            } else {
+                *str_it_width = (ptrdiff_t)utf8_width(*begin, *end);
+            }
             break;
 #endif /* FT_HAVE_UTF8 */
         default:
@@ -557,28 +1009,69 @@ buffer_substring(const f_string_buffer_t *buffer, size_t buffer_row, const void
     }
 }
 
+/* Computes width of the widest line of the content */
+static
+size_t buffer_lines_width(const f_string_buffer_t *buffer)
+{
+    size_t max_length = 0;
+    size_t n = 0;
+    size_t lines = buffer_metrics(buffer)->lines;
+    for (n = 0; n < lines; ++n) {
+        const void *beg = NULL;
+        const void *end = NULL;
+        ptrdiff_t line_width = 0;
+        buffer_substring(buffer, n, &beg, &end, &line_width);
+        if (line_width < 0) /* For safety */
+            line_width = 0;
+        max_length = MAX(max_length, (size_t)line_width);
+    }
+    return max_length;
+}
 
-static int
-buffer_print_range(f_conv_context_t *cntx, const void *beg, const void *end)
+FT_INTERNAL
+size_t buffer_text_visible_width(const f_string_buffer_t *buffer)
 {
-    size_t len;
-    switch (cntx->b_type) {
-        case CHAR_BUF:
-            len = (size_t)((const char *)end - (const char *)beg);
-            return ft_nprint(cntx, (const char *)beg, len);
-#ifdef FT_HAVE_WCHAR
-        case W_CHAR_BUF:
-            len = (size_t)((const wchar_t *)end - (const wchar_t *)beg);
-            return ft_nwprint(cntx, (const wchar_t *)beg, len);
-#endif /* FT_HAVE_WCHAR */
+    /* Width is a part of metrics, so it is cached in const buffers */
+    struct f_text_metrics *metrics = (struct f_text_metrics *)buffer_metrics(buffer);
 #ifdef FT_HAVE_UTF8
-        case UTF8_BUF:
-            return ft_nu8print(cntx, beg, end);
+    /* Custom width function may be changed later, so its results aren't cached */
+    if (buffer->type == UTF8_BUF && _custom_u8strwid)
+        return buffer_lines_width(buffer);
 #endif /* FT_HAVE_UTF8 */
-        default:
-            assert(0);
-            return -1;
+
+    /*
+     * Width of char and printable ASCII content (and of valid utf-8 content)
+     * is computed when metrics are, width of other content is computed once
+     * (it is requested for each printed line).
+     */
+    if (metrics->width == SIZE_MAX)
+        metrics->width = buffer_lines_width(buffer);
+    return metrics->width;
+}
+
+FT_INTERNAL
+size_t buffer_text_extra_code_units(const f_string_buffer_t *buffer)
+{
+#ifdef FT_HAVE_UTF8
+    if (buffer->type == UTF8_BUF) {
+        const struct f_text_metrics *metrics = buffer_metrics(buffer);
+        return metrics->printable_ascii ? 0 : metrics->max_line_len;
+    }
+#endif /* FT_HAVE_UTF8 */
+#ifdef FT_HAVE_WCHAR
+    if (buffer->type == W_CHAR_BUF) {
+        const struct f_text_metrics *metrics = buffer_metrics(buffer);
+        if (metrics->printable_ascii)
+            return 0;
+        /* Widths of lines of multiline content are not known separately */
+        if (metrics->lines > 1)
+            return metrics->max_line_len;
+        size_t width = buffer_text_visible_width(buffer);
+        return metrics->len > width ? metrics->len - width : 0;
     }
+#endif /* FT_HAVE_WCHAR */
+    (void)buffer;
+    return 0;
 }
 
 
@@ -633,12 +1126,12 @@ int buffer_printf(f_string_buffer_t *buffer, size_t buffer_row, f_conv_context_t
 
     size_t padding = content_width - (size_t)str_it_width;
 
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, left, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, left));
     CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, content_style_tag));
-    CHCK_RSLT_ADD_TO_WRITTEN(buffer_print_range(cntx, beg, end));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_range(cntx, beg, end, buffer->type));
     CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, 1, reset_content_style_tag));
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, padding, FT_SPACE));
-    CHCK_RSLT_ADD_TO_WRITTEN(print_n_strings(cntx, right, FT_SPACE));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, padding));
+    CHCK_RSLT_ADD_TO_WRITTEN(print_n_spaces(cntx, right));
     return (int)written;
 
 clear:
@@ -651,14 +1144,14 @@ size_t string_buffer_width_capacity(const f_string_buffer_t *buffer)
     assert(buffer);
     switch (buffer->type) {
         case CHAR_BUF:
-            return buffer->data_sz;
+            return buffer->mem.data_sz;
 #ifdef FT_HAVE_WCHAR
         case W_CHAR_BUF:
-            return buffer->data_sz / sizeof(wchar_t);
+            return buffer->mem.data_sz / sizeof(wchar_t);
 #endif
 #ifdef FT_HAVE_UTF8
         case UTF8_BUF:
-            return buffer->data_sz / 4;
+            return buffer->mem.data_sz / 4;
 #endif
         default:
             assert(0);
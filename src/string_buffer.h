@@ -8,6 +8,43 @@
  *               STRING BUFFER
  * ***************************************************************************/
 
+/*
+ * Ownership of the buffer data.
+ */
+enum f_buffer_ownership {
+    F_BUF_OWNED = 0,   /* allocated by libfort */
+    F_BUF_ADOPTED,     /* adopted from user, released with free_fn */
+    F_BUF_BORROWED     /* owned by user, never released by libfort */
+};
+
+/*
+ * Properties of the buffer content. They are computed in one pass over the
+ * content and used instead of rescanning it while the table is printed.
+ */
+struct f_text_metrics {
+    size_t len;           /* number of code units (chars, wchars or bytes) */
+    size_t lines;         /* number of lines (0 for empty string) */
+    size_t max_line_len;  /* maximum number of code units in a line */
+    size_t width;         /* visible width of the content, SIZE_MAX if unknown */
+    const void *data;     /* content for which metrics were computed */
+    struct f_line_index *line_index;  /* owned, NULL until it is needed */
+    int shared_line_index;  /* line_index is owned by string pool of the table */
+    int printable_ascii;  /* content has only printable ASCII chars and '\n' */
+    int utf8_errors;      /* utf-8 content has ill-formed sequences */
+    enum f_string_type type;
+    int valid;
+};
+
+/*
+ * Offsets of lines of multiline content. Lines of cells are printed one by
+ * one, so the index is built on the first access to a line instead of
+ * searching for the n-th newline from the beginning of the content each time.
+ */
+struct f_line_index {
+    size_t count;         /* number of lines */
+    size_t offsets[1];    /* beginnings of lines and offsets[count] = len + 1 */
+};
+
 struct f_string_buffer {
     union {
         char *cstr;
@@ -19,18 +56,37 @@ struct f_string_buffer {
 #endif
         void *data;
     } str;
-    size_t data_sz;
+    union {
+        size_t data_sz;    /* size of memory owned by the buffer */
+        void *owner;       /* object released with free_fn (adopted buffers) */
+    } mem;
     enum f_string_type type;
+    enum f_buffer_ownership ownership;
+    void (*free_fn)(void *ptr);
+    struct f_text_metrics metrics;
 };
 
+/* Initializes empty buffer that doesn't own memory (e.g. buffer of a cell) */
+FT_INTERNAL
+void init_string_buffer(f_string_buffer_t *buffer, enum f_string_type type);
+
+/* Returns 1 if nothing was written to the buffer since it was initialized */
+FT_INTERNAL
+int buffer_is_unwritten(const f_string_buffer_t *buffer);
+
 FT_INTERNAL
 f_string_buffer_t *create_string_buffer(size_t number_of_chars, enum f_string_type type);
 
 FT_INTERNAL
 void destroy_string_buffer(f_string_buffer_t *buffer);
 
+/* Frees content of the buffer initialized with init_string_buffer */
 FT_INTERNAL
-f_string_buffer_t *copy_string_buffer(const f_string_buffer_t *buffer);
+void release_buffer_data(f_string_buffer_t *buffer);
+
+/* Initializes `result` with a copy of content of `buffer` */
+FT_INTERNAL
+f_status copy_string_buffer(f_string_buffer_t *result, const f_string_buffer_t *buffer);
 
 FT_INTERNAL
 f_status realloc_string_buffer_without_copy(f_string_buffer_t *buffer);
@@ -48,12 +104,79 @@ FT_INTERNAL
 f_status fill_buffer_from_u8string(f_string_buffer_t *buffer, const void *str);
 #endif /* FT_HAVE_UTF8 */
 
+/*
+ * Copies first `len` code units of `str` (it may be not null-terminated) to
+ * the buffer computing metrics of the content at the same time.
+ */
+FT_INTERNAL
+f_status fill_buffer_from_string_len(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len);
+
+/*
+ * Copies `str` (first `len` code units of it or the whole null-terminated
+ * string if `len` is SIZE_MAX) to `dst` computing metrics of the content at the
+ * same time. Memory at `dst` is managed by the caller (e.g. text slab of the
+ * table) and is borrowed by the buffer. Returns length of the copied string.
+ */
+FT_INTERNAL
+size_t fill_buffer_from_string_at(f_string_buffer_t *buffer, const f_string_view_t *str, size_t len, void *dst);
+
+/*
+ * Makes buffer borrow content interned by the table. Metrics of the content
+ * (and index of its lines) were computed when it was interned and are shared
+ * by all buffers with this content.
+ */
+FT_INTERNAL
+void fill_buffer_from_interned(f_string_buffer_t *buffer, const void *data, const struct f_text_metrics *metrics);
+
+/*
+ * Builds index of lines of the multiline content. Used to build index of
+ * interned content before it is shared. Returns NULL if the content has one
+ * line or memory can't be allocated.
+ */
+FT_INTERNAL
+struct f_line_index *buffer_line_index(const f_string_buffer_t *buffer);
+
+/*
+ * Makes buffer use `str` without copying it. If free_fn is NULL the string is
+ * borrowed, otherwise buffer takes ownership of it (or of `owner` of the
+ * string if it is not NULL) and releases it with free_fn.
+ */
+FT_INTERNAL
+void fill_buffer_from_external(f_string_buffer_t *buffer, const f_string_view_t *str,
+                               void (*free_fn)(void *ptr), void *owner);
+
+/*
+ * Makes buffer own `data` allocated with F_MALLOC and filled by the caller
+ * (e.g. formatted in place). Metrics of the content are computed when they
+ * are requested.
+ */
+FT_INTERNAL
+void fill_buffer_from_allocated(f_string_buffer_t *buffer, void *data, enum f_string_type type);
+
+#ifdef FT_HAVE_UTF8
+/*
+ * Handles ill-formed sequences of utf-8 content of the buffer: keeps them,
+ * rejects content (the buffer is left empty and FT_EINVAL is returned) or
+ * replaces them with U+FFFD.
+ */
+FT_INTERNAL
+f_status buffer_check_utf8(f_string_buffer_t *buffer, enum ft_invalid_utf8_handling handling);
+#endif /* FT_HAVE_UTF8 */
+
 FT_INTERNAL
 size_t buffer_text_visible_width(const f_string_buffer_t *buffer);
 
 FT_INTERNAL
 size_t buffer_text_visible_height(const f_string_buffer_t *buffer);
 
+/*
+ * Returns upper bound of the number of code units of the content that don't
+ * take columns of the output (bytes of multibyte utf-8 sequences that are
+ * copied to char output as they are, zero-width wide chars).
+ */
+FT_INTERNAL
+size_t buffer_text_extra_code_units(const f_string_buffer_t *buffer);
+
 FT_INTERNAL
 size_t string_buffer_cod_width_capacity(const f_string_buffer_t *buffer);
 
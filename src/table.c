@@ -4,6 +4,336 @@
 #include "vector.h"
 #include "row.h"
 
+FT_INTERNAL
+f_virtual_data_t *create_virtual_data(size_t rows, size_t cols, ft_cell_provider_t provider, void *ctx)
+{
+    assert(provider);
+
+    f_virtual_data_t *virt = (f_virtual_data_t *)F_CALLOC(1, sizeof(f_virtual_data_t));
+    if (virt == NULL)
+        return NULL;
+    virt->rows = rows;
+    virt->cols = cols;
+    virt->provider = provider;
+    virt->ctx = ctx;
+
+    size_t i = 0;
+    for (i = 0; i < 2; ++i) {
+        virt->scratch_rows[i] = create_row();
+        if (virt->scratch_rows[i] == NULL)
+            goto clear;
+        if (cols && get_cell_and_create_if_not_exists(virt->scratch_rows[i], cols - 1) == NULL)
+            goto clear;
+    }
+    return virt;
+
+clear:
+    destroy_virtual_data(virt);
+    return NULL;
+}
+
+
+FT_INTERNAL
+void destroy_virtual_data(f_virtual_data_t *virt)
+{
+    if (virt == NULL)
+        return;
+    destroy_row(virt->scratch_rows[0]);
+    destroy_row(virt->scratch_rows[1]);
+    if (virt->spans)
+        destroy_vector(virt->spans);
+    F_FREE(virt);
+}
+
+
+FT_INTERNAL
+f_virtual_data_t *copy_virtual_data(const f_virtual_data_t *virt)
+{
+    assert(virt);
+    f_virtual_data_t *result = create_virtual_data(virt->rows, virt->cols, virt->provider, virt->ctx);
+    if (result == NULL || virt->spans == NULL)
+        return result;
+    result->spans = copy_vector(virt->spans);
+    if (result->spans == NULL) {
+        destroy_virtual_data(result);
+        return NULL;
+    }
+    return result;
+}
+
+
+/* Returns index of the first span of the virtual table not less than (row, col) */
+static
+size_t virtual_span_lower_bound(const f_vector_t *spans, size_t row, size_t col)
+{
+    size_t lo = 0;
+    size_t hi = vector_size(spans);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const struct f_virtual_span *span = &VECTOR_AT_C(spans, mid, const struct f_virtual_span);
+        if (span->row < row || (span->row == row && span->col < col))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+FT_INTERNAL
+f_status virtual_data_set_cell_span(f_virtual_data_t *virt, size_t row, size_t col, size_t hor_span)
+{
+    assert(virt);
+
+    if (virt->spans == NULL) {
+        virt->spans = create_vector(sizeof(struct f_virtual_span), DEFAULT_VECTOR_CAPACITY);
+        if (virt->spans == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    size_t pos = virtual_span_lower_bound(virt->spans, row, col);
+    if (pos < vector_size(virt->spans)) {
+        struct f_virtual_span *span = &VECTOR_AT(virt->spans, pos, struct f_virtual_span);
+        if (span->row == row && span->col == col) {
+            span->hor_span = hor_span;
+            return FT_SUCCESS;
+        }
+    }
+    struct f_virtual_span span;
+    span.row = row;
+    span.col = col;
+    span.hor_span = hor_span;
+    return vector_insert(virt->spans, &span, pos);
+}
+
+
+/* Sets types of cells of the scratch row according to spans of the row */
+static
+void apply_virtual_spans(const f_virtual_data_t *virt, f_row_t *scratch, size_t row)
+{
+    size_t col = 0;
+    for (col = 0; col < virt->cols; ++col)
+        set_cell_type(get_cell(scratch, col), COMMON_CELL);
+    if (virt->spans == NULL)
+        return;
+
+    size_t i = virtual_span_lower_bound(virt->spans, row, 0);
+    for (; i < vector_size(virt->spans); ++i) {
+        const struct f_virtual_span *span = &VECTOR_AT_C(virt->spans, i, const struct f_virtual_span);
+        if (span->row != row)
+            break;
+        for (col = span->col; col < virt->cols && col - span->col < span->hor_span; ++col)
+            set_cell_type(get_cell(scratch, col), col == span->col ? GROUP_MASTER_CELL : GROUP_SLAVE_CELL);
+    }
+}
+
+
+/*
+ * Requests content of the row from the provider. Result is stored in one of
+ * the scratch rows, so it stays valid till the request of the row `row + 2`.
+ */
+static
+const f_row_t *get_virtual_row_c(const ft_table_t *table, size_t row)
+{
+    f_virtual_data_t *virt = table->virt;
+    if (row >= virt->rows)
+        return NULL;
+
+    f_row_t *scratch = virt->scratch_rows[row % 2];
+    size_t col = 0;
+    for (col = 0; col < virt->cols; ++col) {
+        f_cell_t *cell = get_cell(scratch, col);
+        const char *content = virt->provider(row, col, virt->ctx);
+        if (FT_IS_ERROR(fill_cell_from_string(cell, content ? content : "")))
+            return NULL;
+    }
+    apply_virtual_spans(virt, scratch, row);
+    invalidate_span_map(scratch);
+    return scratch;
+}
+
+
+FT_INTERNAL
+void *alloc_text_slab(ft_table_t *table, size_t sz)
+{
+    assert(table);
+
+    if (table->text_slabs == NULL) {
+        table->text_slabs = create_vector(sizeof(void *), DEFAULT_VECTOR_CAPACITY);
+        if (table->text_slabs == NULL)
+            return NULL;
+    }
+    void *slab = F_MALLOC(sz ? sz : 1);
+    if (slab == NULL)
+        return NULL;
+    if (FT_IS_ERROR(vector_push(table->text_slabs, &slab))) {
+        F_FREE(slab);
+        return NULL;
+    }
+    return slab;
+}
+
+
+FT_INTERNAL
+void destroy_text_slabs(ft_table_t *table)
+{
+    assert(table);
+
+    if (table->text_slabs == NULL)
+        return;
+    size_t i = 0;
+    size_t n = vector_size(table->text_slabs);
+    for (i = 0; i < n; ++i) {
+        F_FREE(VECTOR_AT(table->text_slabs, i, void *));
+    }
+    destroy_vector(table->text_slabs);
+    table->text_slabs = NULL;
+}
+
+
+/*
+ * Interned string. Content follows the entry in the same block of memory
+ * (size of the entry is a multiple of alignment of its fields, so content is
+ * aligned for wchar_t too).
+ */
+struct f_intern_entry {
+    size_t hash;
+    struct f_text_metrics metrics;
+};
+
+#define INTERN_POOL_INIT_CAPACITY 64
+
+static
+size_t hash_content(const void *data, size_t sz, enum f_string_type type)
+{
+    /* FNV-1a */
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t hash = UINT64_C(14695981039346656037) ^ (uint64_t)type;
+    size_t i = 0;
+    for (i = 0; i < sz; ++i) {
+        hash ^= p[i];
+        hash *= UINT64_C(1099511628211);
+    }
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+static
+f_status grow_intern_pool(f_intern_pool_t *pool)
+{
+    size_t new_capacity = pool->capacity ? pool->capacity * 2 : INTERN_POOL_INIT_CAPACITY;
+    struct f_intern_entry **new_slots =
+        (struct f_intern_entry **)F_CALLOC(new_capacity, sizeof(struct f_intern_entry *));
+    if (new_slots == NULL)
+        return FT_MEMORY_ERROR;
+
+    size_t i = 0;
+    for (i = 0; i < pool->capacity; ++i) {
+        struct f_intern_entry *entry = pool->slots[i];
+        if (entry == NULL)
+            continue;
+        size_t pos = entry->hash & (new_capacity - 1);
+        while (new_slots[pos])
+            pos = (pos + 1) & (new_capacity - 1);
+        new_slots[pos] = entry;
+    }
+    F_FREE(pool->slots);
+    pool->bytes += (new_capacity - pool->capacity) * sizeof(struct f_intern_entry *);
+    pool->slots = new_slots;
+    pool->capacity = new_capacity;
+    return FT_SUCCESS;
+}
+
+FT_INTERNAL
+f_status fill_buffer_from_pool(ft_table_t *table, f_string_buffer_t *buffer, const f_string_view_t *str, size_t len)
+{
+    assert(table);
+    assert(buffer);
+    assert(str && str->u.data);
+
+    size_t char_sz = 1;
+#ifdef FT_HAVE_WCHAR
+    if (str->type == W_CHAR_BUF)
+        char_sz = sizeof(wchar_t);
+#endif /* FT_HAVE_WCHAR */
+    if (len >= (SIZE_MAX - sizeof(struct f_intern_entry)) / char_sz - 1)
+        return FT_EINVAL;
+
+    if (table->intern_pool == NULL) {
+        table->intern_pool = (f_intern_pool_t *)F_CALLOC(1, sizeof(f_intern_pool_t));
+        if (table->intern_pool == NULL)
+            return FT_MEMORY_ERROR;
+    }
+    f_intern_pool_t *pool = table->intern_pool;
+    if (2 * (pool->count + 1) > pool->capacity && FT_IS_ERROR(grow_intern_pool(pool)))
+        return FT_MEMORY_ERROR;
+
+    size_t sz = len * char_sz;
+    size_t hash = hash_content(str->u.data, sz, str->type);
+    size_t pos = hash & (pool->capacity - 1);
+    pool->lookups++;
+    for (; pool->slots[pos]; pos = (pos + 1) & (pool->capacity - 1)) {
+        const struct f_intern_entry *entry = pool->slots[pos];
+        if (entry->hash == hash && entry->metrics.type == str->type
+            && entry->metrics.len == len && memcmp(entry->metrics.data, str->u.data, sz) == 0) {
+            pool->hits++;
+            fill_buffer_from_interned(buffer, entry->metrics.data, &entry->metrics);
+            return FT_SUCCESS;
+        }
+    }
+
+    size_t entry_sz = sizeof(struct f_intern_entry) + (len + 1) * char_sz;
+    struct f_intern_entry *entry = (struct f_intern_entry *)alloc_text_slab(table, entry_sz);
+    if (entry == NULL)
+        return FT_MEMORY_ERROR;
+    entry->hash = hash;
+    fill_buffer_from_string_at(buffer, str, len, entry + 1);
+
+    /* Index of lines is built once and shared by all cells with the content */
+    const struct f_line_index *index = buffer_line_index(buffer);
+    if (index)
+        pool->bytes += sizeof(struct f_line_index) + index->count * sizeof(size_t);
+    entry->metrics = buffer->metrics;
+    buffer->metrics.shared_line_index = 1;
+
+    pool->slots[pos] = entry;
+    pool->count++;
+    pool->bytes += entry_sz;
+    return FT_SUCCESS;
+}
+
+
+FT_INTERNAL
+void destroy_intern_pool(ft_table_t *table)
+{
+    assert(table);
+
+    f_intern_pool_t *pool = table->intern_pool;
+    if (pool == NULL)
+        return;
+    size_t i = 0;
+    for (i = 0; i < pool->capacity; ++i) {
+        if (pool->slots[i])
+            F_FREE(pool->slots[i]->metrics.line_index);
+    }
+    F_FREE(pool->slots);
+    F_FREE(pool);
+    table->intern_pool = NULL;
+}
+
+
+FT_INTERNAL
+const ft_allocator_t *use_table_allocator(const ft_table_t *table)
+{
+    /*
+     * Calls for tables without their own allocator can be made from callbacks
+     * of tables with one (e.g. sink of ft_print_to), so allocator of such
+     * tables is set explicitly.
+     */
+    if (table == NULL || table->allocator.malloc_fn == NULL)
+        return use_global_allocator();
+    return use_allocator(&table->allocator);
+}
+
+
 FT_INTERNAL
 f_separator_t *create_separator(int enabled)
 {
@@ -45,7 +375,10 @@ f_row_t *get_row_impl(ft_table_t *table, size_t row, enum f_get_policy policy)
             return NULL;
         case CREATE_ON_NULL:
             while (row >= vector_size(table->rows)) {
-                f_row_t *new_row = create_row();
+                /* Rows skipped with ft_set_cur_cell don't reserve memory for cells */
+                size_t capacity = (row == vector_size(table->rows))
+                                  ? MAX(table->reserved_cols, DEFAULT_VECTOR_CAPACITY) : 0;
+                f_row_t *new_row = create_row_with_capacity(capacity);
                 if (new_row == NULL)
                     return NULL;
                 if (FT_IS_ERROR(vector_push(table->rows, &new_row))) {
@@ -71,6 +404,8 @@ f_row_t *get_row(ft_table_t *table, size_t row)
 FT_INTERNAL
 const f_row_t *get_row_c(const ft_table_t *table, size_t row)
 {
+    if (table && table->virt)
+        return get_virtual_row_c(table, row);
     return get_row((ft_table_t *)table, row);
 }
 
@@ -82,7 +417,7 @@ f_row_t *get_row_and_create_if_not_exists(ft_table_t *table, size_t row)
 }
 
 FT_INTERNAL
-f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table)
+f_cell_t *get_cur_cell_and_create_if_not_exists(ft_table_t *table)
 {
     assert(table);
 
@@ -104,6 +439,13 @@ f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table
             break;
     }
 
+    return cell;
+}
+
+FT_INTERNAL
+f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table)
+{
+    f_cell_t *cell = get_cur_cell_and_create_if_not_exists(table);
     if (cell == NULL)
         return NULL;
 
@@ -119,7 +461,10 @@ f_status get_table_sizes(const ft_table_t *table, size_t *rows, size_t *cols)
 {
     *rows = 0;
     *cols = 0;
-    if (table && table->rows) {
+    if (table && table->virt) {
+        *rows = table->virt->rows;
+        *cols = table->virt->cols;
+    } else if (table && table->rows) {
         *rows = vector_size(table->rows);
         size_t row_index = 0;
         for (row_index = 0; row_index < vector_size(table->rows); ++row_index) {
@@ -133,17 +478,88 @@ f_status get_table_sizes(const ft_table_t *table, size_t *rows, size_t *cols)
 }
 
 
+/*
+ * Returns height of the cell. Absent cells are considered to be empty.
+ */
+static
+size_t cell_height_in_row(const f_cell_t *cell, const f_context_t *context)
+{
+    if (cell)
+        return hint_height_cell(cell, context);
+
+    size_t cell_empty_string_height = get_cell_property_hierarchically(context->table_properties, context->row, context->column, FT_CPROP_EMPTY_STR_HEIGHT);
+    if (cell_empty_string_height) {
+        size_t cell_top_padding = get_cell_property_hierarchically(context->table_properties, context->row, context->column, FT_CPROP_TOP_PADDING);
+        size_t cell_bottom_padding = get_cell_property_hierarchically(context->table_properties, context->row, context->column, FT_CPROP_BOTTOM_PADDING);
+        return cell_empty_string_height + cell_top_padding + cell_bottom_padding;
+    }
+    return 0;
+}
+
+
+struct f_group_cell_info {
+    size_t row;
+    size_t col;
+    size_t span;
+    size_t hint_width;
+    size_t invis_width;   /* width of invisible codes of the master cell */
+};
+
+static
+int group_cell_info_cmp(const void *lhs, const void *rhs)
+{
+    const struct f_group_cell_info *l = (const struct f_group_cell_info *)lhs;
+    const struct f_group_cell_info *r = (const struct f_group_cell_info *)rhs;
+    if (l->col != r->col)
+        return l->col < r->col ? -1 : 1;
+    if (l->row != r->row)
+        return l->row < r->row ? -1 : 1;
+    return 0;
+}
+
+
+/*
+ * Widens columns of the group of cells so that they fit content of its master
+ * cell of width `hint_width`.
+ */
+static
+void fit_group_cell(size_t *col_width_arr, const struct f_group_cell_info *info, size_t hint_width)
+{
+    size_t col = info->col;
+    size_t slave_col = col + info->span;
+    size_t group_width = col_width_arr[col];
+    size_t i;
+    for (i = col + 1; i < slave_col; ++i)
+        group_width += col_width_arr[i] + FORT_COL_SEPARATOR_LENGTH;
+    if (group_width >= hint_width)
+        return;
+
+    /*
+     * Lacking width is distributed evenly among columns of the group,
+     * remainder goes to the first columns (the same widths as if
+     * columns were widened one by one in turn).
+     */
+    size_t lack = hint_width - group_width;
+    for (i = col; i < slave_col; ++i)
+        col_width_arr[i] += lack / info->span + (i - col < lack % info->span ? 1 : 0);
+}
+
+
+/*
+ * Computes visible widths of columns, widths of columns in codepoints (with
+ * invisible elements, e.g. style tags) and heights of rows in one pass over
+ * the table. Any of vis_col_width_arr_p and cod_col_width_arr_p may be NULL
+ * if the corresponding widths are not needed.
+ */
 FT_INTERNAL
-f_status table_rows_and_cols_geometry(const ft_table_t *table,
-                                      size_t **col_width_arr_p, size_t *col_width_arr_sz,
-                                      size_t **row_height_arr_p, size_t *row_height_arr_sz,
-                                      enum f_geometry_type geom)
+f_status table_full_geometry(const ft_table_t *table,
+                             size_t **vis_col_width_arr_p, size_t **cod_col_width_arr_p, size_t *cols_p,
+                             size_t **row_height_arr_p, size_t *rows_p)
 {
     if (table == NULL) {
         return FT_GEN_ERROR;
     }
 
-    size_t max_invis_codepoints = 0;
     size_t cols = 0;
     size_t rows = 0;
     int status = get_table_sizes(table, &rows, &cols);
@@ -152,98 +568,99 @@ f_status table_rows_and_cols_geometry(const ft_table_t *table,
 
     size_t *col_width_arr = (size_t *)F_CALLOC(cols, sizeof(size_t));
     size_t *row_height_arr = (size_t *)F_CALLOC(rows, sizeof(size_t));
+    size_t *max_invis_arr = NULL;
+    size_t *cod_col_width_arr = NULL;
+    f_vector_t *group_cells = NULL;
     if (col_width_arr == NULL || row_height_arr == NULL) {
-        F_FREE(col_width_arr);
-        F_FREE(row_height_arr);
-        return FT_GEN_ERROR;
+        status = FT_GEN_ERROR;
+        goto clear;
     }
 
-    int combined_cells_found = 0;
+    if (cod_col_width_arr_p) {
+        max_invis_arr = (size_t *)F_CALLOC(cols, sizeof(size_t));
+        if (max_invis_arr == NULL) {
+            status = FT_GEN_ERROR;
+            goto clear;
+        }
+    }
+
+    /*
+     * Table is traversed row by row so that each row is requested only once
+     * (it matters for virtual tables). Master cells of groups are collected
+     * and processed after widths of all common cells are known.
+     */
     f_context_t context;
     context.table_properties = (table->properties ? table->properties : &g_table_properties);
     size_t col = 0;
-    for (col = 0; col < cols; ++col) {
-        col_width_arr[col] = 0;
-        size_t row = 0;
-        for (row = 0; row < rows; ++row) {
-            const f_row_t *row_p = get_row_c(table, row);
+    size_t row = 0;
+    for (row = 0; row < rows; ++row) {
+        const f_row_t *row_p = get_row_c(table, row);
+        context.row = row;
+        for (col = 0; col < cols; ++col) {
             const f_cell_t *cell = get_cell_c(row_p, col);
             context.column = col;
-            context.row = row;
             if (cell) {
+                size_t inv_codepoints = max_invis_arr ? cell_invis_codes_width(cell, &context) : 0;
                 switch (get_cell_type(cell)) {
                     case COMMON_CELL:
                         col_width_arr[col] = MAX(col_width_arr[col], cell_vis_width(cell, &context));
                         break;
-                    case GROUP_MASTER_CELL:
-                        combined_cells_found = 1;
+                    case GROUP_MASTER_CELL: {
+                        struct f_group_cell_info info;
+                        info.row = row;
+                        info.col = col;
+                        info.span = group_cell_number(row_p, col);
+                        info.hint_width = cell_vis_width(cell, &context);
+                        info.invis_width = inv_codepoints;
+                        if (group_cells == NULL) {
+                            group_cells = create_vector(sizeof(struct f_group_cell_info), DEFAULT_VECTOR_CAPACITY);
+                            if (group_cells == NULL) {
+                                status = FT_MEMORY_ERROR;
+                                goto clear;
+                            }
+                        }
+                        status = vector_push(group_cells, &info);
+                        if (FT_IS_ERROR(status))
+                            goto clear;
                         break;
+                    }
                     case GROUP_SLAVE_CELL:
                         ; /* Do nothing */
                         break;
                 }
-                row_height_arr[row] = MAX(row_height_arr[row], hint_height_cell(cell, &context));
-            } else {
-                size_t cell_empty_string_height = get_cell_property_hierarchically(context.table_properties, context.row, context.column, FT_CPROP_EMPTY_STR_HEIGHT);
-                if (cell_empty_string_height) {
-                    size_t cell_top_padding = get_cell_property_hierarchically(context.table_properties, context.row, context.column, FT_CPROP_TOP_PADDING);
-                    size_t cell_bottom_padding = get_cell_property_hierarchically(context.table_properties, context.row, context.column, FT_CPROP_BOTTOM_PADDING);
-                    row_height_arr[row] = MAX(row_height_arr[row], cell_empty_string_height + cell_top_padding + cell_bottom_padding);
-                }
+                if (max_invis_arr)
+                    max_invis_arr[col] = MAX(max_invis_arr[col], inv_codepoints);
             }
+            row_height_arr[row] = MAX(row_height_arr[row], cell_height_in_row(cell, &context));
         }
+    }
 
-        if (geom == INTERN_REPR_GEOMETRY) {
-            max_invis_codepoints = 0;
-            for (row = 0; row < rows; ++row) {
-                const f_row_t *row_p = get_row_c(table, row);
-                const f_cell_t *cell = get_cell_c(row_p, col);
-                if (!cell)
-                    continue;
-                context.column = col;
-                context.row = row;
-                size_t inv_codepoints = cell_invis_codes_width(cell, &context);
-                max_invis_codepoints = MAX(max_invis_codepoints, inv_codepoints);
-            }
-            col_width_arr[col] += max_invis_codepoints;
+    if (max_invis_arr) {
+        cod_col_width_arr = (size_t *)F_CALLOC(cols, sizeof(size_t));
+        if (cod_col_width_arr == NULL) {
+            status = FT_GEN_ERROR;
+            goto clear;
         }
+        for (col = 0; col < cols; ++col)
+            cod_col_width_arr[col] = col_width_arr[col] + max_invis_arr[col];
     }
 
-    if (combined_cells_found) {
-        for (col = 0; col < cols; ++col) {
-            size_t row = 0;
-            for (row = 0; row < rows; ++row) {
-                const f_row_t *row_p = get_row_c(table, row);
-                const f_cell_t *cell = get_cell_c(row_p, col);
-                context.column = col;
-                context.row = row;
-                if (cell) {
-                    if (get_cell_type(cell) == GROUP_MASTER_CELL) {
-                        size_t hint_width = cell_vis_width(cell, &context);
-                        if (geom == INTERN_REPR_GEOMETRY) {
-                            hint_width += cell_invis_codes_width(cell, &context);
-                        }
-                        size_t slave_col = col + group_cell_number(row_p, col);
-                        size_t cur_adj_col = col;
-                        size_t group_width = col_width_arr[col];
-                        size_t i;
-                        for (i = col + 1; i < slave_col; ++i)
-                            group_width += col_width_arr[i] + FORT_COL_SEPARATOR_LENGTH;
-                        /* adjust col. widths */
-                        while (1) {
-                            if (group_width >= hint_width)
-                                break;
-                            col_width_arr[cur_adj_col] += 1;
-                            group_width++;
-                            cur_adj_col++;
-                            if (cur_adj_col == slave_col)
-                                cur_adj_col = col;
-                        }
-                    }
-                }
-            }
+    if (group_cells) {
+        /* Groups are processed column by column, top to bottom. */
+        size_t groups_n = vector_size(group_cells);
+        qsort(vector_at(group_cells, 0), groups_n, sizeof(struct f_group_cell_info), group_cell_info_cmp);
+
+        size_t k = 0;
+        for (k = 0; k < groups_n; ++k) {
+            const struct f_group_cell_info *info = &VECTOR_AT_C(group_cells, k, const struct f_group_cell_info);
+            fit_group_cell(col_width_arr, info, info->hint_width);
+            if (cod_col_width_arr)
+                fit_group_cell(cod_col_width_arr, info, info->hint_width + info->invis_width);
         }
+        destroy_vector(group_cells);
+        group_cells = NULL;
     }
+    F_FREE(max_invis_arr);
 
     /* todo: Maybe it is better to move min width checking to a particular cell
      * width checking. At the moment min width includes paddings. Maybe it is
@@ -258,38 +675,55 @@ f_status table_rows_and_cols_geometry(const ft_table_t *table,
     }
     */
 
-    *col_width_arr_p = col_width_arr;
-    *col_width_arr_sz = cols;
+    if (vis_col_width_arr_p)
+        *vis_col_width_arr_p = col_width_arr;
+    else
+        F_FREE(col_width_arr);
+    if (cod_col_width_arr_p)
+        *cod_col_width_arr_p = cod_col_width_arr;
+    *cols_p = cols;
     *row_height_arr_p = row_height_arr;
-    *row_height_arr_sz = rows;
+    *rows_p = rows;
     return FT_SUCCESS;
+
+clear:
+    if (group_cells)
+        destroy_vector(group_cells);
+    F_FREE(max_invis_arr);
+    F_FREE(cod_col_width_arr);
+    F_FREE(col_width_arr);
+    F_FREE(row_height_arr);
+    return status;
 }
 
 
-/*
- * Returns geometry in characters
- */
 FT_INTERNAL
-f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
+f_status table_rows_and_cols_geometry(const ft_table_t *table,
+                                      size_t **col_width_arr_p, size_t *col_width_arr_sz,
+                                      size_t **row_height_arr_p, size_t *row_height_arr_sz,
+                                      enum f_geometry_type geom)
 {
-    if (table == NULL)
-        return FT_GEN_ERROR;
+    if (geom == INTERN_REPR_GEOMETRY)
+        return table_full_geometry(table, NULL, col_width_arr_p, col_width_arr_sz,
+                                   row_height_arr_p, row_height_arr_sz);
+    return table_full_geometry(table, col_width_arr_p, NULL, col_width_arr_sz,
+                               row_height_arr_p, row_height_arr_sz);
+}
 
-    *height = 0;
-    *width = 0;
-    size_t cols = 0;
-    size_t rows = 0;
-    size_t *col_width_arr = NULL;
-    size_t *row_height_arr = NULL;
 
-    int status = table_rows_and_cols_geometry(table, &col_width_arr, &cols, &row_height_arr, &rows, INTERN_REPR_GEOMETRY);
-    if (FT_IS_ERROR(status))
-        return status;
+FT_INTERNAL
+f_status table_geometry_for_rows(const ft_table_t *table,
+                                 const size_t *cod_col_width_arr, size_t cols,
+                                 const size_t *row_height_arr, size_t rows,
+                                 size_t *height, size_t *width)
+{
+    if (table == NULL)
+        return FT_GEN_ERROR;
 
     *width = 1 + (cols == 0 ? 1 : cols) + 1; /* for boundaries (that take 1 symbol) + newline   */
     size_t i = 0;
     for (i = 0; i < cols; ++i) {
-        *width += col_width_arr[i];
+        *width += cod_col_width_arr[i];
     }
 
     /* todo: add check for non printable horizontal row separators */
@@ -297,8 +731,6 @@ f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
     for (i = 0; i < rows; ++i) {
         *height += row_height_arr[i];
     }
-    F_FREE(col_width_arr);
-    F_FREE(row_height_arr);
 
     f_table_properties_t *properties = table->properties;
     if (properties) {
@@ -316,6 +748,93 @@ f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
     return FT_SUCCESS;
 }
 
+
+/*
+ * Returns geometry in characters
+ */
+FT_INTERNAL
+f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width)
+{
+    if (table == NULL)
+        return FT_GEN_ERROR;
+
+    *height = 0;
+    *width = 0;
+    size_t cols = 0;
+    size_t rows = 0;
+    size_t *col_width_arr = NULL;
+    size_t *row_height_arr = NULL;
+
+    int status = table_rows_and_cols_geometry(table, &col_width_arr, &cols, &row_height_arr, &rows, INTERN_REPR_GEOMETRY);
+    if (FT_IS_ERROR(status))
+        return status;
+
+    status = table_geometry_for_rows(table, col_width_arr, cols, row_height_arr, rows, height, width);
+    F_FREE(col_width_arr);
+    F_FREE(row_height_arr);
+    return status;
+}
+
+
+/*
+ * Geometry caches are valid only for the generation of geometry they were
+ * computed for. Generation is changed with the default properties, which are
+ * not thread-safe either.
+ */
+static size_t g_geometry_generation = 0;
+
+FT_INTERNAL
+void invalidate_all_geometry_caches(void)
+{
+    ++g_geometry_generation;
+}
+
+FT_INTERNAL
+void destroy_geometry_cache(ft_table_t *table)
+{
+    f_geometry_cache_t *cache = &table->geometry_cache;
+    F_FREE(cache->vis_col_width_arr);
+    F_FREE(cache->cod_col_width_arr);
+    F_FREE(cache->row_height_arr);
+    cache->vis_col_width_arr = NULL;
+    cache->cod_col_width_arr = NULL;
+    cache->row_height_arr = NULL;
+    cache->valid = 0;
+}
+
+
+FT_INTERNAL
+void invalidate_geometry_cache(ft_table_t *table)
+{
+    assert(table);
+    table->geometry_cache.valid = 0;
+}
+
+
+FT_INTERNAL
+const f_geometry_cache_t *table_geometry_cache(const ft_table_t *table)
+{
+    assert(table);
+    f_geometry_cache_t *cache = (f_geometry_cache_t *) &table->geometry_cache;
+    if (cache->valid && cache->generation == g_geometry_generation)
+        return cache;
+
+    destroy_geometry_cache((ft_table_t *)table);
+
+    size_t rows = 0;
+    size_t cols = 0;
+    int status = table_full_geometry(table, &cache->vis_col_width_arr, &cache->cod_col_width_arr, &cols,
+                                     &cache->row_height_arr, &rows);
+    if (FT_IS_ERROR(status))
+        return NULL;
+
+    cache->cols = cols;
+    cache->rows = rows;
+    cache->generation = g_geometry_generation;
+    cache->valid = 1;
+    return cache;
+}
+
 FT_INTERNAL
 f_status table_internal_codepoints_geometry(const ft_table_t *table, size_t *height, size_t *width)
 {
@@ -3,6 +3,64 @@
 
 #include "fort_utils.h"
 
+/*
+ * Content source of virtual tables. Cell content is requested from the
+ * provider while the table is being converted to string and is stored only
+ * in two scratch rows (current row and the previous one). Cell spans are
+ * kept in a vector sorted by rows and columns, so the table doesn't create
+ * rows for them.
+ */
+struct f_virtual_span {
+    size_t row;
+    size_t col;
+    size_t hor_span;
+};
+
+struct f_virtual_data {
+    size_t rows;
+    size_t cols;
+    ft_cell_provider_t provider;
+    void *ctx;
+    f_row_t *scratch_rows[2];
+    f_vector_t *spans;  /* of struct f_virtual_span, NULL if no spans are set */
+};
+typedef struct f_virtual_data f_virtual_data_t;
+
+/*
+ * Geometry of the whole table used by windowed rendering (ft_render_rows).
+ * It is computed on demand in one pass over the table and dropped by every
+ * function that may change geometry of the table. Changes of the default
+ * properties are tracked with generation of geometry (see
+ * invalidate_all_geometry_caches).
+ */
+struct f_geometry_cache {
+    size_t *vis_col_width_arr;
+    size_t *cod_col_width_arr;
+    size_t *row_height_arr;
+    size_t cols;
+    size_t rows;
+    size_t generation;
+    int valid;
+};
+typedef struct f_geometry_cache f_geometry_cache_t;
+
+/*
+ * Pool of strings interned by the table (see FT_TPROP_INTERN_STRINGS). Each
+ * distinct cell content is stored once in text slabs together with its
+ * metrics, cells borrow content from the pool. The pool is an open addressing
+ * hash table of entries which is created on the first interned write.
+ */
+struct f_intern_entry;
+struct f_intern_pool {
+    struct f_intern_entry **slots;
+    size_t capacity;      /* power of 2 */
+    size_t count;         /* number of distinct strings */
+    size_t lookups;
+    size_t hits;
+    size_t bytes;         /* memory used by entries and slots */
+};
+typedef struct f_intern_pool f_intern_pool_t;
+
 struct ft_table {
     f_vector_t *rows;
     f_table_properties_t *properties;
@@ -10,8 +68,56 @@ struct ft_table {
     size_t cur_row;
     size_t cur_col;
     f_vector_t *separators;
+    f_virtual_data_t *virt;
+    f_geometry_cache_t geometry_cache;
+    f_vector_t *text_slabs;
+    f_intern_pool_t *intern_pool;
+    size_t reserved_cols;   /* capacity of new rows (see ft_reserve) */
+    ft_allocator_t allocator;   /* malloc_fn is NULL if global allocator is used */
 };
 
+FT_INTERNAL
+f_virtual_data_t *create_virtual_data(size_t rows, size_t cols, ft_cell_provider_t provider, void *ctx);
+
+FT_INTERNAL
+void destroy_virtual_data(f_virtual_data_t *virt);
+
+FT_INTERNAL
+f_virtual_data_t *copy_virtual_data(const f_virtual_data_t *virt);
+
+FT_INTERNAL
+f_status virtual_data_set_cell_span(f_virtual_data_t *virt, size_t row, size_t col, size_t hor_span);
+
+/*
+ * Allocates block of memory for content of cells written by bulk functions
+ * (ft_table_write, ft_row_write). Cells borrow their content from slabs, so
+ * slabs are released only with the table.
+ */
+FT_INTERNAL
+void *alloc_text_slab(ft_table_t *table, size_t sz);
+
+FT_INTERNAL
+void destroy_text_slabs(ft_table_t *table);
+
+/*
+ * Fills buffer with interned copy of first `len` code units of `str` adding it
+ * to the pool of the table if it is not there yet.
+ */
+FT_INTERNAL
+f_status fill_buffer_from_pool(ft_table_t *table, f_string_buffer_t *buffer, const f_string_view_t *str, size_t len);
+
+FT_INTERNAL
+void destroy_intern_pool(ft_table_t *table);
+
+/*
+ * Makes allocator of the table current (global allocator if the table doesn't
+ * have its own one).
+ * Returns allocator that should be restored with use_allocator after the
+ * operation on the table.
+ */
+FT_INTERNAL
+const ft_allocator_t *use_table_allocator(const ft_table_t *table);
+
 FT_INTERNAL
 f_separator_t *create_separator(int enabled);
 
@@ -33,10 +139,18 @@ const f_row_t *get_row_c(const ft_table_t *table, size_t row);
 FT_INTERNAL
 f_row_t *get_row_and_create_if_not_exists(ft_table_t *table, size_t row);
 
+FT_INTERNAL
+f_cell_t *get_cur_cell_and_create_if_not_exists(ft_table_t *table);
+
 FT_INTERNAL
 f_string_buffer_t *get_cur_str_buffer_and_create_if_not_exists(ft_table_t *table);
 
 
+FT_INTERNAL
+f_status table_full_geometry(const ft_table_t *table,
+                             size_t **vis_col_width_arr_p, size_t **cod_col_width_arr_p, size_t *cols_p,
+                             size_t **row_height_arr_p, size_t *rows_p);
+
 FT_INTERNAL
 f_status table_rows_and_cols_geometry(const ft_table_t *table,
                                       size_t **col_width_arr_p, size_t *col_width_arr_sz,
@@ -46,6 +160,32 @@ f_status table_rows_and_cols_geometry(const ft_table_t *table,
 FT_INTERNAL
 f_status table_geometry(const ft_table_t *table, size_t *height, size_t *width);
 
+/*
+ * Returns geometry in characters of the part of the table consisting of rows
+ * with heights `row_height_arr` given widths of columns in codepoints.
+ */
+FT_INTERNAL
+f_status table_geometry_for_rows(const ft_table_t *table,
+                                 const size_t *cod_col_width_arr, size_t cols,
+                                 const size_t *row_height_arr, size_t rows,
+                                 size_t *height, size_t *width);
+
+FT_INTERNAL
+const f_geometry_cache_t *table_geometry_cache(const ft_table_t *table);
+
+FT_INTERNAL
+void invalidate_geometry_cache(ft_table_t *table);
+
+FT_INTERNAL
+void destroy_geometry_cache(ft_table_t *table);
+
+/*
+ * Drops geometry caches of all tables (they depend on the default properties
+ * and on the function that computes width of utf-8 strings).
+ */
+FT_INTERNAL
+void invalidate_all_geometry_caches(void);
+
 /*
  * Returns geometry in codepoints(characters) (include codepoints of invisible
  * elements: e.g. styles tags).
@@ -15,10 +15,12 @@ static int vector_reallocate_(f_vector_t *vector, size_t new_capacity)
     assert(vector);
     assert(new_capacity > vector->m_capacity);
 
+    size_t old_size = MAX(vector->m_capacity * vector->m_item_size, 1);
     size_t new_size = new_capacity * vector->m_item_size;
-    vector->m_data = F_REALLOC(vector->m_data, new_size);
-    if (vector->m_data == NULL)
+    void *new_data = F_REALLOC(vector->m_data, old_size, new_size);
+    if (new_data == NULL)
         return -1;
+    vector->m_data = new_data;
     return 0;
 }
 
@@ -71,6 +73,22 @@ size_t vector_capacity(const f_vector_t *vector)
 }
 
 
+FT_INTERNAL
+f_status vector_reserve(f_vector_t *vector, size_t capacity)
+{
+    assert(vector);
+
+    if (capacity <= vector->m_capacity)
+        return FT_SUCCESS;
+    if (capacity > SIZE_MAX / vector->m_item_size)
+        return FT_EINVAL;
+    if (vector_reallocate_(vector, capacity) == -1)
+        return FT_MEMORY_ERROR;
+    vector->m_capacity = capacity;
+    return FT_SUCCESS;
+}
+
+
 FT_INTERNAL
 int vector_push(f_vector_t *vector, const void *item)
 {
@@ -78,9 +96,10 @@ int vector_push(f_vector_t *vector, const void *item)
     assert(item);
 
     if (vector->m_size == vector->m_capacity) {
-        if (vector_reallocate_(vector, vector->m_capacity * 2) == -1)
+        size_t new_capacity = MAX(vector->m_capacity * 2, 1);
+        if (vector_reallocate_(vector, new_capacity) == -1)
             return FT_GEN_ERROR;
-        vector->m_capacity = vector->m_capacity * 2;
+        vector->m_capacity = new_capacity;
     }
 
     size_t offset = vector->m_size * vector->m_item_size;
@@ -98,6 +117,8 @@ int vector_insert(f_vector_t *vector, const void *item, size_t pos)
     assert(item);
     size_t needed_capacity = MAX(pos + 1, vector->m_size + 1);
     if (vector->m_capacity < needed_capacity) {
+        /* Grow geometrically so that repeated inserts are amortized O(1) */
+        needed_capacity = MAX(needed_capacity, vector->m_capacity * 2);
         if (vector_reallocate_(vector, needed_capacity) == -1)
             return FT_GEN_ERROR;
         vector->m_capacity = needed_capacity;
@@ -237,8 +258,7 @@ int vector_erase(f_vector_t *vector, size_t index)
     return FT_SUCCESS;
 }
 
-#ifdef FT_TEST_BUILD
-
+FT_INTERNAL
 f_vector_t *copy_vector(f_vector_t *v)
 {
     if (v == NULL)
@@ -254,6 +274,8 @@ f_vector_t *copy_vector(f_vector_t *v)
     return new_vector;
 }
 
+#ifdef FT_TEST_BUILD
+
 size_t vector_index_of(const f_vector_t *vector, const void *item)
 {
     assert(vector);
@@ -18,6 +18,9 @@ size_t vector_size(const f_vector_t *);
 FT_INTERNAL
 size_t vector_capacity(const f_vector_t *);
 
+FT_INTERNAL
+f_status vector_reserve(f_vector_t *, size_t capacity);
+
 FT_INTERNAL
 int vector_push(f_vector_t *, const void *item);
 
@@ -42,8 +45,10 @@ void vector_clear(f_vector_t *);
 FT_INTERNAL
 int vector_erase(f_vector_t *, size_t index);
 
-#ifdef FT_TEST_BUILD
+FT_INTERNAL
 f_vector_t *copy_vector(f_vector_t *);
+
+#ifdef FT_TEST_BUILD
 size_t vector_index_of(const f_vector_t *, const void *item);
 #endif
 
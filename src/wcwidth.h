@@ -11,4 +11,19 @@ int mk_wcswidth(const wchar_t *pwcs, size_t n);
 
 #endif /* FT_HAVE_WCHAR */
 
+#ifdef FT_HAVE_UTF8
+#include "utf8.h"
+
+/*
+ * Returns visible width of utf-8 string [beg, end) (utf8cwidth is used for
+ * codepoints).
+ */
+FT_INTERNAL
+size_t utf8_range_width(const void *beg, const void *end);
+
+/* Returns visible width of non null codepoint of utf-8 string */
+FT_INTERNAL
+size_t utf8_codepoint_width(uint32_t c);
+#endif /* FT_HAVE_UTF8 */
+
 #endif /* WCWIDTH_H */
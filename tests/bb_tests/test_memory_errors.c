@@ -137,3 +137,152 @@ void test_memory_errors(void)
     assert_true(i != ITER_MAX);
     ft_set_memory_funcs(NULL, NULL);
 }
+
+struct alloc_stats {
+    size_t mallocs;
+    size_t reallocs;
+    size_t frees;
+};
+
+static void *stats_malloc(size_t size, void *ctx)
+{
+    ((struct alloc_stats *)ctx)->mallocs++;
+    return malloc(size);
+}
+
+static void *stats_realloc(void *ptr, size_t old_size, size_t size, void *ctx)
+{
+    assert_true(ptr == NULL || old_size != 0);
+    ((struct alloc_stats *)ctx)->reallocs++;
+    if (ptr == NULL)
+        ((struct alloc_stats *)ctx)->mallocs++;
+    return realloc(ptr, size);
+}
+
+static void stats_free(void *ptr, void *ctx)
+{
+    assert_true(ptr != NULL);
+    ((struct alloc_stats *)ctx)->frees++;
+    free(ptr);
+}
+
+/* Writes to the default table passed as context while another table is printed */
+static int write_nested_table(const void *data, size_t len, void *ctx)
+{
+    (void)data;
+    (void)len;
+    return ft_write_ln((ft_table_t *)ctx, "nested", "cell") == FT_SUCCESS ? 0 : -1;
+}
+
+void test_table_allocator(void)
+{
+    struct alloc_stats global_stats = {0, 0, 0};
+    struct alloc_stats table_stats = {0, 0, 0};
+    ft_allocator_t global_allocator = {&stats_malloc, NULL, &stats_realloc, &stats_free, &global_stats};
+    ft_allocator_t table_allocator = {&stats_malloc, NULL, &stats_realloc, &stats_free, &table_stats};
+
+    WHEN("Global allocator is set") {
+        ft_allocator_t invalid_allocator = {&stats_malloc, NULL, NULL, NULL, NULL};
+        assert_true(ft_set_allocator(&invalid_allocator) == FT_EINVAL);
+        assert_true(ft_set_allocator(&global_allocator) == FT_SUCCESS);
+
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_write_ln(table, "1", "2", "3") == FT_SUCCESS);
+        assert_true(ft_to_string(table) != NULL);
+        ft_destroy_table(table);
+        assert_true(global_stats.mallocs > 0);
+        assert_true(global_stats.mallocs == global_stats.frees);
+    }
+
+    WHEN("Table has its own allocator") {
+        size_t global_mallocs = global_stats.mallocs;
+        ft_table_t *table = ft_create_table_with_allocator(&table_allocator);
+        assert_true(table != NULL);
+        int i = 0;
+        for (i = 0; i < 30; ++i) {
+            assert_true(ft_printf(table, "%d|%s", i, "cell") == 2);
+            assert_true(ft_write_u64(table, (uint64_t)i) == FT_SUCCESS);
+        }
+        assert_true(ft_ln(table) == FT_SUCCESS);
+        assert_true(ft_set_cell_prop(table, 0, 1, FT_CPROP_LEFT_PADDING, 3) == FT_SUCCESS);
+        assert_true(ft_add_separator(table) == FT_SUCCESS);
+        const char *cells[] = {"a", "b", "c", "d"};
+        assert_true(ft_table_write_ln(table, 2, 2, cells) == FT_SUCCESS);
+        assert_true(ft_to_string(table) != NULL);
+
+        ft_table_t *table_copy = ft_copy_table(table);
+        assert_true(table_copy != NULL);
+        ft_line_iter_t *iter = ft_line_iter_begin(table_copy);
+        assert_true(iter != NULL);
+        char line[1024];
+        assert_true(ft_line_iter_next(iter, line, sizeof(line), NULL) == 1);
+        ft_line_iter_end(iter);
+        ft_destroy_table(table_copy);
+        ft_destroy_table(table);
+
+        /* Memory of the table is not allocated with the global allocator */
+        assert_true(global_stats.mallocs == global_mallocs);
+        assert_true(table_stats.mallocs > 0);
+        assert_true(table_stats.reallocs > 0);
+        assert_true(table_stats.mallocs == table_stats.frees);
+    }
+
+    WHEN("Default table is written from a callback of a table with its own allocator") {
+        ft_table_t *table = ft_create_table_with_allocator(&table_allocator);
+        assert_true(table != NULL);
+        assert_true(ft_write_ln(table, "1", "2", "3") == FT_SUCCESS);
+        ft_table_t *nested = ft_create_table();
+        assert_true(nested != NULL);
+
+        size_t global_mallocs = global_stats.mallocs;
+        assert_true(ft_print_to(table, &write_nested_table, nested) == FT_SUCCESS);
+        ft_destroy_table(table);
+        assert_true(table_stats.mallocs == table_stats.frees);
+
+        /* Memory of the nested table is allocated with the global allocator */
+        assert_true(global_stats.mallocs > global_mallocs);
+        ft_destroy_table(nested);
+        assert_true(global_stats.mallocs == global_stats.frees);
+    }
+
+    WHEN("The same cells are rewritten with bulk writes") {
+        const char *row_cells[] = {"first", "second", "third"};
+        const char *table_cells[] = {"a", "b", "c", "d"};
+        int intern = 0;
+        for (intern = 0; intern <= 1; ++intern) {
+            ft_table_t *table = ft_create_table_with_allocator(&table_allocator);
+            assert_true(table != NULL);
+            assert_true(ft_set_tbl_prop(table, FT_TPROP_INTERN_STRINGS, intern) == FT_SUCCESS);
+            assert_true(ft_row_write(table, 3, row_cells) == FT_SUCCESS);
+            ft_set_cur_cell(table, 1, 0);
+            assert_true(ft_table_write(table, 2, 2, table_cells) == FT_SUCCESS);
+
+            size_t live_allocs = 0;
+            int i = 0;
+            for (i = 0; i < 1000; ++i) {
+                ft_set_cur_cell(table, 0, 0);
+                assert_true(ft_row_write(table, 3, row_cells) == FT_SUCCESS);
+                ft_set_cur_cell(table, 1, 0);
+                assert_true(ft_table_write(table, 2, 2, table_cells) == FT_SUCCESS);
+                if (i == 0)
+                    live_allocs = table_stats.mallocs - table_stats.frees;
+            }
+            /* Rewritten cells release their previous content */
+            assert_true(table_stats.mallocs - table_stats.frees == live_allocs);
+
+            ft_table_t *expected = ft_create_table();
+            assert_true(expected != NULL);
+            assert_true(ft_write_ln(expected, "first", "second", "third") == FT_SUCCESS);
+            assert_true(ft_write_ln(expected, "a", "b") == FT_SUCCESS);
+            assert_true(ft_write_ln(expected, "c", "d") == FT_SUCCESS);
+            assert_str_equal(ft_to_string(table), ft_to_string(expected));
+            ft_destroy_table(expected);
+            ft_destroy_table(table);
+            assert_true(table_stats.mallocs == table_stats.frees);
+        }
+    }
+
+    assert_true(ft_set_allocator(NULL) == FT_SUCCESS);
+    assert_true(global_stats.mallocs == global_stats.frees);
+}
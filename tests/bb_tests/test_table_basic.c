@@ -189,6 +189,23 @@ void test_bug_fixes(void)
     }
 #endif /* FT_HAVE_UTF8 */
 
+#ifdef FT_HAVE_UTF8
+    SCENARIO("Cells written with ft_u8printf are utf-8 cells") {
+        ft_table_t *table = ft_create_table();
+        ft_u8printf_ln(table, "%s|%s", "視野", "x");
+        ft_u8write_ln(table, "ab", "y");
+        const char *table_str = ft_to_u8string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+------+---+\n"
+            "| 視野 | x |\n"
+            "| ab   | y |\n"
+            "+------+---+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+#endif /* FT_HAVE_UTF8 */
+
     SCENARIO("Issue 37 - https://github.com/seleznevae/libfort/issues/37") {
         ft_table_t *table = ft_create_table();
         ft_set_border_style(table, FT_BASIC_STYLE);
@@ -730,6 +747,22 @@ void test_table_basic(void)
         assert_wcs_equal(table_str, table_str_etalon);
         ft_destroy_table(table);
     }
+
+    WHEN("Cells have zero-width chars (wide strings)") {
+        table = ft_create_table();
+        assert_true(table != NULL);
+
+        assert_true(ft_wwrite_ln(table, L"a\u0302b", L"e\u0301", L"\u200b") == FT_SUCCESS);
+
+        const wchar_t *table_str = ft_to_wstring(table);
+        assert_true(table_str != NULL);
+        const wchar_t *table_str_etalon =
+            L"+----+---+--+\n"
+            L"| a\u0302b | e\u0301 | \u200b |\n"
+            L"+----+---+--+\n";
+        assert_wcs_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
 #endif
 
     WHEN("Multiline conten") {
@@ -975,6 +1008,68 @@ void test_utf8_table(void)
 #undef TEST_UTF8_STYLE_WIDE
 
 }
+
+void test_utf8_invalid_content(void)
+{
+    WHEN("Invalid content is kept") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_border_style(table, FT_EMPTY_STYLE) == 0);
+        assert_true(ft_u8write_ln(table, "a\xff", "\xd0\xb0\xd0") == FT_SUCCESS);
+        const char *table_str = (const char *)ft_to_u8string(table);
+        assert_true(table_str != NULL);
+        assert_true(strstr(table_str, "a\xff") != NULL);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Invalid content is rejected") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_INVALID_UTF8, FT_INVALID_UTF8_REJECT) == FT_SUCCESS);
+        assert_true(ft_u8write(table, "\xe4\xb8\xad") == FT_SUCCESS);
+        assert_true(ft_u8write(table, "\xe4\xb8") == FT_EINVAL);
+        assert_true(ft_u8write_len(table, "\xe4\xb8\xad", 2) == FT_EINVAL);
+        assert_true(ft_u8write(table, "\xc0\xaf") == FT_EINVAL);          /* overlong form */
+        assert_true(ft_u8write(table, "\xed\xa0\x80") == FT_EINVAL);     /* surrogate */
+        assert_true(ft_u8write(table, "\xf4\x90\x80\x80") == FT_EINVAL); /* after U+10FFFF */
+        assert_true(ft_u8printf(table, "%s|%s", "ok", "\x80") < 0);
+        assert_true(ft_cur_col(table) == 1);
+
+        char *owned = (char *)malloc(4);
+        assert_true(owned != NULL);
+        memcpy(owned, "x\xfey", 4);
+        /* Ownership isn't transferred in case of error */
+        assert_true(ft_u8write_owned(table, owned, 3, &free) == FT_EINVAL);
+        free(owned);
+
+        assert_true(ft_u8write(table, "\xf0\x9f\x98\x80") == FT_SUCCESS);
+        assert_true(ft_cur_col(table) == 2);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Invalid content is replaced") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_border_style(table, FT_EMPTY_STYLE) == 0);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_INVALID_UTF8, FT_INVALID_UTF8_REPLACE) == FT_SUCCESS);
+        assert_true(ft_u8write_ln(table, "a\xff" "b", "\xd0\xb0\xe4\xb8") == FT_SUCCESS);
+        assert_true(ft_u8printf_ln(table, "%s|c", "\xc0\xaf") == 2);
+        const char *table_str = (const char *)ft_to_u8string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            " a\xef\xbf\xbd" "b  \xd0\xb0\xef\xbf\xbd\xef\xbf\xbd \n"
+            " \xef\xbf\xbd\xef\xbf\xbd   c   \n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Property value is invalid") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_INVALID_UTF8, FT_INVALID_UTF8_REPLACE + 1) == FT_EINVAL);
+        ft_destroy_table(table);
+    }
+}
 #endif /* FT_HAVE_UTF8 */
 
 void test_table_write(void)
@@ -2108,3 +2203,1247 @@ void test_table_erase(void)
 
 
 }
+
+
+static const char *virtual_table_cells[3][4] = {
+    {"Movie title", "Director", "Year", "Rating"},
+    {"The Shawshank Redemption", "Frank Darabont", "1994", "9.5"},
+    {"The Godfather", NULL, "1972", "9.2"},
+};
+
+static size_t virtual_provider_calls = 0;
+
+static const char *virtual_table_provider(size_t row, size_t col, void *ctx)
+{
+    const char *(*cells)[4] = (const char *(*)[4])ctx;
+    ++virtual_provider_calls;
+    return cells[row][col];
+}
+
+void test_table_virtual(void)
+{
+    WHEN("Virtual table") {
+        ft_table_t *table = ft_create_virtual_table(3, 4, virtual_table_provider, virtual_table_cells);
+        assert_true(table != NULL);
+        assert_true(ft_row_count(table) == 3);
+        assert_true(ft_col_count(table) == 4);
+        assert_true(ft_is_empty(table) == 0);
+
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+        ft_set_cell_prop(table, 0, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE, FT_ROW_HEADER);
+        ft_set_cell_prop(table, FT_ANY_ROW, 3, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+
+        virtual_provider_calls = 0;
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_true(virtual_provider_calls > 0);
+        const char *table_str_etalon =
+            "+--------------------------+----------------+------+--------+\n"
+            "| Movie title              | Director       | Year | Rating |\n"
+            "+--------------------------+----------------+------+--------+\n"
+            "| The Shawshank Redemption | Frank Darabont | 1994 |    9.5 |\n"
+            "| The Godfather            |                | 1972 |    9.2 |\n"
+            "+--------------------------+----------------+------+--------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        assert_true(ft_write(table, "1") == FT_EINVAL);
+        assert_true(ft_printf(table, "%d", 1) < 0);
+        assert_true(ft_erase_range(table, 0, 0, 0, 0) == FT_EINVAL);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Virtual table with spans and separators") {
+        ft_table_t *table = ft_create_virtual_table(3, 4, virtual_table_provider, virtual_table_cells);
+        assert_true(table != NULL);
+
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+        assert_true(ft_set_cell_span(table, 2, 0, 2) == FT_SUCCESS);
+        ft_set_cur_cell(table, 1, 0);
+        assert_true(ft_add_separator(table) == FT_SUCCESS);
+
+        ft_table_t *table_copy = ft_copy_table(table);
+        assert_true(table_copy != NULL);
+
+        const char *table_str = ft_to_string(table_copy);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+--------------------------+----------------+------+--------+\n"
+            "| Movie title              | Director       | Year | Rating |\n"
+            "+--------------------------+----------------+------+--------+\n"
+            "| The Shawshank Redemption | Frank Darabont | 1994 | 9.5    |\n"
+            "| The Godfather                             | 1972 | 9.2    |\n"
+            "+-------------------------------------------+------+--------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+        ft_destroy_table(table_copy);
+    }
+
+    WHEN("Empty virtual table") {
+        ft_table_t *table = ft_create_virtual_table(0, 0, virtual_table_provider, NULL);
+        assert_true(table != NULL);
+        assert_true(ft_is_empty(table));
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_str_equal(table_str, "");
+        ft_destroy_table(table);
+
+        assert_true(ft_create_virtual_table(1, 1, NULL, NULL) == NULL);
+    }
+}
+
+
+void test_table_render_rows(void)
+{
+    WHEN("Rows of the table are rendered by parts") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+        ft_set_cell_prop(table, 0, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE, FT_ROW_HEADER);
+
+        assert_true(ft_write_ln(table, "N", "Name", "Value") == FT_SUCCESS);
+        assert_true(ft_write_ln(table, "1", "a", "10") == FT_SUCCESS);
+        assert_true(ft_add_separator(table) == FT_SUCCESS);
+        assert_true(ft_write_ln(table, "2", "Long name", "2") == FT_SUCCESS);
+        assert_true(ft_write_ln(table, "3", "c", "3") == FT_SUCCESS);
+
+        const char *table_str = ft_render_rows(table, 0, 4);
+        assert_true(table_str != NULL);
+        char *full_str = strdup(table_str);
+        assert_str_equal(full_str, ft_to_string(table));
+        free(full_str);
+
+        table_str = ft_render_rows(table, 1, 2);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+---+-----------+-------+\n"
+            "| 1 | a         | 10    |\n"
+            "+---+-----------+-------+\n"
+            "| 2 | Long name | 2     |\n"
+            "+---+-----------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        table_str = ft_render_rows(table, 3, 100);
+        assert_true(table_str != NULL);
+        table_str_etalon =
+            "+---+-----------+-------+\n"
+            "| 3 | c         | 3     |\n"
+            "+---+-----------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        assert_str_equal(ft_render_rows(table, 4, 1), "");
+        assert_str_equal(ft_render_rows(table, 0, 0), "");
+
+        /* Cached geometry is dropped after table modification */
+        assert_true(ft_write_ln(table, "4", "d", "Long value") == FT_SUCCESS);
+        table_str = ft_render_rows(table, 3, 1);
+        assert_true(table_str != NULL);
+        table_str_etalon =
+            "+---+-----------+------------+\n"
+            "| 3 | c         | 3          |\n"
+            "+---+-----------+------------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Rows of virtual table are rendered by parts") {
+        ft_table_t *table = ft_create_virtual_table(3, 4, virtual_table_provider, virtual_table_cells);
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        const char *table_str = ft_render_rows(table, 2, 1);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+--------------------------+----------------+------+--------+\n"
+            "| The Godfather            |                | 1972 | 9.2    |\n"
+            "+--------------------------+----------------+------+--------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+}
+
+
+static int free_calls = 0;
+
+static void test_free(void *ptr)
+{
+    free_calls++;
+    free(ptr);
+}
+
+void test_table_write_external(void)
+{
+    WHEN("Borrowed and owned strings are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        char borrowed[] = "borrowed";
+        free_calls = 0;
+        assert_true(ft_write_borrowed(table, borrowed) == FT_SUCCESS);
+        assert_true(ft_write_owned(table, strdup("owned"), 5, test_free) == FT_SUCCESS);
+        assert_true(ft_ln(table) == FT_SUCCESS);
+        assert_true(ft_write(table, "1", "2") == FT_SUCCESS);
+
+        char *bad_len = strdup("abc");
+        assert_true(ft_write_owned(table, bad_len, 2, test_free) == FT_EINVAL);
+        assert_true(ft_write_owned(table, bad_len, 3, NULL) == FT_EINVAL);
+        assert_true(ft_write_borrowed(table, NULL) == FT_EINVAL);
+        free(bad_len);
+
+        ft_table_t *table_copy = ft_copy_table(table);
+        assert_true(table_copy != NULL);
+
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+----------+-------+\n"
+            "| borrowed | owned |\n"
+            "| 1        | 2     |\n"
+            "+----------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        /* Owned string is released when it is replaced */
+        ft_set_cur_cell(table, 0, 1);
+        assert_true(ft_write(table, "new") == FT_SUCCESS);
+        assert_true(free_calls == 1);
+
+        /* Copy of the table doesn't depend on borrowed strings */
+        borrowed[0] = 'B';
+        table_str = ft_to_string(table_copy);
+        assert_true(table_str != NULL);
+        assert_str_equal(table_str, table_str_etalon);
+
+        assert_true(ft_write_owned(table, strdup("owned"), 5, test_free) == FT_SUCCESS);
+        ft_destroy_table(table);
+        ft_destroy_table(table_copy);
+        assert_true(free_calls == 2);
+    }
+
+    WHEN("Strings that belong to other objects are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+
+        /* Owner is released instead of the string */
+        struct owned_string {
+            char data[8];
+        };
+        struct owned_string *owner = (struct owned_string *)malloc(sizeof(struct owned_string));
+        assert_true(owner != NULL);
+        strcpy(owner->data, "owner");
+        free_calls = 0;
+        assert_true(ft_write_owned_by(table, owner->data, 5, test_free, NULL) == FT_EINVAL);
+        assert_true(ft_write_owned_by(table, owner->data, 4, test_free, owner) == FT_EINVAL);
+        assert_true(ft_write_owned_by(table, owner->data, 5, test_free, owner) == FT_SUCCESS);
+
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_true(strstr(table_str, " owner ") != NULL);
+
+        ft_set_cur_cell(table, 0, 0);
+        assert_true(ft_write(table, "new") == FT_SUCCESS);
+        assert_true(free_calls == 1);
+        ft_destroy_table(table);
+    }
+
+#ifdef FT_HAVE_WCHAR
+    WHEN("Borrowed and owned wide strings are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        assert_true(ft_wwrite_borrowed(table, L"borrowed") == FT_SUCCESS);
+        wchar_t *owned = (wchar_t *)malloc(sizeof(L"owned"));
+        assert_true(owned != NULL);
+        memcpy(owned, L"owned", sizeof(L"owned"));
+        assert_true(ft_wwrite_owned(table, owned, 5, free) == FT_SUCCESS);
+
+        const wchar_t *table_str = ft_to_wstring(table);
+        assert_true(table_str != NULL);
+        const wchar_t *table_str_etalon =
+            L"+----------+-------+\n"
+            L"| borrowed | owned |\n"
+            L"+----------+-------+\n";
+        assert_wcs_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+#endif
+
+#ifdef FT_HAVE_UTF8
+    WHEN("Borrowed and owned utf8 strings are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        assert_true(ft_u8write_borrowed(table, "Привет") == FT_SUCCESS);
+        assert_true(ft_u8write_owned(table, strdup("Мир"), strlen("Мир"), free) == FT_SUCCESS);
+
+        const char *table_str = (const char *)ft_to_u8string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+--------+-----+\n"
+            "| Привет | Мир |\n"
+            "+--------+-----+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+#endif
+}
+
+
+void test_table_write_len(void)
+{
+    WHEN("Strings with specified length are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        const char *data = "first|second line\nthird";
+        assert_true(ft_write_len(table, data, 5) == FT_SUCCESS);
+        assert_true(ft_write_len(table, data + 6, 18) == FT_SUCCESS);
+        assert_true(ft_write_len(table, "abc\0def", 7) == FT_SUCCESS);
+        assert_true(ft_write_len(table, data, 0) == FT_SUCCESS);
+        assert_true(ft_write_len(table, NULL, 0) == FT_EINVAL);
+
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+-------+-------------+-----+--+\n"
+            "| first | second line | abc |  |\n"
+            "|       | third       |     |  |\n"
+            "+-------+-------------+-----+--+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+
+#ifdef FT_HAVE_WCHAR
+    WHEN("Wide strings with specified length are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        assert_true(ft_wwrite_len(table, L"first|second", 5) == FT_SUCCESS);
+        assert_true(ft_wwrite_len(table, L"\x4e2d\x6587text", 2) == FT_SUCCESS);
+
+        const wchar_t *table_str = ft_to_wstring(table);
+        assert_true(table_str != NULL);
+        const wchar_t *table_str_etalon =
+            L"+-------+------+\n"
+            L"| first | \x4e2d\x6587 |\n"
+            L"+-------+------+\n";
+        assert_wcs_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+#endif
+
+#ifdef FT_HAVE_UTF8
+    WHEN("Utf8 strings with specified length are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        const char *data = "Привет|Мир";
+        assert_true(ft_u8write_len(table, data, strlen("Привет")) == FT_SUCCESS);
+        assert_true(ft_u8write_len(table, "ascii|", 5) == FT_SUCCESS);
+
+        const char *table_str = (const char *)ft_to_u8string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+--------+-------+\n"
+            "| Привет | ascii |\n"
+            "+--------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+#endif
+}
+
+
+void test_table_write_column(void)
+{
+    WHEN("Numeric columns are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        const int64_t i64_values[] = {0, -7, 1234567, INT64_MIN};
+        const uint64_t u64_values[] = {255, 10, UINT64_MAX};
+        const double f64_values[] = {0.5, -2.25, 1e20, 3};
+
+        assert_true(ft_write(table, "i64", "u64", "hex", "f64") == FT_SUCCESS);
+        assert_true(ft_write_column_i64(table, 0, 1, i64_values, 4, NULL) == FT_SUCCESS);
+        assert_true(ft_write_column_u64(table, 1, 1, u64_values, 3, NULL) == FT_SUCCESS);
+        assert_true(ft_write_column_u64(table, 2, 1, u64_values, 2, "0x%04X") == FT_SUCCESS);
+        assert_true(ft_write_column_f64(table, 3, 1, f64_values, 4, NULL) == FT_SUCCESS);
+        assert_true(ft_cur_row(table) == 0);
+        assert_true(ft_cur_col(table) == 4);
+
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+----------------------+----------------------+--------+-------+\n"
+            "| i64                  | u64                  | hex    | f64   |\n"
+            "| 0                    | 255                  | 0x00FF | 0.5   |\n"
+            "| -7                   | 10                   | 0x000A | -2.25 |\n"
+            "| 1234567              | 18446744073709551615 |        | 1e+20 |\n"
+            "| -9223372036854775808 |                      |        | 3     |\n"
+            "+----------------------+----------------------+--------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        /* Old content is replaced */
+        assert_true(ft_write_column_f64(table, 3, 1, f64_values, 2, "%.1f%%") == FT_SUCCESS);
+        assert_true(ft_write_column_i64(table, 0, 3, i64_values, 2, "%+d") == FT_SUCCESS);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        table_str_etalon =
+            "+-----+----------------------+--------+-------+\n"
+            "| i64 | u64                  | hex    | f64   |\n"
+            "| 0   | 255                  | 0x00FF | 0.5%  |\n"
+            "| -7  | 10                   | 0x000A | -2.2% |\n"
+            "| +0  | 18446744073709551615 |        | 1e+20 |\n"
+            "| -7  |                      |        | 3     |\n"
+            "+-----+----------------------+--------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        /* Long formatted numbers */
+        assert_true(ft_write_column_f64(table, 4, 0, f64_values, 1, "%40.3f") == FT_SUCCESS);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_true(strstr(table_str, "                                   0.500 |") != NULL);
+
+        /* Invalid format specifications */
+        assert_true(ft_write_column_i64(table, 0, 0, i64_values, 1, "%f") == FT_EINVAL);
+        assert_true(ft_write_column_i64(table, 0, 0, i64_values, 1, "%lld") == FT_EINVAL);
+        assert_true(ft_write_column_i64(table, 0, 0, i64_values, 1, "%d %d") == FT_EINVAL);
+        assert_true(ft_write_column_u64(table, 0, 0, u64_values, 1, "no spec") == FT_EINVAL);
+        assert_true(ft_write_column_f64(table, 0, 0, f64_values, 1, "%*f") == FT_EINVAL);
+        assert_true(ft_write_column_f64(table, 0, 0, NULL, 1, NULL) == FT_EINVAL);
+
+        /* Specifications without text may be given without '%' */
+        assert_true(ft_write_column_f64(table, 4, 0, f64_values, 1, ".2f") == FT_SUCCESS);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_true(strstr(table_str, "| 0.50 |") != NULL);
+        assert_true(ft_write_column_i64(table, 0, 0, i64_values, 1, "+d") == FT_SUCCESS);
+        assert_true(ft_write_column_f64(table, 4, 0, f64_values, 1, ".2f ms") == FT_EINVAL);
+        assert_true(ft_write_column_f64(table, 4, 0, f64_values, 1, ".2") == FT_EINVAL);
+        assert_true(ft_write_column_f64(table, 0, 0, NULL, 0, NULL) == FT_SUCCESS);
+        ft_destroy_table(table);
+    }
+}
+
+void test_table_typed_values(void)
+{
+    WHEN("Typed values are written to the table") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_set_border_style(table, FT_BASIC_STYLE);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+
+        assert_true(ft_write_ln(table, "id", "size", "ratio", "ok") == FT_SUCCESS);
+        assert_true(ft_write_i64(table, -15) == FT_SUCCESS);
+        assert_true(ft_write_u64(table, UINT64_MAX) == FT_SUCCESS);
+        assert_true(ft_write_f64(table, 0.25) == FT_SUCCESS);
+        assert_true(ft_write_bool(table, 1) == FT_SUCCESS);
+        assert_true(ft_ln(table) == FT_SUCCESS);
+        assert_true(ft_write_i64(table, INT64_MIN) == FT_SUCCESS);
+        assert_true(ft_write_u64(table, 0) == FT_SUCCESS);
+        assert_true(ft_write_f64(table, 1e-7) == FT_SUCCESS);
+        assert_true(ft_write_bool(table, 0) == FT_SUCCESS);
+        assert_true(ft_cur_row(table) == 2);
+        assert_true(ft_cur_col(table) == 4);
+
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+----------------------+----------------------+-------+-------+\n"
+            "| id                   | size                 | ratio | ok    |\n"
+            "| -15                  | 18446744073709551615 | 0.25  | true  |\n"
+            "| -9223372036854775808 | 0                    | 1e-07 | false |\n"
+            "+----------------------+----------------------+-------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        /* Column formats are applied to numbers of the types they suit */
+        assert_true(ft_set_column_format(table, 0, "#%d") == FT_SUCCESS);
+        assert_true(ft_set_column_format(table, 1, "%x") == FT_SUCCESS);
+        assert_true(ft_set_column_format(table, 2, "%.1f%%") == FT_SUCCESS);
+        assert_true(ft_set_column_format(table, 3, "%d") == FT_SUCCESS);
+        assert_true(ft_set_cell_prop(table, FT_ANY_ROW, 2, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT) == FT_SUCCESS);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        table_str_etalon =
+            "+-----------------------+------------------+-------+-------+\n"
+            "| id                    | size             | ratio | ok    |\n"
+            "| #-15                  | ffffffffffffffff |  0.2% | true  |\n"
+            "| #-9223372036854775808 | 0                |  0.0% | false |\n"
+            "+-----------------------+------------------+-------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        /* Copies keep typed values and column formats */
+        ft_table_t *table_copy = ft_copy_table(table);
+        assert_true(table_copy != NULL);
+        table_str = ft_to_string(table_copy);
+        assert_true(table_str != NULL);
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table_copy);
+
+        assert_true(ft_set_column_format(table, 2, ".3f") == FT_SUCCESS);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_true(strstr(table_str, "| 0.250 |") != NULL);
+        assert_true(ft_set_column_format(table, 2, "%.1f%%") == FT_SUCCESS);
+
+        /* Text replaces typed value and vice versa */
+        assert_true(ft_set_column_format(table, 0, NULL) == FT_SUCCESS);
+        assert_true(ft_set_column_format(table, 1, NULL) == FT_SUCCESS);
+        ft_set_cur_cell(table, 1, 0);
+        assert_true(ft_write(table, "text") == FT_SUCCESS);
+        ft_set_cur_cell(table, 0, 1);
+        assert_true(ft_write_u64(table, 42) == FT_SUCCESS);
+        const int64_t i64_values[] = {7};
+        assert_true(ft_write_column_i64(table, 0, 2, i64_values, 1, NULL) == FT_SUCCESS);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        table_str_etalon =
+            "+------+----------------------+-------+-------+\n"
+            "| id   | 42                   | ratio | ok    |\n"
+            "| text | 18446744073709551615 |  0.2% | true  |\n"
+            "| 7    | 0                    |  0.0% | false |\n"
+            "+------+----------------------+-------+-------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+#ifdef FT_HAVE_WCHAR
+        ft_table_t *wtable = ft_create_table();
+        assert_true(wtable != NULL);
+        ft_set_border_style(wtable, FT_BASIC_STYLE);
+        ft_set_cell_prop(wtable, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        ft_set_cell_prop(wtable, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+        assert_true(ft_set_column_format(wtable, 1, "%40.3f") == FT_SUCCESS);
+        assert_true(ft_wwrite(wtable, L"n") == FT_SUCCESS);
+        assert_true(ft_write_f64(wtable, 2.5) == FT_SUCCESS);
+        const wchar_t *wtable_str = ft_to_wstring(wtable);
+        assert_true(wtable_str != NULL);
+        assert_wcs_equal(wtable_str,
+                         L"+---+------------------------------------------+\n"
+                         L"| n |                                    2.500 |\n"
+                         L"+---+------------------------------------------+\n");
+        ft_destroy_table(wtable);
+#endif
+
+        /* Invalid format specifications */
+        assert_true(ft_set_column_format(table, 0, "no spec") == FT_EINVAL);
+        assert_true(ft_set_column_format(table, 0, "%s") == FT_EINVAL);
+        ft_destroy_table(table);
+    }
+}
+
+void test_table_printf_compiled(void)
+{
+    WHEN("Rows are printed with compiled format") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_table_t *etalon_table = ft_create_table();
+        assert_true(etalon_table != NULL);
+
+        ft_row_format_t *format = ft_compile_row_format("%d|%-4s|%5.2f||%*lld|%zu%%|%c%hd%ls");
+        assert_true(format != NULL);
+        int i = 0;
+        for (i = 0; i < 3; ++i) {
+            assert_true(ft_printf_compiled_ln(table, format, i, "ab", 3.14159 * i, 6, (long long)i * 1000,
+                                              (size_t)42, 'x', (short)i, L"") == 7);
+            assert_true(ft_printf_ln(etalon_table, "%d|%-4s|%5.2f||%*lld|%zu%%|%c%hd%ls", i, "ab", 3.14159 * i, 6,
+                                     (long long)i * 1000, (size_t)42, 'x', (short)i, L"") == 7);
+        }
+        assert_true(ft_cur_row(table) == 3);
+
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        const char *etalon_str = ft_to_string(etalon_table);
+        assert_true(etalon_str != NULL);
+        assert_str_equal(table_str, etalon_str);
+
+        /* Separators in the printed data don't split cells */
+        ft_destroy_row_format(format);
+        format = ft_compile_row_format("%s|%s");
+        assert_true(format != NULL);
+        ft_set_cur_cell(table, 0, 1);
+        assert_true(ft_printf_compiled(table, format, "a|b", "c") == 2);
+        assert_true(ft_cur_col(table) == 3);
+        assert_true(ft_col_count(table) == 7);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_true(strstr(table_str, " a|b ") != NULL);
+        ft_destroy_row_format(format);
+
+        /* Long fields and fields of tables with interned strings */
+        ft_table_t *interned_table = ft_create_table();
+        assert_true(interned_table != NULL);
+        assert_true(ft_set_tbl_prop(interned_table, FT_TPROP_INTERN_STRINGS, 1) == FT_SUCCESS);
+        format = ft_compile_row_format("%0300d|%s");
+        assert_true(format != NULL);
+        assert_true(ft_printf_compiled_ln(interned_table, format, 7, "ab") == 2);
+        assert_true(ft_printf_compiled_ln(interned_table, format, 7, "ab") == 2);
+        table_str = ft_to_string(interned_table);
+        assert_true(table_str != NULL);
+        const char *long_field = strstr(table_str, "| 000");
+        assert_true(long_field != NULL);
+        assert_true(strncmp(long_field + 2 + 299, "7 | ab |\n| 000", 14) == 0);
+        ft_destroy_row_format(format);
+        ft_destroy_table(interned_table);
+
+        /* Unsupported format strings */
+        assert_true(ft_compile_row_format(NULL) == NULL);
+        assert_true(ft_compile_row_format("%") == NULL);
+        assert_true(ft_compile_row_format("%d|%q") == NULL);
+        assert_true(ft_compile_row_format("%1$d") == NULL);
+
+        ft_destroy_table(etalon_table);
+        ft_destroy_table(table);
+    }
+}
+
+struct output_collector {
+    char *data;
+    size_t sz;
+    size_t calls;
+    size_t fail_after;
+};
+
+static int collect_output(const void *data, size_t len, void *ctx)
+{
+    struct output_collector *collector = (struct output_collector *)ctx;
+    if (++collector->calls > collector->fail_after)
+        return -1;
+    char *new_data = (char *)realloc(collector->data, collector->sz + len + 1);
+    if (new_data == NULL)
+        return -1;
+    memcpy(new_data + collector->sz, data, len);
+    collector->data = new_data;
+    collector->sz += len;
+    collector->data[collector->sz] = '\0';
+    return 0;
+}
+
+#ifdef FT_HAVE_WCHAR
+static int collect_woutput(const void *data, size_t len, void *ctx)
+{
+    struct output_collector *collector = (struct output_collector *)ctx;
+    char *new_data = (char *)realloc(collector->data, (collector->sz + len + 1) * sizeof(wchar_t));
+    if (new_data == NULL)
+        return -1;
+    memcpy(new_data + collector->sz * sizeof(wchar_t), data, len * sizeof(wchar_t));
+    collector->data = new_data;
+    collector->sz += len;
+    ((wchar_t *)collector->data)[collector->sz] = L'\0';
+    return 0;
+}
+#endif
+
+void test_table_print_to(void)
+{
+    WHEN("Table is printed to callback") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_TOP_MARGIN, 1) == FT_SUCCESS);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_BOTTOM_MARGIN, 2) == FT_SUCCESS);
+
+        struct output_collector collector = {NULL, 0, 0, (size_t) -1};
+        assert_true(ft_print_to(table, collect_output, &collector) == FT_SUCCESS);
+        assert_true(collector.calls == 0);
+
+        /* Output of big tables is passed by chunks */
+        int i = 0;
+        for (i = 0; i < 300; ++i) {
+            assert_true(ft_printf_ln(table, "%d|%s|%d", i, i % 7 ? "cell" : "multi\nline", i * i) == 3);
+        }
+        assert_true(ft_print_to(table, collect_output, &collector) == FT_SUCCESS);
+        assert_true(collector.calls > 1);
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        assert_str_equal(collector.data, table_str);
+
+        /* Errors of the callback stop printing */
+        free(collector.data);
+        collector.data = NULL;
+        collector.sz = 0;
+        collector.calls = 0;
+        collector.fail_after = 1;
+        assert_true(ft_print_to(table, collect_output, &collector) == FT_GEN_ERROR);
+        assert_true(collector.calls == 2);
+        assert_true(ft_print_to(table, NULL, &collector) == FT_EINVAL);
+        free(collector.data);
+
+#ifdef FT_HAVE_UTF8
+        collector.data = NULL;
+        collector.sz = 0;
+        collector.calls = 0;
+        collector.fail_after = (size_t) -1;
+        assert_true(ft_set_border_style(table, FT_DOUBLE2_STYLE) == FT_SUCCESS);
+        assert_true(ft_u8print_to(table, collect_output, &collector) == FT_SUCCESS);
+        const char *u8table_str = (const char *)ft_to_u8string(table);
+        assert_true(u8table_str != NULL);
+        assert_str_equal(collector.data, u8table_str);
+        free(collector.data);
+#endif
+        ft_destroy_table(table);
+
+#ifdef FT_HAVE_WCHAR
+        table = ft_create_table();
+        assert_true(table != NULL);
+        for (i = 0; i < 100; ++i) {
+            assert_true(ft_wwrite_ln(table, L"wide", L"cells") == FT_SUCCESS);
+        }
+        collector.data = NULL;
+        collector.sz = 0;
+        assert_true(ft_wprint_to(table, collect_woutput, &collector) == FT_SUCCESS);
+        const wchar_t *wtable_str = ft_to_wstring(table);
+        assert_true(wtable_str != NULL);
+        assert_wcs_equal((const wchar_t *)collector.data, wtable_str);
+        free(collector.data);
+        ft_destroy_table(table);
+#endif
+    }
+
+#if defined(FT_HAVE_WCHAR) && defined(FT_HAVE_UTF8)
+    WHEN("Table with char, wide and utf-8 cells is printed") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_write(table, "id") == FT_SUCCESS);
+        assert_true(ft_wwrite(table, L"\x0434\x0430\x0442\x0430") == FT_SUCCESS);
+        assert_true(ft_u8write_ln(table, "r\xc3\xa9sum\xc3\xa9") == FT_SUCCESS);
+        assert_true(ft_write(table, "1") == FT_SUCCESS);
+        assert_true(ft_wwrite(table, L"\x8868\nab") == FT_SUCCESS);
+        assert_true(ft_u8write_ln(table, "caf\xc3\xa9") == FT_SUCCESS);
+
+        /* Wide content is encoded to utf-8 */
+        const char *table_str_etalon =
+            "+----+------+--------+\n"
+            "| id | \xd0\xb4\xd0\xb0\xd1\x82\xd0\xb0 | r\xc3\xa9sum\xc3\xa9 |\n"
+            "| 1  | \xe8\xa1\xa8   | caf\xc3\xa9   |\n"
+            "|    | ab   |        |\n"
+            "+----+------+--------+\n";
+        const char *table_str = (const char *)ft_to_u8string(table);
+        assert_true(table_str != NULL);
+        assert_str_equal(table_str, table_str_etalon);
+
+        struct output_collector collector = {NULL, 0, 0, (size_t) -1};
+        assert_true(ft_u8print_to(table, collect_output, &collector) == FT_SUCCESS);
+        assert_str_equal(collector.data, table_str_etalon);
+        free(collector.data);
+
+        /* Utf-8 and char content is decoded to wide chars */
+        const wchar_t *wtable_str_etalon =
+            L"+----+------+--------+\n"
+            L"| id | \x0434\x0430\x0442\x0430 | r\x00e9sum\x00e9 |\n"
+            L"| 1  | \x8868   | caf\x00e9   |\n"
+            L"|    | ab   |        |\n"
+            L"+----+------+--------+\n";
+        const wchar_t *wtable_str = ft_to_wstring(table);
+        assert_true(wtable_str != NULL);
+        assert_wcs_equal(wtable_str, wtable_str_etalon);
+
+        /* Wide content can't be printed to char strings */
+        assert_true(ft_to_string(table) == NULL);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Mixed table is printed to utf-8 after failed conversion to char string") {
+        ft_table_t *table = ft_create_table();
+        ft_table_t *table_copy = ft_create_table();
+        assert_true(table != NULL && table_copy != NULL);
+        assert_true(ft_write_ln(table, "a", "b") == FT_SUCCESS);
+        assert_true(ft_write_ln(table_copy, "a", "b") == FT_SUCCESS);
+        int i = 0;
+        for (i = 0; i < 5; ++i) {
+            /* Codepoints that take 4 bytes in utf-8 */
+            const wchar_t *cells[] = {L"\U0001D538\U0001D538\U0001D538\U0001D538\U0001D538\U0001D538",
+                                      L"\U0001D539\U0001D539\U0001D539\U0001D539\U0001D539"
+                                     };
+            assert_true(ft_row_wwrite_ln(table, 2, cells) == FT_SUCCESS);
+            assert_true(ft_row_wwrite_ln(table_copy, 2, cells) == FT_SUCCESS);
+        }
+
+        assert_true(ft_to_string(table) == NULL);
+
+        const char *table_str = (const char *)ft_to_u8string(table);
+        const char *table_str_etalon = (const char *)ft_to_u8string(table_copy);
+        assert_true(table_str != NULL);
+        assert_true(table_str_etalon != NULL);
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+        ft_destroy_table(table_copy);
+    }
+#endif /* defined(FT_HAVE_WCHAR) && defined(FT_HAVE_UTF8) */
+
+#ifdef FT_HAVE_UTF8
+    WHEN("Table with char and utf-8 cells is printed to char string") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_write_ln(table, "a", "b") == FT_SUCCESS);
+        int i = 0;
+        for (i = 0; i < 5; ++i) {
+            /* Codepoints that take 4 bytes in utf-8 */
+            assert_true(ft_u8write_ln(table,
+                                      "\xf0\x9d\x94\xb8\xf0\x9d\x94\xb8\xf0\x9d\x94\xb8"
+                                      "\xf0\x9d\x94\xb8\xf0\x9d\x94\xb8\xf0\x9d\x94\xb8",
+                                      "\xf0\x9d\x94\xb9\xf0\x9d\x94\xb9\xf0\x9d\x94\xb9"
+                                      "\xf0\x9d\x94\xb9\xf0\x9d\x94\xb9") == FT_SUCCESS);
+        }
+
+        /* Utf-8 content is copied as it is */
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        char *table_str_copy = strdup(table_str);
+        const char *table_str_etalon = (const char *)ft_to_u8string(table);
+        assert_true(table_str_etalon != NULL);
+        assert_str_equal(table_str_copy, table_str_etalon);
+        free(table_str_copy);
+
+        struct output_collector collector = {NULL, 0, 0, (size_t) -1};
+        assert_true(ft_print_to(table, collect_output, &collector) == FT_SUCCESS);
+        assert_str_equal(collector.data, table_str_etalon);
+        free(collector.data);
+        ft_destroy_table(table);
+    }
+#endif /* FT_HAVE_UTF8 */
+}
+
+void test_table_line_iter(void)
+{
+    WHEN("Lines of the table are iterated") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_line_iter_t *iter = ft_line_iter_begin(table);
+        assert_true(iter != NULL);
+        char line[256];
+        size_t len = 0;
+        assert_true(ft_line_iter_next(iter, line, sizeof(line), &len) == 0);
+        ft_line_iter_end(iter);
+
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_TOP_MARGIN, 1) == FT_SUCCESS);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_BOTTOM_MARGIN, 2) == FT_SUCCESS);
+        assert_true(ft_set_cell_prop(table, 0, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE, FT_ROW_HEADER) == FT_SUCCESS);
+        assert_true(ft_write_ln(table, "N", "Name", "Value") == FT_SUCCESS);
+        int i = 0;
+        for (i = 0; i < 10; ++i) {
+            assert_true(ft_printf_ln(table, "%d|%s|%d", i, i % 3 ? "cell" : "multi\nline", i * i) == 3);
+            if (i == 4)
+                assert_true(ft_add_separator(table) == FT_SUCCESS);
+        }
+
+        /* Joined lines are the same as string representation */
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        size_t table_str_len = strlen(table_str);
+        char *joined = (char *)calloc(table_str_len + 1, 1);
+        assert_true(joined != NULL);
+        size_t pos = 0;
+        int n_lines = 0;
+        iter = ft_line_iter_begin(table);
+        assert_true(iter != NULL);
+        while (ft_line_iter_next(iter, line, sizeof(line), &len) == 1) {
+            assert_true(strlen(line) == len);
+            assert_true(pos + len + 1 <= table_str_len);
+            memcpy(joined + pos, line, len);
+            joined[pos + len] = '\n';
+            pos += len + 1;
+            n_lines++;
+        }
+        assert_true(ft_line_iter_next(iter, line, sizeof(line), &len) == 0);
+        ft_line_iter_end(iter);
+        assert_str_equal(joined, table_str);
+        free(joined);
+
+        /* Small buffer */
+        iter = ft_line_iter_begin(table);
+        assert_true(iter != NULL);
+        assert_true(ft_line_iter_next(iter, line, 4, &len) == FT_EINVAL);
+        assert_true(len == (size_t)(strchr(table_str, '\n') - table_str));
+        assert_true(ft_line_iter_next(iter, line, len + 1, &len) == 1);
+        assert_true(strncmp(line, table_str, len) == 0);
+
+        /* Iteration may be stopped at any moment */
+        assert_true(ft_line_iter_next(iter, line, sizeof(line), NULL) == 1);
+        ft_line_iter_end(iter);
+        assert_true(n_lines > 20);
+
+#ifdef FT_HAVE_UTF8
+        assert_true(ft_set_border_style(table, FT_DOUBLE2_STYLE) == FT_SUCCESS);
+        const char *u8table_str = (const char *)ft_to_u8string(table);
+        assert_true(u8table_str != NULL);
+        iter = ft_u8line_iter_begin(table);
+        assert_true(iter != NULL);
+        assert_true(ft_line_iter_next(iter, line, sizeof(line), &len) == 1);
+        assert_true(ft_line_iter_next(iter, line, sizeof(line), &len) == 1);
+        assert_true(strncmp(line, strchr(u8table_str, '\n') + 1, len) == 0);
+        ft_line_iter_end(iter);
+#endif
+        ft_destroy_table(table);
+    }
+}
+
+void test_table_bulk_write(void)
+{
+    WHEN("Cells are written by bulk functions") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_write(table, "a", "b") == FT_SUCCESS);
+
+        const char *cells[] = {
+            "c1", "c2", "c3",
+            "d1", "multi\nline", "d3"
+        };
+        assert_true(ft_table_write(table, 2, 3, cells) == FT_SUCCESS);
+        assert_true(ft_cur_row(table) == 1);
+        assert_true(ft_cur_col(table) == 3);
+        assert_true(ft_row_write_ln(table, 2, cells) == FT_SUCCESS);
+        assert_true(ft_row_write(table, 0, cells) == FT_SUCCESS);
+        assert_true(ft_row_count(table) == 2);
+        assert_true(ft_cur_row(table) == 2);
+        assert_true(ft_cur_col(table) == 0);
+
+        /* Content written by bulk functions may be replaced */
+        ft_set_cur_cell(table, 0, 3);
+        assert_true(ft_write(table, "new") == FT_SUCCESS);
+
+        const char *table_str_etalon =
+            "+----+-------+----+-----+----+\n"
+            "| a  | b     | c1 | new | c3 |\n"
+            "| d1 | multi | d3 | c1  | c2 |\n"
+            "|    | line  |    |     |    |\n"
+            "+----+-------+----+-----+----+\n";
+        ft_table_t *table_copy = ft_copy_table(table);
+        assert_true(table_copy != NULL);
+        ft_destroy_table(table);
+        const char *table_str = ft_to_string(table_copy);
+        assert_true(table_str != NULL);
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table_copy);
+    }
+}
+
+static size_t malloc_calls = 0;
+
+static void *counting_malloc(size_t size)
+{
+    malloc_calls++;
+    return malloc(size);
+}
+
+static size_t fill_table_and_count_mallocs(ft_table_t *table, size_t rows, size_t cols)
+{
+    size_t i = 0;
+    size_t j = 0;
+    malloc_calls = 0;
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < cols; ++j) {
+            assert_true(ft_write_i64(table, (int64_t)(i * j)) == FT_SUCCESS);
+        }
+        assert_true(ft_ln(table) == FT_SUCCESS);
+    }
+    return malloc_calls;
+}
+
+void test_table_reserve(void)
+{
+    WHEN("Memory for table is reserved") {
+        ft_set_memory_funcs(&counting_malloc, &free);
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        ft_table_t *reserved_table = ft_create_table();
+        assert_true(reserved_table != NULL);
+
+        assert_true(ft_reserve(reserved_table, 100, 30) == FT_SUCCESS);
+        assert_true(ft_reserve_cell_props(reserved_table, 50) == FT_SUCCESS);
+        assert_true(ft_is_empty(reserved_table));
+        assert_true(ft_row_count(reserved_table) == 0);
+
+        /* Rows and cells are not reallocated */
+        size_t plain_mallocs = fill_table_and_count_mallocs(table, 100, 30);
+        size_t reserved_mallocs = fill_table_and_count_mallocs(reserved_table, 100, 30);
+        assert_true(reserved_mallocs + 100 <= plain_mallocs);
+        assert_true(ft_row_count(reserved_table) == 100);
+        assert_true(ft_col_count(reserved_table) == 30);
+        assert_str_equal(ft_to_string(reserved_table), ft_to_string(table));
+
+        /* Existing rows are reserved too */
+        assert_true(ft_reserve(table, 0, 40) == FT_SUCCESS);
+        assert_true(ft_row_count(table) == 100);
+
+        ft_destroy_table(reserved_table);
+        ft_destroy_table(table);
+        ft_set_memory_funcs(NULL, NULL);
+
+        ft_table_t *virt_table = ft_create_virtual_table(1, 1, virtual_table_provider, NULL);
+        assert_true(virt_table != NULL);
+        assert_true(ft_reserve(virt_table, 10, 10) == FT_EINVAL);
+        ft_destroy_table(virt_table);
+    }
+}
+
+struct size_stats {
+    size_t live_bytes;
+};
+
+/* Size of the block is stored before the block */
+#define SIZE_HEADER_SZ 16
+
+static void *size_stats_malloc(size_t size, void *ctx)
+{
+    char *block = (char *)malloc(SIZE_HEADER_SZ + size);
+    if (block == NULL)
+        return NULL;
+    memcpy(block, &size, sizeof(size));
+    ((struct size_stats *)ctx)->live_bytes += size;
+    return block + SIZE_HEADER_SZ;
+}
+
+static void size_stats_free(void *ptr, void *ctx)
+{
+    char *block = (char *)ptr - SIZE_HEADER_SZ;
+    size_t size = 0;
+    memcpy(&size, block, sizeof(size));
+    ((struct size_stats *)ctx)->live_bytes -= size;
+    free(block);
+}
+
+/*
+ * Writes the same content to the table either jumping over empty cells with
+ * ft_set_cur_cell or writing empty cells explicitly.
+ */
+static void write_with_gap(ft_table_t *table, size_t row, size_t col, const char *content, int sparse)
+{
+    if (sparse) {
+        ft_set_cur_cell(table, row, col);
+    } else {
+        while (ft_cur_row(table) < row)
+            ft_ln(table);
+        while (ft_cur_col(table) < col)
+            assert_true(ft_write(table, "") == FT_SUCCESS);
+    }
+    assert_true(ft_write(table, content) == FT_SUCCESS);
+}
+
+static ft_table_t *create_table_with_gaps(int sparse)
+{
+    ft_table_t *table = ft_create_table();
+    assert_true(table != NULL);
+    assert_true(ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_EMPTY_STR_HEIGHT, 0) == FT_SUCCESS);
+    write_with_gap(table, 0, 0, "a", sparse);
+    write_with_gap(table, 0, 40, "b", sparse);
+    write_with_gap(table, 3, 50, "c", sparse);
+    write_with_gap(table, 3, 90, "d", sparse);
+    return table;
+}
+
+static const char *sparse_virtual_provider(size_t row, size_t col, void *ctx)
+{
+    (void)row;
+    (void)col;
+    (void)ctx;
+    return "x";
+}
+
+void test_table_sparse(void)
+{
+    WHEN("Cells are written far from each other") {
+        ft_table_t *sparse = create_table_with_gaps(1);
+        ft_table_t *dense = create_table_with_gaps(0);
+        assert_true(ft_row_count(sparse) == 4);
+        assert_true(ft_col_count(sparse) == 91);
+        assert_str_equal(ft_to_string(sparse), ft_to_string(dense));
+
+        ft_table_t *copy = ft_copy_table(sparse);
+        assert_true(copy != NULL);
+        assert_str_equal(ft_to_string(copy), ft_to_string(dense));
+        ft_destroy_table(copy);
+
+        /* Cells with content are written to the gap */
+        ft_set_cur_cell(sparse, 3, 70);
+        ft_set_cur_cell(dense, 3, 70);
+        assert_true(ft_printf(sparse, "p|q") == 2);
+        assert_true(ft_printf(dense, "p|q") == 2);
+        assert_true(ft_set_cell_span(sparse, 0, 20, 3) == FT_SUCCESS);
+        assert_true(ft_set_cell_span(dense, 0, 20, 3) == FT_SUCCESS);
+        assert_str_equal(ft_to_string(sparse), ft_to_string(dense));
+
+        /* Cells are inserted in the gap and shift following cells */
+        ft_set_tbl_prop(sparse, FT_TPROP_ADDING_STRATEGY, FT_STRATEGY_INSERT);
+        ft_set_tbl_prop(dense, FT_TPROP_ADDING_STRATEGY, FT_STRATEGY_INSERT);
+        ft_set_cur_cell(sparse, 3, 60);
+        ft_set_cur_cell(dense, 3, 60);
+        assert_true(ft_write(sparse, "i") == FT_SUCCESS);
+        assert_true(ft_write(dense, "i") == FT_SUCCESS);
+        ft_set_cur_cell(sparse, 3, 65);
+        ft_set_cur_cell(dense, 3, 65);
+        assert_true(ft_printf(sparse, "j|k") == 2);
+        assert_true(ft_printf(dense, "j|k") == 2);
+        assert_true(ft_col_count(sparse) == 94);
+        assert_true(ft_col_count(dense) == 94);
+        assert_str_equal(ft_to_string(sparse), ft_to_string(dense));
+
+        /* Erasing of cells shifts following cells */
+        assert_true(ft_erase_range(sparse, 0, 30, 3, 62) == FT_SUCCESS);
+        assert_true(ft_erase_range(dense, 0, 30, 3, 62) == FT_SUCCESS);
+        assert_true(ft_col_count(sparse) == 61);
+        assert_true(ft_col_count(dense) == 61);
+        assert_str_equal(ft_to_string(sparse), ft_to_string(dense));
+
+        ft_destroy_table(sparse);
+        ft_destroy_table(dense);
+    }
+
+    WHEN("Wide table is mostly empty") {
+        struct size_stats stats = {0};
+        ft_allocator_t allocator = {&size_stats_malloc, NULL, NULL, &size_stats_free, &stats};
+        ft_table_t *table = ft_create_table_with_allocator(&allocator);
+        assert_true(table != NULL);
+        size_t i = 0;
+        for (i = 0; i < 100; ++i) {
+            ft_set_cur_cell(table, i * 10, i * 10);
+            assert_true(ft_write(table, "x") == FT_SUCCESS);
+        }
+        assert_true(ft_row_count(table) == 991);
+        assert_true(ft_col_count(table) == 991);
+        /* Absent cells cost nothing (about 1M empty cells otherwise) */
+        assert_true(stats.live_bytes < 200 * 1024);
+
+        ft_destroy_table(table);
+        assert_true(stats.live_bytes == 0);
+    }
+
+    WHEN("Cell span is set in the last row of virtual table") {
+        struct size_stats stats = {0};
+        ft_allocator_t allocator = {&size_stats_malloc, NULL, NULL, &size_stats_free, &stats};
+        assert_true(ft_set_allocator(&allocator) == FT_SUCCESS);
+        ft_table_t *table = ft_create_virtual_table(100000, 3, sparse_virtual_provider, NULL);
+        assert_true(table != NULL);
+        size_t table_bytes = stats.live_bytes;
+        assert_true(ft_set_cell_span(table, 99999, 0, 2) == FT_SUCCESS);
+        /* Rows before the spanned one are not created */
+        assert_true(stats.live_bytes - table_bytes < 1024);
+
+        ft_table_t *copy = ft_copy_table(table);
+        assert_true(copy != NULL);
+        const char *table_str = ft_render_rows(copy, 99998, 2);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+---+---+---+\n"
+            "| x | x | x |\n"
+            "| x     | x |\n"
+            "+-------+---+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(copy);
+        ft_destroy_table(table);
+        assert_true(ft_set_allocator(NULL) == FT_SUCCESS);
+        assert_true(stats.live_bytes == 0);
+    }
+}
+
+void test_table_intern_strings(void)
+{
+    const char *statuses[] = {"OK", "DEGRADED", "FAILED\nretrying"};
+
+    WHEN("Strings are interned") {
+        ft_table_t *plain = ft_create_table();
+        ft_table_t *table = ft_create_table();
+        assert_true(plain != NULL && table != NULL);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_INTERN_STRINGS, 1) == FT_SUCCESS);
+
+        size_t i = 0;
+        for (i = 0; i < 30; ++i) {
+            const char *status = statuses[i % 3];
+            assert_true(ft_write(plain, "host") == FT_SUCCESS);
+            assert_true(ft_write(table, "host") == FT_SUCCESS);
+            assert_true(ft_write_len(plain, status, 2) == FT_SUCCESS);
+            assert_true(ft_write_len(table, status, 2) == FT_SUCCESS);
+            assert_true(ft_write_ln(plain, status) == FT_SUCCESS);
+            assert_true(ft_write_ln(table, status) == FT_SUCCESS);
+        }
+        assert_str_equal(ft_to_string(table), ft_to_string(plain));
+
+        ft_intern_stats_t stats;
+        assert_true(ft_get_intern_stats(table, &stats) == FT_SUCCESS);
+        assert_true(stats.lookups == 90);
+        assert_true(stats.strings == 6);
+        assert_true(stats.hits == 84);
+        assert_true(stats.bytes > 0);
+
+        /* Cells of the copy own their content */
+        ft_table_t *copy = ft_copy_table(table);
+        assert_true(copy != NULL);
+        ft_destroy_table(table);
+        assert_str_equal(ft_to_string(copy), ft_to_string(plain));
+        ft_destroy_table(copy);
+        ft_destroy_table(plain);
+    }
+
+#ifdef FT_HAVE_WCHAR
+    WHEN("Strings of different types are interned") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_INTERN_STRINGS, 1) == FT_SUCCESS);
+        assert_true(ft_write_ln(table, "ab", "ab") == FT_SUCCESS);
+        assert_true(ft_wwrite_ln(table, L"ab", L"ab") == FT_SUCCESS);
+
+        ft_intern_stats_t stats;
+        assert_true(ft_get_intern_stats(table, &stats) == FT_SUCCESS);
+        assert_true(stats.strings == 2);
+        assert_true(stats.hits == 2);
+        assert_true(ft_to_wstring(table) != NULL);
+        ft_destroy_table(table);
+    }
+#endif
+
+    WHEN("Columns written with a format are interned") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_INTERN_STRINGS, 1) == FT_SUCCESS);
+        const double values[] = {1.0, 2.0, 1.0, 1.0};
+        assert_true(ft_write_column_f64(table, 0, 0, values, 4, "%.1f") == FT_SUCCESS);
+        assert_true(ft_write_column_f64(table, 1, 0, values, 2, "%0300.1f") == FT_SUCCESS);
+
+        ft_intern_stats_t stats;
+        assert_true(ft_get_intern_stats(table, &stats) == FT_SUCCESS);
+        assert_true(stats.lookups == 6);
+        assert_true(stats.hits == 2);
+        assert_true(stats.strings == 4);
+        assert_true(ft_to_string(table) != NULL);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Interning is disabled") {
+        ft_table_t *table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_write_ln(table, "OK", "OK") == FT_SUCCESS);
+
+        ft_intern_stats_t stats;
+        assert_true(ft_get_intern_stats(table, &stats) == FT_SUCCESS);
+        assert_true(stats.lookups == 0 && stats.hits == 0 && stats.strings == 0 && stats.bytes == 0);
+        assert_true(ft_get_intern_stats(table, NULL) == FT_EINVAL);
+        assert_true(ft_set_tbl_prop(table, FT_TPROP_INTERN_STRINGS, 2) == FT_EINVAL);
+        ft_destroy_table(table);
+    }
+}
@@ -188,6 +188,42 @@ void test_table_border_style(void)
         assert_str_equal(table_str, table_str_etalon);
         ft_destroy_table(table);
     }
+
+#if defined(FT_HAVE_WCHAR) && !defined(FT_MICROSOFT_COMPILER)
+    WHEN("Utf-8 border chars are printed to wide strings") {
+        struct ft_border_style brdr_style;
+        brdr_style.border_chs.top_border_ch = "═";
+        brdr_style.border_chs.separator_ch = "─";
+        brdr_style.border_chs.bottom_border_ch = "═";
+        brdr_style.border_chs.side_border_ch = "||";
+        brdr_style.border_chs.out_intersect_ch = "╬";
+        brdr_style.border_chs.in_intersect_ch = "┼";
+        brdr_style.header_border_chs = brdr_style.border_chs;
+        brdr_style.hor_separator_char = "─";
+
+        table = ft_create_table();
+        assert_true(table != NULL);
+        assert_true(ft_set_border_style(table, &brdr_style) == FT_SUCCESS);
+        assert_true(ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0) == FT_SUCCESS);
+        assert_true(ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0) == FT_SUCCESS);
+        assert_true(ft_wwrite_ln(table, L"1", L"22") == FT_SUCCESS);
+        assert_true(ft_wwrite_ln(table, L"333", L"4") == FT_SUCCESS);
+
+        /* Conversion of border chars doesn't depend on the locale */
+        setlocale(LC_CTYPE, "C");
+        const wchar_t *table_str = ft_to_wstring(table);
+        assert_true(table_str != NULL);
+        const wchar_t *table_str_etalon =
+            L"╬═════╬════╬\n"
+            L"||   1 || 22 ||\n"
+            L"╬─────┼────╬\n"
+            L"|| 333 ||  4 ||\n"
+            L"╬═════╬════╬\n";
+        assert_wcs_equal(table_str, table_str_etalon);
+        setlocale(LC_CTYPE, "");
+        ft_destroy_table(table);
+    }
+#endif
 }
 
 static ft_table_t *create_simple_table(void)
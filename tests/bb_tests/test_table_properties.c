@@ -763,6 +763,88 @@ void test_table_cell_properties(void)
         assert_str_equal(table_str, table_str_etalon);
         ft_destroy_table(table);
     }
+
+    WHEN("Spanned cells are wider than their columns") {
+        set_test_properties_as_default();
+
+        table = ft_create_table();
+        int n = ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        assert_true(n == FT_SUCCESS);
+        n = ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+        assert_true(n == FT_SUCCESS);
+
+        n = ft_write_ln(table, "this banner is much wider than the columns");
+        assert_true(n == FT_SUCCESS);
+        n = ft_write_ln(table, "a", "bb", "ccc", "dddd");
+        assert_true(n == FT_SUCCESS);
+        n = ft_write_ln(table, "x", "spans three columns of the row");
+        assert_true(n == FT_SUCCESS);
+        n = ft_write_ln(table, "odd width", "", "c", "d");
+        assert_true(n == FT_SUCCESS);
+
+        /* Groups overlap, extra width is distributed starting from the first column of a group */
+        n = ft_set_cell_span(table, 0, 0, 4);
+        assert_true(n == FT_SUCCESS);
+        n = ft_set_cell_span(table, 2, 1, 3);
+        assert_true(n == FT_SUCCESS);
+        n = ft_set_cell_span(table, 3, 0, 2);
+        assert_true(n == FT_SUCCESS);
+
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+--------------------------------------------+\n"
+            "| this banner is much wider than the columns |\n"
+            "+---------+----------+-----------+-----------+\n"
+            "|       a |       bb |       ccc |      dddd |\n"
+            "+---------+----------+-----------+-----------+\n"
+            "|       x |   spans three columns of the row |\n"
+            "+---------+----------+-----------+-----------+\n"
+            "|          odd width |         c |         d |\n"
+            "+--------------------+-----------+-----------+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
+
+    WHEN("Spans are changed after the table is printed") {
+        set_test_properties_as_default();
+
+        table = ft_create_table();
+        int n = ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TOP_PADDING, 0);
+        assert_true(n == FT_SUCCESS);
+        n = ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_BOTTOM_PADDING, 0);
+        assert_true(n == FT_SUCCESS);
+        n = ft_write_ln(table, "1", "2", "3");
+        assert_true(n == FT_SUCCESS);
+        n = ft_write_ln(table, "4", "5", "6");
+        assert_true(n == FT_SUCCESS);
+        assert_true(ft_to_string(table) != NULL);
+
+        n = ft_set_cell_span(table, 0, 0, 2);
+        assert_true(n == FT_SUCCESS);
+        const char *table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        const char *table_str_etalon =
+            "+-------+---+\n"
+            "|     1 | 3 |\n"
+            "+---+---+---+\n"
+            "| 4 | 5 | 6 |\n"
+            "+---+---+---+\n";
+        assert_str_equal(table_str, table_str_etalon);
+
+        n = ft_erase_range(table, 0, 0, 1, 0);
+        assert_true(n == FT_SUCCESS);
+        table_str = ft_to_string(table);
+        assert_true(table_str != NULL);
+        table_str_etalon =
+            "+---+---+\n"
+            "| 2 | 3 |\n"
+            "+---+---+\n"
+            "| 5 | 6 |\n"
+            "+---+---+\n";
+        assert_str_equal(table_str, table_str_etalon);
+        ft_destroy_table(table);
+    }
 }
 
 
@@ -1,6 +1,8 @@
 #include "tests.h"
 #include "fort.hpp"
 #include "test_utils.hpp"
+#include <array>
+#include <vector>
 
 
 void test_cpp_bug_fixes(void)
@@ -390,6 +392,171 @@ void test_cpp_table_write(void)
             "+-----+----------+----------+----------+\n";
         assert_string_equal(table_str, table_str_etalon);
     }
+
+    SCENARIO("Test write of moved strings") {
+        fort::char_table table;
+        assert_true(set_cpp_test_props_for_table(&table));
+        table << fort::header;
+        std::string long_str(40, 'x');
+        assert_true(table.write(std::string("3")));
+        assert_true(table.write_ln(std::move(long_str)));
+        table[0][1] = std::string("c");
+
+        fort::char_table table_copy = table;
+        fort::char_table table_moved = std::move(table);
+        std::string table_str_etalon =
+            "+---+---+\n"
+            "|   |   |\n"
+            "| 3 | c |\n"
+            "|   |   |\n"
+            "+---+---+\n";
+        assert_string_equal(table_moved.to_string(), table_str_etalon);
+        assert_string_equal(table_copy.to_string(), table_str_etalon);
+
+        /* Rewritten cells release moved strings */
+        for (int i = 0; i < 100; ++i) {
+            table_moved[0][0] = std::string(40, 'a' + i % 26);
+            assert_true(table_moved.write(std::string(i % 2 ? "c" : "d")));
+        }
+        table_str_etalon =
+            "+---+---+\n"
+            "|   |   |\n"
+            "| v | c |\n"
+            "|   |   |\n"
+            "+---+---+\n";
+        table_moved[0][0] = std::string("v");
+        assert_string_equal(table_moved.to_string(), table_str_etalon);
+    }
+
+    SCENARIO("Test write of numeric columns") {
+        fort::char_table table;
+        assert_true(set_cpp_test_props_for_table(&table));
+        std::vector<int> ints = {1, -20, 300};
+        std::vector<double> doubles = {0.5, 1.25};
+        std::array<unsigned char, 2> bytes = {{7, 255}};
+        assert_true(table.write_column(0, 0, ints));
+        assert_true(table.write_column(1, 0, doubles, "%.2f"));
+        assert_true(table.write_column(2, 1, bytes, "%02x"));
+        assert_true(!table.write_column(2, 0, bytes, "%s"));
+
+        std::string table_str_etalon =
+            "+-----+------+----+\n"
+            "|     |      |    |\n"
+            "| 1   | 0.50 |    |\n"
+            "|     |      |    |\n"
+            "+-----+------+----+\n"
+            "|     |      |    |\n"
+            "| -20 | 1.25 | 07 |\n"
+            "|     |      |    |\n"
+            "+-----+------+----+\n"
+            "|     |      |    |\n"
+            "| 300 |      | ff |\n"
+            "|     |      |    |\n"
+            "+-----+------+----+\n";
+        assert_string_equal(table.to_string(), table_str_etalon);
+    }
+
+    SCENARIO("Test operator<< for strings and numbers") {
+        fort::char_table table;
+        table << 42 << -7L << 18446744073709551615ULL << true << 0.1 << 2.5f << 'c'
+              << "lit" << std::string("str") << fort::endr;
+        table << std::hex << 255 << std::dec << 255 << std::setw(5) << 1
+              << std::setprecision(3) << 3.14159 << std::setprecision(6) << 1e-10
+              << std::setw(4) << "ab" << fort::endr;
+
+        fort::char_table table_etalon;
+        const char *cells[] = {
+            "42", "-7", "18446744073709551615", "1", "0.1", "2.5", "c", "lit", "str", NULL,
+            "ff", "255", "    1", "3.14", "1e-10", "  ab", NULL
+        };
+        for (const char *cell : cells) {
+            if (cell)
+                table_etalon << cell;
+            else
+                table_etalon << fort::endr;
+        }
+        assert_string_equal(table.to_string(), table_etalon.to_string());
+
+        /* Typed numbers are formatted with the column format */
+        assert_true(table.set_column_format(0, "%05d"));
+        table_etalon[0][0] = "00042";
+        assert_string_equal(table.to_string(), table_etalon.to_string());
+    }
+
+    SCENARIO("Test printing to std::ostream") {
+        fort::char_table table;
+        table << fort::header << "N" << "Name" << fort::endr;
+        for (int i = 0; i < 100; ++i)
+            table << i << "row" << fort::endr;
+
+        std::ostringstream os;
+        os << table;
+        assert_true(os.good());
+        assert_string_equal(os.str(), table.to_string());
+
+#ifdef FT_HAVE_UTF8
+        fort::utf8_table u8table;
+        u8table.set_border_style(FT_NICE_STYLE);
+        u8table << "Привет" << "мир" << fort::endr;
+        std::ostringstream u8os;
+        assert_true(u8table.render_to(u8os));
+        assert_string_equal(u8os.str(), u8table.to_string());
+#endif
+    }
+
+    SCENARIO("Test iterating over table lines") {
+        fort::char_table table;
+        for (auto line : table.lines())
+            assert_true(false);
+
+        table << fort::header << "N" << "Name" << fort::endr;
+        for (int i = 0; i < 20; ++i)
+            table << i << std::string(i * 10, 'x') << fort::endr;
+
+        std::string joined;
+        for (const auto &line : table.lines())
+            joined += line + "\n";
+        assert_string_equal(joined, table.to_string());
+
+        auto lines = table.lines();
+        auto it = lines.begin();
+        assert_true(it != lines.end());
+        assert_true(*it == table.to_string().substr(0, it->size()));
+    }
+
+    SCENARIO("Test reserving memory") {
+        fort::char_table table;
+        assert_true(table.reserve(50, 5, 10));
+        assert_true(table.is_empty());
+        for (int i = 0; i < 50; ++i)
+            table << i << "a" << "b" << "c" << "d" << fort::endr;
+        assert_true(table.row_count() == 50);
+        assert_true(table.col_count() == 5);
+    }
+
+    SCENARIO("Test interning of strings") {
+        fort::char_table table;
+        assert_true(table.set_intern_strings(true));
+        for (int i = 0; i < 20; ++i)
+            table << i << (i % 4 ? "OK" : "FAILED") << fort::endr;  /* numbers aren't interned */
+        ft_intern_stats_t stats = table.intern_stats();
+        assert_true(stats.lookups == 20);
+        assert_true(stats.strings == 2);
+        assert_true(stats.hits == 18);
+        assert_true(table.to_string().find("FAILED") != std::string::npos);
+    }
+
+#ifdef FT_HAVE_UTF8
+    SCENARIO("Test handling of invalid utf-8") {
+        fort::utf8_table table;
+        assert_true(table.set_invalid_utf8_handling(fort::invalid_utf8::reject));
+        assert_true(table.write("\xd0\xb0"));
+        assert_true(!table.write("\xd0"));
+        assert_true(table.set_invalid_utf8_handling(fort::invalid_utf8::replace));
+        assert_true(table.write_ln("\xd0"));
+        assert_true(table.to_string().find("\xef\xbf\xbd") != std::string::npos);
+    }
+#endif
 }
 
 void test_cpp_table_insert(void)
@@ -0,0 +1,71 @@
+/*
+ * Benchmark of fort::table::operator<<.
+ *
+ * Compares writing of strings and numbers with operator<< and writing of the
+ * same values through std::ostream (the path used for user types).
+ */
+#include "fort.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+
+template <typename T>
+struct streamed {
+    const T &value;
+};
+
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const streamed<T> &arg)
+{
+    return os << arg.value;
+}
+
+template <typename T>
+streamed<T> stream(const T &value)
+{
+    return streamed<T> {value};
+}
+
+static double now_sec()
+{
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+static double fill_fast(std::size_t rows)
+{
+    fort::char_table table;
+    const std::string name = "name";
+    double start = now_sec();
+    for (std::size_t i = 0; i < rows; ++i) {
+        table << i << -static_cast<long>(i) << i * 0.25 << name << "literal" << fort::endr;
+    }
+    return now_sec() - start;
+}
+
+static double fill_streamed(std::size_t rows)
+{
+    fort::char_table table;
+    const std::string name = "name";
+    double start = now_sec();
+    for (std::size_t i = 0; i < rows; ++i) {
+        long neg = -static_cast<long>(i);
+        double d = i * 0.25;
+        table << stream(i) << stream(neg) << stream(d) << stream(name) << stream("literal") << fort::endr;
+    }
+    return now_sec() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t rows = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 100000;
+
+    double streamed_time = fill_streamed(rows);
+    double fast_time = fill_fast(rows);
+    std::printf("rows: %zu, cols: 5\n", rows);
+    std::printf("std::ostream:  %.3f s\n", streamed_time);
+    std::printf("operator<<:    %.3f s (x%.2f)\n", fast_time, streamed_time / fast_time);
+    return 0;
+}
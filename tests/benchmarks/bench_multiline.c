@@ -0,0 +1,115 @@
+/*
+ * Benchmark of conversion of tables with large multiline cells to string.
+ *
+ * Renders tables with cells containing log blobs (ASCII), pretty printed JSON
+ * dumps (utf-8 with non-ASCII chars) and wide strings of LINES lines. Number
+ * of iterations may be passed as the first argument.
+ */
+#include "fort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#define ROWS 4
+#define LINES 2000
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char *log_blob(void)
+{
+    char *result = (char *)malloc(LINES * 80);
+    if (result == NULL)
+        return NULL;
+    size_t i = 0;
+    char *pos = result;
+    for (i = 0; i < LINES; ++i)
+        pos += sprintf(pos, "%s2024-01-01 12:00:%02u [INFO] worker-%u: request %u processed",
+                       i ? "\n" : "", (unsigned)(i % 60), (unsigned)(i % 8), (unsigned)i);
+    return result;
+}
+
+static char *json_dump(void)
+{
+    char *result = (char *)malloc(LINES * 80);
+    if (result == NULL)
+        return NULL;
+    size_t i = 0;
+    char *pos = result;
+    pos += sprintf(pos, "{");
+    for (i = 1; i + 1 < LINES; ++i)
+        pos += sprintf(pos, "\n    \"\xd0\xba\xd0\xbb\xd1\x8e\xd1\x87_%u\": \"\xd0\xb7\xd0\xbd\xd0\xb0\xd1\x87\xd0\xb5\xd0\xbd\xd0\xb8\xd0\xb5 %u\",",
+                       (unsigned)i, (unsigned)(i * 7));
+    sprintf(pos, "\n}");
+    return result;
+}
+
+static wchar_t *wide_blob(void)
+{
+    wchar_t *result = (wchar_t *)malloc(LINES * 40 * sizeof(wchar_t));
+    if (result == NULL)
+        return NULL;
+    size_t i = 0;
+    wchar_t *pos = result;
+    for (i = 0; i < LINES; ++i)
+        pos += swprintf(pos, 40, L"%ls\x8868\x683c %u \x00e9v\x00e9nement", i ? L"\n" : L"", (unsigned)i);
+    return result;
+}
+
+static void report(const char *name, double elapsed, size_t iterations)
+{
+    printf("%-6s %8.3f ms/table\n", name, elapsed * 1e3 / (double)iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10;
+    size_t i = 0;
+    size_t r = 0;
+    size_t total = 0;
+    double start;
+
+    char *log = log_blob();
+    char *json = json_dump();
+    wchar_t *wide = wide_blob();
+    if (log == NULL || json == NULL || wide == NULL)
+        return EXIT_FAILURE;
+
+    ft_table_t *table = ft_create_table();
+    for (r = 0; r < ROWS; ++r)
+        ft_write_ln(table, "1", log, "2", log);
+    start = now_sec();
+    for (i = 0; i < iterations; ++i)
+        total += strlen(ft_to_string(table));
+    report("log", now_sec() - start, iterations);
+    ft_destroy_table(table);
+
+    table = ft_create_table();
+    for (r = 0; r < ROWS; ++r)
+        ft_u8write_ln(table, "1", json, "2", json);
+    start = now_sec();
+    for (i = 0; i < iterations; ++i)
+        total += strlen(ft_to_u8string(table));
+    report("json", now_sec() - start, iterations);
+    ft_destroy_table(table);
+
+    table = ft_create_table();
+    for (r = 0; r < ROWS; ++r)
+        ft_wwrite_ln(table, L"1", wide, L"2", wide);
+    start = now_sec();
+    for (i = 0; i < iterations; ++i)
+        total += wcslen(ft_to_wstring(table));
+    report("wide", now_sec() - start, iterations);
+    ft_destroy_table(table);
+
+    free(log);
+    free(json);
+    free(wide);
+    return total ? EXIT_SUCCESS : EXIT_FAILURE;
+}
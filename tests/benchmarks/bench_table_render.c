@@ -0,0 +1,102 @@
+/*
+ * Benchmark of memory used by cells and of conversion of the table to string.
+ *
+ * Fills table of 20000 x 20 cells (number of rows may be passed as the first
+ * argument) cell by cell, reports memory allocated by the library per cell
+ * and time of ft_to_string (number of conversions may be passed as the second
+ * argument).
+ */
+#include "fort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COLS 20
+
+struct alloc_stats {
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t live_blocks;
+};
+
+/* Size of the block is stored before the block */
+#define HEADER_SZ 16
+
+static void *stats_malloc(size_t size, void *ctx)
+{
+    struct alloc_stats *stats = (struct alloc_stats *)ctx;
+    char *block = (char *)malloc(HEADER_SZ + size);
+    if (block == NULL)
+        return NULL;
+    memcpy(block, &size, sizeof(size));
+    stats->live_bytes += size;
+    stats->live_blocks++;
+    if (stats->live_bytes > stats->peak_bytes)
+        stats->peak_bytes = stats->live_bytes;
+    return block + HEADER_SZ;
+}
+
+static void stats_free(void *ptr, void *ctx)
+{
+    struct alloc_stats *stats = (struct alloc_stats *)ctx;
+    char *block = (char *)ptr - HEADER_SZ;
+    size_t size = 0;
+    memcpy(&size, block, sizeof(size));
+    stats->live_bytes -= size;
+    stats->live_blocks--;
+    free(block);
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *const words[] = {"0", "name", "value", "some longer cell content", "42.5"};
+    size_t rows = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+    size_t iterations = (argc > 2) ? strtoul(argv[2], NULL, 10) : 10;
+
+    struct alloc_stats stats = {0, 0, 0};
+    ft_allocator_t allocator = {&stats_malloc, NULL, NULL, &stats_free, &stats};
+    ft_table_t *table = ft_create_table_with_allocator(&allocator);
+    if (table == NULL)
+        return EXIT_FAILURE;
+
+    size_t i = 0;
+    size_t j = 0;
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < COLS; ++j) {
+            if (ft_nwrite(table, 1, words[(i * COLS + j) % (sizeof(words) / sizeof(words[0]))]) != FT_SUCCESS)
+                fprintf(stderr, "ft_nwrite failed\n");
+        }
+        ft_ln(table);
+    }
+
+    printf("rows: %zu, cols: %d\n", rows, COLS);
+    printf("memory:       %zu bytes in %zu blocks (%.1f bytes, %.2f blocks per cell)\n",
+           stats.live_bytes, stats.live_blocks,
+           (double)stats.live_bytes / (double)(rows * COLS),
+           (double)stats.live_blocks / (double)(rows * COLS));
+
+    double start = now_sec();
+    size_t len = 0;
+    for (i = 0; i < iterations; ++i) {
+        const char *str = ft_to_string(table);
+        if (str == NULL) {
+            fprintf(stderr, "ft_to_string failed\n");
+            break;
+        }
+        len += strlen(str);
+    }
+    double elapsed = now_sec() - start;
+    printf("ft_to_string: %.3f s per conversion (%zu bytes)\n",
+           elapsed / (double)iterations, iterations ? len / iterations : 0);
+
+    ft_destroy_table(table);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+/*
+ * Benchmark of bulk writes to the table.
+ *
+ * Fills table of 100000 x 20 cells (number of rows may be passed as the first
+ * argument) with ft_table_write, ft_row_write and writing cells one by one
+ * (with and without interning of strings). Results depend on the state of the
+ * heap after previous runs, so one method may be chosen with the second
+ * argument ("table", "row", "cells" or "interned").
+ */
+#include "fort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COLS 20
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static const char **create_cells(size_t rows)
+{
+    static const char *const words[] = {"0", "name", "value", "some longer cell content", "42.5"};
+    const char **cells = (const char **)malloc(rows * COLS * sizeof(const char *));
+    if (cells == NULL)
+        return NULL;
+    size_t i = 0;
+    for (i = 0; i < rows * COLS; ++i) {
+        cells[i] = words[i % (sizeof(words) / sizeof(words[0]))];
+    }
+    return cells;
+}
+
+static double fill_table_write(const char **cells, size_t rows)
+{
+    ft_table_t *table = ft_create_table();
+    double start = now_sec();
+    if (ft_table_write_ln(table, rows, COLS, cells) != FT_SUCCESS)
+        fprintf(stderr, "ft_table_write_ln failed\n");
+    double result = now_sec() - start;
+    ft_destroy_table(table);
+    return result;
+}
+
+static double fill_row_write(const char **cells, size_t rows)
+{
+    ft_table_t *table = ft_create_table();
+    double start = now_sec();
+    size_t i = 0;
+    for (i = 0; i < rows; ++i) {
+        if (ft_row_write_ln(table, COLS, &cells[i * COLS]) != FT_SUCCESS)
+            fprintf(stderr, "ft_row_write_ln failed\n");
+    }
+    double result = now_sec() - start;
+    ft_destroy_table(table);
+    return result;
+}
+
+static double fill_by_cells(const char **cells, size_t rows, int intern)
+{
+    ft_table_t *table = ft_create_table();
+    ft_set_tbl_prop(table, FT_TPROP_INTERN_STRINGS, intern);
+    double start = now_sec();
+    size_t i = 0;
+    size_t j = 0;
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < COLS; ++j) {
+            if (ft_nwrite(table, 1, cells[i * COLS + j]) != FT_SUCCESS)
+                fprintf(stderr, "ft_nwrite failed\n");
+        }
+        ft_ln(table);
+    }
+    double result = now_sec() - start;
+    if (intern) {
+        ft_intern_stats_t stats;
+        ft_get_intern_stats(table, &stats);
+        printf("interned: %zu strings (%zu bytes), %zu of %zu hits\n",
+               stats.strings, stats.bytes, stats.hits, stats.lookups);
+    }
+    ft_destroy_table(table);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rows = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+    const char **cells = create_cells(rows);
+    if (cells == NULL)
+        return EXIT_FAILURE;
+
+    const char *method = (argc > 2) ? argv[2] : NULL;
+    printf("rows: %zu, cols: %d\n", rows, COLS);
+    if (method == NULL) {
+        double by_cells_time = fill_by_cells(cells, rows, 0);
+        double interned_time = fill_by_cells(cells, rows, 1);
+        double row_write_time = fill_row_write(cells, rows);
+        double table_write_time = fill_table_write(cells, rows);
+        printf("ft_nwrite:      %.3f s\n", by_cells_time);
+        printf("interned:       %.3f s (x%.2f)\n", interned_time, by_cells_time / interned_time);
+        printf("ft_row_write:   %.3f s (x%.2f)\n", row_write_time, by_cells_time / row_write_time);
+        printf("ft_table_write: %.3f s (x%.2f)\n", table_write_time, by_cells_time / table_write_time);
+    } else if (strcmp(method, "cells") == 0) {
+        printf("ft_nwrite:      %.3f s\n", fill_by_cells(cells, rows, 0));
+    } else if (strcmp(method, "interned") == 0) {
+        printf("interned:       %.3f s\n", fill_by_cells(cells, rows, 1));
+    } else if (strcmp(method, "row") == 0) {
+        printf("ft_row_write:   %.3f s\n", fill_row_write(cells, rows));
+    } else if (strcmp(method, "table") == 0) {
+        printf("ft_table_write: %.3f s\n", fill_table_write(cells, rows));
+    }
+    free(cells);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+/*
+ * Benchmark of computation of visible width of strings.
+ *
+ * Computes width of ASCII, Latin-1, CJK and emoji strings of about 1M
+ * codepoints with mk_wcswidth (wchar_t strings) and utf8_range_width (utf-8
+ * strings). Number of iterations may be passed as the first argument.
+ */
+#include "wcwidth.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CODEPOINTS (1024 * 1024)
+
+struct corpus {
+    const char *name;
+    const char *u8str;
+    const wchar_t *wstr;
+};
+
+static const struct corpus corpora[] = {
+    {"ascii", "The quick brown fox jumps over the lazy dog. ", L"The quick brown fox jumps over the lazy dog. "},
+    {"latin-1", "Gr\xc3\xb6\xc3\x9f" "e \xc3\x84rger caf\xc3\xa9 na\xc3\xafve ", L"Gr\x00f6\x00df" L"e \x00c4rger caf\x00e9 na\x00efve "},
+    {"cjk", "\xe8\xa1\xa8\xe6\xa0\xbc\xe8\xbe\x93\xe5\x87\xba\xe4\xb8\xad\xe6\x96\x87", L"\x8868\x683c\x8f93\x51fa\x4e2d\x6587"},
+    {"emoji", "\xf0\x9f\x98\x80\xf0\x9f\x8e\x89\xf0\x9f\x9a\x80\xf0\x9f\x91\x8d", L"\U0001F600\U0001F389\U0001F680\U0001F44D"},
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Repeats `str` till the result has at least CODEPOINTS codepoints */
+static void *repeat(const void *str, size_t str_sz, size_t str_codepoints, size_t char_sz, size_t *result_sz)
+{
+    size_t n = CODEPOINTS / str_codepoints + 1;
+    char *result = (char *)malloc(n * str_sz + char_sz);
+    if (result == NULL)
+        return NULL;
+    size_t i = 0;
+    for (i = 0; i < n; ++i)
+        memcpy(result + i * str_sz, str, str_sz);
+    memset(result + n * str_sz, 0, char_sz);
+    *result_sz = n * str_sz;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20;
+    size_t k = 0;
+    for (k = 0; k < sizeof(corpora) / sizeof(corpora[0]); ++k) {
+        const struct corpus *c = &corpora[k];
+        size_t codepoints = wcslen(c->wstr);
+        size_t i = 0;
+        size_t width = 0;
+        printf("%-8s", c->name);
+
+        size_t sz = 0;
+        const char *u8str = (const char *)repeat(c->u8str, strlen(c->u8str), codepoints, 1, &sz);
+        if (u8str == NULL)
+            return EXIT_FAILURE;
+        double start = now_sec();
+        for (i = 0; i < iterations; ++i)
+            width += utf8_range_width(u8str, u8str + sz);
+        double elapsed = now_sec() - start;
+        printf("  utf-8: %6.2f ns/cp", elapsed * 1e9 / (double)(iterations * sz / strlen(c->u8str) * codepoints));
+        free((void *)u8str);
+
+        const wchar_t *wstr = (const wchar_t *)repeat(c->wstr, codepoints * sizeof(wchar_t), codepoints, sizeof(wchar_t), &sz);
+        if (wstr == NULL)
+            return EXIT_FAILURE;
+        size_t len = sz / sizeof(wchar_t);
+        start = now_sec();
+        for (i = 0; i < iterations; ++i)
+            width += (size_t)mk_wcswidth(wstr, len);
+        elapsed = now_sec() - start;
+        printf("  wchar_t: %6.2f ns/cp  (width %zu)\n", elapsed * 1e9 / (double)(iterations * len), width);
+        free((void *)wstr);
+    }
+    return EXIT_SUCCESS;
+}
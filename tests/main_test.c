@@ -14,6 +14,19 @@ void test_table_basic(void);
 void test_table_copy(void);
 void test_table_changing_cell(void);
 void test_table_erase(void);
+void test_table_virtual(void);
+void test_table_render_rows(void);
+void test_table_write_external(void);
+void test_table_write_len(void);
+void test_table_write_column(void);
+void test_table_typed_values(void);
+void test_table_printf_compiled(void);
+void test_table_print_to(void);
+void test_table_line_iter(void);
+void test_table_bulk_write(void);
+void test_table_reserve(void);
+void test_table_sparse(void);
+void test_table_intern_strings(void);
 #ifdef FT_HAVE_WCHAR
 void test_wcs_table_boundaries(void);
 #endif
@@ -25,9 +38,11 @@ void test_table_cell_properties(void);
 void test_table_text_styles(void);
 void test_table_tbl_properties(void);
 void test_memory_errors(void);
+void test_table_allocator(void);
 void test_error_codes(void);
 #ifdef FT_HAVE_UTF8
 void test_utf8_table(void);
+void test_utf8_invalid_content(void);
 #endif
 
 
@@ -52,17 +67,32 @@ struct test_case bb_test_suite [] = {
 #endif
 #ifdef FT_HAVE_UTF8
     {"test_utf8_table", test_utf8_table},
+    {"test_utf8_invalid_content", test_utf8_invalid_content},
 #endif
     {"test_table_write", test_table_write},
     {"test_table_insert_strategy", test_table_insert_strategy},
     {"test_table_changing_cell", test_table_changing_cell},
     {"test_table_erase", test_table_erase},
+    {"test_table_virtual", test_table_virtual},
+    {"test_table_render_rows", test_table_render_rows},
+    {"test_table_write_external", test_table_write_external},
+    {"test_table_write_len", test_table_write_len},
+    {"test_table_write_column", test_table_write_column},
+    {"test_table_typed_values", test_table_typed_values},
+    {"test_table_printf_compiled", test_table_printf_compiled},
+    {"test_table_print_to", test_table_print_to},
+    {"test_table_line_iter", test_table_line_iter},
+    {"test_table_bulk_write", test_table_bulk_write},
+    {"test_table_reserve", test_table_reserve},
+    {"test_table_sparse", test_table_sparse},
+    {"test_table_intern_strings", test_table_intern_strings},
     {"test_table_border_style", test_table_border_style},
     {"test_table_builtin_border_styles", test_table_builtin_border_styles},
     {"test_table_cell_properties", test_table_cell_properties},
     {"test_table_tbl_properties", test_table_tbl_properties},
     {"test_table_text_styles", test_table_text_styles},
     {"test_memory_errors", test_memory_errors},
+    {"test_table_allocator", test_table_allocator},
     {"test_error_codes", test_error_codes},
 };
 
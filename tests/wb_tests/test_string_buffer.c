@@ -36,6 +36,9 @@ void test_buffer_text_visible_height(void);
 void test_wchar_basics(void);
 #endif
 void test_print_n_strings(void);
+void test_codepoint_width(void);
+void test_ingest_metrics(void);
+void test_line_index(void);
 
 
 
@@ -49,6 +52,9 @@ void test_string_buffer(void)
     test_wchar_basics();
 #endif
     test_print_n_strings();
+    test_codepoint_width();
+    test_ingest_metrics();
+    test_line_index();
 }
 
 
@@ -637,6 +643,8 @@ static void test_print_n_strings_(const char *str, size_t n)
         cntx.u.buf = (char *)buffer_get_data(buffer);
         cntx.raw_avail = 200;
         cntx.b_type = CHAR_BUF;
+        cntx.emitter = get_emitter(CHAR_BUF);
+        cntx.sink = NULL;
         assert_true(print_n_strings(&cntx, n, str) == sz);
         assert_true(cntx.u.buf - origin == (ptrdiff_t)sz);
         destroy_string_buffer(buffer);
@@ -650,6 +658,8 @@ static void test_print_n_strings_(const char *str, size_t n)
         cntx.u.buf = (char *)buffer_get_data(buffer);
         cntx.raw_avail = 200;
         cntx.b_type = W_CHAR_BUF;
+        cntx.emitter = get_emitter(W_CHAR_BUF);
+        cntx.sink = NULL;
         assert_true(print_n_strings(&cntx, n, str) == /*sizeof(wchar_t) **/ sz);
         assert_true(cntx.u.buf - origin == (ptrdiff_t)sizeof(wchar_t) * sz);
         destroy_string_buffer(buffer);
@@ -664,14 +674,73 @@ static void test_print_n_strings_(const char *str, size_t n)
         cntx.u.buf = (char *)buffer_get_data(buffer);
         cntx.raw_avail = 200;
         cntx.b_type = UTF8_BUF;
+        cntx.emitter = get_emitter(UTF8_BUF);
+        cntx.sink = NULL;
         assert_true(print_n_strings(&cntx, n, str) ==  sz);
         assert_true(cntx.u.buf - origin == (ptrdiff_t)sz);
         destroy_string_buffer(buffer);
     }
 #endif /* FT_HAVE_UTF8 */
 }
+
+static void test_print_n_spaces_(size_t n)
+{
+    {
+        f_string_buffer_t *buffer = create_string_buffer(200, CHAR_BUF);
+        const char *origin = (char *)buffer_get_data(buffer);
+        f_conv_context_t cntx;
+        cntx.u.buf = (char *)buffer_get_data(buffer);
+        cntx.raw_avail = 200;
+        cntx.b_type = CHAR_BUF;
+        cntx.emitter = get_emitter(CHAR_BUF);
+        cntx.sink = NULL;
+        assert_true(print_n_spaces(&cntx, n) == (int)n);
+        assert_true(cntx.u.buf - origin == (ptrdiff_t)n);
+        assert_true(strspn(origin, " ") == n && origin[n] == '\0');
+        destroy_string_buffer(buffer);
+    }
+
+#ifdef FT_HAVE_WCHAR
+    {
+        f_string_buffer_t *buffer = create_string_buffer(200, W_CHAR_BUF);
+        const wchar_t *origin = (wchar_t *)buffer_get_data(buffer);
+        f_conv_context_t cntx;
+        cntx.u.buf = (char *)buffer_get_data(buffer);
+        cntx.raw_avail = 200;
+        cntx.b_type = W_CHAR_BUF;
+        cntx.emitter = get_emitter(W_CHAR_BUF);
+        cntx.sink = NULL;
+        assert_true(print_n_spaces(&cntx, n) == (int)n);
+        assert_true(cntx.u.wbuf - origin == (ptrdiff_t)n);
+        assert_true(wcsspn(origin, L" ") == n && origin[n] == L'\0');
+        destroy_string_buffer(buffer);
+    }
+#endif /* FT_HAVE_WCHAR */
+
+#ifdef FT_HAVE_UTF8
+    {
+        f_string_buffer_t *buffer = create_string_buffer(200, UTF8_BUF);
+        const char *origin = (char *)buffer_get_data(buffer);
+        f_conv_context_t cntx;
+        cntx.u.buf = (char *)buffer_get_data(buffer);
+        cntx.raw_avail = 200;
+        cntx.b_type = UTF8_BUF;
+        cntx.emitter = get_emitter(UTF8_BUF);
+        cntx.sink = NULL;
+        assert_true(print_n_spaces(&cntx, n) == (int)n);
+        assert_true(cntx.u.buf - origin == (ptrdiff_t)n);
+        assert_true(strspn(origin, " ") == n && origin[n] == '\0');
+        destroy_string_buffer(buffer);
+    }
+#endif /* FT_HAVE_UTF8 */
+}
+
 void test_print_n_strings(void)
 {
+    test_print_n_spaces_(0);
+    test_print_n_spaces_(1);
+    test_print_n_spaces_(20);
+
     test_print_n_strings_("", 0);
     test_print_n_strings_("", 1);
     test_print_n_strings_("", 2);
@@ -684,3 +753,219 @@ void test_print_n_strings(void)
     test_print_n_strings_("foo", 1);
     test_print_n_strings_("foo", 2);
 }
+
+/* Widths from the generated width tables (see gen_width_table.py) */
+void test_codepoint_width(void)
+{
+#if defined(FT_HAVE_WCHAR) && !defined(FT_MICROSOFT_COMPILER)
+    assert_true(mk_wcswidth(L"\x1b", 1) == -1);          /* control char */
+    assert_true(mk_wcswidth(L"\x9f", 1) == -1);          /* C1 control char */
+    assert_true(mk_wcswidth(L"\xad", 1) == 1);           /* soft hyphen */
+    assert_true(mk_wcswidth(L"e\x301", 2) == 1);         /* combining acute accent */
+    assert_true(mk_wcswidth(L"\x200b", 1) == 0);         /* zero width space */
+    assert_true(mk_wcswidth(L"\x4e2d\x6587", 2) == 4);   /* CJK */
+    assert_true(mk_wcswidth(L"\x303f", 1) == 1);
+    assert_true(mk_wcswidth(L"\xff01", 1) == 2);         /* fullwidth form */
+    if (sizeof(wchar_t) >= 4) {
+        assert_true(mk_wcswidth(L"\x20000", 1) == 2);    /* CJK extension B */
+        assert_true(mk_wcswidth(L"\xe0001", 1) == 0);    /* language tag */
+        assert_true(mk_wcswidth(L"\x1f600", 1) == 1);    /* emoji */
+    }
+#endif /* defined(FT_HAVE_WCHAR) && !defined(FT_MICROSOFT_COMPILER) */
+
+#ifdef FT_HAVE_UTF8
+    {
+        const char *str = "abc";
+        assert_true(utf8_range_width(str, str + strlen(str)) == 3);
+        str = "\xe4\xb8\xad\xe6\x96\x87"; /* CJK */
+        assert_true(utf8_range_width(str, str + strlen(str)) == 4);
+        assert_true(utf8_range_width(str, str + 3) == 2);
+        str = "e\xcc\x81"; /* e with combining acute accent */
+        assert_true(utf8_range_width(str, str + strlen(str)) == 2);
+        str = "\xf0\x9f\x88\x80"; /* U+1F200 */
+        assert_true(utf8_range_width(str, str + strlen(str)) == 2);
+        str = "\xf0\x9f\x98\x80"; /* emoji */
+        assert_true(utf8_range_width(str, str + strlen(str)) == 1);
+    }
+#endif /* FT_HAVE_UTF8 */
+}
+
+/* Metrics (and printable ASCII flag) are computed when content is copied */
+void test_ingest_metrics(void)
+{
+    f_string_buffer_t *buffer = create_string_buffer(128, CHAR_BUF);
+    assert_true(buffer != NULL);
+
+    const char *long_str = "0123456789abcdefghijklmnopqrstuvwxyz";
+    assert_true(fill_buffer_from_string(buffer, long_str) == FT_SUCCESS);
+    assert_true(buffer->metrics.valid);
+    assert_true(buffer->metrics.printable_ascii);
+    assert_true(buffer->metrics.len == strlen(long_str));
+    assert_true(buffer->metrics.lines == 1);
+    assert_true(buffer->metrics.max_line_len == strlen(long_str));
+    assert_str_equal(buffer->str.cstr, long_str);
+
+    /* Non ASCII and control chars at different positions inside words */
+    char str[64];
+    size_t pos;
+    for (pos = 0; pos < 24; ++pos) {
+        memset(str, 'a', 24);
+        str[24] = '\0';
+        str[pos] = '\t';
+        assert_true(fill_buffer_from_string(buffer, str) == FT_SUCCESS);
+        assert_true(buffer->metrics.printable_ascii == 0);
+        assert_true(buffer->metrics.len == 24);
+        str[pos] = (char)0xe4;
+        assert_true(fill_buffer_from_string(buffer, str) == FT_SUCCESS);
+        assert_true(buffer->metrics.printable_ascii == 0);
+        assert_true(buffer->metrics.max_line_len == 24);
+        assert_str_equal(buffer->str.cstr, str);
+
+        str[pos] = '\n';
+        assert_true(fill_buffer_from_string(buffer, str) == FT_SUCCESS);
+        assert_true(buffer->metrics.printable_ascii);
+        assert_true(buffer->metrics.lines == 2);
+        assert_true(buffer->metrics.max_line_len == MAX(pos, 23 - pos));
+    }
+
+    /* Length limited content and null char inside the limit */
+    f_string_view_t view;
+    view.type = CHAR_BUF;
+    view.u.cstr = long_str;
+    assert_true(fill_buffer_from_string_len(buffer, &view, 11) == FT_SUCCESS);
+    assert_true(buffer->metrics.len == 11);
+    assert_str_equal(buffer->str.cstr, "0123456789a");
+    memcpy(str, "abcdefghij\0klmnopqrstu", 22);
+    view.u.cstr = str;
+    assert_true(fill_buffer_from_string_len(buffer, &view, 22) == FT_SUCCESS);
+    assert_true(buffer->metrics.len == 10);
+    assert_true(buffer->metrics.printable_ascii);
+    assert_str_equal(buffer->str.cstr, "abcdefghij");
+
+#ifdef FT_HAVE_UTF8
+    assert_true(fill_buffer_from_u8string(buffer, "abcdefgh\xe4\xb8\xad") == FT_SUCCESS);
+    assert_true(buffer->metrics.valid);
+    assert_true(buffer->metrics.printable_ascii == 0);
+    assert_true(buffer->metrics.len == 11);
+
+    /* Width of valid utf-8 content is computed with validation */
+    {
+        static const char *const u8strs[] = {
+            "\xd0\xb0\xd0\xb1 \xc3\xa9t\xc3\xa9",              /* 2 byte sequences */
+            "\xe8\xa1\xa8\xe6\xa0\xbc\n\xe2\x80\x8b\xef\xbc\x81",  /* CJK, zero width, fullwidth */
+            "e\xcc\x81\xf0\x9f\x98\x80\xf0\xa0\x80\x80\tend",     /* combining, emoji, plane 2 */
+            "0123456789\xef\xbf\xbd" "0123456789\xf4\x8f\xbf\xbf",
+        };
+        size_t i = 0;
+        for (i = 0; i < sizeof(u8strs) / sizeof(u8strs[0]); ++i) {
+            const char *u8str = u8strs[i];
+            const char *nl = strchr(u8str, '\n');
+            size_t width = nl
+                           ? MAX(utf8_range_width(u8str, nl), utf8_range_width(nl + 1, u8str + strlen(u8str)))
+                           : utf8_range_width(u8str, u8str + strlen(u8str));
+            assert_true(fill_buffer_from_u8string(buffer, u8str) == FT_SUCCESS);
+            assert_true(buffer->metrics.utf8_errors == 0);
+            assert_true(buffer->metrics.width == width);
+        }
+    }
+
+    /* Ill-formed sequences: truncated, overlong, surrogate, out of range */
+    {
+        static const char *const u8strs[] = {
+            "\xe4\xb8", "\x80", "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xf8\x88\x80\x80\x80",
+        };
+        size_t i = 0;
+        for (i = 0; i < sizeof(u8strs) / sizeof(u8strs[0]); ++i) {
+            assert_true(fill_buffer_from_u8string(buffer, u8strs[i]) == FT_SUCCESS);
+            assert_true(buffer->metrics.utf8_errors == 1);
+            assert_true(buffer->metrics.width == SIZE_MAX);
+        }
+
+        assert_true(fill_buffer_from_u8string(buffer, "a\xe4\xb8\xad\xc0\xaf") == FT_SUCCESS);
+        assert_true(buffer_check_utf8(buffer, FT_INVALID_UTF8_KEEP) == FT_SUCCESS);
+        assert_str_equal(buffer->str.cstr, "a\xe4\xb8\xad\xc0\xaf");
+        assert_true(buffer_check_utf8(buffer, FT_INVALID_UTF8_REPLACE) == FT_SUCCESS);
+        assert_str_equal(buffer->str.cstr, "a\xe4\xb8\xad\xef\xbf\xbd\xef\xbf\xbd");
+        assert_true(buffer->metrics.utf8_errors == 0);
+        assert_true(buffer_text_visible_width(buffer) == 5);
+        assert_true(buffer_check_utf8(buffer, FT_INVALID_UTF8_REJECT) == FT_SUCCESS);
+
+        assert_true(fill_buffer_from_u8string(buffer, "\xff") == FT_SUCCESS);
+        assert_true(buffer_check_utf8(buffer, FT_INVALID_UTF8_REJECT) == FT_EINVAL);
+        assert_str_equal(buffer->str.cstr, "");
+    }
+#endif /* FT_HAVE_UTF8 */
+
+#ifdef FT_HAVE_WCHAR
+    assert_true(fill_buffer_from_wstring(buffer, L"abc\ndef") == FT_SUCCESS);
+    assert_true(buffer->metrics.valid);
+    assert_true(buffer->metrics.printable_ascii);
+    assert_true(buffer->metrics.lines == 2);
+    assert_true(buffer->metrics.len == 7);
+#endif /* FT_HAVE_WCHAR */
+
+    destroy_string_buffer(buffer);
+}
+
+/* Lines of multiline content are located with the index built on demand */
+void test_line_index(void)
+{
+    f_string_buffer_t *buffer = create_string_buffer(128, CHAR_BUF);
+    assert_true(buffer != NULL);
+
+    assert_true(fill_buffer_from_string(buffer, "one line") == FT_SUCCESS);
+    assert_true(buffer_text_visible_width(buffer) == 8);
+    assert_true(buffer->metrics.line_index == NULL);
+
+#ifdef FT_HAVE_UTF8
+    /* Width of valid utf-8 content is computed when it is written */
+    assert_true(fill_buffer_from_u8string(buffer, "\xd0\xb0\n\nab\n\xe4\xb8\xad\xe6\x96\x87\n") == FT_SUCCESS);
+    assert_true(buffer->metrics.width == 4);
+    assert_true(buffer_text_visible_height(buffer) == 5);
+    assert_true(buffer_text_visible_width(buffer) == 4);
+    assert_true(buffer->metrics.line_index == NULL);
+
+    /* Content with ill-formed sequences is measured line by line */
+    assert_true(fill_buffer_from_u8string(buffer, "a\x80\n\nab\n\xe4\xb8\xad\xe6\x96\x87\n") == FT_SUCCESS);
+    assert_true(buffer->metrics.utf8_errors);
+    assert_true(buffer->metrics.width == SIZE_MAX);
+    assert_true(buffer_text_visible_height(buffer) == 5);
+    assert_true(buffer_text_visible_width(buffer) == 4);
+    assert_true(buffer->metrics.line_index != NULL);
+    assert_true(buffer->metrics.line_index->count == 5);
+    assert_true(buffer->metrics.width == 4);
+    assert_true(buffer->metrics.line_index->offsets[0] == 0);
+    assert_true(buffer->metrics.line_index->offsets[1] == 3);
+    assert_true(buffer->metrics.line_index->offsets[2] == 4);
+    assert_true(buffer->metrics.line_index->offsets[3] == 7);
+    assert_true(buffer->metrics.line_index->offsets[4] == 14);
+    assert_true(buffer->metrics.line_index->offsets[5] == 15);
+    assert_true(buffer_text_visible_width(buffer) == 4);
+
+    /* Index is dropped with the content */
+    assert_true(fill_buffer_from_u8string(buffer, "\xd0\xb0\xd0\xb1\nb") == FT_SUCCESS);
+    assert_true(buffer->metrics.line_index == NULL);
+    assert_true(buffer_text_visible_width(buffer) == 2);
+#endif /* FT_HAVE_UTF8 */
+
+#if defined(FT_HAVE_WCHAR) && !defined(FT_MICROSOFT_COMPILER)
+    {
+        wchar_t str[3 * 100 + 1];
+        size_t i = 0;
+        for (i = 0; i < 100; ++i) {
+            str[3 * i] = L'\x4e2d';
+            str[3 * i + 1] = (i == 57) ? L'\x6587' : L'a';
+            str[3 * i + 2] = L'\n';
+        }
+        str[3 * 100 - 1] = L'\0';
+        assert_true(fill_buffer_from_wstring(buffer, str) == FT_SUCCESS);
+        assert_true(buffer_text_visible_height(buffer) == 100);
+        assert_true(buffer_text_visible_width(buffer) == 4);
+        assert_true(buffer->metrics.line_index != NULL);
+        assert_true(buffer->metrics.line_index->offsets[57] == 3 * 57);
+        assert_true(buffer->metrics.line_index->offsets[100] == 3 * 100);
+    }
+#endif /* defined(FT_HAVE_WCHAR) && !defined(FT_MICROSOFT_COMPILER) */
+
+    destroy_string_buffer(buffer);
+}
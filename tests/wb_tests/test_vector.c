@@ -144,6 +144,16 @@ void test_vector_basic(void)
         assert_true(vector_size(vector) == 15);
     }
 
+    WHEN("Reserving capacity") {
+        size_t sz = vector_size(vector);
+        assert_true(vector_reserve(vector, 1) == FT_SUCCESS);
+        assert_true(vector_size(vector) == sz);
+        assert_true(vector_reserve(vector, 1000) == FT_SUCCESS);
+        assert_true(vector_capacity(vector) == 1000);
+        assert_true(vector_size(vector) == sz);
+        assert_true(*(item_t *)vector_at(vector, 1) == 1);
+    }
+
     destroy_vector(vector);
 }
 